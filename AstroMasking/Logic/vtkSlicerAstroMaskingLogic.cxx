@@ -198,11 +198,11 @@ bool vtkSlicerAstroMaskingLogic::ApplyBlank(vtkMRMLAstroMaskingParametersNode *p
   vtkMRMLAstroVolumeNode *outputVolume =
     vtkMRMLAstroVolumeNode::SafeDownCast
       (this->GetMRMLScene()->GetNodeByID(pnode->GetOutputVolumeNodeID()));
-  if (!outputVolume)
+  if (!outputVolume || !outputVolume->GetImageData())
     {
     vtkErrorMacro("vtkSlicerAstroMaskingLogic::ApplyBlank : "
                   "outputVolume not found.");
-    return 0;
+    return false;
     }
 
   vtkMRMLAstroLabelMapVolumeNode *maskVolume =
@@ -215,6 +215,12 @@ bool vtkSlicerAstroMaskingLogic::ApplyBlank(vtkMRMLAstroMaskingParametersNode *p
     segmentationActive = true;
     }
 
+  bool signalToNoiseActive = false;
+  if (!(strcmp(pnode->GetMode(), "SignalToNoise")))
+    {
+    signalToNoiseActive = true;
+    }
+
   if((!maskVolume || !maskVolume->GetImageData()) && segmentationActive)
     {
     vtkErrorMacro("vtkSlicerAstroMaskingLogic::ApplyBlank :"
@@ -244,6 +250,17 @@ bool vtkSlicerAstroMaskingLogic::ApplyBlank(vtkMRMLAstroMaskingParametersNode *p
   const int numSlice = dims[0] * dims[1] * numComponents;
   const int numElements = dims[0] * dims[1] * dims[2] * numComponents;
 
+  const int *outputDims = outputVolume->GetImageData()->GetDimensions();
+  if (outputDims[0] != dims[0] || outputDims[1] != dims[1] || outputDims[2] != dims[2] ||
+      outputVolume->GetImageData()->GetNumberOfScalarComponents() != numComponents ||
+      outputVolume->GetImageData()->GetScalarType() != inputVolume->GetImageData()->GetScalarType())
+    {
+    vtkErrorMacro("vtkSlicerAstroMaskingLogic::ApplyBlank : "
+                  "the outputVolume must have the dimensions and "
+                  "the data type of the inputVolume.");
+    return false;
+    }
+
   float *inFPixel = NULL;
   float *outFPixel = NULL;
   double *inDPixel = NULL;
@@ -321,6 +338,72 @@ bool vtkSlicerAstroMaskingLogic::ApplyBlank(vtkMRMLAstroMaskingParametersNode *p
         }
       }
     }
+  else if (signalToNoiseActive)
+    {
+    // the S/N cube is calculated in the output volume and
+    // then replaced by the blanked data in place (the attributes
+    // are updated at the end)
+    if (!this->GetAstroVolumeLogic()->CalculateSignalToNoise
+          (inputVolume, outputVolume, pnode->GetNoiseWindowXY(),
+           pnode->GetNoiseWindowZ(), NULL, pnode, false))
+      {
+      if (pnode->GetStatus() != -1)
+        {
+        vtkErrorMacro("vtkSlicerAstroMaskingLogic::ApplyBlank :"
+                      " CalculateSignalToNoise failed!");
+        pnode->SetStatus(100);
+        return false;
+        }
+      cancel = true;
+      }
+
+    const double threshold = pnode->GetSignalToNoiseThreshold();
+    for (int elementCnt = 0; elementCnt < numElements && !cancel; elementCnt++)
+      {
+      if (pnode->GetStatus() == -1)
+        {
+        cancel = true;
+        break;
+        }
+
+      bool signal = false;
+      switch (DataType)
+        {
+        case VTK_FLOAT:
+          signal = *(outFPixel + elementCnt) >= threshold;
+          break;
+        case VTK_DOUBLE:
+          signal = *(outDPixel + elementCnt) >= threshold;
+          break;
+        }
+
+      if ((regionInside && !signal) ||
+          (!regionInside && signal))
+        {
+        switch (DataType)
+          {
+          case VTK_FLOAT:
+            *(outFPixel + elementCnt) = *(inFPixel + elementCnt);
+            break;
+          case VTK_DOUBLE:
+            *(outDPixel + elementCnt) = *(inDPixel + elementCnt);
+            break;
+          }
+        }
+      else
+        {
+        switch (DataType)
+          {
+          case VTK_FLOAT:
+            *(outFPixel + elementCnt) = BlankValue;
+            break;
+          case VTK_DOUBLE:
+            *(outDPixel + elementCnt) = BlankValue;
+            break;
+          }
+        }
+      }
+    }
   else
     {
     vtkMRMLAnnotationROINode *roiNode = pnode->GetROINode();
@@ -803,20 +886,22 @@ bool vtkSlicerAstroMaskingLogic::ApplyMask(vtkMRMLAstroMaskingParametersNode *pn
 
   if (!(strcmp(pnode->GetOperation(), "Blank")))
     {
-    this->ApplyBlank(pnode);
+    return this->ApplyBlank(pnode);
     }
   else if (!(strcmp(pnode->GetOperation(), "Crop")))
     {
-    this->ApplyCrop(pnode, segmentationNode, segment);
-    }
-  else
-    {
-    vtkErrorMacro("vtkSlicerAstroMaskingLogic::ApplyMask : "
-                  "Operation Type not found.");
-    return false;
+    if (!(strcmp(pnode->GetMode(), "SignalToNoise")))
+      {
+      vtkErrorMacro("vtkSlicerAstroMaskingLogic::ApplyMask : "
+                    "the SignalToNoise mode supports only the Blank operation.");
+      return false;
+      }
+    return this->ApplyCrop(pnode, segmentationNode, segment);
     }
 
-  return true;
+  vtkErrorMacro("vtkSlicerAstroMaskingLogic::ApplyMask : "
+                "Operation Type not found.");
+  return false;
 }
 
 //----------------------------------------------------------------------------
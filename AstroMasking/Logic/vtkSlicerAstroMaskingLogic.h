@@ -80,6 +80,9 @@ public:
                  vtkSegment *segment);
 
   /// Apply Blank algorithm
+  /// The output volume must have the dimensions of the input volume.
+  /// In case of failure (or cancel) its data are not fully written
+  /// and the output volume should be removed by the caller.
   /// \param MRML parameter node
   /// \return Success flag
   bool ApplyBlank(vtkMRMLAstroMaskingParametersNode *pnode);
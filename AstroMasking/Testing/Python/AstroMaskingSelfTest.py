@@ -147,6 +147,8 @@ class AstroMaskingSelfTestTest(unittest.TestCase):
   def runTest(self):
     self.setUp()
     self.test_AstroMaskingSelfTest()
+    self.setUp()
+    self.test_SignalToNoise()
 
   def test_AstroMaskingSelfTest(self):
     print("Running AstroMaskingSelfTest Test case:")
@@ -186,6 +188,83 @@ class AstroMaskingSelfTestTest(unittest.TestCase):
        sys.exit()
 
 
+  def test_SignalToNoise(self):
+    print("Running SignalToNoise Test case:")
+
+    import numpy
+
+    astroVolume = self.downloadWEIN069()
+    inputArray = numpy.array(slicer.util.arrayFromVolume(astroVolume), dtype=numpy.float64)
+
+    # reference S/N with one noise per channel (windowXY = 0, windowZ = 1):
+    # median absolute deviation. vtkAstroRobustNoise locates the medians
+    # with histograms, the noise agrees within noiseTolerance
+    noiseTolerance = 1.e-2
+    signalToNoise = numpy.full(inputArray.shape, numpy.nan)
+    for channel in range(inputArray.shape[0]):
+      plane = inputArray[channel]
+      values = plane[~numpy.isnan(plane)]
+      if values.size == 0:
+        continue
+      noise = 1.4826 * numpy.median(numpy.abs(values - numpy.median(values)))
+      if noise > 0.:
+        signalToNoise[channel] = plane / noise
+
+    mainWindow = slicer.util.mainWindow()
+    mainWindow.moduleSelector().selectModule('AstroVolume')
+    mainWindow.moduleSelector().selectModule('AstroMasking')
+
+    astroMaskingModuleWidget = slicer.modules.astromasking.widgetRepresentation()
+
+    AstroMaskingParameterNode = slicer.util.getNode("AstroMaskingParameters")
+    AstroMaskingParameterNode.SetMode("SignalToNoise")
+    AstroMaskingParameterNode.SetSignalToNoiseThreshold(3.)
+    AstroMaskingParameterNode.SetNoiseWindowXY(0)
+    AstroMaskingParameterNode.SetNoiseWindowZ(1)
+    AstroMaskingParameterNode.SetBlankValue("NaN")
+    AstroMaskingParameterNode.SetBlankRegion("Outside")
+
+    QPushButtonList = astroMaskingModuleWidget.findChildren(qt.QPushButton)
+    for QPushButton in (QPushButtonList):
+        if QPushButton.name == "ApplyButton":
+            ApplyPushButton = QPushButton
+
+    self.delayDisplay('Applying S/N blanking', 700)
+    ApplyPushButton.click()
+
+    outputVolume = slicer.mrmlScene.GetNodeByID(AstroMaskingParameterNode.GetOutputVolumeNodeID())
+    outputArray = numpy.array(slicer.util.arrayFromVolume(outputVolume), dtype=numpy.float64)
+
+    # the voxels kept are the ones above the S/N threshold
+    # (voxels at the threshold within the noise tolerance are not compared)
+    kept = numpy.nan_to_num(signalToNoise, nan=-numpy.inf) >= 3.
+    comparable = ~(numpy.abs(signalToNoise - 3.) < 3. * noiseTolerance)
+    expected = numpy.where(kept, inputArray, numpy.nan)
+    mismatches = numpy.count_nonzero(comparable &
+                                     ~((numpy.isnan(expected) & numpy.isnan(outputArray)) |
+                                       (expected == outputArray)))
+
+    # a window covering the whole cube is sampled and gives a single noise value
+    astroVolumeLogic = slicer.modules.astrovolume.logic()
+    signalToNoiseVolume = astroVolumeLogic.CloneAstroVolume(slicer.mrmlScene, astroVolume, None, "_SN_", astroVolume.GetName() + "_SN_1")
+    noiseVolume = astroVolumeLogic.CloneAstroVolume(slicer.mrmlScene, astroVolume, None, "_Noise_", astroVolume.GetName() + "_Noise_1")
+    success = astroVolumeLogic.CalculateSignalToNoise(astroVolume, signalToNoiseVolume, 0, 0, noiseVolume)
+    noiseArray = slicer.util.arrayFromVolume(noiseVolume)
+    values = inputArray[~numpy.isnan(inputArray)]
+    globalNoise = 1.4826 * numpy.median(numpy.abs(values - numpy.median(values)))
+    noiseValues = noiseArray[~numpy.isnan(noiseArray)]
+
+    if (mismatches == 0 and numpy.count_nonzero(kept) > 0 and success and
+        noiseValues.size > 0 and numpy.ptp(noiseValues) == 0. and
+        math.fabs(noiseValues[0] - globalNoise) < 0.05 * globalNoise):
+       self.delayDisplay('Test passed', 700)
+    else:
+       print('mismatches = %d, success = %d' % (mismatches, success))
+       self.delayDisplay('Test failed', 700)
+       # if run from Slicer interface remove the followinf exit
+       sys.exit()
+
+
   def downloadWEIN069(self):
     import AstroSampleData
     astroSampleDataLogic = AstroSampleData.AstroSampleDataLogic()
@@ -36,6 +36,10 @@ int vtkMRMLAstroMaskingParametersNodeTest1(int , char * [] )
   TEST_SET_GET_STRING(node1.GetPointer(), BlankRegion);
   TEST_SET_GET_STRING(node1.GetPointer(), BlankValue);
 
+  TEST_SET_GET_DOUBLE(node1.GetPointer(), SignalToNoiseThreshold, 3.);
+  TEST_SET_GET_INT(node1.GetPointer(), NoiseWindowXY, 0);
+  TEST_SET_GET_INT(node1.GetPointer(), NoiseWindowZ, 1);
+
   TEST_SET_GET_INT(node1.GetPointer(), OutputSerial, 1);
   TEST_SET_GET_INT(node1.GetPointer(), Status, 0);
 
@@ -184,6 +184,20 @@ void qSlicerAstroMaskingModuleWidgetPrivate::init()
   QObject::connect(this->SegmentationModeRadioButton, SIGNAL(toggled(bool)),
                    q, SLOT(onModeChanged()));
 
+  QObject::connect(this->SignalToNoiseModeRadioButton, SIGNAL(toggled(bool)),
+                   q, SLOT(onModeChanged()));
+
+  QObject::connect(this->SignalToNoiseThresholdDoubleSpinBox, SIGNAL(valueChanged(double)),
+                   q, SLOT(onSignalToNoiseThresholdChanged(double)));
+
+  QObject::connect(this->NoiseWindowXYSpinBox, SIGNAL(valueChanged(int)),
+                   q, SLOT(onNoiseWindowXYChanged(int)));
+
+  QObject::connect(this->NoiseWindowZSpinBox, SIGNAL(valueChanged(int)),
+                   q, SLOT(onNoiseWindowZChanged(int)));
+
+  this->SignalToNoiseWidget->hide();
+
   QObject::connect(q, SIGNAL(mrmlSceneChanged(vtkMRMLScene*)),
                    this->SegmentsTableView, SLOT(setMRMLScene(vtkMRMLScene*)));
 
@@ -777,6 +791,45 @@ void qSlicerAstroMaskingModuleWidget::onOperationChanged(QString Operation)
   d->parametersNode->SetOperation(Operation.toStdString().c_str());
 }
 
+//-----------------------------------------------------------------------------
+void qSlicerAstroMaskingModuleWidget::onNoiseWindowXYChanged(int windowXY)
+{
+  Q_D(qSlicerAstroMaskingModuleWidget);
+
+  if (!d->parametersNode)
+    {
+    return;
+    }
+
+  d->parametersNode->SetNoiseWindowXY(windowXY);
+}
+
+//-----------------------------------------------------------------------------
+void qSlicerAstroMaskingModuleWidget::onNoiseWindowZChanged(int windowZ)
+{
+  Q_D(qSlicerAstroMaskingModuleWidget);
+
+  if (!d->parametersNode)
+    {
+    return;
+    }
+
+  d->parametersNode->SetNoiseWindowZ(windowZ);
+}
+
+//-----------------------------------------------------------------------------
+void qSlicerAstroMaskingModuleWidget::onSignalToNoiseThresholdChanged(double threshold)
+{
+  Q_D(qSlicerAstroMaskingModuleWidget);
+
+  if (!d->parametersNode)
+    {
+    return;
+    }
+
+  d->parametersNode->SetSignalToNoiseThreshold(threshold);
+}
+
 //-----------------------------------------------------------------------------
 void qSlicerAstroMaskingModuleWidget::onOutputVolumeChanged(vtkMRMLNode *mrmlNode)
 {
@@ -916,6 +969,12 @@ void qSlicerAstroMaskingModuleWidget::onModeChanged()
     {
     d->parametersNode->SetMode("Segmentation");
     }
+  if (d->SignalToNoiseModeRadioButton->isChecked())
+    {
+    // the S/N threshold mode supports only the blanking
+    d->parametersNode->SetMode("SignalToNoise");
+    d->parametersNode->SetOperation("Blank");
+    }
 
   d->parametersNode->EndModify(wasModifying);
 }
@@ -946,6 +1005,8 @@ void qSlicerAstroMaskingModuleWidget::onMRMLAstroMaskingParametersNodeModified()
     {  
     d->ROIModeRadioButton->setChecked(true);
     d->SegmentsTableView->hide();
+    d->SignalToNoiseWidget->hide();
+    d->OperationComboBox->setEnabled(true);
     if (this->isEntered())
       {
       this->onROIVisibilityChanged(true);
@@ -977,6 +1038,8 @@ void qSlicerAstroMaskingModuleWidget::onMRMLAstroMaskingParametersNodeModified()
     {
     d->SegmentationModeRadioButton->setChecked(true);
     d->SegmentsTableView->show();
+    d->SignalToNoiseWidget->hide();
+    d->OperationComboBox->setEnabled(true);
     this->onROIVisibilityChanged(false);
 
     if (d->segmentEditorNode)
@@ -997,6 +1060,26 @@ void qSlicerAstroMaskingModuleWidget::onMRMLAstroMaskingParametersNodeModified()
         }
       }
     }
+  else if (!(strcmp(d->parametersNode->GetMode(), "SignalToNoise")))
+    {
+    d->SignalToNoiseModeRadioButton->setChecked(true);
+    d->SegmentsTableView->hide();
+    d->SignalToNoiseWidget->show();
+    d->OperationComboBox->setEnabled(false);
+    this->onROIVisibilityChanged(false);
+    }
+
+  bool thresholdState = d->SignalToNoiseThresholdDoubleSpinBox->blockSignals(true);
+  d->SignalToNoiseThresholdDoubleSpinBox->setValue(d->parametersNode->GetSignalToNoiseThreshold());
+  d->SignalToNoiseThresholdDoubleSpinBox->blockSignals(thresholdState);
+
+  bool windowXYState = d->NoiseWindowXYSpinBox->blockSignals(true);
+  d->NoiseWindowXYSpinBox->setValue(d->parametersNode->GetNoiseWindowXY());
+  d->NoiseWindowXYSpinBox->blockSignals(windowXYState);
+
+  bool windowZState = d->NoiseWindowZSpinBox->blockSignals(true);
+  d->NoiseWindowZSpinBox->setValue(d->parametersNode->GetNoiseWindowZ());
+  d->NoiseWindowZSpinBox->blockSignals(windowZState);
 
   if (!(strcmp(d->parametersNode->GetOperation(), "Blank")))
     {
@@ -1201,8 +1284,21 @@ void qSlicerAstroMaskingModuleWidget::onApply()
     }
 
   // Create Astro Volume for the output
-  outputVolume = vtkMRMLAstroVolumeNode::SafeDownCast
-    (logic->GetAstroVolumeLogic()->CloneVolume(scene, inputVolume, outSS.str().c_str()));
+  // (the masking overwrites or replaces the whole output data)
+  outputVolume = logic->GetAstroVolumeLogic()->CloneAstroVolume
+    (scene, inputVolume, NULL,
+     strcmp(d->parametersNode->GetOperation(), "Crop") ? "_Blank_" : "_Crop_",
+     outSS.str().c_str(),
+     vtkSlicerAstroVolumeLogic::AllocateImageData);
+  if(!outputVolume || !outputVolume->GetImageData())
+    {
+    qCritical() <<"qSlicerAstroMaskingModuleWidget::onApply"
+                  " : outputVolume not found!";
+    logic->GetAstroVolumeLogic()->RemoveAstroVolume(scene, outputVolume);
+    d->parametersNode->SetStatus(0);
+    d->FitROI = true;
+    return;
+    }
 
   d->parametersNode->SetOutputVolumeNodeID(outputVolume->GetID());
 
@@ -1243,9 +1339,11 @@ void qSlicerAstroMaskingModuleWidget::onApply()
     }
   else
     {
+    // the output data have not been (fully) written (error or cancel)
     qCritical() <<"qSlicerAstroMaskingModuleWidget::onApply : "
                   "ApplyMask error!";
-    scene->RemoveNode(outputVolume);
+    d->parametersNode->SetOutputVolumeNodeID("");
+    logic->GetAstroVolumeLogic()->RemoveAstroVolume(scene, outputVolume);
     }
 
   d->parametersNode->SetStatus(0);
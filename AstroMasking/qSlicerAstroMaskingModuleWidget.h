@@ -106,10 +106,13 @@ protected slots:
   void onBlankValueChanged();
   void onInsideBlankRegionChanged();
   void onModeChanged();
+  void onNoiseWindowXYChanged(int windowXY);
+  void onNoiseWindowZChanged(int windowZ);
   void onOperationChanged(QString Operation);
   void onOutsideBlankRegionChanged();
   void onROIFit();
   void onROIVisibilityChanged(bool visible);
+  void onSignalToNoiseThresholdChanged(double threshold);
 
   void onMRMLSelectionNodeModified(vtkObject* sender);
   void onMRMLSelectionNodeReferenceAdded(vtkObject* sender);
@@ -23,6 +23,9 @@
 #include "vtkSlicerAstroConfigure.h"
 
 // MRML includes
+#include <vtkAstroCompensatedSum.h>
+#include <vtkAstroProgressToken.h>
+#include <vtkAstroThreadBudget.h>
 #include <vtkMRMLAstroLabelMapVolumeDisplayNode.h>
 #include <vtkMRMLAstroLabelMapVolumeNode.h>
 #include <vtkMRMLAstroVolumeDisplayNode.h>
@@ -42,6 +45,7 @@
 #include <vtkVersion.h>
 
 // STD includes
+#include <algorithm>
 #include <cassert>
 #include <iostream>
 #include <sys/time.h>
@@ -289,21 +293,8 @@ bool vtkSlicerAstroMomentMapsLogic::CalculateMomentMaps(vtkMRMLAstroMomentMapsPa
     }
 
   bool cancel = false;
-  int status = 0;
 
-  #ifdef VTK_SLICER_ASTRO_SUPPORT_OPENMP
-  int numProcs = 0;
-  if (pnode->GetCores() == 0)
-    {
-    numProcs = omp_get_num_procs();
-    }
-  else
-    {
-    numProcs = pnode->GetCores();
-    }
-
-  omp_set_num_threads(numProcs);
-  #endif // VTK_SLICER_ASTRO_SUPPORT_OPENMP
+  vtkAstroThreadBudget threadBudget(pnode->GetCores());
 
   struct timeval start, end;
 
@@ -339,31 +330,35 @@ bool vtkSlicerAstroMomentMapsLogic::CalculateMomentMaps(vtkMRMLAstroMomentMapsPa
     VelFactor = 0.001;
     }
 
+  // each spatial pixel processes a whole spectrum: scale the blocks accordingly
+  vtkAstroProgressToken progress(numSlice);
+  const vtkIdType blockSize = std::max<vtkIdType>(1, vtkAstroProgressToken::GetBlockSize() / dims[2]);
+  const vtkIdType numBlocks = (numSlice + blockSize - 1) / blockSize;
+
   if(pnode->GetMaskActive())
     {
     double dV = fabs((pnode->GetVelocityMax() - pnode->GetVelocityMin()) / dims[2]);
     maskPixel = static_cast<short*> (maskVolume->GetImageData()->GetScalarPointer(0,0,0));
 
     #ifdef VTK_SLICER_ASTRO_SUPPORT_OPENMP
-    #pragma omp parallel for schedule(static) shared(pnode, inFPixel, inDPixel, outZeroFPixel, outZeroDPixel, outFirstFPixel, outFirstDPixel, outSecondFPixel, outSecondDPixel, ijk, world, maskPixel, cancel, status, forceGenerateFirst, VelFactor, dV)
+    #pragma omp parallel for schedule(static) shared(pnode, inFPixel, inDPixel, outZeroFPixel, outZeroDPixel, outFirstFPixel, outFirstDPixel, outSecondFPixel, outSecondDPixel, ijk, world, maskPixel, progress, forceGenerateFirst, VelFactor, dV)
     #endif // VTK_SLICER_ASTRO_SUPPORT_OPENMP
-    for (int elemCnt = 0; elemCnt < numSlice; elemCnt++)
+    for (vtkIdType blockCnt = 0; blockCnt < numBlocks; blockCnt++)
       {
-      int stat = pnode->GetStatus();
-
       #ifdef VTK_SLICER_ASTRO_SUPPORT_OPENMP
-      if (stat == -1 && omp_get_thread_num() == 0)
-      #else
-      if (stat == -1)
+      if (omp_get_thread_num() == 0)
       #endif // VTK_SLICER_ASTRO_SUPPORT_OPENMP
         {
-        cancel = true;
+        progress.Synchronize(pnode);
+        }
+      if (progress.IsCancelled())
+        {
+        continue;
         }
-      #ifdef VTK_SLICER_ASTRO_SUPPORT_OPENMP
-      #pragma omp flush (cancel)
-      #endif // VTK_SLICER_ASTRO_SUPPORT_OPENMP
 
-      if (!cancel)
+      const int firstElem = blockCnt * blockSize;
+      const int lastElem = std::min<vtkIdType>(firstElem + blockSize, numSlice);
+      for (int elemCnt = firstElem; elemCnt < lastElem; elemCnt++)
         {
         switch (DataType)
           {
@@ -395,6 +390,9 @@ bool vtkSlicerAstroMomentMapsLogic::CalculateMomentMaps(vtkMRMLAstroMomentMapsPa
         double ijkCoordinates[3];
         ijkCoordinates[0] = ijk[0];
         ijkCoordinates[1] = ijk[1];
+        // the moments are accumulated in double precision,
+        // with compensation, and stored at the end
+        vtkAstroCompensatedSum zeroSum, firstSum, secondSum;
         for (int kk = 0; kk < dims[2]; kk++)
           {
           int posData = elemCnt + kk * numSlice;
@@ -413,10 +411,10 @@ bool vtkSlicerAstroMomentMapsLogic::CalculateMomentMaps(vtkMRMLAstroMomentMapsPa
                   {
                   continue;
                   }
-                *(outZeroFPixel + elemCnt) += *(inFPixel + posData);
+                zeroSum.Add(*(inFPixel + posData));
                 if (forceGenerateFirst)
                   {
-                  *(outFirstFPixel + elemCnt) += *(inFPixel + posData) * SpaceCoordinates[2];
+                  firstSum.Add(*(inFPixel + posData) * SpaceCoordinates[2]);
                   }
                 }
               break;
@@ -427,16 +425,34 @@ bool vtkSlicerAstroMomentMapsLogic::CalculateMomentMaps(vtkMRMLAstroMomentMapsPa
                   {
                   continue;
                   }
-                *(outZeroDPixel + elemCnt) += *(inDPixel + posData);
+                zeroSum.Add(*(inDPixel + posData));
                 if (forceGenerateFirst)
                   {
-                  *(outFirstDPixel + elemCnt) += *(inDPixel + posData) * SpaceCoordinates[2];
+                  firstSum.Add(*(inDPixel + posData) * SpaceCoordinates[2]);
                   }
                 }
               break;
             }
           }
 
+        switch (DataType)
+          {
+          case VTK_FLOAT:
+            *(outZeroFPixel + elemCnt) = zeroSum.GetSum();
+            if (forceGenerateFirst)
+              {
+              *(outFirstFPixel + elemCnt) = firstSum.GetSum();
+              }
+            break;
+          case VTK_DOUBLE:
+            *(outZeroDPixel + elemCnt) = zeroSum.GetSum();
+            if (forceGenerateFirst)
+              {
+              *(outFirstDPixel + elemCnt) = firstSum.GetSum();
+              }
+            break;
+          }
+
         if (forceGenerateFirst)
           {
           switch (DataType)
@@ -454,7 +470,7 @@ bool vtkSlicerAstroMomentMapsLogic::CalculateMomentMaps(vtkMRMLAstroMomentMapsPa
               break;
             case VTK_DOUBLE:
               if (fabs(*(outZeroDPixel + elemCnt)) < DOUBLEPRECISION ||
-                  fabs(*(outFirstFPixel + elemCnt)) < DOUBLEPRECISION)
+                  fabs(*(outFirstDPixel + elemCnt)) < DOUBLEPRECISION)
                 {
                 *(outFirstDPixel + elemCnt) = NaN;
                 }
@@ -483,8 +499,8 @@ bool vtkSlicerAstroMomentMapsLogic::CalculateMomentMaps(vtkMRMLAstroMomentMapsPa
                     {
                     continue;
                     }
-                  *(outSecondFPixel + elemCnt) += *(inFPixel + posData) * (SpaceCoordinates[2] - *(outFirstFPixel + elemCnt))
-                                                                        * (SpaceCoordinates[2] - *(outFirstFPixel + elemCnt));
+                  secondSum.Add(*(inFPixel + posData) * (SpaceCoordinates[2] - *(outFirstFPixel + elemCnt))
+                                                      * (SpaceCoordinates[2] - *(outFirstFPixel + elemCnt)));
                   }
                 break;
               case VTK_DOUBLE:
@@ -494,12 +510,22 @@ bool vtkSlicerAstroMomentMapsLogic::CalculateMomentMaps(vtkMRMLAstroMomentMapsPa
                     {
                     continue;
                     }
-                  *(outSecondDPixel + elemCnt) += *(inDPixel + posData) * (SpaceCoordinates[2] - *(outFirstDPixel + elemCnt))
-                                                                        * (SpaceCoordinates[2] - *(outFirstDPixel + elemCnt));
+                  secondSum.Add(*(inDPixel + posData) * (SpaceCoordinates[2] - *(outFirstDPixel + elemCnt))
+                                                      * (SpaceCoordinates[2] - *(outFirstDPixel + elemCnt)));
                   }
                 break;
               }
             }
+          switch (DataType)
+            {
+            case VTK_FLOAT:
+              *(outSecondFPixel + elemCnt) = secondSum.GetSum();
+              break;
+            case VTK_DOUBLE:
+              *(outSecondDPixel + elemCnt) = secondSum.GetSum();
+              break;
+            }
+
           switch (DataType)
             {
             case VTK_FLOAT:
@@ -515,7 +541,7 @@ bool vtkSlicerAstroMomentMapsLogic::CalculateMomentMaps(vtkMRMLAstroMomentMapsPa
               break;
             case VTK_DOUBLE:
               if (fabs(*(outZeroDPixel + elemCnt)) < DOUBLEPRECISION ||
-                  fabs(*(outSecondFPixel + elemCnt)) < DOUBLEPRECISION)
+                  fabs(*(outSecondDPixel + elemCnt)) < DOUBLEPRECISION)
                 {
                 *(outSecondDPixel + elemCnt) = NaN;
                 }
@@ -553,24 +579,8 @@ bool vtkSlicerAstroMomentMapsLogic::CalculateMomentMaps(vtkMRMLAstroMomentMapsPa
               break;
             }
           }
-
-        #ifdef VTK_SLICER_ASTRO_SUPPORT_OPENMP
-        if (omp_get_thread_num() == 0)
-          {
-          if(elemCnt / (numSlice / (numProcs * 100.)) > status)
-            {
-            status += 10;
-            pnode->SetStatus(status);
-            }
-          }
-        #else
-        if(elemCnt / (numSlice / 100.) > status)
-          {
-          status += 10;
-          pnode->SetStatus(status);
-          }
-        #endif // VTK_SLICER_ASTRO_SUPPORT_OPENMP
         }
+      progress.AddWork(lastElem - firstElem);
       }
     }
   else
@@ -622,25 +632,24 @@ bool vtkSlicerAstroMomentMapsLogic::CalculateMomentMaps(vtkMRMLAstroMomentMapsPa
 
     double dV = fabs((pnode->GetVelocityMax() - pnode->GetVelocityMin()) / (Zmax - Zmin));
     #ifdef VTK_SLICER_ASTRO_SUPPORT_OPENMP
-    #pragma omp parallel for schedule(static) shared(pnode, inFPixel, inDPixel, outZeroFPixel, outZeroDPixel, outFirstFPixel, outFirstDPixel, outSecondFPixel, outSecondDPixel, ijk, world, maskPixel, cancel, status, forceGenerateFirst, VelFactor, Zmin, Zmax, dV)
+    #pragma omp parallel for schedule(static) shared(pnode, inFPixel, inDPixel, outZeroFPixel, outZeroDPixel, outFirstFPixel, outFirstDPixel, outSecondFPixel, outSecondDPixel, ijk, world, maskPixel, progress, forceGenerateFirst, VelFactor, Zmin, Zmax, dV)
     #endif // VTK_SLICER_ASTRO_SUPPORT_OPENMP
-    for (int elemCnt = 0; elemCnt < numSlice; elemCnt++)
+    for (vtkIdType blockCnt = 0; blockCnt < numBlocks; blockCnt++)
       {
-      int stat = pnode->GetStatus();
-
       #ifdef VTK_SLICER_ASTRO_SUPPORT_OPENMP
-      if (stat == -1 && omp_get_thread_num() == 0)
-      #else
-      if (stat == -1)
+      if (omp_get_thread_num() == 0)
       #endif // VTK_SLICER_ASTRO_SUPPORT_OPENMP
         {
-        cancel = true;
+        progress.Synchronize(pnode);
+        }
+      if (progress.IsCancelled())
+        {
+        continue;
         }
-      #ifdef VTK_SLICER_ASTRO_SUPPORT_OPENMP
-      #pragma omp flush (cancel)
-      #endif // VTK_SLICER_ASTRO_SUPPORT_OPENMP
 
-      if (!cancel)
+      const int firstElem = blockCnt * blockSize;
+      const int lastElem = std::min<vtkIdType>(firstElem + blockSize, numSlice);
+      for (int elemCnt = firstElem; elemCnt < lastElem; elemCnt++)
         {
         switch (DataType)
           {
@@ -672,6 +681,9 @@ bool vtkSlicerAstroMomentMapsLogic::CalculateMomentMaps(vtkMRMLAstroMomentMapsPa
         double ijkCoordinates[3];
         ijkCoordinates[0] = ijk[0];
         ijkCoordinates[1] = ijk[1];
+        // the moments are accumulated in double precision,
+        // with compensation, and stored at the end
+        vtkAstroCompensatedSum zeroSum, firstSum, secondSum;
         for (int kk = Zmin; kk <= Zmax; kk++)
           {
           int posData = elemCnt + kk * numSlice;
@@ -691,10 +703,10 @@ bool vtkSlicerAstroMomentMapsLogic::CalculateMomentMaps(vtkMRMLAstroMomentMapsPa
                   {
                   continue;
                   }
-                *(outZeroFPixel + elemCnt) += *(inFPixel + posData);
+                zeroSum.Add(*(inFPixel + posData));
                 if (forceGenerateFirst)
                   {
-                  *(outFirstFPixel + elemCnt) += *(inFPixel + posData) * SpaceCoordinates[2];
+                  firstSum.Add(*(inFPixel + posData) * SpaceCoordinates[2]);
                   }
                 }
               break;
@@ -706,16 +718,34 @@ bool vtkSlicerAstroMomentMapsLogic::CalculateMomentMaps(vtkMRMLAstroMomentMapsPa
                   {
                   continue;
                   }
-                *(outZeroDPixel + elemCnt) += *(inDPixel + posData);
+                zeroSum.Add(*(inDPixel + posData));
                 if (forceGenerateFirst)
                   {
-                  *(outFirstDPixel + elemCnt) += *(inDPixel + posData) * SpaceCoordinates[2];
+                  firstSum.Add(*(inDPixel + posData) * SpaceCoordinates[2]);
                   }
                 }
               break;
             }
           }
 
+        switch (DataType)
+          {
+          case VTK_FLOAT:
+            *(outZeroFPixel + elemCnt) = zeroSum.GetSum();
+            if (forceGenerateFirst)
+              {
+              *(outFirstFPixel + elemCnt) = firstSum.GetSum();
+              }
+            break;
+          case VTK_DOUBLE:
+            *(outZeroDPixel + elemCnt) = zeroSum.GetSum();
+            if (forceGenerateFirst)
+              {
+              *(outFirstDPixel + elemCnt) = firstSum.GetSum();
+              }
+            break;
+          }
+
         if (forceGenerateFirst)
           {
           switch (DataType)
@@ -733,7 +763,7 @@ bool vtkSlicerAstroMomentMapsLogic::CalculateMomentMaps(vtkMRMLAstroMomentMapsPa
               break;
             case VTK_DOUBLE:
               if (fabs(*(outZeroDPixel + elemCnt)) < DOUBLEPRECISION ||
-                  fabs(*(outFirstFPixel + elemCnt)) < DOUBLEPRECISION)
+                  fabs(*(outFirstDPixel + elemCnt)) < DOUBLEPRECISION)
                 {
                 *(outFirstDPixel + elemCnt) = NaN;
                 }
@@ -764,8 +794,8 @@ bool vtkSlicerAstroMomentMapsLogic::CalculateMomentMaps(vtkMRMLAstroMomentMapsPa
                     {
                     continue;
                     }
-                  *(outSecondFPixel + elemCnt) += *(inFPixel + posData) * (SpaceCoordinates[2] - *(outFirstFPixel + elemCnt))
-                                                                        * (SpaceCoordinates[2] - *(outFirstFPixel + elemCnt));
+                  secondSum.Add(*(inFPixel + posData) * (SpaceCoordinates[2] - *(outFirstFPixel + elemCnt))
+                                                      * (SpaceCoordinates[2] - *(outFirstFPixel + elemCnt)));
                   }
                 break;
               case VTK_DOUBLE:
@@ -776,12 +806,22 @@ bool vtkSlicerAstroMomentMapsLogic::CalculateMomentMaps(vtkMRMLAstroMomentMapsPa
                     {
                     continue;
                     }
-                  *(outSecondDPixel + elemCnt) += *(inDPixel + posData) * (SpaceCoordinates[2] - *(outFirstDPixel + elemCnt))
-                                                                        * (SpaceCoordinates[2] - *(outFirstDPixel + elemCnt));
+                  secondSum.Add(*(inDPixel + posData) * (SpaceCoordinates[2] - *(outFirstDPixel + elemCnt))
+                                                      * (SpaceCoordinates[2] - *(outFirstDPixel + elemCnt)));
                   }
                 break;
               }
             }
+          switch (DataType)
+            {
+            case VTK_FLOAT:
+              *(outSecondFPixel + elemCnt) = secondSum.GetSum();
+              break;
+            case VTK_DOUBLE:
+              *(outSecondDPixel + elemCnt) = secondSum.GetSum();
+              break;
+            }
+
           switch (DataType)
             {
             case VTK_FLOAT:
@@ -835,26 +875,11 @@ bool vtkSlicerAstroMomentMapsLogic::CalculateMomentMaps(vtkMRMLAstroMomentMapsPa
               break;
             }
           }
-
-        #ifdef VTK_SLICER_ASTRO_SUPPORT_OPENMP
-        if (omp_get_thread_num() == 0)
-          {
-          if(elemCnt / (numSlice / (numProcs * 100.)) > status)
-            {
-            status += 10;
-            pnode->SetStatus(status);
-            }
-          }
-        #else
-        if(elemCnt / (numSlice / 100.) > status)
-          {
-          status += 10;
-          pnode->SetStatus(status);
-          }
-        #endif // VTK_SLICER_ASTRO_SUPPORT_OPENMP
         }
+      progress.AddWork(lastElem - firstElem);
       }
     }
+  cancel = progress.IsCancelled();
 
   gettimeofday(&end, NULL);
 
@@ -153,6 +153,9 @@ class AstroMomentMapsSelfTestTest(unittest.TestCase):
 
     self.downloadWEIN069()
     astroVolume = slicer.util.getNode("WEIN069")
+    # the noise estimated at load time is sampled and
+    # it can be refined in the background: use the exact one
+    astroVolume.UpdateDisplayThresholdAttributes()
     rms = astroVolume.GetDisplayThreshold()
 
     mainWindow = slicer.util.mainWindow()
@@ -179,10 +182,12 @@ class AstroMomentMapsSelfTestTest(unittest.TestCase):
     pixelValue1 = FirstMomentMapVolume.GetImageData().GetScalarComponentAsFloat(56, 68, 0, 0)
     SecondMomentMapVolume = slicer.mrmlScene.GetNodeByID(AstroMomentMapsParameterNode.GetSecondMomentVolumeNodeID())
     pixelValue2 = SecondMomentMapVolume.GetImageData().GetScalarComponentAsFloat(56, 68, 0, 0)
+    referenceValue0, referenceValue1, referenceValue2 = \
+      self.momentsReference(astroVolume, AstroMomentMapsParameterNode, 56, 68)
 
-    if (math.fabs(pixelValue0 - 0.511788547039) < 1.e-6 and \
-        math.fabs(pixelValue1 - 5231.70947266) < 1.e-6 and \
-        math.fabs(pixelValue2 - 28.8058509827) < 1.e-6):
+    if (math.fabs(pixelValue0 - referenceValue0) < 1.e-6 * math.fabs(referenceValue0) and \
+        math.fabs(pixelValue1 - referenceValue1) < 1.e-6 * math.fabs(referenceValue1) and \
+        math.fabs(pixelValue2 - referenceValue2) < 1.e-6 * math.fabs(referenceValue2)):
        self.delayDisplay('Test passed', 700)
     else:
        self.delayDisplay('Test failed', 700)
@@ -190,6 +195,53 @@ class AstroMomentMapsSelfTestTest(unittest.TestCase):
        sys.exit()
 
 
+  def momentsReference(self, astroVolume, AstroMomentMapsParameterNode, i, j):
+    # replica of vtkSlicerAstroMomentMapsLogic::CalculateMomentMaps (without
+    # mask) for the spectrum at (i, j), with the same single precision
+    # intermediate values of float volumes
+    import numpy
+    astroDisplay = astroVolume.GetAstroVolumeDisplayNode()
+    dims = astroVolume.GetImageData().GetDimensions()
+    ijk = [float(astroVolume.GetAttribute("SlicerAstro.NAXIS1")) * 0.5,
+           float(astroVolume.GetAttribute("SlicerAstro.NAXIS2")) * 0.5, 0.]
+    world = [0., 0., 0.]
+    worlds = []
+    for k in range(dims[2]):
+      ijk[2] = k
+      astroDisplay.GetReferenceSpace(ijk, world)
+      worlds.append(world[2])
+
+    # the velocity range of the parameters is in km/s, the WCS can be in m/s
+    velocityMin = AstroMomentMapsParameterNode.GetVelocityMin()
+    velocityMax = AstroMomentMapsParameterNode.GetVelocityMax()
+    ijk[2] = dims[2] if dims[2] > 1 else 2
+    astroDisplay.GetReferenceSpace(ijk, world)
+    velFactor = 0.001 if math.fabs(world[2] - worlds[0]) > 100. * (velocityMax - velocityMin) else 1.
+
+    channels = []
+    for velocity in (velocityMin, velocityMax):
+      world[2] = velocity / velFactor
+      astroDisplay.GetIJKSpace(world, ijk)
+      channels.append(0 if ijk[2] < 0 else min(int(ijk[2]), dims[2] - 1))
+    Zmin, Zmax = min(channels), max(channels)
+    dV = math.fabs((velocityMax - velocityMin) / (Zmax - Zmin))
+
+    spectrum = slicer.util.arrayFromVolume(astroVolume)[:, j, i].astype(numpy.float64)
+    velocities = numpy.array(worlds) * velFactor
+    selected = numpy.arange(dims[2])
+    selected = (selected >= Zmin) & (selected <= Zmax) & \
+               (spectrum > AstroMomentMapsParameterNode.GetIntensityMin()) & \
+               (spectrum < AstroMomentMapsParameterNode.GetIntensityMax())
+    spectrum = spectrum[selected]
+    velocities = velocities[selected]
+
+    zero = numpy.float32(math.fsum(spectrum))
+    first = numpy.float32(numpy.float32(math.fsum(spectrum * velocities)) / zero)
+    second = numpy.float32(math.fsum(spectrum * (velocities - float(first)) ** 2))
+    second = numpy.float32(math.sqrt(second / zero))
+    zero = numpy.float32(float(zero) * dV)
+    return float(zero), float(first), float(second)
+
   def downloadWEIN069(self):
     import AstroSampleData
     astroSampleDataLogic = AstroSampleData.AstroSampleDataLogic()
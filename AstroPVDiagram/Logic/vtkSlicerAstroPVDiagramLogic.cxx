@@ -24,6 +24,7 @@
 #include "vtkSlicerAstroConfigure.h"
 
 // MRML includes
+#include <vtkAstroThreadBudget.h>
 #include <vtkMRMLAnnotationRulerNode.h>
 #include <vtkMRMLAnnotationTextDisplayNode.h>
 #include <vtkMRMLAnnotationPointDisplayNode.h>
@@ -868,8 +869,8 @@ bool vtkSlicerAstroPVDiagramLogic::GenerateAndSetPVDiagram(vtkMRMLAstroPVDiagram
   // 2D nearest-neighbour interpolation.
   // Fiducials are restrained on the Moment Map,
   // therefore there are no indexes checks.
+  vtkAstroThreadBudget threadBudget;
   #ifdef VTK_SLICER_ASTRO_SUPPORT_OPENMP
-  omp_set_num_threads(omp_get_num_procs());
   #pragma omp parallel for schedule(static) shared(pnode, points, PVDiagramFPixel, inFPixel, PVDiagramDPixel, inDPixel)
   #endif // VTK_SLICER_ASTRO_SUPPORT_OPENMP
   for (int PointIndex = 0; PointIndex < points->GetNumberOfPoints(); PointIndex++)
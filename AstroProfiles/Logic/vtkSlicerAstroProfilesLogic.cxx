@@ -23,6 +23,8 @@
 #include "vtkSlicerAstroConfigure.h"
 
 // MRML includes
+#include <vtkAstroProgressToken.h>
+#include <vtkAstroThreadBudget.h>
 #include <vtkMRMLAstroLabelMapVolumeDisplayNode.h>
 #include <vtkMRMLAstroLabelMapVolumeNode.h>
 #include <vtkMRMLAstroVolumeDisplayNode.h>
@@ -42,6 +44,7 @@
 #include <vtkVersion.h>
 
 // STD includes
+#include <algorithm>
 #include <cassert>
 #include <iostream>
 #include <sys/time.h>
@@ -262,21 +265,8 @@ bool vtkSlicerAstroProfilesLogic::CalculateProfile(vtkMRMLAstroProfilesParameter
     }
 
   bool cancel = false;
-  int status = 0;
 
-  #ifdef VTK_SLICER_ASTRO_SUPPORT_OPENMP
-  int numProcs = 0;
-  if (pnode->GetCores() == 0)
-    {
-    numProcs = omp_get_num_procs();
-    }
-  else
-    {
-    numProcs = pnode->GetCores();
-    }
-
-  omp_set_num_threads(numProcs);
-  #endif // VTK_SLICER_ASTRO_SUPPORT_OPENMP
+  vtkAstroThreadBudget threadBudget(pnode->GetCores());
 
   struct timeval start, end;
 
@@ -312,30 +302,34 @@ bool vtkSlicerAstroProfilesLogic::CalculateProfile(vtkMRMLAstroProfilesParameter
     VelFactor = 0.001;
     }
 
+  // each channel processes a whole spatial slice: scale the blocks accordingly
+  vtkAstroProgressToken progress(dims[2]);
+  const vtkIdType blockSize = std::max<vtkIdType>(1, vtkAstroProgressToken::GetBlockSize() / numSlice);
+  const vtkIdType numBlocks = (dims[2] + blockSize - 1) / blockSize;
+
   if(pnode->GetMaskActive())
     {
     maskPixel = static_cast<short*> (maskVolume->GetImageData()->GetScalarPointer(0,0,0));
 
     #ifdef VTK_SLICER_ASTRO_SUPPORT_OPENMP
-    #pragma omp parallel for schedule(static) shared(pnode, inFPixel, inDPixel, outProfileFPixel, outProfileDPixel, maskPixel, cancel, status)
+    #pragma omp parallel for schedule(static) shared(pnode, inFPixel, inDPixel, outProfileFPixel, outProfileDPixel, maskPixel, progress)
     #endif // VTK_SLICER_ASTRO_SUPPORT_OPENMP
-    for (int elemCnt = 0; elemCnt < dims[2]; elemCnt++)
+    for (vtkIdType blockCnt = 0; blockCnt < numBlocks; blockCnt++)
       {
-      int stat = pnode->GetStatus();
-
       #ifdef VTK_SLICER_ASTRO_SUPPORT_OPENMP
-      if (stat == -1 && omp_get_thread_num() == 0)
-      #else
-      if (stat == -1)
+      if (omp_get_thread_num() == 0)
       #endif // VTK_SLICER_ASTRO_SUPPORT_OPENMP
         {
-        cancel = true;
+        progress.Synchronize(pnode);
+        }
+      if (progress.IsCancelled())
+        {
+        continue;
         }
-      #ifdef VTK_SLICER_ASTRO_SUPPORT_OPENMP
-      #pragma omp flush (cancel)
-      #endif // VTK_SLICER_ASTRO_SUPPORT_OPENMP
 
-      if (!cancel)
+      const int firstElem = blockCnt * blockSize;
+      const int lastElem = std::min<vtkIdType>(firstElem + blockSize, dims[2]);
+      for (int elemCnt = firstElem; elemCnt < lastElem; elemCnt++)
         {
         switch (DataType)
           {
@@ -392,24 +386,8 @@ bool vtkSlicerAstroProfilesLogic::CalculateProfile(vtkMRMLAstroProfilesParameter
               }
             break;
           }
-
-        #ifdef VTK_SLICER_ASTRO_SUPPORT_OPENMP
-        if (omp_get_thread_num() == 0)
-          {
-          if(elemCnt / (numSlice / (numProcs * 100.)) > status)
-            {
-            status += 10;
-            pnode->SetStatus(status);
-            }
-          }
-        #else
-        if(elemCnt / (numSlice / 100.) > status)
-          {
-          status += 10;
-          pnode->SetStatus(status);
-          }
-        #endif // VTK_SLICER_ASTRO_SUPPORT_OPENMP
         }
+      progress.AddWork(lastElem - firstElem);
       }
     }
   else
@@ -460,25 +438,24 @@ bool vtkSlicerAstroProfilesLogic::CalculateProfile(vtkMRMLAstroProfilesParameter
       }
 
     #ifdef VTK_SLICER_ASTRO_SUPPORT_OPENMP
-    #pragma omp parallel for schedule(static) shared(pnode, inFPixel, inDPixel, outProfileFPixel, outProfileDPixel, maskPixel, cancel, status, Zmin, Zmax)
+    #pragma omp parallel for schedule(static) shared(pnode, inFPixel, inDPixel, outProfileFPixel, outProfileDPixel, maskPixel, progress, Zmin, Zmax)
     #endif // VTK_SLICER_ASTRO_SUPPORT_OPENMP
-    for (int elemCnt = 0; elemCnt < dims[2]; elemCnt++)
+    for (vtkIdType blockCnt = 0; blockCnt < numBlocks; blockCnt++)
       {
-      int stat = pnode->GetStatus();
-
       #ifdef VTK_SLICER_ASTRO_SUPPORT_OPENMP
-      if (stat == -1 && omp_get_thread_num() == 0)
-      #else
-      if (stat == -1)
+      if (omp_get_thread_num() == 0)
       #endif // VTK_SLICER_ASTRO_SUPPORT_OPENMP
         {
-        cancel = true;
+        progress.Synchronize(pnode);
+        }
+      if (progress.IsCancelled())
+        {
+        continue;
         }
-      #ifdef VTK_SLICER_ASTRO_SUPPORT_OPENMP
-      #pragma omp flush (cancel)
-      #endif // VTK_SLICER_ASTRO_SUPPORT_OPENMP
 
-      if (!cancel)
+      const int firstElem = blockCnt * blockSize;
+      const int lastElem = std::min<vtkIdType>(firstElem + blockSize, dims[2]);
+      for (int elemCnt = firstElem; elemCnt < lastElem; elemCnt++)
         {
         switch (DataType)
           {
@@ -537,26 +514,11 @@ bool vtkSlicerAstroProfilesLogic::CalculateProfile(vtkMRMLAstroProfilesParameter
               }
             break;
           }
-
-        #ifdef VTK_SLICER_ASTRO_SUPPORT_OPENMP
-        if (omp_get_thread_num() == 0)
-          {
-          if(elemCnt / (numSlice / (numProcs * 100.)) > status)
-            {
-            status += 10;
-            pnode->SetStatus(status);
-            }
-          }
-        #else
-        if(elemCnt / (numSlice / 100.) > status)
-          {
-          status += 10;
-          pnode->SetStatus(status);
-          }
-        #endif // VTK_SLICER_ASTRO_SUPPORT_OPENMP
         }
+      progress.AddWork(lastElem - firstElem);
       }
     }
+  cancel = progress.IsCancelled();
 
   gettimeofday(&end, NULL);
 
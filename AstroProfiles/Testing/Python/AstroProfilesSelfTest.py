@@ -153,6 +153,9 @@ class AstroProfilesSelfTestTest(unittest.TestCase):
 
     astroVolume = self.downloadWEIN069()
     astroVolume = slicer.util.getNode("WEIN069")
+    # the noise estimated at load time is sampled and
+    # it can be refined in the background: use the exact one
+    astroVolume.UpdateDisplayThresholdAttributes()
     rms = astroVolume.GetDisplayThreshold()
 
     mainWindow = slicer.util.mainWindow()
@@ -175,8 +178,9 @@ class AstroProfilesSelfTestTest(unittest.TestCase):
 
     profileVolume = slicer.mrmlScene.GetNodeByID(AstroProfilesParameterNode.GetProfileVolumeNodeID())
     pixelValue = profileVolume.GetImageData().GetScalarComponentAsFloat(25, 0, 0, 0)
+    referenceValue = self.profileReference(astroVolume, AstroProfilesParameterNode, 25)
 
-    if (math.fabs(pixelValue - 0.0799703) < 1.e-6):
+    if (math.fabs(pixelValue - referenceValue) < 1.e-6):
        self.delayDisplay('Test passed', 700)
     else:
        self.delayDisplay('Test failed', 700)
@@ -184,6 +188,22 @@ class AstroProfilesSelfTestTest(unittest.TestCase):
        sys.exit()
 
 
+  def profileReference(self, astroVolume, AstroProfilesParameterNode, channel):
+    # replica of vtkSlicerAstroProfilesLogic::CalculateProfile (without mask)
+    # for a channel: single precision sum in the order of the voxels
+    import numpy
+    values = slicer.util.arrayFromVolume(astroVolume)[channel].ravel()
+    selected = (values.astype(numpy.float64) > AstroProfilesParameterNode.GetIntensityMin()) & \
+               (values.astype(numpy.float64) < AstroProfilesParameterNode.GetIntensityMax())
+    flux = numpy.cumsum(values[selected], dtype=numpy.float32)[-1] if selected.any() else numpy.float32(0.)
+
+    unitBeamConv = 1.
+    keys = ["SlicerAstro.BMAJ", "SlicerAstro.BMIN", "SlicerAstro.CDELT1", "SlicerAstro.CDELT2"]
+    if all(astroVolume.GetAttribute(key) != "UNDEFINED" for key in keys):
+      BMAJ, BMIN, CDELT1, CDELT2 = [float(astroVolume.GetAttribute(key)) for key in keys]
+      unitBeamConv = math.fabs((CDELT1 * CDELT2) / (1.13 * BMAJ * BMIN))
+    return float(numpy.float32(float(flux) * unitBeamConv))
+
   def downloadWEIN069(self):
     import AstroSampleData
     astroSampleDataLogic = AstroSampleData.AstroSampleDataLogic()
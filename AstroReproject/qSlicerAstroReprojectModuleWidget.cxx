@@ -761,6 +761,14 @@ void qSlicerAstroReprojectModuleWidget::onApply()
     ReferenceID = d->parametersNode->GetReferenceVolumeNodeID();
     }
 
+  if (!d->parametersNode->GetReprojectRotation() && !ReprojectToReference)
+    {
+    qCritical() <<"qSlicerAstroReprojectModuleWidget::onApply"
+                  " : referenceVolume not found!";
+    d->parametersNode->SetStatus(0);
+    return;
+    }
+
   const char* outputNameReference = "_Reprojected_";
 
   // Create output volume
@@ -777,12 +785,16 @@ void qSlicerAstroReprojectModuleWidget::onApply()
       GetNodeByID(d->parametersNode->GetOutputVolumeNodeID()));
 
   // Create Astro Volume for the output volume
+  // (the reprojection replaces the output data)
   outputVolume = logic->GetAstroVolumeLogic()->CloneAstroVolume
-    (this->mrmlScene(), inputVolume, outputVolume, outputNameReference, outSS.str().c_str());
+    (this->mrmlScene(), inputVolume, outputVolume, outputNameReference, outSS.str().c_str(),
+     vtkSlicerAstroVolumeLogic::AllocateImageData);
   if(!outputVolume || !outputVolume->GetImageData())
     {
     qCritical() <<"qSlicerAstroReprojectModuleWidget::onApply"
                   " : outputVolume not found!";
+    logic->GetAstroVolumeLogic()->RemoveAstroVolume(scene, outputVolume);
+    d->parametersNode->SetOutputVolumeNodeID("");
     d->parametersNode->SetStatus(0);
     return;
     }
@@ -811,6 +823,8 @@ void qSlicerAstroReprojectModuleWidget::onApply()
     {
     qCritical() <<"qSlicerAstroReprojectModuleWidget::onApply"
                   " : outputVolumeDisplay not found!";
+    logic->GetAstroVolumeLogic()->RemoveAstroVolume(scene, outputVolume);
+    d->parametersNode->SetOutputVolumeNodeID("");
     d->parametersNode->SetStatus(0);
     return;
     }
@@ -874,7 +888,8 @@ void qSlicerAstroReprojectModuleWidget::onApply()
       }
     else
       {
-      scene->RemoveNode(outputVolume);
+      d->parametersNode->SetReferenceVolumeNodeID("");
+      logic->GetAstroVolumeLogic()->RemoveAstroVolume(scene, outputVolume);
       d->parametersNode->SetOutputVolumeNodeID("");
       }
     }
@@ -960,7 +975,7 @@ void qSlicerAstroReprojectModuleWidget::onApply()
       }
     else
       {
-      scene->RemoveNode(outputVolume);
+      logic->GetAstroVolumeLogic()->RemoveAstroVolume(scene, outputVolume);
       d->parametersNode->SetOutputVolumeNodeID("");
       }
     }
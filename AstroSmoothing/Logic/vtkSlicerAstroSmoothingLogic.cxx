@@ -23,6 +23,11 @@
 #include <vtkSlicerAstroConfigure.h>
 
 // MRML includes
+#include <vtkAstroProgressToken.h>
+#include <vtkAstroThreadBudget.h>
+#include <vtkMRMLAnnotationROINode.h>
+#include <vtkMRMLAstroLabelMapVolumeNode.h>
+#include <vtkMRMLAstroVolumeDisplayNode.h>
 #include <vtkMRMLAstroVolumeNode.h>
 #include <vtkMRMLAstroSmoothingParametersNode.h>
 
@@ -32,6 +37,9 @@
 #include <vtkAstroOpenGLImageGaussian.h>
 #include <vtkAstroOpenGLImageGradient.h>
 #endif
+#include <vtkAOSDataArrayTemplate.h>
+#include <vtkCollection.h>
+#include <vtkDoubleArray.h>
 #include <vtkImageData.h>
 #include <vtkNew.h>
 #include <vtkObjectFactory.h>
@@ -41,9 +49,14 @@
 #include <vtkVersion.h>
 
 // STD includes
+#include <algorithm>
 #include <cassert>
+#include <cstring>
 #include <iostream>
+#include <limits>
+#include <sstream>
 #include <sys/time.h>
+#include <vector>
 
 // OpenMP includes
 #ifdef VTK_SLICER_ASTRO_SUPPORT_OPENMP
@@ -56,6 +69,9 @@
 #endif
 
 #define UNUSED(expr) (void)(expr)
+#define SigmatoFWHM 2.3548200450309493
+// minimum Accuracy (kernel length in sigmas) to cascade Gaussian kernels
+#define MultiScaleCascadeMinimumAccuracy 8
 
 //----------------------------------------------------------------------------
 class vtkSlicerAstroSmoothingLogic::vtkInternal
@@ -66,6 +82,18 @@ public:
 
   vtkSmartPointer<vtkSlicerAstroVolumeLogic> AstroVolumeLogic;
   vtkSmartPointer<vtkImageData> tempVolumeData;
+  // padded region processed by the filters (see ApplyRegion)
+  vtkSmartPointer<vtkMRMLAstroVolumeNode> RegionInputVolume;
+  vtkSmartPointer<vtkMRMLAstroVolumeNode> RegionOutputVolume;
+
+  // results kept while AutoRun is on (see RunFilter and SeparableCPUFilter)
+  std::string CachedResultKey;
+  vtkSmartPointer<vtkImageData> CachedResult;
+  std::string CachedInputKey;
+  std::vector<double> CachedKernels[2];
+  vtkSmartPointer<vtkImageData> CachedPasses[2];
+
+  void ClearCache();
 };
 
 //----------------------------------------------------------------------------
@@ -73,6 +101,8 @@ vtkSlicerAstroSmoothingLogic::vtkInternal::vtkInternal()
 {
   this->AstroVolumeLogic = 0;
   this->tempVolumeData = vtkSmartPointer<vtkImageData>::New();
+  this->RegionInputVolume = NULL;
+  this->RegionOutputVolume = NULL;
 }
 
 //---------------------------------------------------------------------------
@@ -80,6 +110,19 @@ vtkSlicerAstroSmoothingLogic::vtkInternal::~vtkInternal()
 {
 }
 
+//---------------------------------------------------------------------------
+void vtkSlicerAstroSmoothingLogic::vtkInternal::ClearCache()
+{
+  this->CachedResultKey.clear();
+  this->CachedResult = NULL;
+  this->CachedInputKey.clear();
+  for (int ii = 0; ii < 2; ii++)
+    {
+    this->CachedKernels[ii].clear();
+    this->CachedPasses[ii] = NULL;
+    }
+}
+
 //----------------------------------------------------------------------------
 vtkStandardNewMacro(vtkSlicerAstroSmoothingLogic);
 
@@ -87,6 +130,7 @@ vtkStandardNewMacro(vtkSlicerAstroSmoothingLogic);
 vtkSlicerAstroSmoothingLogic::vtkSlicerAstroSmoothingLogic()
 {
   this->Internal = new vtkInternal;
+  this->MaximumCacheSize = 512;
 }
 
 //----------------------------------------------------------------------------
@@ -107,6 +151,12 @@ vtkSlicerAstroVolumeLogic* vtkSlicerAstroSmoothingLogic::GetAstroVolumeLogic()
   return this->Internal->AstroVolumeLogic;
 }
 
+//----------------------------------------------------------------------------
+void vtkSlicerAstroSmoothingLogic::ClearCache()
+{
+  this->Internal->ClearCache();
+}
+
 namespace
 {
 //----------------------------------------------------------------------------
@@ -124,6 +174,37 @@ double StringToDouble(const char* str)
   return StringToNumber<double>(str);
 }
 
+//----------------------------------------------------------------------------
+int StringToInt(const char* str)
+{
+  return StringToNumber<int>(str);
+}
+
+//----------------------------------------------------------------------------
+template <typename T> std::string NumberToString(T V)
+{
+  std::string stringValue;
+  std::stringstream strstream;
+  strstream << V;
+  strstream >> stringValue;
+  return stringValue;
+}
+
+//----------------------------------------------------------------------------
+std::string IntToString(int Value)
+{
+  return NumberToString<int>(Value);
+}
+
+//----------------------------------------------------------------------------
+std::string DoubleToString(double Value)
+{
+  std::ostringstream strstream;
+  strstream.precision(12);
+  strstream << Value;
+  return strstream.str();
+}
+
 //----------------------------------------------------------------------------
 template <typename T> bool isNaN(T value)
 {
@@ -142,396 +223,2334 @@ bool FloatIsNaN(float Value)
   return isNaN<float>(Value);
 }
 
-}// end namespace
-
 //----------------------------------------------------------------------------
-void vtkSlicerAstroSmoothingLogic::PrintSelf(ostream& os, vtkIndent indent)
+// Convolve all the lines of the volume along one axis with a 1D kernel.
+// Each line is copied in a per-thread line buffer before being filtered,
+// therefore inPixel and outPixel can point to the same array (in-place).
+// Blanked (NaN) voxels and voxels outside the volume do not contribute.
+// Returns false if the computation has been cancelled.
+template <typename T> bool SeparableConvolution(const T *inPixel, T *outPixel,
+                                                const int *dims, int axis,
+                                                const std::vector<double> &kernel,
+                                                vtkMRMLAstroSmoothingParametersNode *pnode,
+                                                vtkAstroProgressToken &progress)
 {
-  this->vtkObject::PrintSelf(os, indent);
-  os << indent << "vtkSlicerAstroSmoothingLogic:             " << this->GetClassName() << "\n";
+  const vtkIdType numSlice = (vtkIdType) dims[0] * dims[1];
+  const int length = dims[axis];
+  vtkIdType stride = 1;
+  if (axis == 1)
+    {
+    stride = dims[0];
+    }
+  else if (axis == 2)
+    {
+    stride = numSlice;
+    }
+  const vtkIdType numLines = (numSlice * dims[2]) / length;
+  const int half = ((int) kernel.size() - 1) / 2;
+  const double *weights = &kernel[0];
+
+  #ifdef VTK_SLICER_ASTRO_SUPPORT_OPENMP
+  #pragma omp parallel shared(pnode, progress)
+  #endif // VTK_SLICER_ASTRO_SUPPORT_OPENMP
+  {
+  std::vector<T> lineBuffer(length);
+  #ifdef VTK_SLICER_ASTRO_SUPPORT_OPENMP
+  #pragma omp for schedule(static)
+  #endif // VTK_SLICER_ASTRO_SUPPORT_OPENMP
+  for (vtkIdType lineCnt = 0; lineCnt < numLines; lineCnt++)
+    {
+    #ifdef VTK_SLICER_ASTRO_SUPPORT_OPENMP
+    if (omp_get_thread_num() == 0)
+    #endif // VTK_SLICER_ASTRO_SUPPORT_OPENMP
+      {
+      progress.Synchronize(pnode);
+      }
+    if (progress.IsCancelled())
+      {
+      continue;
+      }
+
+    vtkIdType start = lineCnt;
+    if (axis == 0)
+      {
+      start = lineCnt * dims[0];
+      }
+    else if (axis == 1)
+      {
+      start = (lineCnt / dims[0]) * numSlice + (lineCnt % dims[0]);
+      }
+
+    for (int ii = 0; ii < length; ii++)
+      {
+      lineBuffer[ii] = *(inPixel + start + ii * stride);
+      }
+
+    for (int ii = 0; ii < length; ii++)
+      {
+      const int jmin = std::max(-half, -ii);
+      const int jmax = std::min(half, length - 1 - ii);
+      double sum = 0.;
+      for (int jj = jmin; jj <= jmax; jj++)
+        {
+        const T value = lineBuffer[ii + jj];
+        if (isNaN<T>(value))
+          {
+          continue;
+          }
+        sum += value * *(weights + jj + half);
+        }
+      *(outPixel + start + ii * stride) = static_cast<T>(sum);
+      }
+    progress.AddWork(length);
+    }
+  }
+
+  return !progress.IsCancelled();
 }
 
 //----------------------------------------------------------------------------
-void vtkSlicerAstroSmoothingLogic::RegisterNodes()
+// SeparableConvolution on the scalars of two images with the same
+// dimensions and data type (inData and outData can be the same image).
+bool ImageSeparableConvolution(vtkImageData *inData, vtkImageData *outData,
+                               int axis, const std::vector<double> &kernel,
+                               vtkMRMLAstroSmoothingParametersNode *pnode,
+                               vtkAstroProgressToken &progress)
 {
-  if (!this->GetMRMLScene())
+  const int *dims = inData->GetDimensions();
+  switch (inData->GetScalarType())
     {
-    return;
+    case VTK_FLOAT:
+      return SeparableConvolution<float>(static_cast<float*> (inData->GetScalarPointer(0,0,0)),
+                                         static_cast<float*> (outData->GetScalarPointer(0,0,0)),
+                                         dims, axis, kernel, pnode, progress);
+    case VTK_DOUBLE:
+      return SeparableConvolution<double>(static_cast<double*> (inData->GetScalarPointer(0,0,0)),
+                                          static_cast<double*> (outData->GetScalarPointer(0,0,0)),
+                                          dims, axis, kernel, pnode, progress);
     }
+  return false;
+}
 
-  vtkMRMLAstroSmoothingParametersNode* pNode = vtkMRMLAstroSmoothingParametersNode::New();
-  this->GetMRMLScene()->RegisterNodeClass(pNode);
-  pNode->Delete();
+//----------------------------------------------------------------------------
+// Copy the scalars of inData in outData. Returns false if
+// the number of voxels or the data types are different.
+bool CopyScalars(vtkImageData *inData, vtkImageData *outData)
+{
+  vtkDataArray *inScalars = inData->GetPointData()->GetScalars();
+  vtkDataArray *outScalars = outData->GetPointData()->GetScalars();
+  if (!inScalars || !outScalars ||
+      inScalars->GetDataType() != outScalars->GetDataType() ||
+      inScalars->GetNumberOfTuples() != outScalars->GetNumberOfTuples() ||
+      inScalars->GetNumberOfComponents() != outScalars->GetNumberOfComponents())
+    {
+    return false;
+    }
+  memcpy(outScalars->GetVoidPointer(0), inScalars->GetVoidPointer(0),
+         inScalars->GetNumberOfTuples() * inScalars->GetNumberOfComponents() *
+         inScalars->GetDataTypeSize());
+  outScalars->Modified();
+  return true;
 }
 
 //----------------------------------------------------------------------------
-int vtkSlicerAstroSmoothingLogic::Apply(vtkMRMLAstroSmoothingParametersNode* pnode,
-                                        vtkRenderWindow* renderWindow)
+// Key identifying the data of a volume: it changes if the image data
+// of the volume or their scalars are replaced or modified (the latest of
+// their modification times, as for the integral volume of the statistics).
+std::string InputCacheKey(vtkMRMLAstroVolumeNode *volume)
 {
-  if (!pnode)
-    {
-    vtkErrorMacro("vtkSlicerAstroSmoothingLogic::Apply : "
-                  "parameterNode not found.");
-    return 0;
-    }
+  std::ostringstream key;
+  key << (volume->GetID() ? volume->GetID() : "") << ";"
+      << static_cast<void*> (volume->GetImageData()) << ";"
+      << volume->GetImageDataMTime();
+  return key.str();
+}
 
-  if (!renderWindow)
-    {
-    vtkErrorMacro("vtkSlicerAstroSmoothingLogic::Apply : "
-                  "renderWindow not found.");
-    return 0;
-    }
+//----------------------------------------------------------------------------
+// Key identifying the parameters which change the output of the filters,
+// including the noise of the input (DisplayThreshold attribute) used by the
+// gradient filter: the attribute can be refined in the background without
+// modifying the image data.
+std::string FilterCacheKey(vtkMRMLAstroSmoothingParametersNode *pnode,
+                           vtkMRMLAstroVolumeNode *inputVolume)
+{
+  const char *noise = inputVolume->GetAttribute("SlicerAstro.DisplayThreshold");
+  std::ostringstream key;
+  key.precision(17);
+  key << pnode->GetFilter() << ";" << pnode->GetHardware() << ";"
+      << pnode->GetParameterX() << ";" << pnode->GetParameterY() << ";"
+      << pnode->GetParameterZ() << ";" << pnode->GetRx() << ";"
+      << pnode->GetRy() << ";" << pnode->GetRz() << ";"
+      << pnode->GetAccuracy() << ";" << pnode->GetK() << ";"
+      << pnode->GetTimeStep() << ";" << pnode->GetConvergenceTolerance() << ";"
+      << (noise ? noise : "");
+  return key.str();
+}
 
-  int success = 0;
-  switch (pnode->GetFilter())
+//----------------------------------------------------------------------------
+// Intensity driven gradient (edge preserving) diffusion. outPixel contains
+// the input data and tempPixel is a scratch buffer of the same size (its
+// content is not used): they are used as ping-pong buffers, therefore no copy
+// of the volume is done between iterations.
+// The volume is processed per row (line along X). If tolerance is positive,
+// a row is updated only if the row itself or one of its neighbouring rows
+// changed more than tolerance in the previous iteration, and the iterations
+// end as soon as no row changes. If tolerance is null, all the iterations are
+// done on all the rows.
+// On return outPixel contains the smoothed data and iterations the number of
+// iterations performed. Returns false if the computation has been cancelled.
+template <typename T> bool GradientDiffusion(T *outPixel, T *tempPixel, const int *dims,
+                                             double noise2, double tolerance,
+                                             vtkMRMLAstroSmoothingParametersNode *pnode,
+                                             int &iterations)
+{
+  const vtkIdType numSlice = (vtkIdType) dims[0] * dims[1];
+  const vtkIdType numElements = numSlice * dims[2];
+  const int numRows = dims[1] * dims[2];
+  const int maxIterations = pnode->GetAccuracy();
+  const double timeStep = pnode->GetTimeStep();
+  const double parameterX = pnode->GetParameterX();
+  const double parameterY = pnode->GetParameterY();
+  const double parameterZ = pnode->GetParameterZ();
+
+  // rows changed in the previous iteration (at start all of them)
+  std::vector<char> changed(numRows, 1);
+  std::vector<char> nextChanged(numRows, 0);
+  // rows having the same values in both buffers. All the rows are
+  // computed in the first iteration, therefore tempPixel is never read
+  // before being written
+  std::vector<char> synced(numRows, 0);
+
+  vtkAstroProgressToken progress((vtkIdType) numRows * maxIterations);
+
+  T *srcPixel = outPixel;
+  T *dstPixel = tempPixel;
+  iterations = 0;
+
+  for (int iter = 0; iter < maxIterations; iter++)
     {
-    case 0:
+    int numChanged = 0;
+
+    #ifdef VTK_SLICER_ASTRO_SUPPORT_OPENMP
+    #pragma omp parallel for schedule(dynamic, 16) shared(pnode, progress, changed, nextChanged, synced, srcPixel, dstPixel) reduction(+:numChanged)
+    #endif // VTK_SLICER_ASTRO_SUPPORT_OPENMP
+    for (int row = 0; row < numRows; row++)
       {
-      if (!(pnode->GetHardware()))
+      #ifdef VTK_SLICER_ASTRO_SUPPORT_OPENMP
+      if (omp_get_thread_num() == 0)
+      #endif // VTK_SLICER_ASTRO_SUPPORT_OPENMP
         {
-        if (fabs(pnode->GetParameterX() - pnode->GetParameterY()) < 0.001 &&
-            fabs(pnode->GetParameterY() - pnode->GetParameterZ()) < 0.001)
-          {
-          success = this->IsotropicBoxCPUFilter(pnode);
-          }
-        else
+        progress.Synchronize(pnode);
+        }
+      if (progress.IsCancelled())
+        {
+        continue;
+        }
+
+      const int y = row % dims[1];
+      const int z = row / dims[1];
+      const bool active = changed[row] ||
+                          (y > 0 && changed[row - 1]) ||
+                          (y < dims[1] - 1 && changed[row + 1]) ||
+                          (z > 0 && changed[row - dims[1]]) ||
+                          (z < dims[2] - 1 && changed[row + dims[1]]);
+      const vtkIdType start = (vtkIdType) row * dims[0];
+      nextChanged[row] = 0;
+      progress.AddWork(1);
+
+      if (!active)
+        {
+        // converged region: bring the row in the destination buffer once
+        if (!synced[row])
           {
-          success = this->AnisotropicBoxCPUFilter(pnode);
+          std::copy(srcPixel + start, srcPixel + start + dims[0], dstPixel + start);
+          synced[row] = 1;
           }
+        continue;
         }
-      else
+      synced[row] = 0;
+
+      double maxDelta = 0.;
+      for (int x = 0; x < dims[0]; x++)
         {
-        success = this->BoxGPUFilter(pnode, renderWindow);
-        }
-      break;
-      }
-    case 1:
-      {
-        if (!(pnode->GetHardware()))
+        const vtkIdType elemCnt = start + x;
+        const T center = *(srcPixel + elemCnt);
+        // on the borders the missing neighbour is replaced by the voxel itself
+        const T x1 = x > 0 ? *(srcPixel + elemCnt - 1) : center;
+        const T x2 = x < dims[0] - 1 ? *(srcPixel + elemCnt + 1) : center;
+        const T y1 = y > 0 ? *(srcPixel + elemCnt - dims[0]) : center;
+        const T y2 = y < dims[1] - 1 ? *(srcPixel + elemCnt + dims[0]) : center;
+        const T z1 = z > 0 ? *(srcPixel + elemCnt - numSlice) : center;
+        const T z2 = z < dims[2] - 1 ? *(srcPixel + elemCnt + numSlice) : center;
+
+        if (isNaN<T>(center) || isNaN<T>(x1) || isNaN<T>(x2) ||
+            isNaN<T>(y1) || isNaN<T>(y2) || isNaN<T>(z1) || isNaN<T>(z2))
           {
-          if (fabs(pnode->GetParameterX() - pnode->GetParameterY()) < 0.001 &&
-              fabs(pnode->GetParameterY() - pnode->GetParameterZ()) < 0.001)
-            {
-            success = this->IsotropicGaussianCPUFilter(pnode);
-            }
-          else
-            {
-            success = this->AnisotropicGaussianCPUFilter(pnode);
-            }
+          *(dstPixel + elemCnt) = center;
+          continue;
           }
-        else
+
+        const double norm = 1. + (center * center / noise2);
+        const double cX = ((x1 - center) + (x2 - center)) * parameterX;
+        const double cY = ((y1 - center) + (y2 - center)) * parameterY;
+        const double cZ = ((z1 - center) + (z2 - center)) * parameterZ;
+        const double delta = timeStep * (cX + cY + cZ) / norm;
+
+        *(dstPixel + elemCnt) = static_cast<T>(center + delta);
+        if (fabs(delta) > maxDelta)
           {
-          success = this->GaussianGPUFilter(pnode, renderWindow);
+          maxDelta = fabs(delta);
           }
-      break;
-      }
-    case 2:
-      {
-      if (!(pnode->GetHardware()))
-        {
-        success = this->GradientCPUFilter(pnode);
         }
-      else
+
+      if (tolerance <= 0. || maxDelta >= tolerance)
         {
-        success = this->GradientGPUFilter(pnode, renderWindow);
+        nextChanged[row] = 1;
+        numChanged++;
         }
-      break;
       }
-    }
-  return success;
-}
 
-//----------------------------------------------------------------------------
-int vtkSlicerAstroSmoothingLogic::AnisotropicBoxCPUFilter(vtkMRMLAstroSmoothingParametersNode* pnode)
-{
-  #ifndef VTK_SLICER_ASTRO_SUPPORT_OPENMP
-  vtkWarningMacro("vtkSlicerAstroSmoothingLogic::AnisotropicBoxCPUFilter : "
-                  "this release of SlicerAstro has been built "
-                  "without OpenMP support. It may results that "
-                  "the AstroSmoothing algorithm may show poor performance.")
-  #endif // VTK_SLICER_ASTRO_SUPPORT_OPENMP
+    if (progress.IsCancelled())
+      {
+      return false;
+      }
 
-  if (!pnode)
-    {
-    vtkErrorMacro("vtkSlicerAstroSmoothingLogic::AnisotropicBoxCPUFilter : "
-                  "parameterNode not found.");
-    return 0;
-    }
+    std::swap(srcPixel, dstPixel);
+    changed.swap(nextChanged);
+    iterations++;
 
-  if (!this->GetMRMLScene())
-    {
-    vtkErrorMacro("vtkSlicerAstroSmoothingLogic::AnisotropicBoxCPUFilter :"
-                  " scene not found.");
-    return 0;
+    if (numChanged == 0)
+      {
+      break;
+      }
     }
 
-  vtkMRMLAstroVolumeNode *inputVolume =
-    vtkMRMLAstroVolumeNode::SafeDownCast
-      (this->GetMRMLScene()->GetNodeByID(pnode->GetInputVolumeNodeID()));
-  if (!inputVolume || !inputVolume->GetImageData())
+  if (srcPixel != outPixel)
     {
-    vtkErrorMacro("vtkSlicerAstroSmoothingLogic::AnisotropicBoxCPUFilter : "
-                  "inputVolume not found.");
-    return 0;
+    std::copy(srcPixel, srcPixel + numElements, outPixel);
     }
 
-  vtkMRMLAstroVolumeNode *outputVolume =
-    vtkMRMLAstroVolumeNode::SafeDownCast
-      (this->GetMRMLScene()->GetNodeByID(pnode->GetOutputVolumeNodeID()));
-  if (!outputVolume || !outputVolume->GetImageData())
+  return true;
+}
+
+//----------------------------------------------------------------------------
+// Normalized 1D box kernel of (odd) length size.
+// Returns an empty kernel if size is null.
+std::vector<double> BoxKernel1D(double size)
+{
+  std::vector<double> kernel;
+  if (size < 0.001)
     {
-    vtkErrorMacro("vtkSlicerAstroSmoothingLogic::AnisotropicBoxCPUFilter : "
-                  "outputVolume not found.");
-    return 0;
+    return kernel;
     }
-
-  const int *dims = inputVolume->GetImageData()->GetDimensions();
-  const int numComponents = inputVolume->GetImageData()->GetNumberOfScalarComponents();
-  if (numComponents > 1)
+  int nItems = (int) size;
+  if (nItems % 2 == 0)
     {
-    vtkErrorMacro("vtkSlicerAstroSmoothingLogic::AnisotropicBoxCPUFilter : "
-                  "imageData with more than one components.");
-    return 0.;
+    nItems++;
     }
-  const int numElements = dims[0] * dims[1] * dims[2];
-  const int numSlice = dims[0] * dims[1];
-  int nItemsX = pnode->GetParameterX();
-  if (nItemsX % 2 < 0.001)
+  kernel.assign(nItems, 1. / nItems);
+  return kernel;
+}
+
+//----------------------------------------------------------------------------
+// Normalized 1D Gaussian kernel, sampled as in
+// vtkMRMLAstroSmoothingParametersNode::SetGaussianKernel1D.
+// Returns an empty kernel if FWHM is null.
+std::vector<double> GaussianKernel1D(double FWHM, int accuracy)
+{
+  std::vector<double> kernel;
+  if (FWHM < 0.001)
     {
-    nItemsX++;
+    return kernel;
     }
-  const int Xmax = (int) ((nItemsX - 1) / 2.);
-  int nItemsY = pnode->GetParameterY();
-  if (nItemsY % 2 < 0.001)
+  const double sigma = std::max(FWHM / SigmatoFWHM, 0.001);
+  int nItems = (int) (sigma * accuracy);
+  if (nItems % 2 == 0)
     {
-    nItemsY++;
+    nItems++;
     }
-  const int Ymax = (int) ((nItemsY - 1) / 2.);
-  int nItemsZ = pnode->GetParameterZ();
-  if (nItemsZ % 2 < 0.001)
+  kernel.resize(nItems);
+  const double midpoint = (nItems - 1) / 2.;
+  double sumTotal = 0.;
+  for (int ii = 0; ii < nItems; ii++)
     {
-    nItemsZ++;
+    const double x = ii - midpoint;
+    kernel[ii] = exp(-x * x / (2. * sigma * sigma));
+    sumTotal += kernel[ii];
     }
-  const int Zmax = (int) ((nItemsZ - 1) / 2.);
-  const int cont = nItemsX * nItemsY * nItemsZ;
-  float *inFPixel = NULL;
-  float *outFPixel = NULL;
-  double *inDPixel = NULL;
-  double *outDPixel = NULL;
-  const int DataType = inputVolume->GetImageData()->GetPointData()->GetScalars()->GetDataType();
-  switch (DataType)
+  for (int ii = 0; ii < nItems; ii++)
     {
-    case VTK_FLOAT:
-      inFPixel = static_cast<float*> (inputVolume->GetImageData()->GetScalarPointer(0,0,0));
-      outFPixel = static_cast<float*> (outputVolume->GetImageData()->GetScalarPointer(0,0,0));
-      break;
-    case VTK_DOUBLE:
-      inDPixel = static_cast<double*> (inputVolume->GetImageData()->GetScalarPointer(0,0,0));
-      outDPixel = static_cast<double*> (outputVolume->GetImageData()->GetScalarPointer(0,0,0));
-      break;
-    default:
-      vtkErrorMacro("Attempt to allocate scalars of type not allowed");
-      return 0;
+    kernel[ii] /= sumTotal;
     }
+  return kernel;
+}
 
-  bool cancel = false;
-  int status = 0;
+//----------------------------------------------------------------------------
+// One step of a multi-scale smoothing run.
+struct MultiScalePass
+{
+  // index of the output volume written by this pass
+  int Output;
+  // if true, the X and Y kernels are applied before the Z pass,
+  // otherwise the spatial result of the previous pass is reused
+  bool UpdateSpatial;
+  // if true, the spatial kernels are applied to the input, otherwise
+  // to the spatial result of the previous pass (cascade of Gaussian kernels)
+  bool FromInput;
+  std::vector<double> Kernels[3];
+};
 
-  #ifdef VTK_SLICER_ASTRO_SUPPORT_OPENMP
-  int numProcs = 0;
-  if (pnode->GetCores() == 0)
+//----------------------------------------------------------------------------
+// Apply the X and Y kernels of a pass to sourcePixel and write the spatial
+// result in spatialPixel. Returns false if the computation has been cancelled.
+template <typename T> bool MultiScaleSpatialConvolution(const T *sourcePixel, T *spatialPixel,
+                                                        const int *dims,
+                                                        const MultiScalePass &pass,
+                                                        vtkMRMLAstroSmoothingParametersNode *pnode,
+                                                        vtkAstroProgressToken &progress)
+{
+  const vtkIdType numElements = (vtkIdType) dims[0] * dims[1] * dims[2];
+  for (int axis = 0; axis < 2; axis++)
     {
-    numProcs = omp_get_num_procs();
+    if (pass.Kernels[axis].empty())
+      {
+      continue;
+      }
+    if (!SeparableConvolution<T>(sourcePixel, spatialPixel, dims, axis,
+                                 pass.Kernels[axis], pnode, progress))
+      {
+      return false;
+      }
+    sourcePixel = spatialPixel;
     }
-  else
+  if (sourcePixel != spatialPixel)
     {
-    numProcs = pnode->GetCores();
+    std::copy(sourcePixel, sourcePixel + numElements, spatialPixel);
     }
+  return true;
+}
 
-  omp_set_num_threads(numProcs);
-  #endif // VTK_SLICER_ASTRO_SUPPORT_OPENMP
-
-  struct timeval start, end;
-
-  long mtime, seconds, useconds;
-
-  gettimeofday(&start, NULL);
-
-  pnode->SetStatus(1);
+//----------------------------------------------------------------------------
+// Run the passes of a multi-scale smoothing without any work buffer.
+// The passes sharing the same spatial kernel form a group: the X and Y passes
+// of a group are written in the output of its last pass, the Z passes of the
+// other outputs of the group read from there and, finally, the last output is
+// smoothed along Z in place. The in-place Z pass of a group is delayed after
+// the spatial passes of the next group, which can be cascaded on it.
+// Returns false if the computation has been cancelled.
+template <typename T> bool MultiScaleConvolution(const T *inPixel,
+                                                 const std::vector<T*> &outPixels,
+                                                 const int *dims,
+                                                 const std::vector<MultiScalePass> &passes,
+                                                 vtkMRMLAstroSmoothingParametersNode *pnode)
+{
+  const vtkIdType numElements = (vtkIdType) dims[0] * dims[1] * dims[2];
+  const int numPasses = (int) passes.size();
+  vtkIdType numConvolutions = 0;
+  for (int passCnt = 0; passCnt < numPasses; passCnt++)
+    {
+    for (int axis = 0; axis < 3; axis++)
+      {
+      if ((axis == 2 || passes[passCnt].UpdateSpatial) &&
+          !passes[passCnt].Kernels[axis].empty())
+        {
+        numConvolutions++;
+        }
+      }
+    }
+  vtkAstroProgressToken progress(numElements * numConvolutions);
 
-  #ifdef VTK_SLICER_ASTRO_SUPPORT_OPENMP
-  #pragma omp parallel for schedule(static) shared(pnode, inFPixel, inDPixel, outFPixel, outDPixel, cancel, status)
-  #endif // VTK_SLICER_ASTRO_SUPPORT_OPENMP
-  for (int elemCnt = 0; elemCnt < numElements; elemCnt++)
+  // last pass of the previous group: its output holds the spatial result
+  // until its own Z pass is done
+  int pendingPass = -1;
+  int groupStart = 0;
+  while (groupStart < numPasses)
     {
-    int stat = pnode->GetStatus();
+    int groupEnd = groupStart + 1;
+    while (groupEnd < numPasses && !passes[groupEnd].UpdateSpatial)
+      {
+      groupEnd++;
+      }
+    const int lastPass = groupEnd - 1;
+    T *spatialPixel = outPixels[passes[lastPass].Output];
 
-    #ifdef VTK_SLICER_ASTRO_SUPPORT_OPENMP
-    if (stat == -1 && omp_get_thread_num() == 0)
-    #else
-    if (stat == -1)
-    #endif // VTK_SLICER_ASTRO_SUPPORT_OPENMP
+    const MultiScalePass &first = passes[groupStart];
+    const T *sourcePixel = inPixel;
+    if (!first.FromInput && pendingPass >= 0)
       {
-      cancel = true;
+      sourcePixel = outPixels[passes[pendingPass].Output];
       }
-    #ifdef VTK_SLICER_ASTRO_SUPPORT_OPENMP
-    #pragma omp flush (cancel)
-    #endif // VTK_SLICER_ASTRO_SUPPORT_OPENMP
-    if (!cancel)
+    if (!MultiScaleSpatialConvolution<T>(sourcePixel, spatialPixel, dims,
+                                         first, pnode, progress))
       {
-      switch (DataType)
+      return false;
+      }
+
+    if (pendingPass >= 0 && !passes[pendingPass].Kernels[2].empty())
+      {
+      T *pendingPixel = outPixels[passes[pendingPass].Output];
+      if (!SeparableConvolution<T>(pendingPixel, pendingPixel, dims, 2,
+                                   passes[pendingPass].Kernels[2], pnode, progress))
         {
-        case VTK_FLOAT:
-          *(outFPixel + elemCnt) = 0.;
-          break;
-        case VTK_DOUBLE:
-          *(outDPixel + elemCnt) = 0.;
-          break;
+        return false;
         }
+      }
 
-      for (int k = -Zmax; k <= Zmax; k++)
+    for (int passCnt = groupStart; passCnt < lastPass; passCnt++)
+      {
+      T *outPixel = outPixels[passes[passCnt].Output];
+      if (passes[passCnt].Kernels[2].empty())
         {
-        for (int j = -Ymax; j <= Ymax; j++)
-          {
-          for (int i = -Xmax; i <= Xmax; i++)
-            {
-            int posData = elemCnt + i;
+        std::copy(spatialPixel, spatialPixel + numElements, outPixel);
+        }
+      else if (!SeparableConvolution<T>(spatialPixel, outPixel, dims, 2,
+                                        passes[passCnt].Kernels[2], pnode, progress))
+        {
+        return false;
+        }
+      }
 
-            int ref = (int) floor(elemCnt / dims[0]);
-            ref *= dims[0];
-            if(posData < ref)
-              {
-              continue;
-              }
-            if(posData >= ref + dims[0])
-              {
-              break;
-              }
+    pendingPass = lastPass;
+    groupStart = groupEnd;
+    }
 
-            posData += j * dims[0];
-            ref = (int) floor(elemCnt / numSlice);
-            ref *= numSlice;
-            if(posData < ref)
-              {
-              continue;
-              }
-            if(posData >= ref + numSlice)
-              {
-              break;
-              }
+  if (pendingPass >= 0 && !passes[pendingPass].Kernels[2].empty())
+    {
+    T *pendingPixel = outPixels[passes[pendingPass].Output];
+    if (!SeparableConvolution<T>(pendingPixel, pendingPixel, dims, 2,
+                                 passes[pendingPass].Kernels[2], pnode, progress))
+      {
+      return false;
+      }
+    }
 
-            posData += k * numSlice;
-            if(posData < 0)
-              {
-              continue;
-              }
-            if(posData >= numElements)
-              {
-              break;
-              }
+  return true;
+}
 
-            switch (DataType)
-              {
-              case VTK_FLOAT:
-                if (FloatIsNaN(*(inFPixel + posData)))
-                  {
-                  continue;
-                  }
-                *(outFPixel + elemCnt) += *(inFPixel + posData);
-                break;
-              case VTK_DOUBLE:
-                if (DoubleIsNaN(*(inDPixel + posData)))
-                  {
-                  continue;
-                  }
-                *(outDPixel + elemCnt) += *(inDPixel + posData);
-                break;
-              }
-            }
+//----------------------------------------------------------------------------
+// Returns true if the volume contains blanked (NaN) voxels.
+template <typename T> bool HasBlankedVoxels(const T *inPixel, vtkIdType numElements)
+{
+  for (vtkIdType elemCnt = 0; elemCnt < numElements; elemCnt++)
+    {
+    if (isNaN<T>(*(inPixel + elemCnt)))
+      {
+      return true;
+      }
+    }
+  return false;
+}
+
+//----------------------------------------------------------------------------
+// Smooth all the lines of the volume along one axis with the B3-spline
+// kernel [1, 4, 6, 4, 1] / 16 dilated by step ("à trous" algorithm).
+// Borders are mirrored. Blanked (NaN) taps are skipped and the sum is
+// normalized by the weights of the valid taps, so that the voxels next to
+// blanks are not biased low; a voxel without valid taps stays blanked.
+// As in SeparableConvolution, each line is copied in a per-thread
+// line buffer, therefore inPixel and outPixel can be the same array.
+// Returns false if the computation has been cancelled.
+template <typename T> bool AtrousConvolution(const T *inPixel, T *outPixel,
+                                             const int *dims, int axis, int step,
+                                             vtkMRMLAstroSmoothingParametersNode *pnode,
+                                             vtkAstroProgressToken &progress)
+{
+  static const double weights[5] = {1. / 16., 4. / 16., 6. / 16., 4. / 16., 1. / 16.};
+  const vtkIdType numSlice = (vtkIdType) dims[0] * dims[1];
+  const int length = dims[axis];
+  vtkIdType stride = 1;
+  if (axis == 1)
+    {
+    stride = dims[0];
+    }
+  else if (axis == 2)
+    {
+    stride = numSlice;
+    }
+  const vtkIdType numLines = (numSlice * dims[2]) / length;
+
+  #ifdef VTK_SLICER_ASTRO_SUPPORT_OPENMP
+  #pragma omp parallel shared(pnode, progress)
+  #endif // VTK_SLICER_ASTRO_SUPPORT_OPENMP
+  {
+  std::vector<T> lineBuffer(length);
+  #ifdef VTK_SLICER_ASTRO_SUPPORT_OPENMP
+  #pragma omp for schedule(static)
+  #endif // VTK_SLICER_ASTRO_SUPPORT_OPENMP
+  for (vtkIdType lineCnt = 0; lineCnt < numLines; lineCnt++)
+    {
+    #ifdef VTK_SLICER_ASTRO_SUPPORT_OPENMP
+    if (omp_get_thread_num() == 0)
+    #endif // VTK_SLICER_ASTRO_SUPPORT_OPENMP
+      {
+      progress.Synchronize(pnode);
+      }
+    if (progress.IsCancelled())
+      {
+      continue;
+      }
+
+    vtkIdType start = lineCnt;
+    if (axis == 0)
+      {
+      start = lineCnt * dims[0];
+      }
+    else if (axis == 1)
+      {
+      start = (lineCnt / dims[0]) * numSlice + (lineCnt % dims[0]);
+      }
+
+    for (int ii = 0; ii < length; ii++)
+      {
+      lineBuffer[ii] = *(inPixel + start + ii * stride);
+      }
+
+    for (int ii = 0; ii < length; ii++)
+      {
+      double sum = 0., weightSum = 0.;
+      for (int jj = -2; jj <= 2; jj++)
+        {
+        int pos = ii + jj * step;
+        if (pos < 0)
+          {
+          pos = -pos;
+          }
+        if (pos > length - 1)
+          {
+          pos = 2 * (length - 1) - pos;
+          }
+        pos = std::min(std::max(pos, 0), length - 1);
+        const T value = lineBuffer[pos];
+        if (isNaN<T>(value))
+          {
+          continue;
           }
+        sum += value * weights[jj + 2];
+        weightSum += weights[jj + 2];
         }
+      *(outPixel + start + ii * stride) =
+        weightSum > 0. ? static_cast<T>(sum / weightSum) : lineBuffer[ii];
+      }
+    progress.AddWork(length);
+    }
+  }
 
-      switch (DataType)
+  return !progress.IsCancelled();
+}
+
+//----------------------------------------------------------------------------
+// Noise of a wavelet scale, estimated from the median absolute value of
+// (at most one million) regularly sampled coefficients. Blanked voxels are skipped.
+template <typename T> double WaveletScaleNoise(const T *coeffPixel, vtkIdType numElements)
+{
+  const vtkIdType maxSamples = 1000000;
+  const vtkIdType stride = std::max<vtkIdType>(1, numElements / maxSamples);
+  std::vector<T> samples;
+  samples.reserve(numElements / stride + 1);
+  for (vtkIdType elemCnt = 0; elemCnt < numElements; elemCnt += stride)
+    {
+    const T value = *(coeffPixel + elemCnt);
+    if (isNaN<T>(value))
+      {
+      continue;
+      }
+    samples.push_back(fabs(value));
+    }
+  if (samples.empty())
+    {
+    return 0.;
+    }
+  typename std::vector<T>::iterator median = samples.begin() + samples.size() / 2;
+  std::nth_element(samples.begin(), median, samples.end());
+  // median absolute deviation of a Gaussian distribution
+  return *median / 0.6745;
+}
+
+//----------------------------------------------------------------------------
+// Starlet (isotropic undecimated wavelet) denoising. The volume is decomposed
+// in numScales wavelet scales w_j = c_(j-1) - c_j, where c_j is c_(j-1)
+// smoothed along the three axes with the B3-spline kernel dilated by 2^(j-1).
+// Coefficients smaller than K times the noise of their scale are removed and
+// the volume is reconstructed as c_J plus the sum of the thresholded scales.
+// The smoothing passes are done in place, therefore only two temporary volumes
+// are allocated (c_j and the previous scale). They are not initialized: their
+// pages are first touched by the parallel loops filling them, with the same
+// static partition of the following passes. Blanked voxels stay blanked.
+// On return noises contains the noise of each scale.
+// Returns false if the computation has been cancelled.
+template <typename T> bool StarletDenoising(const T *inPixel, T *outPixel,
+                                            const int *dims, int numScales, double K,
+                                            vtkMRMLAstroSmoothingParametersNode *pnode,
+                                            std::vector<double> &noises)
+{
+  const vtkIdType numElements = (vtkIdType) dims[0] * dims[1] * dims[2];
+  const vtkIdType blockSize = vtkAstroProgressToken::GetBlockSize();
+  const vtkIdType numBlocks = vtkAstroProgressToken::GetNumberOfBlocks(numElements);
+  // three smoothing passes, the wavelet scale and the thresholding for each scale
+  vtkAstroProgressToken progress(numElements * (5 * numScales + 1));
+
+  vtkNew<vtkAOSDataArrayTemplate<T> > coarse, work;
+  coarse->SetNumberOfValues(numElements);
+  work->SetNumberOfValues(numElements);
+  T *coarsePixel = coarse->GetPointer(0);
+  T *workPixel = work->GetPointer(0);
+  const T *previousPixel = inPixel;
+  noises.clear();
+
+  for (int scale = 0; scale < numScales; scale++)
+    {
+    const int step = 1 << scale;
+    const T *sourcePixel = previousPixel;
+    for (int axis = 0; axis < 3; axis++)
+      {
+      if (!AtrousConvolution<T>(sourcePixel, coarsePixel, dims, axis, step, pnode, progress))
         {
-        case VTK_FLOAT:
-          *(outFPixel + elemCnt) /= cont;
-          break;
-        case VTK_DOUBLE:
-          *(outDPixel + elemCnt) /= cont;
-          break;
+        return false;
         }
+      sourcePixel = coarsePixel;
+      }
 
+    // wavelet scale (it overwrites the previous smoothed volume, if any).
+    // The blanked voxels of the input stay blanked in all the scales, so
+    // that the values smoothed into them do not enter the noise estimate.
+    #ifdef VTK_SLICER_ASTRO_SUPPORT_OPENMP
+    #pragma omp parallel for schedule(static) shared(pnode, progress, inPixel, previousPixel, coarsePixel, workPixel)
+    #endif // VTK_SLICER_ASTRO_SUPPORT_OPENMP
+    for (vtkIdType blockCnt = 0; blockCnt < numBlocks; blockCnt++)
+      {
       #ifdef VTK_SLICER_ASTRO_SUPPORT_OPENMP
       if (omp_get_thread_num() == 0)
+      #endif // VTK_SLICER_ASTRO_SUPPORT_OPENMP
         {
-        if(elemCnt / (numElements / (numProcs * 100)) > status)
-          {
-          status += 10;
-          pnode->SetStatus(status);
-          }
+        progress.Synchronize(pnode);
+        }
+      if (progress.IsCancelled())
+        {
+        continue;
         }
-      #else
-      if(elemCnt / (numElements / 100) > status)
+
+      const vtkIdType firstElem = blockCnt * blockSize;
+      const vtkIdType lastElem = std::min<vtkIdType>(firstElem + blockSize, numElements);
+      for (vtkIdType elemCnt = firstElem; elemCnt < lastElem; elemCnt++)
         {
-        status += 10;
-        pnode->SetStatus(status);
+        *(workPixel + elemCnt) = isNaN<T>(*(inPixel + elemCnt)) ? *(inPixel + elemCnt) :
+                                 *(previousPixel + elemCnt) - *(coarsePixel + elemCnt);
         }
+      progress.AddWork(lastElem - firstElem);
+      }
+    if (progress.IsCancelled())
+      {
+      return false;
+      }
+
+    const double threshold = K * WaveletScaleNoise<T>(workPixel, numElements);
+    noises.push_back(threshold / K);
+
+    // add the significant coefficients to the output
+    #ifdef VTK_SLICER_ASTRO_SUPPORT_OPENMP
+    #pragma omp parallel for schedule(static) shared(pnode, progress, workPixel, outPixel)
+    #endif // VTK_SLICER_ASTRO_SUPPORT_OPENMP
+    for (vtkIdType blockCnt = 0; blockCnt < numBlocks; blockCnt++)
+      {
+      #ifdef VTK_SLICER_ASTRO_SUPPORT_OPENMP
+      if (omp_get_thread_num() == 0)
       #endif // VTK_SLICER_ASTRO_SUPPORT_OPENMP
+        {
+        progress.Synchronize(pnode);
+        }
+      if (progress.IsCancelled())
+        {
+        continue;
+        }
+
+      const vtkIdType firstElem = blockCnt * blockSize;
+      const vtkIdType lastElem = std::min<vtkIdType>(firstElem + blockSize, numElements);
+      for (vtkIdType elemCnt = firstElem; elemCnt < lastElem; elemCnt++)
+        {
+        const T coeff = *(workPixel + elemCnt);
+        const T value = fabs(coeff) >= threshold ? coeff : static_cast<T>(0.);
+        if (scale == 0)
+          {
+          *(outPixel + elemCnt) = value;
+          }
+        else
+          {
+          *(outPixel + elemCnt) += value;
+          }
+        }
+      progress.AddWork(lastElem - firstElem);
+      }
+    if (progress.IsCancelled())
+      {
+      return false;
       }
+
+    previousPixel = coarsePixel;
+    std::swap(coarsePixel, workPixel);
     }
 
-  gettimeofday(&end, NULL);
+  // add the last smoothed volume
+  #ifdef VTK_SLICER_ASTRO_SUPPORT_OPENMP
+  #pragma omp parallel for schedule(static) shared(pnode, progress, inPixel, previousPixel, outPixel)
+  #endif // VTK_SLICER_ASTRO_SUPPORT_OPENMP
+  for (vtkIdType blockCnt = 0; blockCnt < numBlocks; blockCnt++)
+    {
+    #ifdef VTK_SLICER_ASTRO_SUPPORT_OPENMP
+    if (omp_get_thread_num() == 0)
+    #endif // VTK_SLICER_ASTRO_SUPPORT_OPENMP
+      {
+      progress.Synchronize(pnode);
+      }
+    if (progress.IsCancelled())
+      {
+      continue;
+      }
 
-  seconds  = end.tv_sec  - start.tv_sec;
-  useconds = end.tv_usec - start.tv_usec;
+    const vtkIdType firstElem = blockCnt * blockSize;
+    const vtkIdType lastElem = std::min<vtkIdType>(firstElem + blockSize, numElements);
+    for (vtkIdType elemCnt = firstElem; elemCnt < lastElem; elemCnt++)
+      {
+      if (isNaN<T>(*(inPixel + elemCnt)))
+        {
+        *(outPixel + elemCnt) = *(inPixel + elemCnt);
+        continue;
+        }
+      *(outPixel + elemCnt) += *(previousPixel + elemCnt);
+      }
+    progress.AddWork(lastElem - firstElem);
+    }
 
-  mtime = ((seconds) * 1000 + useconds/1000.0) + 0.5;
+  return !progress.IsCancelled();
+}
 
-  vtkDebugMacro("Box Filter (CPU) Kernel Time : "<<mtime<<" ms.");
+//----------------------------------------------------------------------------
+// Copy a box of size voxels, starting at inOrigin in the volume inPixel
+// (of dimensions inDims), at outOrigin in the volume outPixel.
+template <typename T> void CopyBox(const T *inPixel, const int *inDims, const int *inOrigin,
+                                   T *outPixel, const int *outDims, const int *outOrigin,
+                                   const int *size)
+{
+  const int numRows = size[1] * size[2];
 
-  inFPixel = NULL;
-  outFPixel = NULL;
-  inDPixel = NULL;
-  outDPixel = NULL;
+  #ifdef VTK_SLICER_ASTRO_SUPPORT_OPENMP
+  #pragma omp parallel for schedule(static)
+  #endif // VTK_SLICER_ASTRO_SUPPORT_OPENMP
+  for (int row = 0; row < numRows; row++)
+    {
+    const int y = row % size[1];
+    const int z = row / size[1];
+    const T *inRow = inPixel + ((vtkIdType) (z + inOrigin[2]) * inDims[1] + y + inOrigin[1])
+                   * inDims[0] + inOrigin[0];
+    T *outRow = outPixel + ((vtkIdType) (z + outOrigin[2]) * outDims[1] + y + outOrigin[1])
+              * outDims[0] + outOrigin[0];
+    std::copy(inRow, inRow + size[0], outRow);
+    }
+}
 
-  delete inFPixel;
-  delete outFPixel;
-  delete inDPixel;
-  delete outDPixel;
+//----------------------------------------------------------------------------
+// Bounding box (in IJK coordinates) of the voxels of a label map different
+// from zero. Returns false if the label map is empty.
+bool LabelMapBounds(const short *maskPixel, const int *dims, int *bounds)
+{
+  int xMin = dims[0], yMin = dims[1], zMin = dims[2];
+  int xMax = -1, yMax = -1, zMax = -1;
+  const int numRows = dims[1] * dims[2];
 
-  if (cancel)
+  #ifdef VTK_SLICER_ASTRO_SUPPORT_OPENMP
+  #pragma omp parallel for schedule(static) reduction(min : xMin, yMin, zMin), reduction(max : xMax, yMax, zMax)
+  #endif // VTK_SLICER_ASTRO_SUPPORT_OPENMP
+  for (int row = 0; row < numRows; row++)
     {
-    pnode->SetStatus(100);
-    return 0;
+    const short *maskRow = maskPixel + (vtkIdType) row * dims[0];
+    int first = -1, last = -1;
+    for (int x = 0; x < dims[0]; x++)
+      {
+      if (*(maskRow + x))
+        {
+        if (first < 0)
+          {
+          first = x;
+          }
+        last = x;
+        }
+      }
+    if (first < 0)
+      {
+      continue;
+      }
+    const int y = row % dims[1];
+    const int z = row / dims[1];
+    xMin = std::min(xMin, first);
+    xMax = std::max(xMax, last);
+    yMin = std::min(yMin, y);
+    yMax = std::max(yMax, y);
+    zMin = std::min(zMin, z);
+    zMax = std::max(zMax, z);
+    }
+
+  bounds[0] = xMin;
+  bounds[1] = xMax;
+  bounds[2] = yMin;
+  bounds[3] = yMax;
+  bounds[4] = zMin;
+  bounds[5] = zMax;
+
+  return xMax >= 0;
+}
+
+//----------------------------------------------------------------------------
+// Number of scales of the wavelet filter for a volume of dimensions dims:
+// the largest scale must fit in the smallest dimension of the volume.
+int WaveletNumberOfScales(int accuracy, const int *dims)
+{
+  int numScales = std::min(std::max(accuracy, 1), 16);
+  const int minDim = std::min(dims[0], std::min(dims[1], dims[2]));
+  while (numScales > 1 && (2 << (numScales - 1)) >= minDim)
+    {
+    numScales--;
     }
+  return numScales;
+}
 
-  gettimeofday(&start, NULL);
+//----------------------------------------------------------------------------
+// Number of voxels around a region, along each axis, which contribute
+// to the filtered values inside the region. dims are the dimensions of
+// the whole volume.
+void RegionPadding(vtkMRMLAstroSmoothingParametersNode *pnode, const int *dims, int *padding)
+{
+  const double parameters[3] = {pnode->GetParameterX(),
+                                pnode->GetParameterY(),
+                                pnode->GetParameterZ()};
+  const int accuracy = std::max(pnode->GetAccuracy(), 1);
+  switch (pnode->GetFilter())
+    {
+    case 0:
+      {
+      for (int axis = 0; axis < 3; axis++)
+        {
+        padding[axis] = (int) parameters[axis] / 2;
+        }
+      break;
+      }
+    case 1:
+      {
+      // a rotated kernel can extend along any axis as its largest FWHM
+      double FWHM[3] = {parameters[0], parameters[1], parameters[2]};
+      if (fabs(pnode->GetRx()) > 0.001 || fabs(pnode->GetRy()) > 0.001 ||
+          fabs(pnode->GetRz()) > 0.001)
+        {
+        const double maxFWHM = std::max(FWHM[0], std::max(FWHM[1], FWHM[2]));
+        FWHM[0] = FWHM[1] = FWHM[2] = maxFWHM;
+        }
+      for (int axis = 0; axis < 3; axis++)
+        {
+        padding[axis] = (int) (FWHM[axis] / SigmatoFWHM * accuracy) / 2 + 1;
+        }
+      break;
+      }
+    case 2:
+      {
+      // each iteration spreads the signal by one voxel
+      for (int axis = 0; axis < 3; axis++)
+        {
+        padding[axis] = parameters[axis] > 0. ? accuracy : 0;
+        }
+      break;
+      }
+    case 3:
+      {
+      // half-width of the B3-spline kernel summed over the scales
+      // (as many scales as for the whole volume)
+      const int numScales = WaveletNumberOfScales(accuracy, dims);
+      for (int axis = 0; axis < 3; axis++)
+        {
+        padding[axis] = 2 * ((1 << numScales) - 1);
+        }
+      break;
+      }
+    default:
+      {
+      padding[0] = padding[1] = padding[2] = 0;
+      break;
+      }
+    }
+}
+
+//----------------------------------------------------------------------------
+// Average groups of factor consecutive channels (boxcar rebinning).
+// If hanning, each channel is first smoothed with the Hanning kernel
+// (1/4, 1/2, 1/4), i.e. the channels bordering each group contribute too.
+// The volume is processed one output channel slab at a time.
+// Blanked (NaN) voxels and channels outside the volume do not contribute,
+// output voxels without contributions are blanked.
+// Returns false if the computation has been cancelled.
+template <typename T> bool SpectralRebin(const T *inPixel, T *outPixel,
+                                         const int *dims, int factor, bool hanning,
+                                         vtkMRMLAstroSmoothingParametersNode *pnode,
+                                         vtkAstroProgressToken &progress)
+{
+  const vtkIdType numSlice = (vtkIdType) dims[0] * dims[1];
+  const int outNumChannels = dims[2] / factor;
+  const int firstOffset = hanning ? -1 : 0;
+
+  // weights of the input channels of a group, from firstOffset
+  std::vector<double> weights(factor - 2 * firstOffset, 0.);
+  for (int member = 0; member < factor; member++)
+    {
+    if (hanning)
+      {
+      weights[member] += 0.25;
+      weights[member + 1] += 0.5;
+      weights[member + 2] += 0.25;
+      }
+    else
+      {
+      weights[member] = 1.;
+      }
+    }
+  const int numWeights = (int) weights.size();
+  const int numRows = outNumChannels * dims[1];
+
+  #ifdef VTK_SLICER_ASTRO_SUPPORT_OPENMP
+  #pragma omp parallel shared(pnode, progress)
+  #endif // VTK_SLICER_ASTRO_SUPPORT_OPENMP
+  {
+  std::vector<double> sum(dims[0]);
+  std::vector<double> norm(dims[0]);
+  #ifdef VTK_SLICER_ASTRO_SUPPORT_OPENMP
+  #pragma omp for schedule(static)
+  #endif // VTK_SLICER_ASTRO_SUPPORT_OPENMP
+  for (int row = 0; row < numRows; row++)
+    {
+    #ifdef VTK_SLICER_ASTRO_SUPPORT_OPENMP
+    if (omp_get_thread_num() == 0)
+    #endif // VTK_SLICER_ASTRO_SUPPORT_OPENMP
+      {
+      progress.Synchronize(pnode);
+      }
+    if (progress.IsCancelled())
+      {
+      continue;
+      }
+
+    const int y = row % dims[1];
+    const int channel = row / dims[1];
+    std::fill(sum.begin(), sum.end(), 0.);
+    std::fill(norm.begin(), norm.end(), 0.);
+
+    for (int ww = 0; ww < numWeights; ww++)
+      {
+      const int z = channel * factor + firstOffset + ww;
+      if (z < 0 || z >= dims[2])
+        {
+        continue;
+        }
+      const double weight = weights[ww];
+      const T *inRow = inPixel + z * numSlice + (vtkIdType) y * dims[0];
+      for (int x = 0; x < dims[0]; x++)
+        {
+        const T value = *(inRow + x);
+        const bool valid = !isNaN<T>(value);
+        sum[x] += valid ? weight * value : 0.;
+        norm[x] += valid ? weight : 0.;
+        }
+      }
+
+    T *outRow = outPixel + channel * numSlice + (vtkIdType) y * dims[0];
+    for (int x = 0; x < dims[0]; x++)
+      {
+      *(outRow + x) = norm[x] > 0. ? static_cast<T>(sum[x] / norm[x]) :
+                                     std::numeric_limits<T>::quiet_NaN();
+      }
+    progress.AddWork(dims[0]);
+    }
+  }
+
+  return !progress.IsCancelled();
+}
+
+//----------------------------------------------------------------------------
+// Average blocks of factor x factor pixels of each channel (spatial binning).
+// Pixels beyond the last complete block along X and Y are discarded.
+// Blanked (NaN) voxels do not contribute, output voxels without
+// contributions are blanked.
+// Returns false if the computation has been cancelled.
+template <typename T> bool SpatialBinning(const T *inPixel, T *outPixel,
+                                          const int *dims, int factor,
+                                          vtkMRMLAstroSmoothingParametersNode *pnode,
+                                          vtkAstroProgressToken &progress)
+{
+  const int outDims[3] = {dims[0] / factor, dims[1] / factor, dims[2]};
+  const int numRows = outDims[1] * outDims[2];
+
+  #ifdef VTK_SLICER_ASTRO_SUPPORT_OPENMP
+  #pragma omp parallel shared(pnode, progress)
+  #endif // VTK_SLICER_ASTRO_SUPPORT_OPENMP
+  {
+  std::vector<double> sum(outDims[0]);
+  std::vector<int> count(outDims[0]);
+  #ifdef VTK_SLICER_ASTRO_SUPPORT_OPENMP
+  #pragma omp for schedule(static)
+  #endif // VTK_SLICER_ASTRO_SUPPORT_OPENMP
+  for (int row = 0; row < numRows; row++)
+    {
+    #ifdef VTK_SLICER_ASTRO_SUPPORT_OPENMP
+    if (omp_get_thread_num() == 0)
+    #endif // VTK_SLICER_ASTRO_SUPPORT_OPENMP
+      {
+      progress.Synchronize(pnode);
+      }
+    if (progress.IsCancelled())
+      {
+      continue;
+      }
+
+    const int y = row % outDims[1];
+    const int z = row / outDims[1];
+    std::fill(sum.begin(), sum.end(), 0.);
+    std::fill(count.begin(), count.end(), 0);
+
+    for (int yy = y * factor; yy < (y + 1) * factor; yy++)
+      {
+      const T *inRow = inPixel + ((vtkIdType) z * dims[1] + yy) * dims[0];
+      for (int x = 0; x < outDims[0]; x++)
+        {
+        const T *inBlock = inRow + x * factor;
+        double blockSum = 0.;
+        int blockCount = 0;
+        for (int xx = 0; xx < factor; xx++)
+          {
+          const T value = *(inBlock + xx);
+          const bool valid = !isNaN<T>(value);
+          blockSum += valid ? value : 0.;
+          blockCount += valid;
+          }
+        sum[x] += blockSum;
+        count[x] += blockCount;
+        }
+      }
+
+    T *outRow = outPixel + ((vtkIdType) z * outDims[1] + y) * outDims[0];
+    for (int x = 0; x < outDims[0]; x++)
+      {
+      *(outRow + x) = count[x] > 0 ? static_cast<T>(sum[x] / count[x]) :
+                                     std::numeric_limits<T>::quiet_NaN();
+      }
+    progress.AddWork(outDims[0]);
+    }
+  }
+
+  return !progress.IsCancelled();
+}
+
+//----------------------------------------------------------------------------
+// Update the header keywords and the WCS of a volume after binning
+// factor pixels of axis in one pixel. The world coordinates of the
+// reference point are preserved. The column of axis of the CD matrix (if
+// any) is scaled as CDELT, the PC matrix is dimensionless and is not
+// modified. Returns the wcsset status.
+int BinAxisWCS(vtkMRMLAstroVolumeNode *volume, int axis, int factor)
+{
+  const std::string axisNumber = IntToString(axis + 1);
+  const std::string cdeltKey = "SlicerAstro.CDELT" + axisNumber;
+  const std::string crpixKey = "SlicerAstro.CRPIX" + axisNumber;
+
+  // the center of the output pixel q (FITS convention) is at the input
+  // pixel (q - 1) * factor + (factor + 1) / 2
+  const double cdelt = StringToDouble(volume->GetAttribute(cdeltKey.c_str())) * factor;
+  const double crpix = (StringToDouble(volume->GetAttribute(crpixKey.c_str())) - 0.5) / factor + 0.5;
+  volume->SetAttribute(cdeltKey.c_str(), DoubleToString(cdelt).c_str());
+  volume->SetAttribute(crpixKey.c_str(), DoubleToString(crpix).c_str());
+  volume->SetAttribute(("SlicerAstro.NAXIS" + axisNumber).c_str(),
+                       IntToString(volume->GetImageData()->GetDimensions()[axis]).c_str());
+  for (int ii = 1; ii <= 3; ii++)
+    {
+    const std::string cdKey = "SlicerAstro.CD" + IntToString(ii) + "_" + axisNumber;
+    if (volume->GetAttribute(cdKey.c_str()))
+      {
+      const double cd = StringToDouble(volume->GetAttribute(cdKey.c_str())) * factor;
+      volume->SetAttribute(cdKey.c_str(), DoubleToString(cd).c_str());
+      }
+    }
+
+  vtkMRMLAstroVolumeDisplayNode* astroDisplay = volume->GetAstroVolumeDisplayNode();
+  wcsprm* wcs = astroDisplay ? astroDisplay->GetWCSStruct() : NULL;
+  if (!wcs || axis >= wcs->naxis)
+    {
+    return 0;
+    }
+
+  wcs->crpix[axis] = (wcs->crpix[axis] - 0.5) / factor + 0.5;
+  wcs->cdelt[axis] *= factor;
+  if (wcs->altlin & 2)
+    {
+    for (int ii = 0; ii < wcs->naxis; ii++)
+      {
+      wcs->cd[ii * wcs->naxis + axis] *= factor;
+      }
+    }
+  wcs->flag = 0;
+
+  return wcsset(wcs);
+}
+
+}// end namespace
+
+//----------------------------------------------------------------------------
+void vtkSlicerAstroSmoothingLogic::PrintSelf(ostream& os, vtkIndent indent)
+{
+  this->vtkObject::PrintSelf(os, indent);
+  os << indent << "vtkSlicerAstroSmoothingLogic:             " << this->GetClassName() << "\n";
+  os << indent << "MaximumCacheSize: " << this->MaximumCacheSize << " MB\n";
+}
+
+//----------------------------------------------------------------------------
+void vtkSlicerAstroSmoothingLogic::RegisterNodes()
+{
+  if (!this->GetMRMLScene())
+    {
+    return;
+    }
+
+  vtkMRMLAstroSmoothingParametersNode* pNode = vtkMRMLAstroSmoothingParametersNode::New();
+  this->GetMRMLScene()->RegisterNodeClass(pNode);
+  pNode->Delete();
+}
+
+//----------------------------------------------------------------------------
+int vtkSlicerAstroSmoothingLogic::Apply(vtkMRMLAstroSmoothingParametersNode* pnode,
+                                        vtkRenderWindow* renderWindow)
+{
+  if (!pnode)
+    {
+    vtkErrorMacro("vtkSlicerAstroSmoothingLogic::Apply : "
+                  "parameterNode not found.");
+    return 0;
+    }
+
+  if (!renderWindow)
+    {
+    vtkErrorMacro("vtkSlicerAstroSmoothingLogic::Apply : "
+                  "renderWindow not found.");
+    return 0;
+    }
+
+  if ((pnode->GetRegion() && strcmp(pnode->GetRegion(), "None")) ||
+      pnode->GetPreviewChannel() >= 0)
+    {
+    return this->ApplyRegion(pnode, renderWindow);
+    }
+
+  return this->RunFilter(pnode, renderWindow);
+}
+
+//----------------------------------------------------------------------------
+int vtkSlicerAstroSmoothingLogic::RunFilter(vtkMRMLAstroSmoothingParametersNode* pnode,
+                                            vtkRenderWindow* renderWindow)
+{
+  // With AutoRun the filter is run at each change of the parameters:
+  // the last result is cached and reused if neither the input data nor
+  // the parameters changed. The regions of ApplyRegion are not cached,
+  // nor the results larger than MaximumCacheSize.
+  vtkMRMLAstroVolumeNode *inputVolume = this->GetFilterInputVolume(pnode);
+  const bool useCache = pnode->GetAutoRun() && !this->Internal->RegionInputVolume &&
+                        inputVolume && inputVolume->GetImageData() &&
+                        inputVolume->GetImageData()->GetActualMemorySize() <=
+                        (unsigned long) this->MaximumCacheSize * 1024;
+  std::string resultKey;
+  if (!useCache)
+    {
+    this->Internal->ClearCache();
+    }
+  else
+    {
+    resultKey = InputCacheKey(inputVolume) + "|" + FilterCacheKey(pnode, inputVolume);
+    vtkMRMLAstroVolumeNode *outputVolume = this->GetFilterOutputVolume(pnode);
+    if (resultKey == this->Internal->CachedResultKey &&
+        outputVolume && outputVolume->GetImageData() &&
+        CopyScalars(this->Internal->CachedResult, outputVolume->GetImageData()))
+      {
+      pnode->SetStatus(1);
+      int wasModifying = outputVolume->StartModify();
+      outputVolume->UpdateRangeAttributes();
+      outputVolume->UpdateDisplayThresholdAttributes();
+      outputVolume->EndModify(wasModifying);
+      pnode->SetStatus(100);
+      vtkDebugMacro("vtkSlicerAstroSmoothingLogic::RunFilter : "
+                    "result taken from the cache.");
+      return 1;
+      }
+    this->Internal->CachedResultKey.clear();
+    }
+
+  int success = 0;
+  switch (pnode->GetFilter())
+    {
+    case 0:
+      {
+      if (!(pnode->GetHardware()))
+        {
+        success = this->SeparableCPUFilter(pnode);
+        }
+      else
+        {
+        success = this->BoxGPUFilter(pnode, renderWindow);
+        }
+      break;
+      }
+    case 1:
+      {
+        if (!(pnode->GetHardware()))
+          {
+          // the Gaussian kernel is separable if it is isotropic or not rotated
+          if ((fabs(pnode->GetParameterX() - pnode->GetParameterY()) < 0.001 &&
+               fabs(pnode->GetParameterY() - pnode->GetParameterZ()) < 0.001) ||
+              (fabs(pnode->GetRx()) < 0.001 && fabs(pnode->GetRy()) < 0.001 &&
+               fabs(pnode->GetRz()) < 0.001))
+            {
+            success = this->SeparableCPUFilter(pnode);
+            }
+          else
+            {
+            success = this->AnisotropicGaussianCPUFilter(pnode);
+            }
+          }
+        else
+          {
+          success = this->GaussianGPUFilter(pnode, renderWindow);
+          }
+      break;
+      }
+    case 2:
+      {
+      if (!(pnode->GetHardware()))
+        {
+        success = this->GradientCPUFilter(pnode);
+        }
+      else
+        {
+        success = this->GradientGPUFilter(pnode, renderWindow);
+        }
+      break;
+      }
+    case 3:
+      {
+      // the wavelet filter is available only on the CPU
+      success = this->WaveletCPUFilter(pnode);
+      break;
+      }
+    }
+
+  if (useCache && success)
+    {
+    vtkMRMLAstroVolumeNode *outputVolume = this->GetFilterOutputVolume(pnode);
+    if (outputVolume && outputVolume->GetImageData())
+      {
+      if (!this->Internal->CachedResult)
+        {
+        this->Internal->CachedResult = vtkSmartPointer<vtkImageData>::New();
+        }
+      this->Internal->CachedResult->DeepCopy(outputVolume->GetImageData());
+      this->Internal->CachedResultKey = resultKey;
+      }
+    }
+
+  return success;
+}
+
+//----------------------------------------------------------------------------
+vtkMRMLAstroVolumeNode* vtkSlicerAstroSmoothingLogic::GetFilterInputVolume(vtkMRMLAstroSmoothingParametersNode* pnode)
+{
+  if (this->Internal->RegionInputVolume)
+    {
+    return this->Internal->RegionInputVolume;
+    }
+
+  if (!pnode || !this->GetMRMLScene())
+    {
+    return NULL;
+    }
+
+  return vtkMRMLAstroVolumeNode::SafeDownCast
+    (this->GetMRMLScene()->GetNodeByID(pnode->GetInputVolumeNodeID()));
+}
+
+//----------------------------------------------------------------------------
+vtkMRMLAstroVolumeNode* vtkSlicerAstroSmoothingLogic::GetFilterOutputVolume(vtkMRMLAstroSmoothingParametersNode* pnode)
+{
+  if (this->Internal->RegionOutputVolume)
+    {
+    return this->Internal->RegionOutputVolume;
+    }
+
+  if (!pnode || !this->GetMRMLScene())
+    {
+    return NULL;
+    }
+
+  return vtkMRMLAstroVolumeNode::SafeDownCast
+    (this->GetMRMLScene()->GetNodeByID(pnode->GetOutputVolumeNodeID()));
+}
+
+//----------------------------------------------------------------------------
+int vtkSlicerAstroSmoothingLogic::ApplyRegion(vtkMRMLAstroSmoothingParametersNode* pnode,
+                                              vtkRenderWindow* renderWindow)
+{
+  if (!pnode)
+    {
+    vtkErrorMacro("vtkSlicerAstroSmoothingLogic::ApplyRegion : "
+                  "parameterNode not found.");
+    return 0;
+    }
+
+  if (!this->GetMRMLScene())
+    {
+    vtkErrorMacro("vtkSlicerAstroSmoothingLogic::ApplyRegion :"
+                  " scene not found.");
+    return 0;
+    }
+
+  vtkMRMLAstroVolumeNode *inputVolume =
+    vtkMRMLAstroVolumeNode::SafeDownCast
+      (this->GetMRMLScene()->GetNodeByID(pnode->GetInputVolumeNodeID()));
+  if (!inputVolume || !inputVolume->GetImageData())
+    {
+    vtkErrorMacro("vtkSlicerAstroSmoothingLogic::ApplyRegion : "
+                  "inputVolume not found.");
+    return 0;
+    }
+
+  vtkMRMLAstroVolumeNode *outputVolume =
+    vtkMRMLAstroVolumeNode::SafeDownCast
+      (this->GetMRMLScene()->GetNodeByID(pnode->GetOutputVolumeNodeID()));
+  if (!outputVolume || !outputVolume->GetImageData())
+    {
+    vtkErrorMacro("vtkSlicerAstroSmoothingLogic::ApplyRegion : "
+                  "outputVolume not found.");
+    return 0;
+    }
+
+  const int *dims = inputVolume->GetImageData()->GetDimensions();
+  const int numComponents = inputVolume->GetImageData()->GetNumberOfScalarComponents();
+  if (numComponents > 1)
+    {
+    vtkErrorMacro("vtkSlicerAstroSmoothingLogic::ApplyRegion : "
+                  "imageData with more than one components.");
+    return 0;
+    }
+
+  const int DataType = inputVolume->GetImageData()->GetPointData()->GetScalars()->GetDataType();
+  if (DataType != VTK_FLOAT && DataType != VTK_DOUBLE)
+    {
+    vtkErrorMacro("Attempt to allocate scalars of type not allowed");
+    return 0;
+    }
+
+  // the preview writes a channel of an output as large as the input
+  const bool preview = pnode->GetPreviewChannel() >= 0;
+  const bool cropOutput = pnode->GetCropOutput() && !preview;
+
+  const int *outDims = outputVolume->GetImageData()->GetDimensions();
+  if (!cropOutput &&
+      (outDims[0] != dims[0] || outDims[1] != dims[1] || outDims[2] != dims[2]))
+    {
+    vtkErrorMacro("vtkSlicerAstroSmoothingLogic::ApplyRegion : "
+                  "outputVolume and inputVolume have different dimensions.");
+    return 0;
+    }
+
+  // Bounds of the selection in IJK coordinates
+  // (the whole volume if there is no selection)
+  int bounds[6] = {0, dims[0] - 1, 0, dims[1] - 1, 0, dims[2] - 1};
+  const char *region = pnode->GetRegion() ? pnode->GetRegion() : "None";
+  if (!strcmp(region, "ROI"))
+    {
+    vtkMRMLAnnotationROINode *roiNode = pnode->GetROINode();
+    if (!roiNode)
+      {
+      vtkErrorMacro("vtkSlicerAstroSmoothingLogic::ApplyRegion :"
+                    " roiNode not found!");
+      return 0;
+      }
+
+    double cropBounds[6] = {0.};
+    if (!this->Internal->AstroVolumeLogic->CalculateROICropVolumeBounds(roiNode, inputVolume, cropBounds))
+      {
+      vtkErrorMacro("vtkSlicerAstroSmoothingLogic::ApplyRegion :"
+                    " failed to compute the bounds of the ROI.");
+      return 0;
+      }
+    // the voxels within the bounds (included), as in the ROI statistics
+    for (int ii = 0; ii < 6; ii += 2)
+      {
+      bounds[ii] = (int) ceil(cropBounds[ii]);
+      bounds[ii + 1] = (int) floor(cropBounds[ii + 1]);
+      }
+    }
+  else if (!strcmp(region, "Segmentation"))
+    {
+    vtkMRMLAstroLabelMapVolumeNode *maskVolume =
+      vtkMRMLAstroLabelMapVolumeNode::SafeDownCast
+        (this->GetMRMLScene()->GetNodeByID(pnode->GetMaskVolumeNodeID()));
+    if (!maskVolume || !maskVolume->GetImageData())
+      {
+      vtkErrorMacro("vtkSlicerAstroSmoothingLogic::ApplyRegion :"
+                    " maskVolume not found!");
+      return 0;
+      }
+
+    const int *maskDims = maskVolume->GetImageData()->GetDimensions();
+    if (maskDims[0] != dims[0] || maskDims[1] != dims[1] || maskDims[2] != dims[2] ||
+        maskVolume->GetImageData()->GetScalarType() != VTK_SHORT)
+      {
+      vtkErrorMacro("vtkSlicerAstroSmoothingLogic::ApplyRegion :"
+                    " maskVolume does not match the inputVolume.");
+      return 0;
+      }
+
+    const short *maskPixel = static_cast<short*> (maskVolume->GetImageData()->GetScalarPointer(0,0,0));
+    if (!LabelMapBounds(maskPixel, dims, bounds))
+      {
+      vtkErrorMacro("vtkSlicerAstroSmoothingLogic::ApplyRegion :"
+                    " the segmentation is empty.");
+      return 0;
+      }
+    }
+  else if (strcmp(region, "None"))
+    {
+    vtkErrorMacro("vtkSlicerAstroSmoothingLogic::ApplyRegion : "
+                  "unknown Region "<<region<<".");
+    return 0;
+    }
+
+  if (preview)
+    {
+    const int channel = pnode->GetPreviewChannel();
+    if (channel < bounds[4] || channel > bounds[5] || channel >= dims[2])
+      {
+      vtkErrorMacro("vtkSlicerAstroSmoothingLogic::ApplyRegion : "
+                    "the preview channel "<<channel<<" is outside the selection.");
+      return 0;
+      }
+    bounds[4] = bounds[5] = channel;
+    }
+
+  // Padded region processed by the filter and position of the selection in it
+  int padding[3] = {0};
+  RegionPadding(pnode, dims, padding);
+  int regionOrigin[3], regionDims[3], innerOrigin[3], innerDims[3], outOrigin[3];
+  for (int axis = 0; axis < 3; axis++)
+    {
+    const int first = std::max(bounds[2 * axis], 0);
+    const int last = std::min(bounds[2 * axis + 1], dims[axis] - 1);
+    if (first > last)
+      {
+      vtkErrorMacro("vtkSlicerAstroSmoothingLogic::ApplyRegion : "
+                    "the selection is outside the inputVolume.");
+      return 0;
+      }
+    regionOrigin[axis] = std::max(first - padding[axis], 0);
+    regionDims[axis] = std::min(last + padding[axis], dims[axis] - 1) - regionOrigin[axis] + 1;
+    innerOrigin[axis] = first - regionOrigin[axis];
+    innerDims[axis] = last - first + 1;
+    outOrigin[axis] = cropOutput ? 0 : first;
+    bounds[2 * axis] = first;
+    bounds[2 * axis + 1] = last;
+    }
+  const int zeroOrigin[3] = {0, 0, 0};
+
+  vtkDebugMacro("Smoothing region: "<<regionDims[0]<<"x"<<regionDims[1]<<"x"<<regionDims[2]
+                <<" voxels (padding "<<padding[0]<<", "<<padding[1]<<", "<<padding[2]<<").");
+
+  // Temporary volumes processed by the filters
+  vtkNew<vtkImageData> regionInputData;
+  regionInputData->SetDimensions(regionDims);
+  regionInputData->SetSpacing(1.,1.,1.);
+  regionInputData->AllocateScalars(DataType, 1);
+  vtkNew<vtkImageData> regionOutputData;
+  regionOutputData->SetDimensions(regionDims);
+  regionOutputData->SetSpacing(1.,1.,1.);
+  regionOutputData->AllocateScalars(DataType, 1);
+
+  switch (DataType)
+    {
+    case VTK_FLOAT:
+      CopyBox<float>(static_cast<float*> (inputVolume->GetImageData()->GetScalarPointer(0,0,0)),
+                     dims, regionOrigin,
+                     static_cast<float*> (regionInputData->GetScalarPointer(0,0,0)),
+                     regionDims, zeroOrigin, regionDims);
+      break;
+    case VTK_DOUBLE:
+      CopyBox<double>(static_cast<double*> (inputVolume->GetImageData()->GetScalarPointer(0,0,0)),
+                      dims, regionOrigin,
+                      static_cast<double*> (regionInputData->GetScalarPointer(0,0,0)),
+                      regionDims, zeroOrigin, regionDims);
+      break;
+    }
+
+  this->Internal->RegionInputVolume = vtkSmartPointer<vtkMRMLAstroVolumeNode>::New();
+  this->Internal->RegionOutputVolume = vtkSmartPointer<vtkMRMLAstroVolumeNode>::New();
+  std::vector<std::string> attributeNames = inputVolume->GetAttributeNames();
+  for (size_t attributeCnt = 0; attributeCnt < attributeNames.size(); attributeCnt++)
+    {
+    const char *attributeName = attributeNames[attributeCnt].c_str();
+    this->Internal->RegionInputVolume->SetAttribute(attributeName, inputVolume->GetAttribute(attributeName));
+    this->Internal->RegionOutputVolume->SetAttribute(attributeName, inputVolume->GetAttribute(attributeName));
+    }
+  this->Internal->RegionInputVolume->SetAndObserveImageData(regionInputData.GetPointer());
+  this->Internal->RegionOutputVolume->SetAndObserveImageData(regionOutputData.GetPointer());
+
+  const int success = this->RunFilter(pnode, renderWindow);
+
+  this->Internal->RegionInputVolume = NULL;
+  this->Internal->RegionOutputVolume = NULL;
+
+  if (!success)
+    {
+    return 0;
+    }
+
+  struct timeval start, end;
+
+  long mtime, seconds, useconds;
+
+  gettimeofday(&start, NULL);
+
+  int wasModifying = outputVolume->StartModify();
+
+  // the full-size output is written in place
+  if (!cropOutput)
+    {
+    outputVolume->CancelAttributesRefinement();
+    }
+
+  if (cropOutput)
+    {
+    vtkNew<vtkImageData> croppedData;
+    croppedData->SetDimensions(innerDims);
+    croppedData->SetSpacing(1.,1.,1.);
+    croppedData->AllocateScalars(DataType, 1);
+    outputVolume->SetAndObserveImageData(croppedData.GetPointer());
+    outputVolume->SetAttribute("SlicerAstro.NAXIS1", IntToString(innerDims[0]).c_str());
+    outputVolume->SetAttribute("SlicerAstro.NAXIS2", IntToString(innerDims[1]).c_str());
+    outputVolume->SetAttribute("SlicerAstro.NAXIS3", IntToString(innerDims[2]).c_str());
+    }
+  else if (!preview)
+    {
+    // outside the selection the full-size output is the unfiltered input
+    // (the preview instead updates only one channel of a previous output)
+    CopyScalars(inputVolume->GetImageData(), outputVolume->GetImageData());
+    }
+
+  switch (DataType)
+    {
+    case VTK_FLOAT:
+      CopyBox<float>(static_cast<float*> (regionOutputData->GetScalarPointer(0,0,0)),
+                     regionDims, innerOrigin,
+                     static_cast<float*> (outputVolume->GetImageData()->GetScalarPointer(0,0,0)),
+                     outputVolume->GetImageData()->GetDimensions(), outOrigin, innerDims);
+      break;
+    case VTK_DOUBLE:
+      CopyBox<double>(static_cast<double*> (regionOutputData->GetScalarPointer(0,0,0)),
+                      regionDims, innerOrigin,
+                      static_cast<double*> (outputVolume->GetImageData()->GetScalarPointer(0,0,0)),
+                      outputVolume->GetImageData()->GetDimensions(), outOrigin, innerDims);
+      break;
+    }
+  outputVolume->GetImageData()->Modified();
+
+  // the preview keeps the range of the output to stay interactive
+  if (!preview)
+    {
+    outputVolume->UpdateRangeAttributes();
+    outputVolume->UpdateDisplayThresholdAttributes();
+    }
+
+  if (cropOutput)
+    {
+    // center the volume
+    this->Internal->AstroVolumeLogic->CenterVolume(outputVolume);
+
+    // calculate the center with respect to the cutout cube
+    double cPixXCut = StringToDouble(outputVolume->GetAttribute("SlicerAstro.CRPIX1")) - bounds[0];
+    double cPixYCut = StringToDouble(outputVolume->GetAttribute("SlicerAstro.CRPIX2")) - bounds[2];
+    double cPixZCut = StringToDouble(outputVolume->GetAttribute("SlicerAstro.CRPIX3")) - bounds[4];
+
+    // update header keywords:
+    outputVolume->SetAttribute("SlicerAstro.CRPIX1", DoubleToString(cPixXCut).c_str());
+    outputVolume->SetAttribute("SlicerAstro.CRPIX2", DoubleToString(cPixYCut).c_str());
+    outputVolume->SetAttribute("SlicerAstro.CRPIX3", DoubleToString(cPixZCut).c_str());
+
+    vtkMRMLAstroVolumeDisplayNode* astroDisplay = outputVolume->GetAstroVolumeDisplayNode();
+    wcsprm* wcs = astroDisplay ? astroDisplay->GetWCSStruct() : NULL;
+    if (wcs)
+      {
+      wcs->crpix[0] = cPixXCut;
+      wcs->crpix[1] = cPixYCut;
+      wcs->crpix[2] = cPixZCut;
+
+      int wcsStatus;
+      if ((wcsStatus = wcsset(wcs)))
+        {
+        vtkErrorMacro("vtkSlicerAstroSmoothingLogic::ApplyRegion :"
+                      "wcsset ERROR "<<wcsStatus<<":\n"<<
+                      "Message from "<<wcs->err->function<<
+                      "at line "<<wcs->err->line_no<<
+                      " of file "<<wcs->err->file<<
+                      ": \n"<<wcs->err->msg<<"\n");
+        }
+      }
+    }
+
+  outputVolume->EndModify(wasModifying);
+
+  gettimeofday(&end, NULL);
+
+  seconds  = end.tv_sec  - start.tv_sec;
+  useconds = end.tv_usec - start.tv_usec;
+
+  mtime = ((seconds) * 1000 + useconds/1000.0) + 0.5;
+
+  vtkDebugMacro("Region Update Time : "<<mtime<<" ms.");
+
+  return 1;
+}
+
+//----------------------------------------------------------------------------
+int vtkSlicerAstroSmoothingLogic::ApplyMultiScale(vtkMRMLAstroSmoothingParametersNode* pnode,
+                                                  vtkDoubleArray* scales,
+                                                  vtkCollection* outputVolumes)
+{
+  #ifndef VTK_SLICER_ASTRO_SUPPORT_OPENMP
+  vtkWarningMacro("vtkSlicerAstroSmoothingLogic::ApplyMultiScale : "
+                  "this release of SlicerAstro has been built "
+                  "without OpenMP support. It may results that "
+                  "the AstroSmoothing algorithm may show poor performance.")
+  #endif // VTK_SLICER_ASTRO_SUPPORT_OPENMP
+
+  if (!pnode)
+    {
+    vtkErrorMacro("vtkSlicerAstroSmoothingLogic::ApplyMultiScale : "
+                  "parameterNode not found.");
+    return 0;
+    }
+
+  if (!scales || scales->GetNumberOfComponents() != 3 ||
+      scales->GetNumberOfTuples() < 1)
+    {
+    vtkErrorMacro("vtkSlicerAstroSmoothingLogic::ApplyMultiScale : "
+                  "scales must contain at least one tuple with three components.");
+    return 0;
+    }
+
+  if (!outputVolumes)
+    {
+    vtkErrorMacro("vtkSlicerAstroSmoothingLogic::ApplyMultiScale : "
+                  "outputVolumes collection not found.");
+    return 0;
+    }
+
+  if (pnode->GetFilter() != 0 && pnode->GetFilter() != 1)
+    {
+    vtkErrorMacro("vtkSlicerAstroSmoothingLogic::ApplyMultiScale : "
+                  "the multi-scale smoothing is available only for the box and Gaussian filters.");
+    return 0;
+    }
+
+  if (!this->GetMRMLScene())
+    {
+    vtkErrorMacro("vtkSlicerAstroSmoothingLogic::ApplyMultiScale :"
+                  " scene not found.");
+    return 0;
+    }
+
+  if (!this->Internal->AstroVolumeLogic)
+    {
+    vtkErrorMacro("vtkSlicerAstroSmoothingLogic::ApplyMultiScale :"
+                  " astroVolumeLogic not found.");
+    return 0;
+    }
+
+  vtkMRMLAstroVolumeNode *inputVolume =
+    vtkMRMLAstroVolumeNode::SafeDownCast
+      (this->GetMRMLScene()->GetNodeByID(pnode->GetInputVolumeNodeID()));
+  if (!inputVolume || !inputVolume->GetImageData())
+    {
+    vtkErrorMacro("vtkSlicerAstroSmoothingLogic::ApplyMultiScale : "
+                  "inputVolume not found.");
+    return 0;
+    }
+
+  const int *dims = inputVolume->GetImageData()->GetDimensions();
+  const int numComponents = inputVolume->GetImageData()->GetNumberOfScalarComponents();
+  if (numComponents > 1)
+    {
+    vtkErrorMacro("vtkSlicerAstroSmoothingLogic::ApplyMultiScale : "
+                  "imageData with more than one components.");
+    return 0;
+    }
+
+  const int DataType = inputVolume->GetImageData()->GetPointData()->GetScalars()->GetDataType();
+  if (DataType != VTK_FLOAT && DataType != VTK_DOUBLE)
+    {
+    vtkErrorMacro("Attempt to allocate scalars of type not allowed");
+    return 0;
+    }
+
+  const bool gaussian = pnode->GetFilter() == 1;
+  const int numScales = scales->GetNumberOfTuples();
+
+  // The cascade is equivalent to the direct smoothing only if the discrete
+  // kernels sample well the Gaussians: the differential kernel must be
+  // wider than one voxel and all the kernels must be truncated far in the
+  // tails. Blanked voxels do not contribute to a smoothing, therefore the
+  // cascade would spread them differently: in all those cases each scale
+  // is smoothed directly from the input.
+  bool cascade = gaussian && pnode->GetAccuracy() >= MultiScaleCascadeMinimumAccuracy;
+  if (cascade)
+    {
+    const vtkIdType numElements = (vtkIdType) dims[0] * dims[1] * dims[2];
+    switch (DataType)
+      {
+      case VTK_FLOAT:
+        cascade = !HasBlankedVoxels<float>
+          (static_cast<float*> (inputVolume->GetImageData()->GetScalarPointer(0,0,0)), numElements);
+        break;
+      case VTK_DOUBLE:
+        cascade = !HasBlankedVoxels<double>
+          (static_cast<double*> (inputVolume->GetImageData()->GetScalarPointer(0,0,0)), numElements);
+        break;
+      }
+    }
+
+  // Sort the scales by spatial and then spectral size:
+  // consecutive scales with the same spatial kernel share the X and Y passes.
+  std::vector<std::vector<double> > sizes(numScales, std::vector<double>(4));
+  for (int scaleCnt = 0; scaleCnt < numScales; scaleCnt++)
+    {
+    for (int axis = 0; axis < 3; axis++)
+      {
+      sizes[scaleCnt][axis] = std::max(scales->GetComponent(scaleCnt, axis), 0.);
+      }
+    sizes[scaleCnt][3] = scaleCnt;
+    }
+  std::sort(sizes.begin(), sizes.end());
+
+  std::vector<MultiScalePass> passes(numScales);
+  double spatialSize[2] = {-1., -1.};
+  for (int scaleCnt = 0; scaleCnt < numScales; scaleCnt++)
+    {
+    MultiScalePass &pass = passes[scaleCnt];
+    const std::vector<double> &size = sizes[scaleCnt];
+    pass.Output = (int) size[3];
+    pass.UpdateSpatial = fabs(size[0] - spatialSize[0]) > 0.001 ||
+                         fabs(size[1] - spatialSize[1]) > 0.001;
+    pass.FromInput = true;
+
+    if (pass.UpdateSpatial)
+      {
+      // Gaussian kernels can be cascaded: smoothing the previous spatial result
+      // with FWHM_d = sqrt(FWHM^2 - FWHM_prev^2) is equivalent to smoothing the
+      // input with FWHM, and the differential kernel is smaller.
+      bool cascadePass = cascade && spatialSize[0] > 0.001 && spatialSize[1] > 0.001 &&
+                         size[0] >= spatialSize[0] && size[1] >= spatialSize[1];
+      for (int axis = 0; axis < 2 && cascadePass; axis++)
+        {
+        const double differentialSigma =
+          sqrt(size[axis] * size[axis] - spatialSize[axis] * spatialSize[axis]) / SigmatoFWHM;
+        cascadePass = differentialSigma >= 1.;
+        }
+      if (cascadePass)
+        {
+        pass.FromInput = false;
+        for (int axis = 0; axis < 2; axis++)
+          {
+          const double differentialFWHM =
+            sqrt(size[axis] * size[axis] - spatialSize[axis] * spatialSize[axis]);
+          pass.Kernels[axis] = GaussianKernel1D(differentialFWHM, pnode->GetAccuracy());
+          }
+        }
+      else
+        {
+        for (int axis = 0; axis < 2; axis++)
+          {
+          pass.Kernels[axis] = gaussian ?
+            GaussianKernel1D(size[axis], pnode->GetAccuracy()) : BoxKernel1D(size[axis]);
+          }
+        }
+      spatialSize[0] = size[0];
+      spatialSize[1] = size[1];
+      }
+
+    pass.Kernels[2] = gaussian ?
+      GaussianKernel1D(size[2], pnode->GetAccuracy()) : BoxKernel1D(size[2]);
+    }
+
+  // Create the output volumes
+  std::vector<vtkMRMLAstroVolumeNode*> outputs(numScales);
+  std::vector<float*> outFPixels(numScales);
+  std::vector<double*> outDPixels(numScales);
+  for (int scaleCnt = 0; scaleCnt < numScales; scaleCnt++)
+    {
+    std::ostringstream outSS;
+    outSS << inputVolume->GetName() << "_Filtered_"
+          << (gaussian ? "Gaussian" : "Box") << "_" << pnode->GetOutputSerial();
+    pnode->SetOutputSerial(pnode->GetOutputSerial() + 1);
+
+    vtkMRMLAstroVolumeNode *outputVolume = this->Internal->AstroVolumeLogic->CloneAstroVolume
+      (this->GetMRMLScene(), inputVolume, NULL, "_Filtered_", outSS.str().c_str(),
+       vtkSlicerAstroVolumeLogic::AllocateImageData);
+    if (!outputVolume || !outputVolume->GetImageData())
+      {
+      vtkErrorMacro("vtkSlicerAstroSmoothingLogic::ApplyMultiScale : "
+                    "outputVolume not created.");
+      for (int ii = 0; ii < scaleCnt; ii++)
+        {
+        this->Internal->AstroVolumeLogic->RemoveAstroVolume(this->GetMRMLScene(), outputs[ii]);
+        }
+      return 0;
+      }
+
+    outputs[scaleCnt] = outputVolume;
+    outFPixels[scaleCnt] = static_cast<float*> (outputVolume->GetImageData()->GetScalarPointer(0,0,0));
+    outDPixels[scaleCnt] = static_cast<double*> (outputVolume->GetImageData()->GetScalarPointer(0,0,0));
+    }
+
+  vtkAstroThreadBudget threadBudget(pnode->GetCores());
+
+  struct timeval start, end;
+
+  long mtime, seconds, useconds;
+
+  gettimeofday(&start, NULL);
+
+  pnode->SetStatus(1);
+
+  bool cancel = false;
+  switch (DataType)
+    {
+    case VTK_FLOAT:
+      cancel = !MultiScaleConvolution<float>
+        (static_cast<float*> (inputVolume->GetImageData()->GetScalarPointer(0,0,0)),
+         outFPixels, dims, passes, pnode);
+      break;
+    case VTK_DOUBLE:
+      cancel = !MultiScaleConvolution<double>
+        (static_cast<double*> (inputVolume->GetImageData()->GetScalarPointer(0,0,0)),
+         outDPixels, dims, passes, pnode);
+      break;
+    }
+
+  gettimeofday(&end, NULL);
+
+  seconds  = end.tv_sec  - start.tv_sec;
+  useconds = end.tv_usec - start.tv_usec;
+
+  mtime = ((seconds) * 1000 + useconds/1000.0) + 0.5;
+
+  vtkDebugMacro("Multi-scale Filter (CPU) Time : "<<mtime<<" ms.");
+
+  if (cancel)
+    {
+    for (int scaleCnt = 0; scaleCnt < numScales; scaleCnt++)
+      {
+      this->Internal->AstroVolumeLogic->RemoveAstroVolume(this->GetMRMLScene(), outputs[scaleCnt]);
+      }
+    pnode->SetStatus(100);
+    return 0;
+    }
+
+  for (int scaleCnt = 0; scaleCnt < numScales; scaleCnt++)
+    {
+    int wasModifying = outputs[scaleCnt]->StartModify();
+    outputs[scaleCnt]->UpdateRangeAttributes();
+    outputs[scaleCnt]->UpdateDisplayThresholdAttributes();
+    outputs[scaleCnt]->EndModify(wasModifying);
+    outputVolumes->AddItem(outputs[scaleCnt]);
+    }
+
+  pnode->SetStatus(100);
+
+  return 1;
+}
+
+//----------------------------------------------------------------------------
+int vtkSlicerAstroSmoothingLogic::ApplyBatch(vtkMRMLAstroSmoothingParametersNode* pnode,
+                                             vtkCollection* inputVolumes,
+                                             vtkCollection* outputVolumes)
+{
+  #ifndef VTK_SLICER_ASTRO_SUPPORT_OPENMP
+  vtkWarningMacro("vtkSlicerAstroSmoothingLogic::ApplyBatch : "
+                  "this release of SlicerAstro has been built "
+                  "without OpenMP support. It may results that "
+                  "the AstroSmoothing algorithm may show poor performance.")
+  #endif // VTK_SLICER_ASTRO_SUPPORT_OPENMP
+
+  if (!pnode)
+    {
+    vtkErrorMacro("vtkSlicerAstroSmoothingLogic::ApplyBatch : "
+                  "parameterNode not found.");
+    return 0;
+    }
+
+  if (!inputVolumes || inputVolumes->GetNumberOfItems() < 1)
+    {
+    vtkErrorMacro("vtkSlicerAstroSmoothingLogic::ApplyBatch : "
+                  "inputVolumes must contain at least one volume.");
+    return 0;
+    }
+
+  if (!outputVolumes)
+    {
+    vtkErrorMacro("vtkSlicerAstroSmoothingLogic::ApplyBatch : "
+                  "outputVolumes collection not found.");
+    return 0;
+    }
+
+  // the batch shares the 1D kernels: only the separable filters are supported
+  const bool separable = pnode->GetFilter() == 0 ||
+    (pnode->GetFilter() == 1 &&
+     ((fabs(pnode->GetParameterX() - pnode->GetParameterY()) < 0.001 &&
+       fabs(pnode->GetParameterY() - pnode->GetParameterZ()) < 0.001) ||
+      (fabs(pnode->GetRx()) < 0.001 && fabs(pnode->GetRy()) < 0.001 &&
+       fabs(pnode->GetRz()) < 0.001)));
+  if (!separable)
+    {
+    vtkErrorMacro("vtkSlicerAstroSmoothingLogic::ApplyBatch : "
+                  "the batch smoothing is available only for the box and "
+                  "non-rotated Gaussian filters.");
+    return 0;
+    }
+
+  if (!this->GetMRMLScene())
+    {
+    vtkErrorMacro("vtkSlicerAstroSmoothingLogic::ApplyBatch :"
+                  " scene not found.");
+    return 0;
+    }
+
+  if (!this->Internal->AstroVolumeLogic)
+    {
+    vtkErrorMacro("vtkSlicerAstroSmoothingLogic::ApplyBatch :"
+                  " astroVolumeLogic not found.");
+    return 0;
+    }
+
+  const int numVolumes = inputVolumes->GetNumberOfItems();
+  std::vector<vtkMRMLAstroVolumeNode*> inputs(numVolumes);
+  vtkIdType totalElements = 0;
+  for (int volumeCnt = 0; volumeCnt < numVolumes; volumeCnt++)
+    {
+    vtkMRMLAstroVolumeNode *inputVolume =
+      vtkMRMLAstroVolumeNode::SafeDownCast(inputVolumes->GetItemAsObject(volumeCnt));
+    if (!inputVolume || !inputVolume->GetImageData() ||
+        !inputVolume->GetImageData()->GetPointData()->GetScalars())
+      {
+      vtkErrorMacro("vtkSlicerAstroSmoothingLogic::ApplyBatch : "
+                    "inputVolume "<<volumeCnt<<" not found.");
+      return 0;
+      }
+
+    if (inputVolume->GetImageData()->GetNumberOfScalarComponents() > 1)
+      {
+      vtkErrorMacro("vtkSlicerAstroSmoothingLogic::ApplyBatch : "
+                    "imageData with more than one components.");
+      return 0;
+      }
+
+    const int DataType = inputVolume->GetImageData()->GetScalarType();
+    if (DataType != VTK_FLOAT && DataType != VTK_DOUBLE)
+      {
+      vtkErrorMacro("Attempt to allocate scalars of type not allowed");
+      return 0;
+      }
+
+    const int *dims = inputVolume->GetImageData()->GetDimensions();
+    totalElements += (vtkIdType) dims[0] * dims[1] * dims[2];
+    inputs[volumeCnt] = inputVolume;
+    }
+
+  // The kernels are built once for all the volumes
+  const bool gaussian = pnode->GetFilter() == 1;
+  const double parameters[3] = {pnode->GetParameterX(),
+                                pnode->GetParameterY(),
+                                pnode->GetParameterZ()};
+  std::vector<double> kernels[3];
+  int numPasses = 0;
+  for (int axis = 0; axis < 3; axis++)
+    {
+    kernels[axis] = gaussian ?
+      GaussianKernel1D(parameters[axis], pnode->GetAccuracy()) : BoxKernel1D(parameters[axis]);
+    if (!kernels[axis].empty())
+      {
+      numPasses++;
+      }
+    }
+
+  // Create the output volumes
+  std::vector<vtkMRMLAstroVolumeNode*> outputs(numVolumes);
+  for (int volumeCnt = 0; volumeCnt < numVolumes; volumeCnt++)
+    {
+    vtkMRMLAstroVolumeNode *inputVolume = inputs[volumeCnt];
+    std::ostringstream outSS;
+    outSS << inputVolume->GetName() << "_Filtered_"
+          << (gaussian ? "Gaussian" : "Box") << "_" << pnode->GetOutputSerial();
+    pnode->SetOutputSerial(pnode->GetOutputSerial() + 1);
+
+    vtkMRMLAstroVolumeNode *outputVolume = this->Internal->AstroVolumeLogic->CloneAstroVolume
+      (this->GetMRMLScene(), inputVolume, NULL, "_Filtered_", outSS.str().c_str(),
+       vtkSlicerAstroVolumeLogic::AllocateImageData);
+    if (!outputVolume || !outputVolume->GetImageData())
+      {
+      vtkErrorMacro("vtkSlicerAstroSmoothingLogic::ApplyBatch : "
+                    "outputVolume not created.");
+      for (int ii = 0; ii < volumeCnt; ii++)
+        {
+        this->Internal->AstroVolumeLogic->RemoveAstroVolume(this->GetMRMLScene(), outputs[ii]);
+        }
+      return 0;
+      }
+    outputs[volumeCnt] = outputVolume;
+    }
+
+  // The thread team is set up once for the whole batch. Each pass of each
+  // volume is already parallel over all the lines, therefore the volumes
+  // are processed one after the other by the same team.
+  vtkAstroThreadBudget threadBudget(pnode->GetCores());
+
+  struct timeval start, end;
+
+  long mtime, seconds, useconds;
+
+  gettimeofday(&start, NULL);
+
+  pnode->SetStatus(1);
+
+  vtkAstroProgressToken progress(totalElements * std::max(numPasses, 1));
+  bool cancel = false;
+  for (int volumeCnt = 0; volumeCnt < numVolumes && !cancel; volumeCnt++)
+    {
+    vtkImageData *inputImage = inputs[volumeCnt]->GetImageData();
+    vtkImageData *outputImage = outputs[volumeCnt]->GetImageData();
+
+    // the first pass writes in the output volume, the following ones work in place
+    vtkImageData *sourceImage = inputImage;
+    for (int axis = 0; axis < 3 && !cancel; axis++)
+      {
+      if (kernels[axis].empty())
+        {
+        continue;
+        }
+      cancel = !ImageSeparableConvolution(sourceImage, outputImage, axis,
+                                          kernels[axis], pnode, progress);
+      sourceImage = outputImage;
+      }
+
+    if (!cancel && sourceImage != outputImage)
+      {
+      CopyScalars(sourceImage, outputImage);
+      }
+    }
+
+  gettimeofday(&end, NULL);
+
+  seconds  = end.tv_sec  - start.tv_sec;
+  useconds = end.tv_usec - start.tv_usec;
+
+  mtime = ((seconds) * 1000 + useconds/1000.0) + 0.5;
+
+  vtkDebugMacro("Batch " << (gaussian ? "Gaussian" : "Box") << " Filter (CPU) Time : "
+                << mtime << " ms (" << numVolumes << " volumes).");
+
+  if (cancel)
+    {
+    for (int volumeCnt = 0; volumeCnt < numVolumes; volumeCnt++)
+      {
+      this->Internal->AstroVolumeLogic->RemoveAstroVolume(this->GetMRMLScene(), outputs[volumeCnt]);
+      }
+    pnode->SetStatus(100);
+    return 0;
+    }
+
+  for (int volumeCnt = 0; volumeCnt < numVolumes; volumeCnt++)
+    {
+    int wasModifying = outputs[volumeCnt]->StartModify();
+    outputs[volumeCnt]->UpdateRangeAttributes();
+    outputs[volumeCnt]->UpdateDisplayThresholdAttributes();
+    outputs[volumeCnt]->EndModify(wasModifying);
+    outputVolumes->AddItem(outputs[volumeCnt]);
+    }
+
+  pnode->SetStatus(100);
+
+  return 1;
+}
+
+//----------------------------------------------------------------------------
+vtkMRMLAstroVolumeNode* vtkSlicerAstroSmoothingLogic::ApplySpectralRebin(vtkMRMLAstroSmoothingParametersNode* pnode,
+                                                                        int factor, bool hanning)
+{
+  #ifndef VTK_SLICER_ASTRO_SUPPORT_OPENMP
+  vtkWarningMacro("vtkSlicerAstroSmoothingLogic::ApplySpectralRebin : "
+                  "this release of SlicerAstro has been built "
+                  "without OpenMP support. It may results that "
+                  "the AstroSmoothing algorithm may show poor performance.")
+  #endif // VTK_SLICER_ASTRO_SUPPORT_OPENMP
+
+  if (!pnode)
+    {
+    vtkErrorMacro("vtkSlicerAstroSmoothingLogic::ApplySpectralRebin : "
+                  "parameterNode not found.");
+    return NULL;
+    }
+
+  if (!this->GetMRMLScene())
+    {
+    vtkErrorMacro("vtkSlicerAstroSmoothingLogic::ApplySpectralRebin :"
+                  " scene not found.");
+    return NULL;
+    }
+
+  if (!this->Internal->AstroVolumeLogic)
+    {
+    vtkErrorMacro("vtkSlicerAstroSmoothingLogic::ApplySpectralRebin :"
+                  " astroVolumeLogic not found.");
+    return NULL;
+    }
+
+  vtkMRMLAstroVolumeNode *inputVolume =
+    vtkMRMLAstroVolumeNode::SafeDownCast
+      (this->GetMRMLScene()->GetNodeByID(pnode->GetInputVolumeNodeID()));
+  if (!inputVolume || !inputVolume->GetImageData())
+    {
+    vtkErrorMacro("vtkSlicerAstroSmoothingLogic::ApplySpectralRebin : "
+                  "inputVolume not found.");
+    return NULL;
+    }
+
+  const int *dims = inputVolume->GetImageData()->GetDimensions();
+  if (factor < 1 || factor > dims[2] || (factor == 1 && !hanning))
+    {
+    vtkErrorMacro("vtkSlicerAstroSmoothingLogic::ApplySpectralRebin : "
+                  "the rebinning factor must be between 1 and the number of channels "
+                  "(1 only with the Hanning smoothing).");
+    return NULL;
+    }
+
+  const int numComponents = inputVolume->GetImageData()->GetNumberOfScalarComponents();
+  if (numComponents > 1)
+    {
+    vtkErrorMacro("vtkSlicerAstroSmoothingLogic::ApplySpectralRebin : "
+                  "imageData with more than one components.");
+    return NULL;
+    }
+
+  const int DataType = inputVolume->GetImageData()->GetPointData()->GetScalars()->GetDataType();
+  if (DataType != VTK_FLOAT && DataType != VTK_DOUBLE)
+    {
+    vtkErrorMacro("Attempt to allocate scalars of type not allowed");
+    return NULL;
+    }
+
+  std::ostringstream outSS;
+  outSS << inputVolume->GetName() << "_Rebinned_"
+        << (hanning ? "Hanning" : "Boxcar") << factor << "_" << pnode->GetOutputSerial();
+  pnode->SetOutputSerial(pnode->GetOutputSerial() + 1);
+
+  vtkMRMLAstroVolumeNode *outputVolume = this->Internal->AstroVolumeLogic->CloneAstroVolume
+    (this->GetMRMLScene(), inputVolume, NULL, "_Rebinned_", outSS.str().c_str(),
+     vtkSlicerAstroVolumeLogic::NoImageData);
+  if (!outputVolume)
+    {
+    vtkErrorMacro("vtkSlicerAstroSmoothingLogic::ApplySpectralRebin : "
+                  "outputVolume not created.");
+    return NULL;
+    }
+
+  const int outDims[3] = {dims[0], dims[1], dims[2] / factor};
+  vtkNew<vtkImageData> imageData;
+  imageData->SetDimensions(outDims[0], outDims[1], outDims[2]);
+  imageData->SetSpacing(inputVolume->GetImageData()->GetSpacing());
+  imageData->SetOrigin(inputVolume->GetImageData()->GetOrigin());
+  imageData->AllocateScalars(DataType, 1);
+  outputVolume->SetAndObserveImageData(imageData.GetPointer());
+
+  vtkAstroThreadBudget threadBudget(pnode->GetCores());
+
+  struct timeval start, end;
+
+  long mtime, seconds, useconds;
+
+  gettimeofday(&start, NULL);
+
+  pnode->SetStatus(1);
+
+  vtkAstroProgressToken progress((vtkIdType) outDims[0] * outDims[1] * outDims[2]);
+  bool cancel = false;
+  switch (DataType)
+    {
+    case VTK_FLOAT:
+      cancel = !SpectralRebin<float>
+        (static_cast<float*> (inputVolume->GetImageData()->GetScalarPointer(0,0,0)),
+         static_cast<float*> (imageData->GetScalarPointer(0,0,0)),
+         dims, factor, hanning, pnode, progress);
+      break;
+    case VTK_DOUBLE:
+      cancel = !SpectralRebin<double>
+        (static_cast<double*> (inputVolume->GetImageData()->GetScalarPointer(0,0,0)),
+         static_cast<double*> (imageData->GetScalarPointer(0,0,0)),
+         dims, factor, hanning, pnode, progress);
+      break;
+    }
+
+  gettimeofday(&end, NULL);
+
+  seconds  = end.tv_sec  - start.tv_sec;
+  useconds = end.tv_usec - start.tv_usec;
+
+  mtime = ((seconds) * 1000 + useconds/1000.0) + 0.5;
+
+  vtkDebugMacro("Spectral Rebin Time : "<<mtime<<" ms.");
+
+  if (cancel)
+    {
+    this->Internal->AstroVolumeLogic->RemoveAstroVolume(this->GetMRMLScene(), outputVolume);
+    pnode->SetStatus(100);
+    return NULL;
+    }
 
   int wasModifying = outputVolume->StartModify();
+  if (factor > 1)
+    {
+    int wcsStatus = BinAxisWCS(outputVolume, 2, factor);
+    wcsprm* wcs = outputVolume->GetAstroVolumeDisplayNode() ?
+      outputVolume->GetAstroVolumeDisplayNode()->GetWCSStruct() : NULL;
+    if (wcsStatus && wcs)
+      {
+      vtkErrorMacro("vtkSlicerAstroSmoothingLogic::ApplySpectralRebin :"
+                    "wcsset ERROR "<<wcsStatus<<":\n"<<
+                    "Message from "<<wcs->err->function<<
+                    "at line "<<wcs->err->line_no<<
+                    " of file "<<wcs->err->file<<
+                    ": \n"<<wcs->err->msg<<"\n");
+      }
+    this->Internal->AstroVolumeLogic->CenterVolume(outputVolume);
+    }
   outputVolume->UpdateRangeAttributes();
   outputVolume->UpdateDisplayThresholdAttributes();
   outputVolume->EndModify(wasModifying);
 
   pnode->SetStatus(100);
 
-  gettimeofday(&end, NULL);
-
-  seconds  = end.tv_sec  - start.tv_sec;
-  useconds = end.tv_usec - start.tv_usec;
-
-  mtime = ((seconds) * 1000 + useconds/1000.0) + 0.5;
-
-  vtkDebugMacro("Update Time : "<<mtime<<" ms.");
-
-  return 1;
+  return outputVolume;
 }
 
-
 //----------------------------------------------------------------------------
-int vtkSlicerAstroSmoothingLogic::IsotropicBoxCPUFilter(vtkMRMLAstroSmoothingParametersNode* pnode)
+vtkMRMLAstroVolumeNode* vtkSlicerAstroSmoothingLogic::ApplySpatialBinning(vtkMRMLAstroSmoothingParametersNode* pnode,
+                                                                         int factor)
 {
   #ifndef VTK_SLICER_ASTRO_SUPPORT_OPENMP
-  vtkWarningMacro("vtkSlicerAstroSmoothingLogic::IsotropicBoxCPUFilter "
+  vtkWarningMacro("vtkSlicerAstroSmoothingLogic::ApplySpatialBinning : "
                   "this release of SlicerAstro has been built "
                   "without OpenMP support. It may results that "
                   "the AstroSmoothing algorithm may show poor performance.")
@@ -539,16 +2558,23 @@ int vtkSlicerAstroSmoothingLogic::IsotropicBoxCPUFilter(vtkMRMLAstroSmoothingPar
 
   if (!pnode)
     {
-    vtkErrorMacro("vtkSlicerAstroSmoothingLogic::IsotropicBoxCPUFilter : "
+    vtkErrorMacro("vtkSlicerAstroSmoothingLogic::ApplySpatialBinning : "
                   "parameterNode not found.");
-    return 0;
+    return NULL;
     }
 
   if (!this->GetMRMLScene())
     {
-    vtkErrorMacro("vtkSlicerAstroSmoothingLogic::IsotropicBoxCPUFilter :"
+    vtkErrorMacro("vtkSlicerAstroSmoothingLogic::ApplySpatialBinning :"
                   " scene not found.");
-    return 0;
+    return NULL;
+    }
+
+  if (!this->Internal->AstroVolumeLogic)
+    {
+    vtkErrorMacro("vtkSlicerAstroSmoothingLogic::ApplySpatialBinning :"
+                  " astroVolumeLogic not found.");
+    return NULL;
     }
 
   vtkMRMLAstroVolumeNode *inputVolume =
@@ -556,78 +2582,58 @@ int vtkSlicerAstroSmoothingLogic::IsotropicBoxCPUFilter(vtkMRMLAstroSmoothingPar
       (this->GetMRMLScene()->GetNodeByID(pnode->GetInputVolumeNodeID()));
   if (!inputVolume || !inputVolume->GetImageData())
     {
-    vtkErrorMacro("vtkSlicerAstroSmoothingLogic::IsotropicBoxCPUFilter : "
+    vtkErrorMacro("vtkSlicerAstroSmoothingLogic::ApplySpatialBinning : "
                   "inputVolume not found.");
-    return 0;
+    return NULL;
     }
 
-  vtkMRMLAstroVolumeNode *outputVolume =
-    vtkMRMLAstroVolumeNode::SafeDownCast
-      (this->GetMRMLScene()->GetNodeByID(pnode->GetOutputVolumeNodeID()));
-  if (!outputVolume || !outputVolume->GetImageData())
+  const int *dims = inputVolume->GetImageData()->GetDimensions();
+  if (factor < 2 || factor > dims[0] || factor > dims[1])
     {
-    vtkErrorMacro("vtkSlicerAstroSmoothingLogic::IsotropicBoxCPUFilter : "
-                  "outputVolume not found.");
-    return 0;
+    vtkErrorMacro("vtkSlicerAstroSmoothingLogic::ApplySpatialBinning : "
+                  "the binning factor must be between 2 and the number of pixels along X and Y.");
+    return NULL;
     }
 
-  this->Internal->tempVolumeData->Initialize();
-  this->Internal->tempVolumeData->DeepCopy(inputVolume->GetImageData());
-  this->Internal->tempVolumeData->Modified();
-  this->Internal->tempVolumeData->GetPointData()->GetScalars()->Modified();
-
-  const int *dims = inputVolume->GetImageData()->GetDimensions();
   const int numComponents = inputVolume->GetImageData()->GetNumberOfScalarComponents();
   if (numComponents > 1)
     {
-    vtkErrorMacro("vtkSlicerAstroSmoothingLogic::IsotropicBoxCPUFilter : "
+    vtkErrorMacro("vtkSlicerAstroSmoothingLogic::ApplySpatialBinning : "
                   "imageData with more than one components.");
-    return 0.;
-    }
-  const int numElements = dims[0] * dims[1] * dims[2];
-  const int numSlice = dims[0] * dims[1];
-  int nItems = (pnode->GetParameterX());
-  if (nItems % 2 < 0.001)
-    {
-    nItems++;
+    return NULL;
     }
-  const int is = (int) ((nItems - 1) / 2.);
 
-  float *outFPixel = NULL;
-  float *tempFPixel = NULL;
-  double *outDPixel = NULL;
-  double *tempDPixel = NULL;
   const int DataType = inputVolume->GetImageData()->GetPointData()->GetScalars()->GetDataType();
-  switch (DataType)
+  if (DataType != VTK_FLOAT && DataType != VTK_DOUBLE)
     {
-    case VTK_FLOAT:
-      outFPixel = static_cast<float*> (outputVolume->GetImageData()->GetScalarPointer(0,0,0));
-      tempFPixel = static_cast<float*> (this->Internal->tempVolumeData->GetScalarPointer(0,0,0));
-      break;
-    case VTK_DOUBLE:
-      outDPixel = static_cast<double*> (outputVolume->GetImageData()->GetScalarPointer(0,0,0));
-      tempDPixel = static_cast<double*> (this->Internal->tempVolumeData->GetScalarPointer(0,0,0));
-      break;
-    default:
-      vtkErrorMacro("Attempt to allocate scalars of type not allowed");
-      return 0;
+    vtkErrorMacro("Attempt to allocate scalars of type not allowed");
+    return NULL;
     }
 
-  bool cancel = false;
+  std::ostringstream outSS;
+  outSS << inputVolume->GetName() << "_Binned_"
+        << factor << "x" << factor << "_" << pnode->GetOutputSerial();
+  pnode->SetOutputSerial(pnode->GetOutputSerial() + 1);
 
-  #ifdef VTK_SLICER_ASTRO_SUPPORT_OPENMP
-  int numProcs = 0;
-  if (pnode->GetCores() == 0)
-    {
-    numProcs = omp_get_num_procs();
-    }
-  else
+  vtkMRMLAstroVolumeNode *outputVolume = this->Internal->AstroVolumeLogic->CloneAstroVolume
+    (this->GetMRMLScene(), inputVolume, NULL, "_Binned_", outSS.str().c_str(),
+     vtkSlicerAstroVolumeLogic::NoImageData);
+  if (!outputVolume)
     {
-    numProcs = pnode->GetCores();
+    vtkErrorMacro("vtkSlicerAstroSmoothingLogic::ApplySpatialBinning : "
+                  "outputVolume not created.");
+    return NULL;
     }
 
-  omp_set_num_threads(numProcs);
-  #endif // VTK_SLICER_ASTRO_SUPPORT_OPENMP
+  const int outDims[3] = {dims[0] / factor, dims[1] / factor, dims[2]};
+  vtkNew<vtkImageData> imageData;
+  imageData->SetDimensions(outDims[0], outDims[1], outDims[2]);
+  imageData->SetSpacing(inputVolume->GetImageData()->GetSpacing());
+  imageData->SetOrigin(inputVolume->GetImageData()->GetOrigin());
+  imageData->AllocateScalars(DataType, 1);
+  outputVolume->SetAndObserveImageData(imageData.GetPointer());
+
+  vtkAstroThreadBudget threadBudget(pnode->GetCores());
 
   struct timeval start, end;
 
@@ -637,369 +2643,254 @@ int vtkSlicerAstroSmoothingLogic::IsotropicBoxCPUFilter(vtkMRMLAstroSmoothingPar
 
   pnode->SetStatus(1);
 
-  if (pnode->GetParameterX() > 0.001)
+  vtkAstroProgressToken progress((vtkIdType) outDims[0] * outDims[1] * outDims[2]);
+  bool cancel = false;
+  switch (DataType)
     {
-    #ifdef VTK_SLICER_ASTRO_SUPPORT_OPENMP
-    #pragma omp parallel for schedule(static) shared(pnode, outFPixel, outDPixel, tempFPixel, tempDPixel, cancel)
-    #endif // VTK_SLICER_ASTRO_SUPPORT_OPENMP
-    for (int elemCnt = 0; elemCnt < numElements; elemCnt++)
-      {
-      int status = pnode->GetStatus();
+    case VTK_FLOAT:
+      cancel = !SpatialBinning<float>
+        (static_cast<float*> (inputVolume->GetImageData()->GetScalarPointer(0,0,0)),
+         static_cast<float*> (imageData->GetScalarPointer(0,0,0)),
+         dims, factor, pnode, progress);
+      break;
+    case VTK_DOUBLE:
+      cancel = !SpatialBinning<double>
+        (static_cast<double*> (inputVolume->GetImageData()->GetScalarPointer(0,0,0)),
+         static_cast<double*> (imageData->GetScalarPointer(0,0,0)),
+         dims, factor, pnode, progress);
+      break;
+    }
 
-      #ifdef VTK_SLICER_ASTRO_SUPPORT_OPENMP
-      if (status == -1 && omp_get_thread_num() == 0)
-      #else
-      if (status == -1)
-      #endif // VTK_SLICER_ASTRO_SUPPORT_OPENMP
-        {
-        cancel = true;
-        }
+  gettimeofday(&end, NULL);
 
-      #ifdef VTK_SLICER_ASTRO_SUPPORT_OPENMP
-      #pragma omp flush (cancel)
-      #endif // VTK_SLICER_ASTRO_SUPPORT_OPENMP
-      if (!cancel)
-        {
-        switch (DataType)
-          {
-          case VTK_FLOAT:
-            *(outFPixel + elemCnt) = 0.;
-            break;
-          case VTK_DOUBLE:
-            *(outDPixel + elemCnt) = 0.;
-            break;
-          }
+  seconds  = end.tv_sec  - start.tv_sec;
+  useconds = end.tv_usec - start.tv_usec;
 
-        for (int i = -is; i <= is; i++)
-          {
-          int posData = elemCnt + i;
-          int ref = (int) floor(elemCnt / dims[0]);
-          ref *= dims[0];
-          if(posData < ref)
-            {
-            continue;
-            }
-          if(posData >= ref + dims[0])
-            {
-            break;
-            }
-          switch (DataType)
-            {
-            case VTK_FLOAT:
-              if (FloatIsNaN(*(tempFPixel + posData)))
-                {
-                continue;
-                }
-              *(outFPixel + elemCnt) += *(tempFPixel + posData);
-              break;
-            case VTK_DOUBLE:
-              if (DoubleIsNaN(*(tempDPixel + posData)))
-                {
-                continue;
-                }
-              *(outDPixel + elemCnt) += *(tempDPixel + posData);
-              break;
-            }
-          }
+  mtime = ((seconds) * 1000 + useconds/1000.0) + 0.5;
 
-        switch (DataType)
-          {
-          case VTK_FLOAT:
-            *(outFPixel + elemCnt) /= nItems;
-            break;
-          case VTK_DOUBLE:
-            *(outDPixel + elemCnt) /= nItems;
-            break;
-          }
+  vtkDebugMacro("Spatial Binning Time : "<<mtime<<" ms.");
 
-         #ifdef VTK_SLICER_ASTRO_SUPPORT_OPENMP
-         if (omp_get_thread_num() == 0)
-           {
-           if(elemCnt / (numElements / (numProcs * 33.)) > status)
-             {
-             status += 10;
-             pnode->SetStatus(status);
-             }
-           }
-         #else
-         if(elemCnt / (numElements / 33.) > status)
-           {
-           status += 10;
-           pnode->SetStatus(status);
-           }
-         #endif // VTK_SLICER_ASTRO_SUPPORT_OPENMP
-        }
-      }
+  if (cancel)
+    {
+    this->Internal->AstroVolumeLogic->RemoveAstroVolume(this->GetMRMLScene(), outputVolume);
+    pnode->SetStatus(100);
+    return NULL;
     }
 
-  if (cancel)
+  int wasModifying = outputVolume->StartModify();
+  for (int axis = 0; axis < 2; axis++)
     {
-    outFPixel = NULL;
-    tempFPixel = NULL;
-    outDPixel = NULL;
-    tempDPixel = NULL;
+    int wcsStatus = BinAxisWCS(outputVolume, axis, factor);
+    wcsprm* wcs = outputVolume->GetAstroVolumeDisplayNode() ?
+      outputVolume->GetAstroVolumeDisplayNode()->GetWCSStruct() : NULL;
+    if (wcsStatus && wcs)
+      {
+      vtkErrorMacro("vtkSlicerAstroSmoothingLogic::ApplySpatialBinning :"
+                    "wcsset ERROR "<<wcsStatus<<":\n"<<
+                    "Message from "<<wcs->err->function<<
+                    "at line "<<wcs->err->line_no<<
+                    " of file "<<wcs->err->file<<
+                    ": \n"<<wcs->err->msg<<"\n");
+      }
+    }
+  this->Internal->AstroVolumeLogic->CenterVolume(outputVolume);
+  outputVolume->UpdateRangeAttributes();
+  outputVolume->UpdateDisplayThresholdAttributes();
+  outputVolume->EndModify(wasModifying);
 
-    delete outFPixel;
-    delete tempFPixel;
-    delete outDPixel;
-    delete tempDPixel;
+  pnode->SetStatus(100);
 
-    this->Internal->tempVolumeData->Initialize();
+  return outputVolume;
+}
 
-    pnode->SetStatus(100);
+//----------------------------------------------------------------------------
+int vtkSlicerAstroSmoothingLogic::SeparableCPUFilter(vtkMRMLAstroSmoothingParametersNode* pnode)
+{
+  #ifndef VTK_SLICER_ASTRO_SUPPORT_OPENMP
+  vtkWarningMacro("vtkSlicerAstroSmoothingLogic::SeparableCPUFilter : "
+                  "this release of SlicerAstro has been built "
+                  "without OpenMP support. It may results that "
+                  "the AstroSmoothing algorithm may show poor performance.")
+  #endif // VTK_SLICER_ASTRO_SUPPORT_OPENMP
 
+  if (!pnode)
+    {
+    vtkErrorMacro("vtkSlicerAstroSmoothingLogic::SeparableCPUFilter : "
+                  "parameterNode not found.");
     return 0;
     }
 
-  if (pnode->GetParameterY() > 0.001)
+  if (!this->GetMRMLScene())
     {
-    #ifdef VTK_SLICER_ASTRO_SUPPORT_OPENMP
-    #pragma omp parallel for schedule(static) shared(pnode, outFPixel, outDPixel, tempFPixel, tempDPixel, cancel)
-    #endif // VTK_SLICER_ASTRO_SUPPORT_OPENMP
-    for (int elemCnt = 0; elemCnt < numElements; elemCnt++)
-      {
-      int status = pnode->GetStatus();
+    vtkErrorMacro("vtkSlicerAstroSmoothingLogic::SeparableCPUFilter :"
+                  " scene not found.");
+    return 0;
+    }
 
-      #ifdef VTK_SLICER_ASTRO_SUPPORT_OPENMP
-      if (status == -1 && omp_get_thread_num() == 0)
-      #else
-      if (status == -1)
-      #endif // VTK_SLICER_ASTRO_SUPPORT_OPENMP
-        {
-        cancel = true;
-        }
+  vtkMRMLAstroVolumeNode *inputVolume = this->GetFilterInputVolume(pnode);
+  if (!inputVolume || !inputVolume->GetImageData())
+    {
+    vtkErrorMacro("vtkSlicerAstroSmoothingLogic::SeparableCPUFilter : "
+                  "inputVolume not found.");
+    return 0;
+    }
 
-      #ifdef VTK_SLICER_ASTRO_SUPPORT_OPENMP
-      #pragma omp flush (cancel)
-      #endif // VTK_SLICER_ASTRO_SUPPORT_OPENMP
-      if (!cancel)
-        {
-        switch (DataType)
-          {
-          case VTK_FLOAT:
-            *(tempFPixel + elemCnt) = 0.;
-            break;
-          case VTK_DOUBLE:
-            *(tempDPixel + elemCnt) = 0.;
-            break;
-          }
+  vtkMRMLAstroVolumeNode *outputVolume = this->GetFilterOutputVolume(pnode);
+  if (!outputVolume || !outputVolume->GetImageData())
+    {
+    vtkErrorMacro("vtkSlicerAstroSmoothingLogic::SeparableCPUFilter : "
+                  "outputVolume not found.");
+    return 0;
+    }
 
-        for (int i = -is; i <= is; i++)
-          {
-          int posData = elemCnt + (i * dims[0]);
-          int ref = (int) floor(elemCnt / numSlice);
-          ref *= numSlice;
-          if(posData < ref)
-            {
-            continue;
-            }
-          if(posData >= ref + numSlice)
-            {
-            break;
-            }
-          switch (DataType)
-            {
-            case VTK_FLOAT:
-              if (FloatIsNaN(*(outFPixel + posData)))
-                {
-                continue;
-                }
-              *(tempFPixel + elemCnt) += *(outFPixel + posData);
-              break;
-            case VTK_DOUBLE:
-              if (DoubleIsNaN(*(outDPixel + posData)))
-                {
-                continue;
-                }
-              *(tempDPixel + elemCnt) += *(outDPixel + posData);
-              break;
-            }
-          }
+  vtkImageData *inputImage = inputVolume->GetImageData();
+  vtkImageData *outputImage = outputVolume->GetImageData();
+  const int *dims = inputImage->GetDimensions();
+  const vtkIdType numElements = (vtkIdType) dims[0] * dims[1] * dims[2];
+  const int numComponents = inputImage->GetNumberOfScalarComponents();
+  if (numComponents > 1)
+    {
+    vtkErrorMacro("vtkSlicerAstroSmoothingLogic::SeparableCPUFilter : "
+                  "imageData with more than one components.");
+    return 0;
+    }
 
-        switch (DataType)
-          {
-          case VTK_FLOAT:
-            *(tempFPixel + elemCnt) /= nItems;
-            break;
-          case VTK_DOUBLE:
-            *(tempDPixel + elemCnt) /= nItems;
-            break;
-          }
+  const int DataType = inputImage->GetPointData()->GetScalars()->GetDataType();
+  if (DataType != VTK_FLOAT && DataType != VTK_DOUBLE)
+    {
+    vtkErrorMacro("Attempt to allocate scalars of type not allowed");
+    return 0;
+    }
 
-        #ifdef VTK_SLICER_ASTRO_SUPPORT_OPENMP
-        if (omp_get_thread_num() == 0)
-          {
-          if(33. + (elemCnt / (numElements / (numProcs * 33.))) > status)
-            {
-            status += 10;
-            pnode->SetStatus(status);
-            }
-          }
-        #else
-        if(33. + (elemCnt / (numElements / 33.)) > status)
-          {
-          status += 10;
-          pnode->SetStatus(status);
-          }
-        #endif // VTK_SLICER_ASTRO_SUPPORT_OPENMP
-        }
+  // The box and the non-rotated Gaussian kernels are separable: a 1D kernel
+  // is applied along each axis using per-thread line buffers.
+  const double parameters[3] = {pnode->GetParameterX(),
+                                pnode->GetParameterY(),
+                                pnode->GetParameterZ()};
+  std::vector<double> kernels[3];
+  for (int axis = 0; axis < 3; axis++)
+    {
+    if (pnode->GetFilter() == 0)
+      {
+      kernels[axis] = BoxKernel1D(parameters[axis]);
+      }
+    else
+      {
+      kernels[axis] = GaussianKernel1D(parameters[axis], pnode->GetAccuracy());
       }
     }
-  else
-    {
-    this->Internal->tempVolumeData->DeepCopy(outputVolume->GetImageData());
-    this->Internal->tempVolumeData->Modified();
-    this->Internal->tempVolumeData->GetPointData()->GetScalars()->Modified();
 
-    switch (DataType)
+  // With AutoRun the results of the X and XY passes are cached: if the input
+  // data did not change, the filter restarts from the first pass whose
+  // kernel changed (e.g., only the Z pass when tuning the spectral kernel).
+  // The two passes are cached only if they fit in MaximumCacheSize together
+  // with the final result cached by RunFilter.
+  const bool useCache = pnode->GetAutoRun() && !this->Internal->RegionInputVolume &&
+                        3 * inputImage->GetActualMemorySize() <=
+                        (unsigned long) this->MaximumCacheSize * 1024;
+  if (!useCache)
+    {
+    this->Internal->CachedInputKey.clear();
+    for (int axis = 0; axis < 2; axis++)
       {
-      case VTK_FLOAT:
-        tempFPixel = static_cast<float*> (this->Internal->tempVolumeData->GetScalarPointer(0,0,0));
-        break;
-      case VTK_DOUBLE:
-        tempDPixel = static_cast<double*> (this->Internal->tempVolumeData->GetScalarPointer(0,0,0));
-        break;
-      default:
-        vtkErrorMacro("Attempt to allocate scalars of type not allowed");
-        return 0;
+      this->Internal->CachedKernels[axis].clear();
+      this->Internal->CachedPasses[axis] = NULL;
+      }
+    }
+  int firstAxis = 0;
+  std::string inputKey;
+  if (useCache)
+    {
+    inputKey = InputCacheKey(inputVolume);
+    if (inputKey == this->Internal->CachedInputKey)
+      {
+      while (firstAxis < 2 && kernels[firstAxis] == this->Internal->CachedKernels[firstAxis])
+        {
+        firstAxis++;
+        }
       }
+    this->Internal->CachedInputKey.clear();
     }
 
-  if (cancel)
+  int numPasses = 0;
+  for (int axis = firstAxis; axis < 3; axis++)
     {
-    outFPixel = NULL;
-    tempFPixel = NULL;
-    outDPixel = NULL;
-    tempDPixel = NULL;
+    if (!kernels[axis].empty())
+      {
+      numPasses++;
+      }
+    }
+  vtkAstroProgressToken progress(numElements * numPasses);
 
-    delete outFPixel;
-    delete tempFPixel;
-    delete outDPixel;
-    delete tempDPixel;
+  bool cancel = false;
 
-    this->Internal->tempVolumeData->Initialize();
+  vtkAstroThreadBudget threadBudget(pnode->GetCores());
 
-    pnode->SetStatus(100);
+  struct timeval start, end;
 
-    return 0;
-    }
+  long mtime, seconds, useconds;
+
+  gettimeofday(&start, NULL);
+
+  pnode->SetStatus(1);
 
-  if (pnode->GetParameterZ() > 0.001)
+  // Without cache the first pass writes in the output volume and the
+  // following ones work in place. With cache the X and XY passes are
+  // written in the cached volumes (an empty kernel shares the data of the
+  // previous pass) and the Z pass reads from them.
+  vtkImageData *sourceImage = inputImage;
+  if (firstAxis > 0)
     {
-    #ifdef VTK_SLICER_ASTRO_SUPPORT_OPENMP
-    #pragma omp parallel for schedule(static) shared(pnode, outFPixel, outDPixel, tempFPixel, tempDPixel, cancel)
-    #endif // VTK_SLICER_ASTRO_SUPPORT_OPENMP
-    for (int elemCnt = 0; elemCnt < numElements; elemCnt++)
+    sourceImage = this->Internal->CachedPasses[firstAxis - 1];
+    }
+  for (int axis = firstAxis; axis < 3 && !cancel; axis++)
+    {
+    vtkImageData *targetImage = outputImage;
+    if (useCache && axis < 2)
       {
-      int status = pnode->GetStatus();
-
-      #ifdef VTK_SLICER_ASTRO_SUPPORT_OPENMP
-      if (status == -1 && omp_get_thread_num() == 0)
-      #else
-      if (status == -1)
-      #endif // VTK_SLICER_ASTRO_SUPPORT_OPENMP
+      vtkSmartPointer<vtkImageData> &cachedPass = this->Internal->CachedPasses[axis];
+      if (kernels[axis].empty())
         {
-        cancel = true;
+        cachedPass = sourceImage;
+        continue;
         }
-
-      #ifdef VTK_SLICER_ASTRO_SUPPORT_OPENMP
-      #pragma omp flush (cancel)
-      #endif // VTK_SLICER_ASTRO_SUPPORT_OPENMP
-      if (!cancel)
+      if (!cachedPass || cachedPass.GetPointer() == sourceImage ||
+          cachedPass.GetPointer() == inputImage ||
+          cachedPass->GetScalarType() != DataType ||
+          cachedPass->GetDimensions()[0] != dims[0] ||
+          cachedPass->GetDimensions()[1] != dims[1] ||
+          cachedPass->GetDimensions()[2] != dims[2])
         {
-        switch (DataType)
-          {
-          case VTK_FLOAT:
-            *(outFPixel + elemCnt) = 0.;
-            break;
-          case VTK_DOUBLE:
-            *(outDPixel + elemCnt) = 0.;
-            break;
-          }
-
-        for (int i = -is; i <= is; i++)
-          {
-          int posData = elemCnt + (i * numSlice);
-          if(posData < 0)
-            {
-            continue;
-            }
-          if(posData >= numElements)
-            {
-            break;
-            }
-          switch (DataType)
-            {
-            case VTK_FLOAT:
-              if (FloatIsNaN(*(tempFPixel + posData)))
-                {
-                continue;
-                }
-              *(outFPixel + elemCnt) += *(tempFPixel + posData);
-              break;
-            case VTK_DOUBLE:
-              if (DoubleIsNaN(*(tempDPixel + posData)))
-                {
-                continue;
-                }
-              *(outDPixel + elemCnt) += *(tempDPixel + posData);
-              break;
-            }
-          }
-
-        switch (DataType)
-          {
-          case VTK_FLOAT:
-            *(outFPixel + elemCnt) /= nItems;
-            break;
-          case VTK_DOUBLE:
-            *(outDPixel + elemCnt) /= nItems;
-            break;
-          }
-
-        #ifdef VTK_SLICER_ASTRO_SUPPORT_OPENMP
-        if (omp_get_thread_num() == 0)
-          {
-          if(66. + (elemCnt / (numElements / (numProcs * 33.))) > status)
-            {
-            status += 10;
-            pnode->SetStatus(status);
-            }
-          }
-        #else
-        if(66. + (elemCnt / (numElements / 33.)) > status)
-          {
-          status += 10;
-          pnode->SetStatus(status);
-          }
-        #endif // VTK_SLICER_ASTRO_SUPPORT_OPENMP
+        cachedPass = vtkSmartPointer<vtkImageData>::New();
+        cachedPass->SetDimensions(dims[0], dims[1], dims[2]);
+        cachedPass->AllocateScalars(DataType, 1);
         }
+      targetImage = cachedPass;
+      }
+    else if (kernels[axis].empty())
+      {
+      continue;
       }
-    }
-  else
-    {
-    outputVolume->GetImageData()->DeepCopy(this->Internal->tempVolumeData);
-    }
-
-  gettimeofday(&end, NULL);
-
-  seconds  = end.tv_sec  - start.tv_sec;
-  useconds = end.tv_usec - start.tv_usec;
 
-  mtime = ((seconds) * 1000 + useconds/1000.0) + 0.5;
-  vtkDebugMacro("Box Filter (CPU) Time : "<<mtime<<" ms.");
+    cancel = !ImageSeparableConvolution(sourceImage, targetImage, axis,
+                                        kernels[axis], pnode, progress);
+    sourceImage = targetImage;
+    }
 
-  outFPixel = NULL;
-  tempFPixel = NULL;
-  outDPixel = NULL;
-  tempDPixel = NULL;
+  if (!cancel && sourceImage != outputImage)
+    {
+    CopyScalars(sourceImage, outputImage);
+    }
 
-  delete outFPixel;
-  delete tempFPixel;
-  delete outDPixel;
-  delete tempDPixel;
+  gettimeofday(&end, NULL);
 
-  this->Internal->tempVolumeData->Initialize();
+  seconds  = end.tv_sec  - start.tv_sec;
+  useconds = end.tv_usec - start.tv_usec;
+
+  mtime = ((seconds) * 1000 + useconds/1000.0) + 0.5;
+  vtkDebugMacro("Separable " << (pnode->GetFilter() == 0 ? "Box" : "Gaussian")
+                << " Filter (CPU) Time : " << mtime << " ms (from pass "
+                << firstAxis << ").");
 
   if (cancel)
     {
@@ -1007,6 +2898,15 @@ int vtkSlicerAstroSmoothingLogic::IsotropicBoxCPUFilter(vtkMRMLAstroSmoothingPar
     return 0;
     }
 
+  if (useCache)
+    {
+    for (int axis = 0; axis < 2; axis++)
+      {
+      this->Internal->CachedKernels[axis] = kernels[axis];
+      }
+    this->Internal->CachedInputKey = inputKey;
+    }
+
   gettimeofday(&start, NULL);
 
   int wasModifying = outputVolume->StartModify();
@@ -1062,9 +2962,7 @@ int vtkSlicerAstroSmoothingLogic::BoxGPUFilter(vtkMRMLAstroSmoothingParametersNo
   long mtime, seconds, useconds;
   gettimeofday(&start, NULL);
 
-  vtkMRMLAstroVolumeNode *inputVolume =
-    vtkMRMLAstroVolumeNode::SafeDownCast
-      (this->GetMRMLScene()->GetNodeByID(pnode->GetInputVolumeNodeID()));
+  vtkMRMLAstroVolumeNode *inputVolume = this->GetFilterInputVolume(pnode);
   if (!inputVolume || !inputVolume->GetImageData())
     {
     vtkErrorMacro("vtkSlicerAstroSmoothingLogic::BoxGPUFilter : "
@@ -1073,9 +2971,7 @@ int vtkSlicerAstroSmoothingLogic::BoxGPUFilter(vtkMRMLAstroSmoothingParametersNo
     return 0;
     }
 
-  vtkMRMLAstroVolumeNode *outputVolume =
-    vtkMRMLAstroVolumeNode::SafeDownCast
-      (this->GetMRMLScene()->GetNodeByID(pnode->GetOutputVolumeNodeID()));
+  vtkMRMLAstroVolumeNode *outputVolume = this->GetFilterOutputVolume(pnode);
   if (!outputVolume || !outputVolume->GetImageData())
     {
     vtkErrorMacro("vtkSlicerAstroSmoothingLogic::BoxGPUFilter : "
@@ -1103,298 +2999,27 @@ int vtkSlicerAstroSmoothingLogic::BoxGPUFilter(vtkMRMLAstroSmoothingParametersNo
 
   pnode->SetStatus(20);
 
-  if (pnode->GetStatus() == -1)
-    {
-    cancel = true;
-    }
-
-  if(!cancel)
-    {
-    filter->Update();
-    }
-
-  pnode->SetStatus(70);
-
-  outputVolume->GetImageData()->DeepCopy(filter->GetOutput());
-
-  gettimeofday(&end, NULL);
-
-  seconds  = end.tv_sec  - start.tv_sec;
-  useconds = end.tv_usec - start.tv_usec;
-
-  mtime = ((seconds) * 1000 + useconds/1000.0) + 0.5;
-  vtkDebugMacro(" Box Filter (GPU, OpenGL) Time : "<<mtime<<" ms.");
-
-  gettimeofday(&start, NULL);
-
-  int wasModifying = outputVolume->StartModify();
-  outputVolume->UpdateRangeAttributes();
-  outputVolume->UpdateDisplayThresholdAttributes();
-  outputVolume->EndModify(wasModifying);
-
-  pnode->SetStatus(100);
-
-  gettimeofday(&end, NULL);
-
-  seconds  = end.tv_sec  - start.tv_sec;
-  useconds = end.tv_usec - start.tv_usec;
-
-  mtime = ((seconds) * 1000 + useconds/1000.0) + 0.5;
-
-  vtkDebugMacro("Update Time : "<<mtime<<" ms.");
-
-
-  if(cancel)
-    {
-    return 0;
-    }
-
-  return 1;
-  #endif // VTK_SLICER_ASTRO_SUPPORT_OPENGL
-}
-
-//----------------------------------------------------------------------------
-int vtkSlicerAstroSmoothingLogic::AnisotropicGaussianCPUFilter(vtkMRMLAstroSmoothingParametersNode* pnode)
-{
-  #ifndef VTK_SLICER_ASTRO_SUPPORT_OPENMP
-  vtkWarningMacro("vtkSlicerAstroSmoothingLogic::AnisotropicGaussianCPUFilter : "
-                  "this release of SlicerAstro has been built "
-                  "without OpenMP support. It may results that "
-                  "the AstroSmoothing algorithm may show poor performance.")
-  #endif // VTK_SLICER_ASTRO_SUPPORT_OPENMP
-
-   if (!pnode)
-     {
-     vtkErrorMacro("vtkSlicerAstroSmoothingLogic::AnisotropicGaussianCPUFilter : "
-                   "parameterNode not found.");
-     return 0;
-     }
-
-  if (!this->GetMRMLScene())
-    {
-    vtkErrorMacro("vtkSlicerAstroSmoothingLogic::AnisotropicGaussianCPUFilter :"
-                  " scene not found.");
-    return 0;
-    }
-
-   vtkMRMLAstroVolumeNode *inputVolume =
-     vtkMRMLAstroVolumeNode::SafeDownCast
-       (this->GetMRMLScene()->GetNodeByID(pnode->GetInputVolumeNodeID()));
-   if (!inputVolume || !inputVolume->GetImageData())
-     {
-     vtkErrorMacro("vtkSlicerAstroSmoothingLogic::AnisotropicGaussianCPUFilter : "
-                   "inputVolume not found.");
-     return 0;
-     }
-
-   vtkMRMLAstroVolumeNode *outputVolume =
-     vtkMRMLAstroVolumeNode::SafeDownCast
-       (this->GetMRMLScene()->GetNodeByID(pnode->GetOutputVolumeNodeID()));
-   if (!outputVolume || !outputVolume->GetImageData())
-     {
-     vtkErrorMacro("vtkSlicerAstroSmoothingLogic::AnisotropicGaussianCPUFilter : "
-                   "outputVolume not found.");
-     return 0;
-     }
-
-  const int *dims = inputVolume->GetImageData()->GetDimensions();
-  const int numComponents = inputVolume->GetImageData()->GetNumberOfScalarComponents();
-  if (numComponents > 1)
-    {
-    vtkErrorMacro("vtkSlicerAstroSmoothingLogic::AnisotropicGaussianCPUFilter : "
-                  "imageData with more than one components.");
-    return 0.;
-    }
-  const int numElements = dims[0] * dims[1] * dims[2];
-  const int numSlice = dims[0] * dims[1];
-  const int Xmax = (int) (pnode->GetKernelLengthX() - 1) / 2.;
-  const int Ymax = (int) (pnode->GetKernelLengthY() - 1) / 2.;
-  const int Zmax = (int) (pnode->GetKernelLengthZ() - 1) / 2.;
-  const int numKernelSlice = pnode->GetKernelLengthX() * pnode->GetKernelLengthY();
-  float *inFPixel = NULL;
-  float *outFPixel = NULL;
-  double *inDPixel = NULL;
-  double *outDPixel = NULL;
-  const int DataType = inputVolume->GetImageData()->GetPointData()->GetScalars()->GetDataType();
-  switch (DataType)
-    {
-    case VTK_FLOAT:
-      inFPixel = static_cast<float*> (inputVolume->GetImageData()->GetScalarPointer(0,0,0));
-      outFPixel = static_cast<float*> (outputVolume->GetImageData()->GetScalarPointer(0,0,0));
-      break;
-    case VTK_DOUBLE:
-      inDPixel = static_cast<double*> (inputVolume->GetImageData()->GetScalarPointer(0,0,0));
-      outDPixel = static_cast<double*> (outputVolume->GetImageData()->GetScalarPointer(0,0,0));
-      break;
-    default:
-      vtkErrorMacro("Attempt to allocate scalars of type not allowed");
-      return 0;
-    }
-
-  double *GaussKernel = static_cast<double*> (pnode->GetGaussianKernel3D()->GetVoidPointer(0));
-
-  bool cancel = false;
-  int status = 0;
-
-  #ifdef VTK_SLICER_ASTRO_SUPPORT_OPENMP
-  int numProcs = 0;
-  if (pnode->GetCores() == 0)
-    {
-    numProcs = omp_get_num_procs();
-    }
-  else
-    {
-    numProcs = pnode->GetCores();
-    }
-
-  omp_set_num_threads(numProcs);
-  #endif // VTK_SLICER_ASTRO_SUPPORT_OPENMP
-
-  struct timeval start, end;
-
-  long mtime, seconds, useconds;
-
-  gettimeofday(&start, NULL);
-
-  pnode->SetStatus(1);
-
-  #ifdef VTK_SLICER_ASTRO_SUPPORT_OPENMP
-  #pragma omp parallel for schedule(static) shared(pnode, inFPixel, inDPixel, outFPixel, outDPixel, cancel, status)
-  #endif // VTK_SLICER_ASTRO_SUPPORT_OPENMP
-  for (int elemCnt = 0; elemCnt < numElements; elemCnt++)
-    {
-    int stat = pnode->GetStatus();
-
-    #ifdef VTK_SLICER_ASTRO_SUPPORT_OPENMP
-    if (stat == -1 && omp_get_thread_num() == 0)
-    #else
-    if (stat == -1)
-    #endif // VTK_SLICER_ASTRO_SUPPORT_OPENMP
-      {
-      cancel = true;
-      }
-
-    #ifdef VTK_SLICER_ASTRO_SUPPORT_OPENMP
-    #pragma omp flush (cancel)
-    #endif // VTK_SLICER_ASTRO_SUPPORT_OPENMP
-    if (!cancel)
-      {
-      switch (DataType)
-        {
-        case VTK_FLOAT:
-          *(outFPixel + elemCnt) = 0.;
-          break;
-        case VTK_DOUBLE:
-          *(outDPixel + elemCnt) = 0.;
-          break;
-        }
-
-      for (int k = -Zmax; k <= Zmax; k++)
-        {
-        for (int j = -Ymax; j <= Ymax; j++)
-          {
-          for (int i = -Xmax; i <= Xmax; i++)
-            {
-            int posData = elemCnt + i;
-            int ref = (int) floor(elemCnt / dims[0]);
-            ref *= dims[0];
-            if(posData < ref)
-              {
-              continue;
-              }
-            if(posData >= ref + dims[0])
-              {
-              break;
-              }
-
-            posData += j * dims[0];
-            ref = (int) floor(elemCnt / numSlice);
-            ref *= numSlice;
-            if(posData < ref)
-              {
-              continue;
-              }
-            if(posData >= ref + numSlice)
-              {
-              break;
-              }
-
-            posData += k * numSlice;
-            if(posData < 0)
-              {
-              continue;
-              }
-            if(posData >= numElements)
-              {
-              break;
-              }
-
-            int posKernel = (k + Zmax) * numKernelSlice
-                          + (j + Ymax) * pnode->GetKernelLengthX() + (i + Xmax);
-
-            switch (DataType)
-              {
-              case VTK_FLOAT:
-                if (FloatIsNaN(*(inFPixel + posData)))
-                  {
-                  continue;
-                  }
-                *(outFPixel + elemCnt) += *(inFPixel + posData) * *(GaussKernel + posKernel);
-                break;
-              case VTK_DOUBLE:
-                if (DoubleIsNaN(*(inDPixel + posData)))
-                  {
-                  continue;
-                  }
-                *(outDPixel + elemCnt) += *(inDPixel + posData) * *(GaussKernel + posKernel);
-                break;
-              }
-            }
-          }
-        }
-
-      #ifdef VTK_SLICER_ASTRO_SUPPORT_OPENMP
-      if (omp_get_thread_num() == 0)
-        {
-        if(elemCnt / (numElements / (numProcs * 100)) > status)
-          {
-          status += 10;
-          pnode->SetStatus(status);
-          }
-        }
-      #else
-      if(elemCnt / (numElements / 100) > status)
-        {
-        status += 10;
-        pnode->SetStatus(status);
-        }
-      #endif // VTK_SLICER_ASTRO_SUPPORT_OPENMP
-      }
+  if (pnode->GetStatus() == -1)
+    {
+    cancel = true;
+    }
+
+  if(!cancel)
+    {
+    filter->Update();
     }
 
+  pnode->SetStatus(70);
+
+  outputVolume->GetImageData()->DeepCopy(filter->GetOutput());
+
   gettimeofday(&end, NULL);
 
   seconds  = end.tv_sec  - start.tv_sec;
   useconds = end.tv_usec - start.tv_usec;
 
   mtime = ((seconds) * 1000 + useconds/1000.0) + 0.5;
-  vtkDebugMacro("Gaussian Filter (CPU) Time : "<<mtime<<" ms.");
-
-  inFPixel = NULL;
-  outFPixel = NULL;
-  inDPixel = NULL;
-  outDPixel = NULL;
-
-  delete inFPixel;
-  delete outFPixel;
-  delete inDPixel;
-  delete outDPixel;
-
-  if (cancel)
-    {
-    pnode->SetStatus(100);
-    return 0;
-    }
+  vtkDebugMacro(" Box Filter (GPU, OpenGL) Time : "<<mtime<<" ms.");
 
   gettimeofday(&start, NULL);
 
@@ -1402,6 +3027,7 @@ int vtkSlicerAstroSmoothingLogic::AnisotropicGaussianCPUFilter(vtkMRMLAstroSmoot
   outputVolume->UpdateRangeAttributes();
   outputVolume->UpdateDisplayThresholdAttributes();
   outputVolume->EndModify(wasModifying);
+
   pnode->SetStatus(100);
 
   gettimeofday(&end, NULL);
@@ -1413,110 +3039,95 @@ int vtkSlicerAstroSmoothingLogic::AnisotropicGaussianCPUFilter(vtkMRMLAstroSmoot
 
   vtkDebugMacro("Update Time : "<<mtime<<" ms.");
 
+
+  if(cancel)
+    {
+    return 0;
+    }
+
   return 1;
+  #endif // VTK_SLICER_ASTRO_SUPPORT_OPENGL
 }
 
 //----------------------------------------------------------------------------
-int vtkSlicerAstroSmoothingLogic::IsotropicGaussianCPUFilter(vtkMRMLAstroSmoothingParametersNode* pnode)
+int vtkSlicerAstroSmoothingLogic::AnisotropicGaussianCPUFilter(vtkMRMLAstroSmoothingParametersNode* pnode)
 {
   #ifndef VTK_SLICER_ASTRO_SUPPORT_OPENMP
-  vtkWarningMacro("vtkSlicerAstroSmoothingLogic::IsotropicGaussianCPUFilter : "
+  vtkWarningMacro("vtkSlicerAstroSmoothingLogic::AnisotropicGaussianCPUFilter : "
                   "this release of SlicerAstro has been built "
                   "without OpenMP support. It may results that "
                   "the AstroSmoothing algorithm may show poor performance.")
   #endif // VTK_SLICER_ASTRO_SUPPORT_OPENMP
 
-  if (!pnode)
-    {
-    vtkErrorMacro("vtkSlicerAstroSmoothingLogic::IsotropicGaussianCPUFilter : "
-                  "parameterNode not found.");
-    return 0;
-    }
+   if (!pnode)
+     {
+     vtkErrorMacro("vtkSlicerAstroSmoothingLogic::AnisotropicGaussianCPUFilter : "
+                   "parameterNode not found.");
+     return 0;
+     }
 
   if (!this->GetMRMLScene())
     {
-    vtkErrorMacro("vtkSlicerAstroSmoothingLogic::IsotropicGaussianCPUFilter :"
+    vtkErrorMacro("vtkSlicerAstroSmoothingLogic::AnisotropicGaussianCPUFilter :"
                   " scene not found.");
     return 0;
     }
 
-  vtkMRMLAstroVolumeNode *inputVolume =
-    vtkMRMLAstroVolumeNode::SafeDownCast
-      (this->GetMRMLScene()->GetNodeByID(pnode->GetInputVolumeNodeID()));
-  if (!inputVolume || !inputVolume->GetImageData())
-    {
-    vtkErrorMacro("vtkSlicerAstroSmoothingLogic::IsotropicGaussianCPUFilter : "
-                  "inputVolume not found.");
-    return 0;
-    }
-
-  vtkMRMLAstroVolumeNode *outputVolume =
-    vtkMRMLAstroVolumeNode::SafeDownCast
-      (this->GetMRMLScene()->GetNodeByID(pnode->GetOutputVolumeNodeID()));
-  if (!outputVolume || !outputVolume->GetImageData())
-    {
-    vtkErrorMacro("vtkSlicerAstroSmoothingLogic::IsotropicGaussianCPUFilter : "
-                  "outputVolume not found.");
-    return 0;
-    }
+   vtkMRMLAstroVolumeNode *inputVolume = this->GetFilterInputVolume(pnode);
+   if (!inputVolume || !inputVolume->GetImageData())
+     {
+     vtkErrorMacro("vtkSlicerAstroSmoothingLogic::AnisotropicGaussianCPUFilter : "
+                   "inputVolume not found.");
+     return 0;
+     }
 
-  this->Internal->tempVolumeData->Initialize();
-  this->Internal->tempVolumeData->DeepCopy(inputVolume->GetImageData());
-  this->Internal->tempVolumeData->Modified();
-  this->Internal->tempVolumeData->GetPointData()->GetScalars()->Modified();
+   vtkMRMLAstroVolumeNode *outputVolume = this->GetFilterOutputVolume(pnode);
+   if (!outputVolume || !outputVolume->GetImageData())
+     {
+     vtkErrorMacro("vtkSlicerAstroSmoothingLogic::AnisotropicGaussianCPUFilter : "
+                   "outputVolume not found.");
+     return 0;
+     }
 
   const int *dims = inputVolume->GetImageData()->GetDimensions();
   const int numComponents = inputVolume->GetImageData()->GetNumberOfScalarComponents();
   if (numComponents > 1)
     {
-    vtkErrorMacro("vtkSlicerAstroSmoothingLogic::IsotropicGaussianCPUFilter : "
+    vtkErrorMacro("vtkSlicerAstroSmoothingLogic::AnisotropicGaussianCPUFilter : "
                   "imageData with more than one components.");
     return 0.;
     }
-  const int numElements = dims[0] * dims[1] * dims[2];
-  const int numSlice = dims[0] * dims[1];
-  int is = (int) (pnode->GetKernelLengthX());
-  if (is % 2 < 0.001)
-    {
-    is++;
-    }
-  const int is2 = (int) - ((is - 1)/ 2);
+  const vtkIdType numSlice = (vtkIdType) dims[0] * dims[1];
+  const vtkIdType numElements = numSlice * dims[2];
+  const int Xmax = (int) (pnode->GetKernelLengthX() - 1) / 2.;
+  const int Ymax = (int) (pnode->GetKernelLengthY() - 1) / 2.;
+  const int Zmax = (int) (pnode->GetKernelLengthZ() - 1) / 2.;
+  const int numKernelSlice = pnode->GetKernelLengthX() * pnode->GetKernelLengthY();
+  float *inFPixel = NULL;
   float *outFPixel = NULL;
-  float *tempFPixel = NULL;
+  double *inDPixel = NULL;
   double *outDPixel = NULL;
-  double *tempDPixel = NULL;
   const int DataType = inputVolume->GetImageData()->GetPointData()->GetScalars()->GetDataType();
   switch (DataType)
     {
     case VTK_FLOAT:
+      inFPixel = static_cast<float*> (inputVolume->GetImageData()->GetScalarPointer(0,0,0));
       outFPixel = static_cast<float*> (outputVolume->GetImageData()->GetScalarPointer(0,0,0));
-      tempFPixel = static_cast<float*> (this->Internal->tempVolumeData->GetScalarPointer(0,0,0));
       break;
     case VTK_DOUBLE:
+      inDPixel = static_cast<double*> (inputVolume->GetImageData()->GetScalarPointer(0,0,0));
       outDPixel = static_cast<double*> (outputVolume->GetImageData()->GetScalarPointer(0,0,0));
-      tempDPixel = static_cast<double*> (this->Internal->tempVolumeData->GetScalarPointer(0,0,0));
       break;
     default:
       vtkErrorMacro("Attempt to allocate scalars of type not allowed");
       return 0;
     }
 
-  double *GaussKernel1D = static_cast<double*> (pnode->GetGaussianKernel1D()->GetVoidPointer(0));
-  bool cancel = false;
+  double *GaussKernel = static_cast<double*> (pnode->GetGaussianKernel3D()->GetVoidPointer(0));
 
-  #ifdef VTK_SLICER_ASTRO_SUPPORT_OPENMP
-  int numProcs = 0;
-  if (pnode->GetCores() == 0)
-    {
-    numProcs = omp_get_num_procs();
-    }
-  else
-    {
-    numProcs = pnode->GetCores();
-    }
+  bool cancel = false;
 
-  omp_set_num_threads(numProcs);
-  #endif // VTK_SLICER_ASTRO_SUPPORT_OPENMP
+  vtkAstroThreadBudget threadBudget(pnode->GetCores());
 
   struct timeval start, end;
 
@@ -1526,327 +3137,107 @@ int vtkSlicerAstroSmoothingLogic::IsotropicGaussianCPUFilter(vtkMRMLAstroSmoothi
 
   pnode->SetStatus(1);
 
-  if (pnode->GetParameterX() > 0.001)
-    {
-    pnode->SetStatus(10);
-
-    #ifdef VTK_SLICER_ASTRO_SUPPORT_OPENMP
-    #pragma omp parallel for schedule(static) shared(pnode, outFPixel, outDPixel, tempFPixel, tempDPixel, cancel)
-    #endif // VTK_SLICER_ASTRO_SUPPORT_OPENMP
-    for (int elemCnt = 0; elemCnt < numElements; elemCnt++)
-      {
-      int status = pnode->GetStatus();
-
-      #ifdef VTK_SLICER_ASTRO_SUPPORT_OPENMP
-      if (status == -1 && omp_get_thread_num() == 0)
-      #else
-      if (status == -1)
-      #endif // VTK_SLICER_ASTRO_SUPPORT_OPENMP
-        {
-        cancel = true;
-        }
-
-      #ifdef VTK_SLICER_ASTRO_SUPPORT_OPENMP
-      #pragma omp flush (cancel)
-      #endif // VTK_SLICER_ASTRO_SUPPORT_OPENMP
-
-      if (!cancel)
-        {
-        switch (DataType)
-          {
-          case VTK_FLOAT:
-            *(outFPixel + elemCnt) = 0.;
-            break;
-          case VTK_DOUBLE:
-            *(outDPixel + elemCnt) = 0.;
-            break;
-          }
-
-        for (int i = 0; i <= is; i++)
-          {
-          int posData = elemCnt + i + is2;
-          int ref = (int) floor(elemCnt / dims[0]);
-          ref *= dims[0];
-          if(posData < ref)
-            {
-            continue;
-            }
-          if(posData >= ref + dims[0])
-            {
-            break;
-            }
-          switch (DataType)
-            {
-            case VTK_FLOAT:
-              if (FloatIsNaN(*(tempFPixel + posData)))
-                {
-                continue;
-                }
-              *(outFPixel + elemCnt) += *(tempFPixel + posData) * *(GaussKernel1D + i);
-              break;
-            case VTK_DOUBLE:
-              if (DoubleIsNaN(*(tempDPixel + posData)))
-                {
-                continue;
-                }
-              *(outDPixel + elemCnt) += *(tempDPixel + posData) * *(GaussKernel1D + i);
-              break;
-            }
-          }
-
-        #ifdef VTK_SLICER_ASTRO_SUPPORT_OPENMP
-        if (omp_get_thread_num() == 0)
-          {
-          if(elemCnt / (numElements / (numProcs * 33.)) > status)
-            {
-            status += 10;
-            pnode->SetStatus(status);
-            }
-          }
-        #else
-        if(elemCnt / (numElements / 33.) > status)
-          {
-          status += 10;
-          pnode->SetStatus(status);
-          }
-        #endif // VTK_SLICER_ASTRO_SUPPORT_OPENMP
-        }
-      }
-    }
-
-  if (cancel)
-    {  
-    outFPixel = NULL;
-    tempFPixel = NULL;
-    outDPixel = NULL;
-    tempDPixel = NULL;
-
-    delete outFPixel;
-    delete tempFPixel;
-    delete outDPixel;
-    delete tempDPixel;
-
-    this->Internal->tempVolumeData->Initialize();
-
-    pnode->SetStatus(100);
-
-    return 0;
-    }
+  vtkAstroProgressToken progress(numElements);
+  const vtkIdType blockSize = vtkAstroProgressToken::GetBlockSize();
+  const vtkIdType numBlocks = vtkAstroProgressToken::GetNumberOfBlocks(numElements);
 
-  if (pnode->GetParameterY() > 0.001)
+  #ifdef VTK_SLICER_ASTRO_SUPPORT_OPENMP
+  #pragma omp parallel for schedule(static) shared(pnode, inFPixel, inDPixel, outFPixel, outDPixel, GaussKernel, progress)
+  #endif // VTK_SLICER_ASTRO_SUPPORT_OPENMP
+  for (vtkIdType blockCnt = 0; blockCnt < numBlocks; blockCnt++)
     {
-    pnode->SetStatus(40);
-
     #ifdef VTK_SLICER_ASTRO_SUPPORT_OPENMP
-    #pragma omp parallel for schedule(static) shared(pnode, outFPixel, outDPixel, tempFPixel, tempDPixel, cancel)
+    if (omp_get_thread_num() == 0)
     #endif // VTK_SLICER_ASTRO_SUPPORT_OPENMP
-    for (int elemCnt = 0; elemCnt < numElements; elemCnt++)
       {
-      int status = pnode->GetStatus();
-
-      #ifdef VTK_SLICER_ASTRO_SUPPORT_OPENMP
-      if (status == -1 && omp_get_thread_num() == 0)
-      #else
-      if (status == -1)
-      #endif // VTK_SLICER_ASTRO_SUPPORT_OPENMP
-        {
-        cancel = true;
-        }
-
-      #ifdef VTK_SLICER_ASTRO_SUPPORT_OPENMP
-      #pragma omp flush (cancel)
-      #endif // VTK_SLICER_ASTRO_SUPPORT_OPENMP
-
-      if (!cancel)
-        {
-        switch (DataType)
-          {
-          case VTK_FLOAT:
-            *(tempFPixel + elemCnt) = 0.;
-            break;
-          case VTK_DOUBLE:
-            *(tempDPixel + elemCnt) = 0.;
-            break;
-          }
-
-        for (int i = 0; i <= is; i++)
-          {
-          int posData = elemCnt + ((i + is2) * dims[0]);
-          int ref = (int) floor(elemCnt / numSlice);
-          ref *= numSlice;
-          if(posData < ref)
-            {
-            continue;
-            }
-          if(posData >= ref + numSlice)
-            {
-            break;
-            }
-          switch (DataType)
-            {
-            case VTK_FLOAT:
-              if (FloatIsNaN(*(outFPixel + posData)))
-                {
-                continue;
-                }
-              *(tempFPixel + elemCnt) += *(outFPixel + posData) * *(GaussKernel1D + i);
-              break;
-            case VTK_DOUBLE:
-              if (DoubleIsNaN(*(outDPixel + posData)))
-                {
-                continue;
-                }
-              *(tempDPixel + elemCnt) += *(outDPixel + posData) * *(GaussKernel1D + i);
-              break;
-            }
-          }
-
-        #ifdef VTK_SLICER_ASTRO_SUPPORT_OPENMP
-        if (omp_get_thread_num() == 0)
-          {
-          if(33. + (elemCnt / (numElements / (numProcs * 33.))) > status)
-            {
-            status += 10;
-            pnode->SetStatus(status);
-            }
-          }
-        #else
-        if(33. + (elemCnt / (numElements / 33.)) > status)
-          {
-          status += 10;
-          pnode->SetStatus(status);
-          }
-        #endif // VTK_SLICER_ASTRO_SUPPORT_OPENMP
-        }
+      progress.Synchronize(pnode);
       }
-    }
-  else
-    {
-    this->Internal->tempVolumeData->DeepCopy(outputVolume->GetImageData());
-    this->Internal->tempVolumeData->Modified();
-    this->Internal->tempVolumeData->GetPointData()->GetScalars()->Modified();
-
-    switch (DataType)
+    if (progress.IsCancelled())
       {
-      case VTK_FLOAT:
-        tempFPixel = static_cast<float*> (this->Internal->tempVolumeData->GetScalarPointer(0,0,0));
-        break;
-      case VTK_DOUBLE:
-        tempDPixel = static_cast<double*> (this->Internal->tempVolumeData->GetScalarPointer(0,0,0));
-        break;
-      default:
-        vtkErrorMacro("Attempt to allocate scalars of type not allowed");
-        return 0;
+      continue;
       }
-    }
-
-  if (cancel)
-    {  
-    outFPixel = NULL;
-    tempFPixel = NULL;
-    outDPixel = NULL;
-    tempDPixel = NULL;
-
-    delete outFPixel;
-    delete tempFPixel;
-    delete outDPixel;
-    delete tempDPixel;
-
-    this->Internal->tempVolumeData->Initialize();
-
-    pnode->SetStatus(100);
-
-    return 0;
-    }
-
-  if (pnode->GetParameterZ() > 0.001)
-    {
-    pnode->SetStatus(70);
 
-    #ifdef VTK_SLICER_ASTRO_SUPPORT_OPENMP
-    #pragma omp parallel for schedule(static) shared(pnode, outFPixel, outDPixel, tempFPixel, tempDPixel, cancel)
-    #endif // VTK_SLICER_ASTRO_SUPPORT_OPENMP
-    for (int elemCnt = 0; elemCnt < numElements; elemCnt++)
+    const vtkIdType firstElem = blockCnt * blockSize;
+    const vtkIdType lastElem = std::min<vtkIdType>(firstElem + blockSize, numElements);
+    for (vtkIdType elemCnt = firstElem; elemCnt < lastElem; elemCnt++)
       {
-      int status = pnode->GetStatus();
-
-      #ifdef VTK_SLICER_ASTRO_SUPPORT_OPENMP
-      if (status == -1 && omp_get_thread_num() == 0)
-      #else
-      if (status == -1)
-      #endif // VTK_SLICER_ASTRO_SUPPORT_OPENMP
+      switch (DataType)
         {
-        cancel = true;
+        case VTK_FLOAT:
+          *(outFPixel + elemCnt) = 0.;
+          break;
+        case VTK_DOUBLE:
+          *(outDPixel + elemCnt) = 0.;
+          break;
         }
 
-      #ifdef VTK_SLICER_ASTRO_SUPPORT_OPENMP
-      #pragma omp flush (cancel)
-      #endif // VTK_SLICER_ASTRO_SUPPORT_OPENMP
-      if (!cancel)
+      for (int k = -Zmax; k <= Zmax; k++)
         {
-        switch (DataType)
-          {
-          case VTK_FLOAT:
-            *(outFPixel + elemCnt) = 0.;
-            break;
-          case VTK_DOUBLE:
-            *(outDPixel + elemCnt) = 0.;
-            break;
-          }
-
-        for (int i = 0; i <= is; i++)
+        for (int j = -Ymax; j <= Ymax; j++)
           {
-          int posData = elemCnt + ((i + is2) * numSlice);
-          if(posData < 0)
-            {
-            continue;
-            }
-          if(posData >= numElements)
-            {
-            break;
-            }
-          switch (DataType)
+          for (int i = -Xmax; i <= Xmax; i++)
             {
-            case VTK_FLOAT:
-              if (FloatIsNaN(*(tempFPixel + posData)))
-                {
-                continue;
-                }
-              *(outFPixel + elemCnt) += *(tempFPixel + posData) * *(GaussKernel1D + i);
+            vtkIdType posData = elemCnt + i;
+            vtkIdType ref = elemCnt / dims[0];
+            ref *= dims[0];
+            if(posData < ref)
+              {
+              continue;
+              }
+            if(posData >= ref + dims[0])
+              {
               break;
-            case VTK_DOUBLE:
-              if (DoubleIsNaN(*(tempDPixel + posData)))
-                {
-                continue;
-                }
-              *(outDPixel + elemCnt) += *(tempDPixel + posData) * *(GaussKernel1D + i);
+              }
+
+            posData += j * dims[0];
+            ref = elemCnt / numSlice;
+            ref *= numSlice;
+            if(posData < ref)
+              {
+              continue;
+              }
+            if(posData >= ref + numSlice)
+              {
+              break;
+              }
+
+            posData += k * numSlice;
+            if(posData < 0)
+              {
+              continue;
+              }
+            if(posData >= numElements)
+              {
               break;
-            }
-          }
+              }
 
-        #ifdef VTK_SLICER_ASTRO_SUPPORT_OPENMP
-        if (omp_get_thread_num() == 0)
-          {
-          if(66. + (elemCnt / (numElements / (numProcs * 33.))) > status)
-            {
-            status += 10;
-            pnode->SetStatus(status);
+            int posKernel = (k + Zmax) * numKernelSlice
+                          + (j + Ymax) * pnode->GetKernelLengthX() + (i + Xmax);
+
+            switch (DataType)
+              {
+              case VTK_FLOAT:
+                if (FloatIsNaN(*(inFPixel + posData)))
+                  {
+                  continue;
+                  }
+                *(outFPixel + elemCnt) += *(inFPixel + posData) * *(GaussKernel + posKernel);
+                break;
+              case VTK_DOUBLE:
+                if (DoubleIsNaN(*(inDPixel + posData)))
+                  {
+                  continue;
+                  }
+                *(outDPixel + elemCnt) += *(inDPixel + posData) * *(GaussKernel + posKernel);
+                break;
+              }
             }
           }
-        #else
-        if(66. + (elemCnt / (numElements / 33.)) > status)
-          {
-          status += 10;
-          pnode->SetStatus(status);
-          }
-        #endif // VTK_SLICER_ASTRO_SUPPORT_OPENMP
         }
       }
+    progress.AddWork(lastElem - firstElem);
     }
-  else
-    {
-    outputVolume->GetImageData()->DeepCopy(this->Internal->tempVolumeData);
-    }
+  cancel = progress.IsCancelled();
 
   gettimeofday(&end, NULL);
 
@@ -1856,17 +3247,15 @@ int vtkSlicerAstroSmoothingLogic::IsotropicGaussianCPUFilter(vtkMRMLAstroSmoothi
   mtime = ((seconds) * 1000 + useconds/1000.0) + 0.5;
   vtkDebugMacro("Gaussian Filter (CPU) Time : "<<mtime<<" ms.");
 
+  inFPixel = NULL;
   outFPixel = NULL;
-  tempFPixel = NULL;
+  inDPixel = NULL;
   outDPixel = NULL;
-  tempDPixel = NULL;
 
+  delete inFPixel;
   delete outFPixel;
-  delete tempFPixel;
+  delete inDPixel;
   delete outDPixel;
-  delete tempDPixel;
-
-  this->Internal->tempVolumeData->Initialize();
 
   if (cancel)
     {
@@ -1880,7 +3269,6 @@ int vtkSlicerAstroSmoothingLogic::IsotropicGaussianCPUFilter(vtkMRMLAstroSmoothi
   outputVolume->UpdateRangeAttributes();
   outputVolume->UpdateDisplayThresholdAttributes();
   outputVolume->EndModify(wasModifying);
-
   pnode->SetStatus(100);
 
   gettimeofday(&end, NULL);
@@ -1929,9 +3317,7 @@ int vtkSlicerAstroSmoothingLogic::GaussianGPUFilter(vtkMRMLAstroSmoothingParamet
   long mtime, seconds, useconds;
   gettimeofday(&start, NULL);
 
-  vtkMRMLAstroVolumeNode *inputVolume =
-    vtkMRMLAstroVolumeNode::SafeDownCast
-      (this->GetMRMLScene()->GetNodeByID(pnode->GetInputVolumeNodeID()));
+  vtkMRMLAstroVolumeNode *inputVolume = this->GetFilterInputVolume(pnode);
   if (!inputVolume || !inputVolume->GetImageData())
     {
     vtkErrorMacro("vtkSlicerAstroSmoothingLogic::GaussianGPUFilter : "
@@ -1940,9 +3326,7 @@ int vtkSlicerAstroSmoothingLogic::GaussianGPUFilter(vtkMRMLAstroSmoothingParamet
     return 0;
     }
 
-  vtkMRMLAstroVolumeNode *outputVolume =
-    vtkMRMLAstroVolumeNode::SafeDownCast
-      (this->GetMRMLScene()->GetNodeByID(pnode->GetOutputVolumeNodeID()));
+  vtkMRMLAstroVolumeNode *outputVolume = this->GetFilterOutputVolume(pnode);
   if (!outputVolume || !outputVolume->GetImageData())
     {
     vtkErrorMacro("vtkSlicerAstroSmoothingLogic::GaussianGPUFilter : "
@@ -2047,9 +3431,7 @@ int vtkSlicerAstroSmoothingLogic::GradientCPUFilter(vtkMRMLAstroSmoothingParamet
     return 0;
     }
 
-   vtkMRMLAstroVolumeNode *inputVolume =
-     vtkMRMLAstroVolumeNode::SafeDownCast
-       (this->GetMRMLScene()->GetNodeByID(pnode->GetInputVolumeNodeID()));
+   vtkMRMLAstroVolumeNode *inputVolume = this->GetFilterInputVolume(pnode);
    if (!inputVolume || !inputVolume->GetImageData())
      {
      vtkErrorMacro("vtkSlicerAstroSmoothingLogic::GradientCPUFilter : "
@@ -2057,9 +3439,7 @@ int vtkSlicerAstroSmoothingLogic::GradientCPUFilter(vtkMRMLAstroSmoothingParamet
      return 0;
      }
 
-   vtkMRMLAstroVolumeNode *outputVolume =
-     vtkMRMLAstroVolumeNode::SafeDownCast
-       (this->GetMRMLScene()->GetNodeByID(pnode->GetOutputVolumeNodeID()));
+   vtkMRMLAstroVolumeNode *outputVolume = this->GetFilterOutputVolume(pnode);
    if (!outputVolume || !outputVolume->GetImageData())
      {
      vtkErrorMacro("vtkSlicerAstroSmoothingLogic::GradientCPUFilter : "
@@ -2067,12 +3447,6 @@ int vtkSlicerAstroSmoothingLogic::GradientCPUFilter(vtkMRMLAstroSmoothingParamet
      return 0;
      }
 
-  this->Internal->tempVolumeData->Initialize();
-  this->Internal->tempVolumeData->DeepCopy(inputVolume->GetImageData());
-  this->Internal->tempVolumeData->Modified();
-  this->Internal->tempVolumeData->GetPointData()->GetScalars()->Modified();
-  outputVolume->GetImageData()->DeepCopy(this->Internal->tempVolumeData);
-
   int *dims = inputVolume->GetImageData()->GetDimensions();
   const int numComponents = inputVolume->GetImageData()->GetNumberOfScalarComponents();
   if (numComponents > 1)
@@ -2081,15 +3455,27 @@ int vtkSlicerAstroSmoothingLogic::GradientCPUFilter(vtkMRMLAstroSmoothingParamet
                   "imageData with more than one components.");
     return 0.;
     }
-  const int numElements = dims[0] * dims[1] * dims[2];
-  const int numSlice = dims[0] * dims[1];
+
+  const int DataType = inputVolume->GetImageData()->GetPointData()->GetScalars()->GetDataType();
+
+  // the output is the first ping-pong buffer: the scratch one is only allocated
+  outputVolume->GetImageData()->DeepCopy(inputVolume->GetImageData());
+  this->Internal->tempVolumeData->Initialize();
+  this->Internal->tempVolumeData->CopyStructure(inputVolume->GetImageData());
+  this->Internal->tempVolumeData->AllocateScalars(DataType, 1);
+
   const double noise = StringToDouble(inputVolume->GetAttribute("SlicerAstro.DisplayThreshold"));
   const double noise2 = noise * noise * pnode->GetK() * pnode->GetK();
+  // a row of voxels is considered converged when its largest update is below
+  // tolerance. A converged row can miss at most tolerance per iteration,
+  // therefore the total error is bound to ConvergenceTolerance * noise.
+  // With a null ConvergenceTolerance (default) no row is skipped.
+  const double tolerance = pnode->GetConvergenceTolerance() * noise /
+                           std::max(pnode->GetAccuracy(), 1);
   float *outFPixel = NULL;
   float *tempFPixel = NULL;
   double *outDPixel = NULL;
   double *tempDPixel = NULL;
-  const int DataType = inputVolume->GetImageData()->GetPointData()->GetScalars()->GetDataType();
   switch (DataType)
     {
     case VTK_FLOAT:
@@ -2105,20 +3491,9 @@ int vtkSlicerAstroSmoothingLogic::GradientCPUFilter(vtkMRMLAstroSmoothingParamet
       return 0;
     }
   bool cancel = false;
+  int iterations = 0;
 
-  #ifdef VTK_SLICER_ASTRO_SUPPORT_OPENMP
-  int numProcs = 0;
-  if (pnode->GetCores() == 0)
-    {
-    numProcs = omp_get_num_procs();
-    }
-  else
-    {
-    numProcs = pnode->GetCores();
-    }
-
-  omp_set_num_threads(numProcs);
-  #endif // VTK_SLICER_ASTRO_SUPPORT_OPENMP
+  vtkAstroThreadBudget threadBudget(pnode->GetCores());
 
   struct timeval start, end;
 
@@ -2128,161 +3503,184 @@ int vtkSlicerAstroSmoothingLogic::GradientCPUFilter(vtkMRMLAstroSmoothingParamet
 
   pnode->SetStatus(1);
 
-  for (int i = 1; i <= pnode->GetAccuracy(); i++)
+  switch (DataType)
     {
+    case VTK_FLOAT:
+      cancel = !GradientDiffusion<float>(outFPixel, tempFPixel, dims, noise2,
+                                         tolerance, pnode, iterations);
+      break;
+    case VTK_DOUBLE:
+      cancel = !GradientDiffusion<double>(outDPixel, tempDPixel, dims, noise2,
+                                          tolerance, pnode, iterations);
+      break;
+    }
 
-    #ifdef VTK_SLICER_ASTRO_SUPPORT_OPENMP
-    #pragma omp parallel for schedule(static) shared(pnode, outFPixel, outDPixel, tempFPixel, tempDPixel, cancel)
-    #endif // VTK_SLICER_ASTRO_SUPPORT_OPENMP
-    for (int elemCnt = 0; elemCnt < numElements; elemCnt++)
-      {
-      int status = pnode->GetStatus();
+  outFPixel = NULL;
+  tempFPixel = NULL;
+  outDPixel = NULL;
+  tempDPixel = NULL;
 
-      #ifdef VTK_SLICER_ASTRO_SUPPORT_OPENMP
-      if (status == -1 && omp_get_thread_num() == 0)
-      #else
-      if (status == -1)
-      #endif // VTK_SLICER_ASTRO_SUPPORT_OPENMP
-        {
-        cancel = true;
-        }
+  delete outFPixel;
+  delete tempFPixel;
+  delete outDPixel;
+  delete tempDPixel;
 
-      #ifdef VTK_SLICER_ASTRO_SUPPORT_OPENMP
-      #pragma omp flush (cancel)
-      #endif // VTK_SLICER_ASTRO_SUPPORT_OPENMP
-      if (!cancel)
-        {
-        int x1 = elemCnt - 1;
-        int ref = (int) floor(elemCnt / dims[0]);
-        ref *= dims[0];
-        if(x1 < ref)
-          {
-          x1++;
-          }
-        int x2 = elemCnt + 1;
-        if(x2 >= ref + dims[0])
-          {
-          x2--;
-          }
+  this->Internal->tempVolumeData->Initialize();
 
-        int y1 = elemCnt - dims[0];
-        ref = (int) floor(elemCnt / numSlice);
-        ref *= numSlice;
-        if(y1 < ref)
-          {
-          y1 += dims[0];
-          }
-        int y2 = elemCnt + dims[0];
-        if(y2 >= ref + numSlice)
-          {
-          y2 -= dims[0];
-          }
+  if (cancel)
+    {
+    pnode->SetStatus(100);
+    return 0;
+    }
 
-        int z1 = elemCnt - numSlice;
-        if(z1 < 0)
-          {
-          z1 += numSlice;
-          }
-        int z2 = elemCnt + numSlice;
-        if(z2 >= numElements)
-          {
-          z2 -= numSlice;
-          }
+  gettimeofday(&end, NULL);
+
+  seconds  = end.tv_sec  - start.tv_sec;
+  useconds = end.tv_usec - start.tv_usec;
 
-        double Pixel2, norm;
-        double cX, cY, cZ;
+  mtime = ((seconds) * 1000 + useconds/1000.0) + 0.5;
 
-        switch (DataType)
-          {
-          case VTK_FLOAT:
-            if (FloatIsNaN(*(outFPixel + elemCnt)) ||
-                FloatIsNaN(*(outFPixel + x1)) ||
-                FloatIsNaN(*(outFPixel + x2)) ||
-                FloatIsNaN(*(outFPixel + y1)) ||
-                FloatIsNaN(*(outFPixel + y2)) ||
-                FloatIsNaN(*(outFPixel + z1)) ||
-                FloatIsNaN(*(outFPixel + z2)))
-              {
-              continue;
-              }
+  vtkDebugMacro("Intensity driven Gradient Filter (CPU) Time : "<<mtime<<" ms"
+                " ("<<iterations<<" of "<<pnode->GetAccuracy()<<" iterations).");
 
-            Pixel2 = *(outFPixel + elemCnt) * *(outFPixel + elemCnt);
-            norm = 1. + (Pixel2 / noise2);
-            cX = ((*(outFPixel + x1) - *(outFPixel + elemCnt)) +
-                  (*(outFPixel + x2) - *(outFPixel + elemCnt))) * pnode->GetParameterX();
-            cY = ((*(outFPixel + y1) - *(outFPixel + elemCnt)) +
-                  (*(outFPixel + y2) - *(outFPixel + elemCnt))) * pnode->GetParameterY();
-            cZ = ((*(outFPixel + z1) - *(outFPixel + elemCnt)) +
-                  (*(outFPixel + z2) - *(outFPixel + elemCnt))) * pnode->GetParameterZ();
-
-            *(tempFPixel + elemCnt) = *(outFPixel + elemCnt) +
-                                      pnode->GetTimeStep() * (cX + cY + cZ) / norm;
-            break;
-          case VTK_DOUBLE:
-            if (DoubleIsNaN(*(outDPixel + elemCnt)) ||
-                DoubleIsNaN(*(outDPixel + x1)) ||
-                DoubleIsNaN(*(outDPixel + x2)) ||
-                DoubleIsNaN(*(outDPixel + y1)) ||
-                DoubleIsNaN(*(outDPixel + y2)) ||
-                DoubleIsNaN(*(outDPixel + z1)) ||
-                DoubleIsNaN(*(outDPixel + z2)))
-              {
-              continue;
-              }
+  gettimeofday(&start, NULL);
 
-            Pixel2 = *(outDPixel + elemCnt) * *(outDPixel + elemCnt);
-            norm = 1. + (Pixel2 / noise2);
-            cX = ((*(outDPixel + x1) - *(outDPixel + elemCnt)) +
-                  (*(outDPixel + x2) - *(outDPixel + elemCnt))) * pnode->GetParameterX();
-            cY = ((*(outDPixel + y1) - *(outDPixel + elemCnt)) +
-                  (*(outDPixel + y2) - *(outDPixel + elemCnt))) * pnode->GetParameterY();
-            cZ = ((*(outDPixel + z1) - *(outDPixel + elemCnt)) +
-                  (*(outDPixel + z2) - *(outDPixel + elemCnt))) * pnode->GetParameterZ();
-
-            *(tempDPixel + elemCnt) = *(outDPixel + elemCnt) +
-                                      pnode->GetTimeStep() * (cX + cY + cZ) / norm;
-            break;
-          }
-        }
-      }
+  int wasModifying = outputVolume->StartModify();
+  outputVolume->UpdateRangeAttributes();
+  outputVolume->UpdateDisplayThresholdAttributes();
+  outputVolume->EndModify(wasModifying);
 
-    if (cancel)
-      {  
-      outFPixel = NULL;
-      tempFPixel = NULL;
-      outDPixel = NULL;
-      tempDPixel = NULL;
+  pnode->SetStatus(100);
 
-      delete outFPixel;
-      delete tempFPixel;
-      delete outDPixel;
-      delete tempDPixel;
+  gettimeofday(&end, NULL);
 
-      this->Internal->tempVolumeData->Initialize();
+  seconds  = end.tv_sec  - start.tv_sec;
+  useconds = end.tv_usec - start.tv_usec;
 
-      pnode->SetStatus(100);
+  mtime = ((seconds) * 1000 + useconds/1000.0) + 0.5;
+
+  vtkDebugMacro("Update Time : "<<mtime<<" ms.");
+
+  return 1;
+}
+
+//----------------------------------------------------------------------------
+int vtkSlicerAstroSmoothingLogic::WaveletCPUFilter(vtkMRMLAstroSmoothingParametersNode* pnode)
+{
+  #ifndef VTK_SLICER_ASTRO_SUPPORT_OPENMP
+  vtkWarningMacro("vtkSlicerAstroSmoothingLogic::WaveletCPUFilter : "
+                  "this release of SlicerAstro has been built "
+                  "without OpenMP support. It may results that "
+                  "the AstroSmoothing algorithm may show poor performance.")
+  #endif // VTK_SLICER_ASTRO_SUPPORT_OPENMP
+
+  if (!pnode)
+    {
+    vtkErrorMacro("vtkSlicerAstroSmoothingLogic::WaveletCPUFilter : "
+                  "parameterNode not found.");
+    return 0;
+    }
+
+  if (!this->GetMRMLScene())
+    {
+    vtkErrorMacro("vtkSlicerAstroSmoothingLogic::WaveletCPUFilter :"
+                  " scene not found.");
+    return 0;
+    }
+
+  vtkMRMLAstroVolumeNode *inputVolume = this->GetFilterInputVolume(pnode);
+  if (!inputVolume || !inputVolume->GetImageData())
+    {
+    vtkErrorMacro("vtkSlicerAstroSmoothingLogic::WaveletCPUFilter : "
+                  "inputVolume not found.");
+    return 0;
+    }
+
+  vtkMRMLAstroVolumeNode *outputVolume = this->GetFilterOutputVolume(pnode);
+  if (!outputVolume || !outputVolume->GetImageData())
+    {
+    vtkErrorMacro("vtkSlicerAstroSmoothingLogic::WaveletCPUFilter : "
+                  "outputVolume not found.");
+    return 0;
+    }
+
+  const int *dims = inputVolume->GetImageData()->GetDimensions();
+  const int numComponents = inputVolume->GetImageData()->GetNumberOfScalarComponents();
+  if (numComponents > 1)
+    {
+    vtkErrorMacro("vtkSlicerAstroSmoothingLogic::WaveletCPUFilter : "
+                  "imageData with more than one components.");
+    return 0;
+    }
+
+  // the number of scales depends on the whole volume, not on the
+  // (padded) region which is smoothed: a region gives the same scales
+  // of the whole volume and the padding of RegionPadding covers them
+  vtkMRMLAstroVolumeNode *wholeVolume =
+    vtkMRMLAstroVolumeNode::SafeDownCast
+      (this->GetMRMLScene()->GetNodeByID(pnode->GetInputVolumeNodeID()));
+  const int *wholeDims = dims;
+  if (wholeVolume && wholeVolume->GetImageData())
+    {
+    wholeDims = wholeVolume->GetImageData()->GetDimensions();
+    }
+  const int numScales = WaveletNumberOfScales(pnode->GetAccuracy(), wholeDims);
+  const double K = pnode->GetK();
 
+  float *inFPixel = NULL;
+  float *outFPixel = NULL;
+  double *inDPixel = NULL;
+  double *outDPixel = NULL;
+  const int DataType = inputVolume->GetImageData()->GetPointData()->GetScalars()->GetDataType();
+  switch (DataType)
+    {
+    case VTK_FLOAT:
+      inFPixel = static_cast<float*> (inputVolume->GetImageData()->GetScalarPointer(0,0,0));
+      outFPixel = static_cast<float*> (outputVolume->GetImageData()->GetScalarPointer(0,0,0));
+      break;
+    case VTK_DOUBLE:
+      inDPixel = static_cast<double*> (inputVolume->GetImageData()->GetScalarPointer(0,0,0));
+      outDPixel = static_cast<double*> (outputVolume->GetImageData()->GetScalarPointer(0,0,0));
+      break;
+    default:
+      vtkErrorMacro("Attempt to allocate scalars of type not allowed");
       return 0;
-      }
+    }
+  bool cancel = false;
+  std::vector<double> noises;
 
-    outputVolume->GetImageData()->DeepCopy(this->Internal->tempVolumeData);
+  vtkAstroThreadBudget threadBudget(pnode->GetCores());
 
-    switch (DataType)
-      {
-      case VTK_FLOAT:
-        outFPixel = static_cast<float*> (outputVolume->GetImageData()->GetScalarPointer(0,0,0));
-        break;
-      case VTK_DOUBLE:
-        outDPixel = static_cast<double*> (outputVolume->GetImageData()->GetScalarPointer(0,0,0));
-        break;
-      default:
-        vtkErrorMacro("Attempt to allocate scalars of type not allowed");
-        return 0;
-      }
+  struct timeval start, end;
+
+  long mtime, seconds, useconds;
 
-    pnode->SetStatus((int) i * 100 / pnode->GetAccuracy());
+  gettimeofday(&start, NULL);
+
+  pnode->SetStatus(1);
+
+  switch (DataType)
+    {
+    case VTK_FLOAT:
+      cancel = !StarletDenoising<float>(inFPixel, outFPixel, dims, numScales,
+                                        K, pnode, noises);
+      break;
+    case VTK_DOUBLE:
+      cancel = !StarletDenoising<double>(inDPixel, outDPixel, dims, numScales,
+                                         K, pnode, noises);
+      break;
     }
 
+  inFPixel = NULL;
+  outFPixel = NULL;
+  inDPixel = NULL;
+  outDPixel = NULL;
+
+  if (cancel)
+    {
+    pnode->SetStatus(100);
+    return 0;
+    }
 
   gettimeofday(&end, NULL);
 
@@ -2291,7 +3689,13 @@ int vtkSlicerAstroSmoothingLogic::GradientCPUFilter(vtkMRMLAstroSmoothingParamet
 
   mtime = ((seconds) * 1000 + useconds/1000.0) + 0.5;
 
-  vtkDebugMacro("Intensity driven Gradient Filter (CPU) Time : "<<mtime<<" ms.");
+  std::ostringstream noisesSS;
+  for (size_t scale = 0; scale < noises.size(); scale++)
+    {
+    noisesSS << " " << noises[scale];
+    }
+  vtkDebugMacro("Wavelet Filter (CPU) Time : "<<mtime<<" ms"
+                " ("<<numScales<<" scales, noise per scale:"<<noisesSS.str()<<").");
 
   gettimeofday(&start, NULL);
 
@@ -2311,18 +3715,6 @@ int vtkSlicerAstroSmoothingLogic::GradientCPUFilter(vtkMRMLAstroSmoothingParamet
 
   vtkDebugMacro("Update Time : "<<mtime<<" ms.");
 
-  outFPixel = NULL;
-  tempFPixel = NULL;
-  outDPixel = NULL;
-  tempDPixel = NULL;
-
-  delete outFPixel;
-  delete tempFPixel;
-  delete outDPixel;
-  delete tempDPixel;
-
-  this->Internal->tempVolumeData->Initialize();
-
   return 1;
 }
 
@@ -2360,9 +3752,7 @@ int vtkSlicerAstroSmoothingLogic::GradientGPUFilter(vtkMRMLAstroSmoothingParamet
   long mtime, seconds, useconds;
   gettimeofday(&start, NULL);
 
-  vtkMRMLAstroVolumeNode *inputVolume =
-    vtkMRMLAstroVolumeNode::SafeDownCast
-      (this->GetMRMLScene()->GetNodeByID(pnode->GetInputVolumeNodeID()));
+  vtkMRMLAstroVolumeNode *inputVolume = this->GetFilterInputVolume(pnode);
   if (!inputVolume || !inputVolume->GetImageData())
     {
     vtkErrorMacro("vtkSlicerAstroSmoothingLogic::GradientGPUFilter : "
@@ -2371,9 +3761,7 @@ int vtkSlicerAstroSmoothingLogic::GradientGPUFilter(vtkMRMLAstroSmoothingParamet
     return 0;
     }
 
-  vtkMRMLAstroVolumeNode *outputVolume =
-    vtkMRMLAstroVolumeNode::SafeDownCast
-      (this->GetMRMLScene()->GetNodeByID(pnode->GetOutputVolumeNodeID()));
+  vtkMRMLAstroVolumeNode *outputVolume = this->GetFilterOutputVolume(pnode);
   if (!outputVolume || !outputVolume->GetImageData())
     {
     vtkErrorMacro("vtkSlicerAstroSmoothingLogic::GradientGPUFilter : "
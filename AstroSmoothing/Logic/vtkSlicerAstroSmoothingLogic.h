@@ -22,9 +22,12 @@
 
 // Slicer includes
 #include "vtkSlicerModuleLogic.h"
+class vtkMRMLAstroVolumeNode;
 class vtkMRMLVolumeNode;
 class vtkSlicerAstroVolumeLogic;
 // vtk includes
+class vtkCollection;
+class vtkDoubleArray;
 class vtkRenderWindow;
 // AstroSmoothings includes
 #include "vtkSlicerAstroSmoothingModuleLogicExport.h"
@@ -39,6 +42,8 @@ class vtkMRMLAstroSmoothingParametersNode;
 /// CPU and GPU hardware, offering interactive performance when processing data-cubes
 /// of dimensions up to 10^7 voxels and very fast performance (< 3.5 sec)
 /// for larger ones (up to 10^8 voxels).
+/// An a trous (starlet) wavelet denoising, with thresholding of each
+/// wavelet scale according to its noise, is available on CPU.
 
 /// The intensity-driven gradient filter, due to its adaptive characteristics,
 /// is the optimal choice for HI data. Therefore,
@@ -70,25 +75,116 @@ public:
   /// Gets called automatically when the MRMLScene is attached to this logic class
   virtual void RegisterNodes() VTK_OVERRIDE;
 
-  /// Run smoothing algorithm
+  /// Run smoothing algorithm.
+  /// If the Region of the parameter node is "ROI" or "Segmentation",
+  /// only the bounding box of the selection, padded by the half-width of
+  /// the filter, is processed (see vtkMRMLAstroSmoothingParametersNode::SetCropOutput).
+  /// If the PreviewChannel of the parameter node is not negative, only that
+  /// channel of the output volume is computed (live preview).
   /// \param MRML parameter node
   /// \param vtkRenderWindow to init the GPU algorithm
   /// \return Success flag
   int Apply(vtkMRMLAstroSmoothingParametersNode *pnode, vtkRenderWindow *renderWindow);
 
+  /// Run the box or Gaussian smoothing for several kernel sizes in one run (CPU).
+  /// Each tuple of scales holds the kernel sizes along X, Y and Z (as ParameterX,
+  /// ParameterY and ParameterZ of the parameter node). The X and Y passes are
+  /// shared between the scales with the same spatial size and, for the Gaussian
+  /// filter, larger spatial sizes are cascaded on the previous spatial result.
+  /// The cascade is used only if the input has no blanked voxels, the Accuracy
+  /// is at least 8 and the differential kernel is wider than one voxel
+  /// (sigma >= 1); otherwise each scale is smoothed from the input. Within half
+  /// a kernel from the borders a cascaded result differs from the direct one,
+  /// since the voxels outside the volume do not contribute to either pass.
+  /// No work volume is allocated: the spatial results are kept in the outputs.
+  /// A new output volume is created for each scale and added to outputVolumes
+  /// (in the same order of scales).
+  /// \param MRML parameter node
+  /// \param scales kernel sizes (three components)
+  /// \param outputVolumes collection filled with the output volumes
+  /// \return Success flag
+  int ApplyMultiScale(vtkMRMLAstroSmoothingParametersNode *pnode,
+                      vtkDoubleArray *scales,
+                      vtkCollection *outputVolumes);
+
+  /// Run the box or non-rotated Gaussian smoothing of the parameter node on
+  /// several input volumes (e.g., a data cube and its model) in one run (CPU).
+  /// The kernels are built and the threads are set up once for the whole batch.
+  /// A new output volume is created for each input volume and added to
+  /// outputVolumes (in the same order of inputVolumes).
+  /// The input volume of the parameter node is not used.
+  /// \param MRML parameter node
+  /// \param inputVolumes collection of vtkMRMLAstroVolumeNode
+  /// \param outputVolumes collection filled with the output volumes
+  /// \return Success flag
+  int ApplyBatch(vtkMRMLAstroSmoothingParametersNode *pnode,
+                 vtkCollection *inputVolumes,
+                 vtkCollection *outputVolumes);
+
+  /// Rebin the input volume spectrally, averaging groups of factor channels
+  /// (boxcar). If hanning, the channels are first smoothed with the Hanning
+  /// kernel (1/4, 1/2, 1/4); a factor of 1 gives a Hanning smoothing only.
+  /// Blanked voxels do not contribute to the averages. A new output volume
+  /// is created with NAXIS3, CDELT3 and CRPIX3 (header and WCS) updated.
+  /// \param MRML parameter node
+  /// \param factor number of channels averaged in one output channel
+  /// \param hanning apply the Hanning smoothing
+  /// \return the output volume, NULL on failure or cancel
+  vtkMRMLAstroVolumeNode* ApplySpectralRebin(vtkMRMLAstroSmoothingParametersNode *pnode,
+                                             int factor, bool hanning);
+
+  /// Bin the input volume spatially, averaging blocks of factor x factor
+  /// pixels of each channel. Blanked voxels do not contribute to the averages.
+  /// A new output volume is created with NAXIS1/2, CDELT1/2 and CRPIX1/2
+  /// (header and WCS) updated.
+  /// \param MRML parameter node
+  /// \param factor number of pixels binned along X and Y
+  /// \return the output volume, NULL on failure or cancel
+  vtkMRMLAstroVolumeNode* ApplySpatialBinning(vtkMRMLAstroSmoothingParametersNode *pnode,
+                                              int factor);
+
+  /// Set/Get the maximum memory (in MB) used by the results cached while
+  /// AutoRun is on. The X and XY passes of the separable filters are cached
+  /// only if they fit together with the final result, and the final result
+  /// only if it fits alone. Default is 512 MB, 0 disables the cache.
+  vtkSetClampMacro(MaximumCacheSize, int, 0, VTK_INT_MAX);
+  vtkGetMacro(MaximumCacheSize, int);
+
+  /// Release the results cached while AutoRun is on
+  void ClearCache();
+
 protected:
   vtkSlicerAstroSmoothingLogic();
   virtual ~vtkSlicerAstroSmoothingLogic();
 
-  /// Run anisotropic box filter algorithm on CPU
+  /// Run the filter selected in the parameter node.
+  /// With AutoRun the last result is cached and copied in the
+  /// output if neither the input data nor the parameters changed
+  /// \param MRML parameter node
+  /// \param vtkRenderWindow to init the GPU algorithm
+  /// \return Success flag
+  int RunFilter(vtkMRMLAstroSmoothingParametersNode *pnode, vtkRenderWindow *renderWindow);
+
+  /// Run the filter only on the padded bounding box of the selection
+  /// (ROI or segmentation) and/or of the preview channel
+  /// and copy the result in the output volume
   /// \param MRML parameter node
+  /// \param vtkRenderWindow to init the GPU algorithm
   /// \return Success flag
-  int AnisotropicBoxCPUFilter(vtkMRMLAstroSmoothingParametersNode *pnode);
+  int ApplyRegion(vtkMRMLAstroSmoothingParametersNode *pnode, vtkRenderWindow *renderWindow);
 
-  /// Run isotropic box filter algorithm on CPU
+  /// Get the volumes processed by the filters: the input and output volumes
+  /// of the parameter node or, while running ApplyRegion, the temporary
+  /// volumes holding the padded region
+  vtkMRMLAstroVolumeNode* GetFilterInputVolume(vtkMRMLAstroSmoothingParametersNode *pnode);
+  vtkMRMLAstroVolumeNode* GetFilterOutputVolume(vtkMRMLAstroSmoothingParametersNode *pnode);
+
+  /// Run box or non-rotated Gaussian filter algorithm on CPU as three
+  /// 1D passes. With AutoRun the X and XY passes are cached and only the
+  /// passes from the first changed kernel are computed again
   /// \param MRML parameter node
   /// \return Success flag
-  int IsotropicBoxCPUFilter(vtkMRMLAstroSmoothingParametersNode *pnode);
+  int SeparableCPUFilter(vtkMRMLAstroSmoothingParametersNode *pnode);
 
   /// Run box filter algorithm on GPU
   /// \param MRML parameter node
@@ -96,16 +192,11 @@ protected:
   /// \return Success flag
   int BoxGPUFilter(vtkMRMLAstroSmoothingParametersNode *pnode, vtkRenderWindow* renderWindow);
 
-  /// Run anisotropic Gaussian filter algorithm on CPU
+  /// Run rotated anisotropic Gaussian filter algorithm on CPU
   /// \param MRML parameter node
   /// \return Success flag
   int AnisotropicGaussianCPUFilter(vtkMRMLAstroSmoothingParametersNode *pnode);
 
-  /// Run isotropic Gaussian filter algorithm on CPU
-  /// \param MRML parameter node
-  /// \return Success flag
-  int IsotropicGaussianCPUFilter(vtkMRMLAstroSmoothingParametersNode *pnode);
-
   /// Run Gaussian filter algorithm on GPU
   /// \param MRML parameter node
   /// \param vtkRenderWindow to init the GPU algorithm
@@ -123,12 +214,21 @@ protected:
   /// \return Success flag
   int GradientGPUFilter(vtkMRMLAstroSmoothingParametersNode *pnode, vtkRenderWindow* renderWindow);
 
+  /// Run the a trous (starlet) wavelet denoising on CPU.
+  /// The number of wavelet scales is given by the Accuracy and the
+  /// threshold, in units of the noise of each scale, by K.
+  /// \param MRML parameter node
+  /// \return Success flag
+  int WaveletCPUFilter(vtkMRMLAstroSmoothingParametersNode *pnode);
+
 private:
   vtkSlicerAstroSmoothingLogic(const vtkSlicerAstroSmoothingLogic&); // Not implemented
   void operator=(const vtkSlicerAstroSmoothingLogic&);           // Not implemented
 
   class vtkInternal;
   vtkInternal* Internal;
+
+  int MaximumCacheSize;
 };
 
 #endif
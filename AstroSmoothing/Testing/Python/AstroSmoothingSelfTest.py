@@ -147,39 +147,528 @@ class AstroSmoothingSelfTestTest(unittest.TestCase):
   def runTest(self):
     self.setUp()
     self.test_AstroSmoothingSelfTest()
+    self.setUp()
+    self.test_GradientConvergenceTolerance()
+    self.setUp()
+    self.test_MultiScale()
+    self.setUp()
+    self.test_Wavelet()
+    self.setUp()
+    self.test_Region()
+    self.setUp()
+    self.test_AutoRunCache()
+    self.setUp()
+    self.test_Preview()
+    self.setUp()
+    self.test_SpectralRebin()
+    self.setUp()
+    self.test_SpatialBinning()
+    self.setUp()
+    self.test_Batch()
 
   def test_AstroSmoothingSelfTest(self):
     print("Running AstroSmoothingSelfTest Test case:")
 
-    astroVolume = self.downloadWEIN069()
+    astroVolume, AstroSmoothingParameterNode, ApplyPushButton = self.setUpSmoothingModule()
+
+    # the output of the gradient filter depends on the noise estimated at
+    # load time, which is not part of the sample: the input and the noise
+    # are pinned to a deterministic pattern, the reference values have been
+    # computed once with the CPU filter (Accuracy 8 reaches at most 8 voxels
+    # away, hence the values do not depend on the cube size)
+    import numpy
+    array = slicer.util.arrayFromVolume(astroVolume)
+    k, j, i = numpy.indices(array.shape)
+    array[:] = (((7 * i + 13 * j + 29 * k) % 17) - 4) * 1.e-4
+    astroVolume.GetImageData().Modified()
+    astroVolume.UpdateRangeAttributes()
+    astroVolume.UpdateDisplayThresholdAttributes()
+    astroVolume.SetDisplayThreshold(4.e-4)
+
+    AstroSmoothingParameterNode.SetFilter(2)
+    AstroSmoothingParameterNode.SetHardware(0)
+    AstroSmoothingParameterNode.SetAccuracy(8)
+    AstroSmoothingParameterNode.SetTimeStep(0.0325)
+    AstroSmoothingParameterNode.SetK(2.)
+    AstroSmoothingParameterNode.SetParameterX(5.)
+    AstroSmoothingParameterNode.SetParameterY(5.)
+    AstroSmoothingParameterNode.SetParameterZ(5.)
+    AstroSmoothingParameterNode.SetConvergenceTolerance(0.)
 
-    mainWindow = slicer.util.mainWindow()
-    mainWindow.moduleSelector().selectModule('AstroVolume')
-    mainWindow.moduleSelector().selectModule('AstroSmoothing')
+    self.delayDisplay('Generating smoothed datacube', 700)
+    ApplyPushButton.click()
 
-    astroSmoothingModule = module = slicer.modules.astrosmoothing
-    astroSmoothingModuleWidget = astroSmoothingModule.widgetRepresentation()
+    outputVolume = slicer.mrmlScene.GetNodeByID(AstroSmoothingParameterNode.GetOutputVolumeNodeID())
+    references = [((40, 30, 12), 5.5798015092e-04),
+                  ((45, 33, 16), 5.5672466988e-04),
+                  ((50, 25, 14), 5.5611587595e-04)]
+    passed = True
+    for (x, y, z), referenceValue in references:
+      pixelValue = outputVolume.GetImageData().GetScalarComponentAsFloat(x, y, z, 0)
+      if (math.fabs(pixelValue - referenceValue) > 1.e-9):
+        passed = False
+
+    if passed:
+       self.delayDisplay('Test passed', 700)
+    else:
+       self.delayDisplay('Test failed', 700)
+       # if run from Slicer interface remove the followinf exit
+       sys.exit()
 
-    AstroSmoothingParameterNode = slicer.util.getNode("AstroSmoothingParameters")
+  def test_GradientConvergenceTolerance(self):
+    print("Running AstroSmoothingSelfTest GradientConvergenceTolerance Test case:")
 
-    QPushButtonList = astroSmoothingModuleWidget.findChildren(qt.QPushButton)
-    for QPushButton in (QPushButtonList):
-        if QPushButton.name == "ApplyButton":
-            ApplyPushButton = QPushButton
+    astroVolume, AstroSmoothingParameterNode, ApplyPushButton = self.setUpSmoothingModule()
+    noise = float(astroVolume.GetAttribute("SlicerAstro.DisplayThreshold"))
 
-    self.delayDisplay('Generating smoothed datacube', 700)
+    self.delayDisplay('Generating smoothed datacube (all the rows)', 700)
+    AstroSmoothingParameterNode.SetConvergenceTolerance(0.)
+    ApplyPushButton.click()
+    exactArray = self.getOutputArray(AstroSmoothingParameterNode)
+
+    # rows changing less than the tolerance are skipped:
+    # the error is bound to ConvergenceTolerance * noise
+    self.delayDisplay('Generating smoothed datacube (converged rows skipped)', 700)
+    AstroSmoothingParameterNode.SetConvergenceTolerance(0.01)
+    ApplyPushButton.click()
+    approximatedArray = self.getOutputArray(AstroSmoothingParameterNode)
+    AstroSmoothingParameterNode.SetConvergenceTolerance(0.)
+
+    import numpy
+    maxError = numpy.nanmax(numpy.fabs(exactArray - approximatedArray))
+    if (maxError <= 0.01 * noise):
+       self.delayDisplay('Test passed', 700)
+    else:
+       self.delayDisplay('Test failed', 700)
+       # if run from Slicer interface remove the followinf exit
+       sys.exit()
+
+  def test_MultiScale(self):
+    print("Running AstroSmoothingSelfTest MultiScale Test case:")
+
+    astroVolume, AstroSmoothingParameterNode, ApplyPushButton = self.setUpSmoothingModule()
+    noise = float(astroVolume.GetAttribute("SlicerAstro.DisplayThreshold"))
+    logic = slicer.modules.astrosmoothing.logic()
+
+    AstroSmoothingParameterNode.SetFilter(1)
+    AstroSmoothingParameterNode.SetRx(0.)
+    AstroSmoothingParameterNode.SetRy(0.)
+    AstroSmoothingParameterNode.SetRz(0.)
+
+    import numpy
+    passed = True
+    # with Accuracy 8 the FWHM 5 scale is cascaded on the FWHM 3 one
+    # (differential sigma 1.7 voxels), with Accuracy 3 it is smoothed directly
+    for accuracy, tolerance in ((8, 0.01 * noise), (3, 0.)):
+      AstroSmoothingParameterNode.SetAccuracy(accuracy)
+
+      scales = vtk.vtkDoubleArray()
+      scales.SetNumberOfComponents(3)
+      scales.InsertNextTuple3(3., 3., 3.)
+      scales.InsertNextTuple3(5., 5., 3.)
+      outputVolumes = vtk.vtkCollection()
+      self.delayDisplay('Generating multi-scale smoothed datacubes (Accuracy %d)' % accuracy, 700)
+      if not logic.ApplyMultiScale(AstroSmoothingParameterNode, scales, outputVolumes):
+        passed = False
+        break
+      multiScaleArray = slicer.util.arrayFromVolume(outputVolumes.GetItemAsObject(1)).copy()
+
+      self.delayDisplay('Generating smoothed datacube (Accuracy %d)' % accuracy, 700)
+      AstroSmoothingParameterNode.SetParameterX(5.)
+      AstroSmoothingParameterNode.SetParameterY(5.)
+      AstroSmoothingParameterNode.SetParameterZ(3.)
+      AstroSmoothingParameterNode.SetAccuracy(accuracy)
+      ApplyPushButton.click()
+      directArray = self.getOutputArray(AstroSmoothingParameterNode)
+
+      # the cascade differs from the direct smoothing within half a kernel
+      # from the spatial borders (the array axes are Z, Y, X)
+      margin = int(5. / 2.3548200450309493 * accuracy) // 2 + 1
+      diff = numpy.fabs(multiScaleArray - directArray)[:, margin:-margin, margin:-margin]
+      if numpy.nanmax(diff) > tolerance:
+        passed = False
+
+    if passed:
+       self.delayDisplay('Test passed', 700)
+    else:
+       self.delayDisplay('Test failed', 700)
+       # if run from Slicer interface remove the followinf exit
+       sys.exit()
+
+  def test_Wavelet(self):
+    print("Running AstroSmoothingSelfTest Wavelet Test case:")
+
+    astroVolume, AstroSmoothingParameterNode, ApplyPushButton = self.setUpSmoothingModule()
+
+    AstroSmoothingParameterNode.SetFilter(3)
+    AstroSmoothingParameterNode.SetHardware(0)
+    AstroSmoothingParameterNode.SetAccuracy(4)
+    AstroSmoothingParameterNode.SetK(3.)
+
+    self.delayDisplay('Generating wavelet denoised datacube', 700)
     ApplyPushButton.click()
 
     outputVolume = slicer.mrmlScene.GetNodeByID(AstroSmoothingParameterNode.GetOutputVolumeNodeID())
     pixelValue = outputVolume.GetImageData().GetScalarComponentAsFloat(83, 53, 24, 0)
 
-    if (math.fabs(pixelValue - 0.000662423) < 1.e-9):
+    if (math.fabs(pixelValue - 2.66463612e-05) < 1.e-9):
        self.delayDisplay('Test passed', 700)
     else:
        self.delayDisplay('Test failed', 700)
        # if run from Slicer interface remove the followinf exit
        sys.exit()
 
+  def test_Region(self):
+    print("Running AstroSmoothingSelfTest Region Test case:")
+
+    astroVolume, AstroSmoothingParameterNode, ApplyPushButton = self.setUpSmoothingModule()
+
+    AstroSmoothingParameterNode.SetFilter(0)
+    AstroSmoothingParameterNode.SetHardware(0)
+    AstroSmoothingParameterNode.SetParameterX(5)
+    AstroSmoothingParameterNode.SetParameterY(5)
+    AstroSmoothingParameterNode.SetParameterZ(5)
+
+    self.delayDisplay('Generating smoothed datacube', 700)
+    ApplyPushButton.click()
+    wholeArray = self.getOutputArray(AstroSmoothingParameterNode)
+
+    # ROI around the voxels 57-77, 25-45, 31-51
+    IJKToRAS = vtk.vtkMatrix4x4()
+    astroVolume.GetIJKToRASMatrix(IJKToRAS)
+    firstRAS = IJKToRAS.MultiplyPoint((57., 25., 31., 1.))
+    lastRAS = IJKToRAS.MultiplyPoint((77., 45., 51., 1.))
+    roiNode = slicer.vtkMRMLAnnotationROINode()
+    roiNode.SetXYZ([(firstRAS[ii] + lastRAS[ii]) * 0.5 for ii in range(3)])
+    roiNode.SetRadiusXYZ([math.fabs(lastRAS[ii] - firstRAS[ii]) * 0.5 for ii in range(3)])
+    slicer.mrmlScene.AddNode(roiNode)
+
+    AstroSmoothingParameterNode.SetROINode(roiNode)
+    AstroSmoothingParameterNode.SetRegion("ROI")
+    AstroSmoothingParameterNode.SetCropOutput(False)
+
+    self.delayDisplay('Generating smoothed region of the datacube', 700)
+    ApplyPushButton.click()
+    regionArray = self.getOutputArray(AstroSmoothingParameterNode)
+    inputArray = slicer.util.arrayFromVolume(astroVolume)
+    AstroSmoothingParameterNode.SetRegion("None")
+
+    # the array axes are Z, Y, X: inside the ROI the padded region gives the
+    # values of the whole smoothing, outside it the output is the input
+    insideMatch = math.fabs(regionArray[41, 35, 67] - wholeArray[41, 35, 67]) < 1.e-9
+    outsideMatch = regionArray[5, 5, 5] == inputArray[5, 5, 5]
+    if insideMatch and outsideMatch:
+       self.delayDisplay('Test passed', 700)
+    else:
+       self.delayDisplay('Test failed', 700)
+       # if run from Slicer interface remove the followinf exit
+       sys.exit()
+
+  def test_AutoRunCache(self):
+    print("Running AstroSmoothingSelfTest AutoRunCache Test case:")
+
+    astroVolume, AstroSmoothingParameterNode, ApplyPushButton = self.setUpSmoothingModule()
+
+    AstroSmoothingParameterNode.SetFilter(0)
+    AstroSmoothingParameterNode.SetHardware(0)
+    AstroSmoothingParameterNode.SetParameterX(5)
+    AstroSmoothingParameterNode.SetParameterY(5)
+    AstroSmoothingParameterNode.SetParameterZ(5)
+    AstroSmoothingParameterNode.SetAutoRun(True)
+
+    self.delayDisplay('Generating smoothed datacube (AutoRun)', 700)
+    ApplyPushButton.click()
+
+    # only the Z pass is computed again, from the cached XY pass
+    self.delayDisplay('Generating smoothed datacube from the cache', 700)
+    AstroSmoothingParameterNode.SetParameterZ(3)
+    ApplyPushButton.click()
+    cachedArray = self.getOutputArray(AstroSmoothingParameterNode)
+
+    self.delayDisplay('Generating smoothed datacube without cache', 700)
+    AstroSmoothingParameterNode.SetAutoRun(False)
+    slicer.modules.astrosmoothing.logic().ClearCache()
+    ApplyPushButton.click()
+    freshArray = self.getOutputArray(AstroSmoothingParameterNode)
+
+    import numpy
+    if numpy.array_equal(cachedArray, freshArray):
+       self.delayDisplay('Test passed', 700)
+    else:
+       self.delayDisplay('Test failed', 700)
+       # if run from Slicer interface remove the followinf exit
+       sys.exit()
+
+  def test_Preview(self):
+    print("Running AstroSmoothingSelfTest Preview Test case:")
+
+    astroVolume, AstroSmoothingParameterNode, ApplyPushButton = self.setUpSmoothingModule()
+
+    AstroSmoothingParameterNode.SetFilter(0)
+    AstroSmoothingParameterNode.SetHardware(0)
+    AstroSmoothingParameterNode.SetParameterX(5)
+    AstroSmoothingParameterNode.SetParameterY(5)
+    AstroSmoothingParameterNode.SetParameterZ(5)
+
+    self.delayDisplay('Generating smoothed datacube', 700)
+    ApplyPushButton.click()
+    wholeArray = self.getOutputArray(AstroSmoothingParameterNode)
+
+    # blank one channel of the output and compute it again with the preview
+    # (the array axes are Z, Y, X)
+    channel = 41
+    outputVolume = slicer.mrmlScene.GetNodeByID(AstroSmoothingParameterNode.GetOutputVolumeNodeID())
+    outputArray = slicer.util.arrayFromVolume(outputVolume)
+    outputArray[channel, :, :] = 0.
+    outputVolume.GetImageData().Modified()
+
+    self.delayDisplay('Generating preview of channel %d' % channel, 700)
+    AstroSmoothingParameterNode.SetPreviewChannel(channel)
+    slicer.modules.astrosmoothing.logic().Apply(AstroSmoothingParameterNode, vtk.vtkRenderWindow())
+    AstroSmoothingParameterNode.SetPreviewChannel(-1)
+
+    import numpy
+    previewArray = slicer.util.arrayFromVolume(outputVolume)
+    if numpy.array_equal(previewArray[channel], wholeArray[channel]):
+       self.delayDisplay('Test passed', 700)
+    else:
+       self.delayDisplay('Test failed', 700)
+       # if run from Slicer interface remove the followinf exit
+       sys.exit()
+
+  def test_SpectralRebin(self):
+    print("Running AstroSmoothingSelfTest SpectralRebin Test case:")
+
+    astroVolume, AstroSmoothingParameterNode, ApplyPushButton = self.setUpSmoothingModule()
+
+    # blank a whole spectrum and a few voxels (the array axes are Z, Y, X)
+    import numpy
+    array = slicer.util.arrayFromVolume(astroVolume)
+    array[:, 30, 40] = numpy.nan
+    array[10, 20, 20] = numpy.nan
+    array[11:13, 21, 21] = numpy.nan
+    astroVolume.GetImageData().Modified()
+    inputArray = numpy.array(array, dtype=numpy.float64)
+
+    # a factor not dividing NAXIS3: the trailing channels are dropped
+    numChannels = inputArray.shape[0]
+    factor = 4
+    while numChannels % factor == 0:
+      factor += 1
+
+    logic = slicer.modules.astrosmoothing.logic()
+    passed = True
+    for hanning in (False, True):
+      self.delayDisplay('Rebinning datacube (factor %d, %s)' % (factor, 'Hanning' if hanning else 'Boxcar'), 700)
+      outputVolume = logic.ApplySpectralRebin(AstroSmoothingParameterNode, factor, hanning)
+      if not outputVolume:
+        passed = False
+        break
+
+      # weighted average of the valid channels of each group: the Hanning
+      # kernel (1/4, 1/2, 1/4) of each member spreads over its neighbours
+      if hanning:
+        weights = numpy.zeros(factor + 2)
+        for member in range(factor):
+          weights[member:member + 3] += (0.25, 0.5, 0.25)
+        firstOffset = -1
+      else:
+        weights = numpy.ones(factor)
+        firstOffset = 0
+      referenceArray = numpy.empty((numChannels // factor,) + inputArray.shape[1:])
+      for channel in range(numChannels // factor):
+        total = numpy.zeros(inputArray.shape[1:])
+        norm = numpy.zeros(inputArray.shape[1:])
+        for ww in range(weights.size):
+          z = channel * factor + firstOffset + ww
+          if z < 0 or z >= numChannels:
+            continue
+          valid = ~numpy.isnan(inputArray[z])
+          total += numpy.where(valid, weights[ww] * inputArray[z], 0.)
+          norm += numpy.where(valid, weights[ww], 0.)
+        referenceArray[channel] = numpy.where(norm > 0., total / numpy.where(norm > 0., norm, 1.), numpy.nan)
+
+      outputArray = numpy.array(slicer.util.arrayFromVolume(outputVolume), dtype=numpy.float64)
+      if outputArray.shape != referenceArray.shape or \
+         not numpy.array_equal(numpy.isnan(outputArray), numpy.isnan(referenceArray)) or \
+         not numpy.allclose(outputArray, referenceArray, rtol=1.e-5, atol=1.e-9, equal_nan=True) or \
+         not numpy.isnan(outputArray[:, 30, 40]).all() or \
+         not self.binnedWCSMatches(astroVolume, outputVolume, (1, 1, factor)):
+        passed = False
+
+    if passed:
+       self.delayDisplay('Test passed', 700)
+    else:
+       self.delayDisplay('Test failed', 700)
+       # if run from Slicer interface remove the followinf exit
+       sys.exit()
+
+  def test_SpatialBinning(self):
+    print("Running AstroSmoothingSelfTest SpatialBinning Test case:")
+
+    astroVolume, AstroSmoothingParameterNode, ApplyPushButton = self.setUpSmoothingModule()
+
+    # blank a whole 3x3 block and a few voxels (the array axes are Z, Y, X)
+    import numpy
+    factor = 3
+    array = slicer.util.arrayFromVolume(astroVolume)
+    array[:, 12:15, 15:18] = numpy.nan
+    array[10, 20, 20] = numpy.nan
+    array[11, 21:23, 21] = numpy.nan
+    astroVolume.GetImageData().Modified()
+    inputArray = numpy.array(array, dtype=numpy.float64)
+
+    # CD matrix keywords: the columns of the binned axes are scaled
+    cdKeys = ["SlicerAstro.CD%d_%d" % (ii, jj) for ii in range(1, 4) for jj in range(1, 4)]
+    for cdKey in cdKeys:
+      astroVolume.SetAttribute(cdKey, str(1.e-4 * (cdKeys.index(cdKey) + 1)))
+
+    self.delayDisplay('Binning datacube (%dx%d)' % (factor, factor), 700)
+    logic = slicer.modules.astrosmoothing.logic()
+    outputVolume = logic.ApplySpatialBinning(AstroSmoothingParameterNode, factor)
+
+    passed = outputVolume is not None
+    if passed:
+      # mean of the valid voxels of each block, the trailing pixels are dropped
+      numChannels, numY, numX = inputArray.shape
+      blocks = inputArray[:, :numY // factor * factor, :numX // factor * factor]
+      blocks = blocks.reshape(numChannels, numY // factor, factor, numX // factor, factor)
+      valid = ~numpy.isnan(blocks)
+      total = numpy.where(valid, blocks, 0.).sum(axis=(2, 4))
+      count = valid.sum(axis=(2, 4))
+      referenceArray = numpy.where(count > 0, total / numpy.maximum(count, 1), numpy.nan)
+
+      outputArray = numpy.array(slicer.util.arrayFromVolume(outputVolume), dtype=numpy.float64)
+      if outputArray.shape != referenceArray.shape or \
+         not numpy.array_equal(numpy.isnan(outputArray), numpy.isnan(referenceArray)) or \
+         not numpy.allclose(outputArray, referenceArray, rtol=1.e-5, atol=1.e-9, equal_nan=True) or \
+         not numpy.isnan(outputArray[:, 4, 5]).all() or \
+         not self.binnedWCSMatches(astroVolume, outputVolume, (factor, factor, 1)):
+        passed = False
+
+      for cdKey in cdKeys:
+        cd = float(astroVolume.GetAttribute(cdKey))
+        if not cdKey.endswith("_3"):
+          cd *= factor
+        if math.fabs(float(outputVolume.GetAttribute(cdKey)) - cd) > 1.e-9 * math.fabs(cd):
+          passed = False
+
+    if passed:
+       self.delayDisplay('Test passed', 700)
+    else:
+       self.delayDisplay('Test failed', 700)
+       # if run from Slicer interface remove the followinf exit
+       sys.exit()
+
+  def test_Batch(self):
+    print("Running AstroSmoothingSelfTest Batch Test case:")
+
+    astroVolume, AstroSmoothingParameterNode, ApplyPushButton = self.setUpSmoothingModule()
+
+    # a second input with other values and blanks (the array axes are Z, Y, X)
+    import numpy
+    astroVolumeLogic = slicer.modules.astrovolume.logic()
+    modelVolume = astroVolumeLogic.CloneAstroVolume(slicer.mrmlScene, astroVolume, None, "_Model_", astroVolume.GetName() + "_Model_1")
+    modelArray = slicer.util.arrayFromVolume(modelVolume)
+    modelArray *= 0.5
+    modelArray[:, 30, 40] = numpy.nan
+    modelArray[41, 30:40, 60:70] = numpy.nan
+    modelVolume.GetImageData().Modified()
+    modelVolume.UpdateRangeAttributes()
+    modelVolume.UpdateDisplayThresholdAttributes()
+
+    logic = slicer.modules.astrosmoothing.logic()
+    passed = True
+    for filterIndex in (0, 1):
+      AstroSmoothingParameterNode.SetFilter(filterIndex)
+      AstroSmoothingParameterNode.SetHardware(0)
+      AstroSmoothingParameterNode.SetAutoRun(False)
+      AstroSmoothingParameterNode.SetParameterX(5.)
+      AstroSmoothingParameterNode.SetParameterY(3.)
+      AstroSmoothingParameterNode.SetParameterZ(3.)
+
+      inputVolumes = vtk.vtkCollection()
+      inputVolumes.AddItem(astroVolume)
+      inputVolumes.AddItem(modelVolume)
+      outputVolumes = vtk.vtkCollection()
+      self.delayDisplay('Generating smoothed datacubes (batch, filter %d)' % filterIndex, 700)
+      if not logic.ApplyBatch(AstroSmoothingParameterNode, inputVolumes, outputVolumes) or \
+         outputVolumes.GetNumberOfItems() != 2:
+        passed = False
+        break
+
+      # each output of the batch equals the single run with the same parameters
+      for volumeCnt in range(2):
+        batchArray = slicer.util.arrayFromVolume(outputVolumes.GetItemAsObject(volumeCnt))
+        AstroSmoothingParameterNode.SetInputVolumeNodeID(inputVolumes.GetItemAsObject(volumeCnt).GetID())
+        logic.ClearCache()
+        self.delayDisplay('Generating smoothed datacube (single, filter %d)' % filterIndex, 700)
+        ApplyPushButton.click()
+        singleArray = self.getOutputArray(AstroSmoothingParameterNode)
+        if batchArray.shape != singleArray.shape or \
+           not numpy.array_equal(numpy.isnan(batchArray), numpy.isnan(singleArray)) or \
+           not numpy.allclose(batchArray, singleArray, rtol=1.e-6, atol=1.e-12, equal_nan=True):
+          passed = False
+
+    if passed:
+       self.delayDisplay('Test passed', 700)
+    else:
+       self.delayDisplay('Test failed', 700)
+       # if run from Slicer interface remove the followinf exit
+       sys.exit()
+
+  def setUpSmoothingModule(self):
+    astroVolume = self.downloadWEIN069()
+
+    mainWindow = slicer.util.mainWindow()
+    mainWindow.moduleSelector().selectModule('AstroVolume')
+    mainWindow.moduleSelector().selectModule('AstroSmoothing')
+
+    astroSmoothingModuleWidget = slicer.modules.astrosmoothing.widgetRepresentation()
+    AstroSmoothingParameterNode = slicer.util.getNode("AstroSmoothingParameters")
+
+    ApplyPushButton = None
+    QPushButtonList = astroSmoothingModuleWidget.findChildren(qt.QPushButton)
+    for QPushButton in (QPushButtonList):
+        if QPushButton.name == "ApplyButton":
+            ApplyPushButton = QPushButton
+
+    return astroVolume, AstroSmoothingParameterNode, ApplyPushButton
+
+  def binnedWCSMatches(self, inputVolume, outputVolume, factors):
+    # NAXIS, CDELT and CRPIX of the binned axes are updated (the output
+    # pixel p is centered on the input pixel (p - 0.5) * factor + 0.5) and
+    # the WCS gives the same world coordinates in both volumes
+    outputDims = outputVolume.GetImageData().GetDimensions()
+    for axis in range(3):
+      key = "SlicerAstro.%s" + str(axis + 1)
+      cdelt = float(inputVolume.GetAttribute(key % "CDELT")) * factors[axis]
+      crpix = (float(inputVolume.GetAttribute(key % "CRPIX")) - 0.5) / factors[axis] + 0.5
+      if int(float(outputVolume.GetAttribute(key % "NAXIS"))) != outputDims[axis] or \
+         math.fabs(float(outputVolume.GetAttribute(key % "CDELT")) - cdelt) > 1.e-9 * math.fabs(cdelt) or \
+         math.fabs(float(outputVolume.GetAttribute(key % "CRPIX")) - crpix) > 1.e-9:
+        return False
+
+    inputDisplay = inputVolume.GetAstroVolumeDisplayNode()
+    outputDisplay = outputVolume.GetAstroVolumeDisplayNode()
+    inputWorld = [0., 0., 0.]
+    outputWorld = [0., 0., 0.]
+    for pixel in (0., 1., 5.):
+      inputIJK = [(pixel - 0.5) * factors[axis] + 0.5 for axis in range(3)]
+      if not inputDisplay.GetReferenceSpace(inputIJK, inputWorld) or \
+         not outputDisplay.GetReferenceSpace([pixel, pixel, pixel], outputWorld):
+        return False
+      for axis in range(3):
+        cdelt = float(inputVolume.GetAttribute("SlicerAstro.CDELT" + str(axis + 1)))
+        if math.fabs(outputWorld[axis] - inputWorld[axis]) > 1.e-6 * math.fabs(cdelt):
+          return False
+
+    return True
+
+  def getOutputArray(self, AstroSmoothingParameterNode):
+    # each run replaces the previous output volume: the data are copied
+    outputVolume = slicer.mrmlScene.GetNodeByID(AstroSmoothingParameterNode.GetOutputVolumeNodeID())
+    return slicer.util.arrayFromVolume(outputVolume).copy()
 
   def downloadWEIN069(self):
     import AstroSampleData
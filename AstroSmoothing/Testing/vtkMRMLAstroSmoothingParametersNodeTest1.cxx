@@ -29,21 +29,28 @@ int vtkMRMLAstroSmoothingParametersNodeTest1(int , char * [] )
 
   TEST_SET_GET_STRING(node1.GetPointer(), InputVolumeNodeID);
   TEST_SET_GET_STRING(node1.GetPointer(), OutputVolumeNodeID);
+  TEST_SET_GET_STRING(node1.GetPointer(), PreviewOutputVolumeNodeID);
+  TEST_SET_GET_STRING(node1.GetPointer(), MaskVolumeNodeID);
   TEST_SET_GET_STRING(node1.GetPointer(), Mode);
   TEST_SET_GET_STRING(node1.GetPointer(), MasksCommand);
+  TEST_SET_GET_STRING(node1.GetPointer(), Region);
 
   TEST_SET_GET_INT(node1.GetPointer(), OutputSerial, 1);
   TEST_SET_GET_INT(node1.GetPointer(), Status, 0);
   TEST_SET_GET_INT(node1.GetPointer(), Filter, 2);
   TEST_SET_GET_INT(node1.GetPointer(), Hardware, 0);
   TEST_SET_GET_INT(node1.GetPointer(), Cores, 0);
+  TEST_SET_GET_INT(node1.GetPointer(), PreviewChannel, -1);
 
   TEST_SET_GET_BOOLEAN(node1.GetPointer(), Link);
   TEST_SET_GET_BOOLEAN(node1.GetPointer(), AutoRun);
+  TEST_SET_GET_BOOLEAN(node1.GetPointer(), CropOutput);
+  TEST_SET_GET_BOOLEAN(node1.GetPointer(), Preview);
 
   TEST_SET_GET_INT(node1.GetPointer(), Accuracy, 20);
 
   TEST_SET_GET_DOUBLE_RANGE(node1.GetPointer(), TimeStep, 0., 10.);
+  TEST_SET_GET_DOUBLE_RANGE(node1.GetPointer(), ConvergenceTolerance, 0., 1.);
   TEST_SET_GET_DOUBLE_RANGE(node1.GetPointer(), K, 0., 10.);
   TEST_SET_GET_DOUBLE_RANGE(node1.GetPointer(), ParameterX, 0., 10.);
   TEST_SET_GET_DOUBLE_RANGE(node1.GetPointer(), ParameterY, 0., 10.);
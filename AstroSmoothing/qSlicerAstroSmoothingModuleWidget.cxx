@@ -79,6 +79,7 @@
 #include <vtkMRMLSelectionNode.h>
 #include <vtkMRMLSegmentationNode.h>
 #include <vtkMRMLSegmentEditorNode.h>
+#include <vtkMRMLSliceNode.h>
 #include <vtkMRMLVolumeNode.h>
 #include <vtkMRMLVolumeRenderingDisplayNode.h>
 
@@ -105,6 +106,7 @@ public:
   vtkSmartPointer<vtkMRMLSelectionNode> selectionNode;
   vtkSmartPointer<vtkMRMLSegmentEditorNode> segmentEditorNode;
   vtkSmartPointer<vtkMRMLCameraNode> cameraNodeOne;
+  vtkSmartPointer<vtkMRMLSliceNode> redSliceNode;
   vtkSmartPointer<vtkParametricEllipsoid> parametricVTKEllipsoid;
   vtkSmartPointer<vtkParametricFunctionSource> parametricFunctionSource;
   vtkSmartPointer<vtkMatrix4x4> transformationMatrix;
@@ -112,6 +114,7 @@ public:
   vtkSmartPointer<vtkPolyDataMapper> mapper;
   vtkSmartPointer<vtkActor> actor;
   double DegToRad;
+  int PreviewChannel;
 
 };
 
@@ -135,6 +138,7 @@ qSlicerAstroSmoothingModuleWidgetPrivate::qSlicerAstroSmoothingModuleWidgetPriva
   this->mapper = vtkSmartPointer<vtkPolyDataMapper>::New();
   this->actor = vtkSmartPointer<vtkActor>::New();
   this->DegToRad = atan(1.) / 45.;
+  this->PreviewChannel = -1;
 }
 
 //-----------------------------------------------------------------------------
@@ -185,6 +189,9 @@ void qSlicerAstroSmoothingModuleWidgetPrivate::init()
   QObject::connect(this->InputVolumeNodeSelector, SIGNAL(currentNodeChanged(bool)),
                    this->AutoRunCheckBox, SLOT(setEnabled(bool)));
 
+  QObject::connect(this->InputVolumeNodeSelector, SIGNAL(currentNodeChanged(bool)),
+                   this->PreviewCheckBox, SLOT(setEnabled(bool)));
+
   QObject::connect(this->ParametersNodeComboBox, SIGNAL(currentNodeChanged(vtkMRMLNode*)),
                    q, SLOT(setMRMLAstroSmoothingParametersNode(vtkMRMLNode*)));
 
@@ -251,6 +258,9 @@ void qSlicerAstroSmoothingModuleWidgetPrivate::init()
   QObject::connect(this->AutoRunCheckBox, SIGNAL(toggled(bool)),
                    q, SLOT(onAutoRunChanged(bool)));
 
+  QObject::connect(this->PreviewCheckBox, SIGNAL(toggled(bool)),
+                   q, SLOT(onPreviewChanged(bool)));
+
   QObject::connect(q, SIGNAL(mrmlSceneChanged(vtkMRMLScene*)),
                    this->SegmentsTableView, SLOT(setMRMLScene(vtkMRMLScene*)));
 
@@ -344,6 +354,8 @@ qSlicerAstroSmoothingModuleWidget::~qSlicerAstroSmoothingModuleWidget()
 //----------------------------------------------------------------------------
 void qSlicerAstroSmoothingModuleWidget::enter()
 {
+  Q_D(qSlicerAstroSmoothingModuleWidget);
+
   this->Superclass::enter();
 
   qSlicerApplication* app = qSlicerApplication::application();
@@ -358,6 +370,16 @@ void qSlicerAstroSmoothingModuleWidget::enter()
 
   app->layoutManager()->layoutLogic()->GetLayoutNode()->SetViewArrangement
           (vtkMRMLLayoutNode::SlicerLayoutDual3DView);
+
+  // the preview follows the channel displayed in the red slice view
+  if (this->mrmlScene())
+    {
+    vtkMRMLSliceNode *redSliceNode = vtkMRMLSliceNode::SafeDownCast
+      (this->mrmlScene()->GetNodeByID("vtkMRMLSliceNodeRed"));
+    this->qvtkReconnect(d->redSliceNode, redSliceNode, vtkCommand::ModifiedEvent,
+                        this, SLOT(onMRMLRedSliceNodeModified()));
+    d->redSliceNode = redSliceNode;
+    }
 }
 
 //----------------------------------------------------------------------------
@@ -997,6 +1019,7 @@ void qSlicerAstroSmoothingModuleWidget::onMRMLAstroSmoothingParametersNodeModifi
   d->HardwareComboBox->setCurrentIndex(d->parametersNode->GetHardware());
 
   d->AutoRunCheckBox->setChecked(d->parametersNode->GetAutoRun());
+  d->PreviewCheckBox->setChecked(d->parametersNode->GetPreview());
   d->LinkCheckBox->setChecked(d->parametersNode->GetLink());
 
   if(status == 0)
@@ -1033,6 +1056,9 @@ void qSlicerAstroSmoothingModuleWidget::onMRMLAstroSmoothingParametersNodeModifi
         d->CDELT2LabelValue->show();
         d->CDELT3Label->show();
         d->CDELT3LabelValue->show();
+        d->SigmaXLabel->show();
+        d->DoubleSpinBoxX->show();
+        d->LinkCheckBox->show();
         d->SigmaYLabel->show();
         d->DoubleSpinBoxY->show();
         d->SigmaZLabel->show();
@@ -1126,6 +1152,9 @@ void qSlicerAstroSmoothingModuleWidget::onMRMLAstroSmoothingParametersNodeModifi
         d->CDELT2LabelValue->show();
         d->CDELT3Label->show();
         d->CDELT3LabelValue->show();
+        d->SigmaXLabel->show();
+        d->DoubleSpinBoxX->show();
+        d->LinkCheckBox->show();
         d->SigmaYLabel->show();
         d->DoubleSpinBoxY->show();
         d->SigmaZLabel->show();
@@ -1368,12 +1397,16 @@ void qSlicerAstroSmoothingModuleWidget::onMRMLAstroSmoothingParametersNodeModifi
         d->LinkCheckBox->setToolTip("Click to link/unlink the conductivity parameters.");
         d->KLabel->show();
         d->KSpinBox->show();
+        d->SigmaXLabel->show();
+        d->DoubleSpinBoxX->show();
+        d->LinkCheckBox->show();
         d->SigmaYLabel->show();
         d->DoubleSpinBoxY->show();
         d->SigmaZLabel->show();
         d->DoubleSpinBoxZ->show();
 
         d->KSpinBox->setValue(d->parametersNode->GetK());
+        d->KSpinBox->setToolTip("");
         d->TimeStepLabel->show();
         d->TimeStepSpinBox->show();
         d->SigmaXLabel->setText("Horizontal Conductance:");
@@ -1441,6 +1474,52 @@ void qSlicerAstroSmoothingModuleWidget::onMRMLAstroSmoothingParametersNodeModifi
         d->TimeStepSpinBox->setMaximum(0.0625);
         break;
         }
+      case 3:
+        {
+        d->OldBeamInfoLabel->hide();
+        d->OldBeamInfoLineEdit->hide();
+        d->NewBeamInfoLabel->hide();
+        d->NewBeamInfoLineEdit->hide();
+        d->AccuracyLabel->show();
+        d->AccuracySpinBox->show();
+        d->AccuracyValueLabel->hide();
+        d->HardwareLabel->hide();
+        d->HardwareComboBox->hide();
+        d->GaussianKernelView->hide();
+        d->RxLabel->hide();
+        d->RxSpinBox->hide();
+        d->RyLabel->hide();
+        d->RySpinBox->hide();
+        d->RzLabel->hide();
+        d->RzSpinBox->hide();
+        d->CDELT1Label->hide();
+        d->CDELT1LabelValue->hide();
+        d->CDELT2Label->hide();
+        d->CDELT2LabelValue->hide();
+        d->CDELT3Label->hide();
+        d->CDELT3LabelValue->hide();
+        d->TimeStepLabel->hide();
+        d->TimeStepSpinBox->hide();
+        d->SigmaXLabel->hide();
+        d->DoubleSpinBoxX->hide();
+        d->SigmaYLabel->hide();
+        d->DoubleSpinBoxY->hide();
+        d->SigmaZLabel->hide();
+        d->DoubleSpinBoxZ->hide();
+        d->LinkCheckBox->hide();
+
+        d->KLabel->show();
+        d->KSpinBox->show();
+        d->KSpinBox->setValue(d->parametersNode->GetK());
+        d->KSpinBox->setToolTip("Threshold of the wavelet coefficients"
+                                " in units of the noise of each scale.");
+        d->AccuracyLabel->setText("Scales:");
+        d->AccuracySpinBox->setSingleStep(1);
+        d->AccuracySpinBox->setMaximum(8);
+        d->AccuracySpinBox->setValue(d->parametersNode->GetAccuracy());
+        d->AccuracySpinBox->setToolTip("Number of wavelet scales.");
+        break;
+        }
       }
     d->parametersNode->SetGaussianKernels();
     }
@@ -1626,6 +1705,13 @@ void qSlicerAstroSmoothingModuleWidget::onCurrentFilterChanged(int index)
     d->parametersNode->SetK(1.5);
     }
 
+  if (index == 3)
+    {
+    d->parametersNode->SetHardware(0);
+    d->parametersNode->SetAccuracy(4);
+    d->parametersNode->SetK(3.);
+    }
+
   d->parametersNode->SetParameterX(5);
   d->parametersNode->SetParameterY(5);
   d->parametersNode->SetParameterZ(5);
@@ -1645,16 +1731,7 @@ void qSlicerAstroSmoothingModuleWidget::onKChanged(double value)
     }
   int wasModifying = d->parametersNode->StartModify();
   d->parametersNode->SetK(value);
-  if (d->parametersNode->GetAutoRun() && d->parametersNode->GetStatus() > 1)
-    {
-    d->parametersNode->SetStatus(-1);
-    }
-  d->parametersNode->EndModify(wasModifying);
-
-  if (d->parametersNode->GetAutoRun() && d->parametersNode->GetStatus() == 0)
-    {
-    this->onApply();
-  }
+  this->endParametersModify(wasModifying);
 }
 
 //-----------------------------------------------------------------------------
@@ -1707,16 +1784,7 @@ void qSlicerAstroSmoothingModuleWidget::onTimeStepChanged(double value)
     }
   int wasModifying = d->parametersNode->StartModify();
   d->parametersNode->SetTimeStep(value);
-  if (d->parametersNode->GetAutoRun() && d->parametersNode->GetStatus() > 1)
-    {
-    d->parametersNode->SetStatus(-1);
-    }
-  d->parametersNode->EndModify(wasModifying);
-
-  if (d->parametersNode->GetAutoRun() && d->parametersNode->GetStatus() == 0)
-    {
-    this->onApply();
-    }
+  this->endParametersModify(wasModifying);
 }
 
 //-----------------------------------------------------------------------------
@@ -1729,16 +1797,7 @@ void qSlicerAstroSmoothingModuleWidget::onRxChanged(double value)
     }
   int wasModifying = d->parametersNode->StartModify();
   d->parametersNode->SetRx(value);
-  if (d->parametersNode->GetAutoRun() && d->parametersNode->GetStatus() > 1)
-    {
-    d->parametersNode->SetStatus(-1);
-    }
-  d->parametersNode->EndModify(wasModifying);
-
-  if (d->parametersNode->GetAutoRun() && d->parametersNode->GetStatus() == 0)
-    {
-    this->onApply();
-    }
+  this->endParametersModify(wasModifying);
 }
 
 //-----------------------------------------------------------------------------
@@ -1751,16 +1810,7 @@ void qSlicerAstroSmoothingModuleWidget::onRyChanged(double value)
     }
   int wasModifying = d->parametersNode->StartModify();
   d->parametersNode->SetRy(value);
-  if (d->parametersNode->GetAutoRun() && d->parametersNode->GetStatus() > 1)
-    {
-    d->parametersNode->SetStatus(-1);
-    }
-  d->parametersNode->EndModify(wasModifying);
-
-  if (d->parametersNode->GetAutoRun() && d->parametersNode->GetStatus() == 0)
-    {
-    this->onApply();
-    }
+  this->endParametersModify(wasModifying);
 }
 
 //-----------------------------------------------------------------------------
@@ -1773,16 +1823,7 @@ void qSlicerAstroSmoothingModuleWidget::onRzChanged(double value)
     }
   int wasModifying = d->parametersNode->StartModify();
   d->parametersNode->SetRz(value);
-  if (d->parametersNode->GetAutoRun() && d->parametersNode->GetStatus() > 1)
-    {
-    d->parametersNode->SetStatus(-1);
-    }
-  d->parametersNode->EndModify(wasModifying);
-
-  if (d->parametersNode->GetAutoRun() && d->parametersNode->GetStatus() == 0)
-    {
-    this->onApply();
-    }
+  this->endParametersModify(wasModifying);
 }
 
 //-----------------------------------------------------------------------------
@@ -1809,16 +1850,7 @@ void qSlicerAstroSmoothingModuleWidget::onParameterXChanged(double value)
     {
     d->parametersNode->SetKernelLengthX(value);
     }
-  if (d->parametersNode->GetAutoRun() && d->parametersNode->GetStatus() > 1)
-    {
-    d->parametersNode->SetStatus(-1);
-    }
-  d->parametersNode->EndModify(wasModifying);
-
-  if (d->parametersNode->GetAutoRun() && d->parametersNode->GetStatus() == 0)
-    {
-    this->onApply();
-    }
+  this->endParametersModify(wasModifying);
 }
 
 //-----------------------------------------------------------------------------
@@ -1845,16 +1877,7 @@ void qSlicerAstroSmoothingModuleWidget::onParameterYChanged(double value)
     {
     d->parametersNode->SetKernelLengthY(value);
     } 
-  if (d->parametersNode->GetAutoRun() && d->parametersNode->GetStatus() > 1)
-    {
-    d->parametersNode->SetStatus(-1);
-    }
-  d->parametersNode->EndModify(wasModifying);
-
-  if (d->parametersNode->GetAutoRun() && d->parametersNode->GetStatus() == 0)
-    {
-    this->onApply();
-    }
+  this->endParametersModify(wasModifying);
 }
 
 //-----------------------------------------------------------------------------
@@ -1881,21 +1904,25 @@ void qSlicerAstroSmoothingModuleWidget::onParameterZChanged(double value)
     {
     d->parametersNode->SetKernelLengthZ(value);
     }
-  if (d->parametersNode->GetAutoRun() && d->parametersNode->GetStatus() > 1)
-    {
-    d->parametersNode->SetStatus(-1);
-    }
-  d->parametersNode->EndModify(wasModifying);
+  this->endParametersModify(wasModifying);
+}
 
-  if (d->parametersNode->GetAutoRun() && d->parametersNode->GetStatus() == 0)
+//-----------------------------------------------------------------------------
+void qSlicerAstroSmoothingModuleWidget::onAccuracyChanged(double value)
+{
+  Q_D(qSlicerAstroSmoothingModuleWidget);
+  if (!d->parametersNode)
     {
-    this->onApply();
+    return;
     }
 
+  int wasModifying = d->parametersNode->StartModify();
+  d->parametersNode->SetAccuracy(value);
+  this->endParametersModify(wasModifying);
 }
 
 //-----------------------------------------------------------------------------
-void qSlicerAstroSmoothingModuleWidget::onAccuracyChanged(double value)
+void qSlicerAstroSmoothingModuleWidget::endParametersModify(int wasModifying)
 {
   Q_D(qSlicerAstroSmoothingModuleWidget);
   if (!d->parametersNode)
@@ -1903,15 +1930,19 @@ void qSlicerAstroSmoothingModuleWidget::onAccuracyChanged(double value)
     return;
     }
 
-  int wasModifying = d->parametersNode->StartModify();
-  d->parametersNode->SetAccuracy(value);
-  if (d->parametersNode->GetAutoRun() && d->parametersNode->GetStatus() > 1)
+  // a running preview (or AutoRun) is computing the old parameters
+  if ((d->parametersNode->GetAutoRun() || d->parametersNode->GetPreview()) &&
+      d->parametersNode->GetStatus() > 1)
     {
     d->parametersNode->SetStatus(-1);
     }
   d->parametersNode->EndModify(wasModifying);
 
-  if (d->parametersNode->GetAutoRun() && d->parametersNode->GetStatus() == 0)
+  if (d->parametersNode->GetPreview() && d->parametersNode->GetStatus() == 0)
+    {
+    this->onPreview();
+    }
+  else if (d->parametersNode->GetAutoRun() && d->parametersNode->GetStatus() == 0)
     {
     this->onApply();
     }
@@ -1919,6 +1950,99 @@ void qSlicerAstroSmoothingModuleWidget::onAccuracyChanged(double value)
 
 //-----------------------------------------------------------------------------
 void qSlicerAstroSmoothingModuleWidget::onApply()
+{
+  this->runSmoothing(-1);
+}
+
+//-----------------------------------------------------------------------------
+void qSlicerAstroSmoothingModuleWidget::onPreview()
+{
+  Q_D(qSlicerAstroSmoothingModuleWidget);
+
+  const int channel = this->displayedChannel();
+  if (channel < 0)
+    {
+    return;
+    }
+
+  d->PreviewChannel = channel;
+  this->runSmoothing(channel);
+}
+
+//-----------------------------------------------------------------------------
+int qSlicerAstroSmoothingModuleWidget::displayedChannel()
+{
+  Q_D(qSlicerAstroSmoothingModuleWidget);
+
+  if (!d->parametersNode || !d->redSliceNode ||
+      !d->redSliceNode->GetSliceToRAS() || !this->mrmlScene())
+    {
+    return -1;
+    }
+
+  vtkMRMLAstroVolumeNode *inputVolume =
+    vtkMRMLAstroVolumeNode::SafeDownCast(this->mrmlScene()->
+      GetNodeByID(d->parametersNode->GetInputVolumeNodeID()));
+  if(!inputVolume || !inputVolume->GetImageData())
+    {
+    return -1;
+    }
+
+  vtkMatrix4x4 *sliceToRAS = d->redSliceNode->GetSliceToRAS();
+  double RAS[4] = {sliceToRAS->GetElement(0, 3),
+                   sliceToRAS->GetElement(1, 3),
+                   sliceToRAS->GetElement(2, 3), 1.};
+  double IJK[4] = {0., 0., 0., 1.};
+  vtkNew<vtkMatrix4x4> RAStoIJKMatrix;
+  inputVolume->GetRASToIJKMatrix(RAStoIJKMatrix.GetPointer());
+  RAStoIJKMatrix->MultiplyPoint(RAS, IJK);
+
+  const int channel = (int) floor(IJK[2] + 0.5);
+  if (channel < 0 || channel >= inputVolume->GetImageData()->GetDimensions()[2])
+    {
+    return -1;
+    }
+
+  return channel;
+}
+
+//-----------------------------------------------------------------------------
+void qSlicerAstroSmoothingModuleWidget::onMRMLRedSliceNodeModified()
+{
+  Q_D(qSlicerAstroSmoothingModuleWidget);
+
+  if (!d->parametersNode || !d->parametersNode->GetPreview() ||
+      d->parametersNode->GetStatus() != 0)
+    {
+    return;
+    }
+
+  if (this->displayedChannel() != d->PreviewChannel)
+    {
+    this->onPreview();
+    }
+}
+
+//-----------------------------------------------------------------------------
+void qSlicerAstroSmoothingModuleWidget::onPreviewChanged(bool value)
+{
+  Q_D(qSlicerAstroSmoothingModuleWidget);
+  if (!d->parametersNode)
+    {
+    return;
+    }
+
+  d->parametersNode->SetPreview(value);
+  d->PreviewChannel = -1;
+
+  if (value && d->parametersNode->GetStatus() == 0)
+    {
+    this->onPreview();
+    }
+}
+
+//-----------------------------------------------------------------------------
+void qSlicerAstroSmoothingModuleWidget::runSmoothing(int previewChannel)
 {
   Q_D(const qSlicerAstroSmoothingModuleWidget);
 
@@ -1971,97 +2095,134 @@ void qSlicerAstroSmoothingModuleWidget::onApply()
     return;
     }
 
-  std::ostringstream outSS;
-  outSS << inputVolume->GetName() << "_Filtered_";
-
-  switch (d->parametersNode->GetFilter())
-    {
-    case 0:
-      {
-      outSS<<"Box";
-      break;
-      }
-    case 1:
-      {
-      outSS<<"Gaussian";
-      break;
-      }
-    case 2:
-      {
-      outSS<<"Gradient";
-      break;
-      }
-    }
-
-  int serial = d->parametersNode->GetOutputSerial();
-  outSS<<"_"<< IntToString(serial);
-  serial++;
-  d->parametersNode->SetOutputSerial(serial);
-
   // Create output volume
   vtkMRMLAstroVolumeNode *outputVolume =
     vtkMRMLAstroVolumeNode::SafeDownCast(scene->
       GetNodeByID(d->parametersNode->GetOutputVolumeNodeID()));
 
-  if (outputVolume)
+  // the preview updates the output created by the previous preview (or
+  // filtering) instead of cloning the input volume at each change of the
+  // parameters
+  bool reuseOutput = false;
+  const char* previewOutputID = d->parametersNode->GetPreviewOutputVolumeNodeID();
+  if (previewChannel >= 0 && outputVolume && outputVolume != inputVolume &&
+      outputVolume->GetImageData() && previewOutputID &&
+      !strcmp(previewOutputID, outputVolume->GetID()))
     {
-    std::string name;
-    name = outputVolume->GetName();
-    if (!name.compare(inputVolume->GetName()))
-      {
-      outputVolume = NULL;
-      }
-    else if (name.find("_Filtered_") != std::string::npos)
+    int inputDims[3], outputDims[3];
+    inputVolume->GetImageData()->GetDimensions(inputDims);
+    outputVolume->GetImageData()->GetDimensions(outputDims);
+    reuseOutput = inputDims[0] == outputDims[0] &&
+                  inputDims[1] == outputDims[1] &&
+                  inputDims[2] == outputDims[2];
+    }
+
+  if (!reuseOutput)
+    {
+    std::ostringstream outSS;
+    outSS << inputVolume->GetName() << "_Filtered_";
+
+    switch (d->parametersNode->GetFilter())
       {
-      vtkMRMLAstroVolumeStorageNode* astroStorage =
-        vtkMRMLAstroVolumeStorageNode::SafeDownCast(outputVolume->GetStorageNode());
-      scene->RemoveNode(astroStorage);
-      scene->RemoveNode(outputVolume->GetDisplayNode());
-
-      vtkMRMLVolumeRenderingDisplayNode *volumeRenderingDisplay =
-        vtkMRMLVolumeRenderingDisplayNode::SafeDownCast(outputVolume->GetDisplayNode());
-      if (volumeRenderingDisplay)
+      case 0:
+        {
+        outSS<<"Box";
+        break;
+        }
+      case 1:
         {
-        scene->RemoveNode(volumeRenderingDisplay->GetROINode());
-        scene->RemoveNode(volumeRenderingDisplay);
+        outSS<<"Gaussian";
+        break;
+        }
+      case 2:
+        {
+        outSS<<"Gradient";
+        break;
+        }
+      case 3:
+        {
+        outSS<<"Wavelet";
+        break;
         }
-      scene->RemoveNode(outputVolume);
       }
-    }
 
-  // Create Astro Volume for the output volume
-  outputVolume = vtkMRMLAstroVolumeNode::SafeDownCast
-     (logic->GetAstroVolumeLogic()->CloneVolume(scene, inputVolume, outSS.str().c_str()));
+    int serial = d->parametersNode->GetOutputSerial();
+    outSS<<"_"<< IntToString(serial);
+    serial++;
+    d->parametersNode->SetOutputSerial(serial);
 
-  d->parametersNode->SetOutputVolumeNodeID(outputVolume->GetID());
-
-  vtkMRMLNode* node = NULL;
-  outputVolume->SetPresetNode(node);
+    if (outputVolume)
+      {
+      std::string name;
+      name = outputVolume->GetName();
+      if (!name.compare(inputVolume->GetName()))
+        {
+        outputVolume = NULL;
+        }
+      else if (name.find("_Filtered_") != std::string::npos)
+        {
+        vtkMRMLAstroVolumeStorageNode* astroStorage =
+          vtkMRMLAstroVolumeStorageNode::SafeDownCast(outputVolume->GetStorageNode());
+        scene->RemoveNode(astroStorage);
+        scene->RemoveNode(outputVolume->GetDisplayNode());
+
+        vtkMRMLVolumeRenderingDisplayNode *volumeRenderingDisplay =
+          vtkMRMLVolumeRenderingDisplayNode::SafeDownCast(outputVolume->GetDisplayNode());
+        if (volumeRenderingDisplay)
+          {
+          scene->RemoveNode(volumeRenderingDisplay->GetROINode());
+          scene->RemoveNode(volumeRenderingDisplay);
+          }
+        scene->RemoveNode(outputVolume);
+        }
+      }
 
-  // Remove old rendering Display
-  int ndnodes = outputVolume->GetNumberOfDisplayNodes();
-  for (int ii = 0; ii < ndnodes; ii++)
-    {
-    vtkMRMLVolumeRenderingDisplayNode *dnode =
-      vtkMRMLVolumeRenderingDisplayNode::SafeDownCast(
-        outputVolume->GetNthDisplayNode(ii));
-    if (dnode)
+    // Create Astro Volume for the output volume.
+    // The filters overwrite the whole output (outside a region smoothed in
+    // place the logic copies the input), unless a single channel is
+    // previewed: only then the input data have to be copied.
+    const bool copyInput = previewChannel >= 0;
+    outputVolume = logic->GetAstroVolumeLogic()->CloneAstroVolume
+       (scene, inputVolume, NULL, "_Filtered_", outSS.str().c_str(),
+        copyInput ? vtkSlicerAstroVolumeLogic::CopyImageData :
+                    vtkSlicerAstroVolumeLogic::AllocateImageData);
+
+    d->parametersNode->SetOutputVolumeNodeID(outputVolume->GetID());
+    d->parametersNode->SetPreviewOutputVolumeNodeID(outputVolume->GetID());
+
+    vtkMRMLNode* node = NULL;
+    outputVolume->SetPresetNode(node);
+
+    // Remove old rendering Display
+    int ndnodes = outputVolume->GetNumberOfDisplayNodes();
+    for (int ii = 0; ii < ndnodes; ii++)
       {
-      outputVolume->RemoveNthDisplayNodeID(ii);
+      vtkMRMLVolumeRenderingDisplayNode *dnode =
+        vtkMRMLVolumeRenderingDisplayNode::SafeDownCast(
+          outputVolume->GetNthDisplayNode(ii));
+      if (dnode)
+        {
+        outputVolume->RemoveNthDisplayNodeID(ii);
+        }
       }
-    }
 
-  vtkNew<vtkMatrix4x4> transformationMatrix;
-  inputVolume->GetRASToIJKMatrix(transformationMatrix.GetPointer());
-  outputVolume->SetRASToIJKMatrix(transformationMatrix.GetPointer());
-  outputVolume->SetAndObserveTransformNodeID(inputVolume->GetTransformNodeID());
+    vtkNew<vtkMatrix4x4> transformationMatrix;
+    inputVolume->GetRASToIJKMatrix(transformationMatrix.GetPointer());
+    outputVolume->SetRASToIJKMatrix(transformationMatrix.GetPointer());
+    outputVolume->SetAndObserveTransformNodeID(inputVolume->GetTransformNodeID());
+    }
 
   // Necessary to guarantee that the renderWindow is initialized
   d->GaussianKernelView->show();
   d->GaussianKernelView->hide();
 
   // Run calculation
-  if (logic->Apply(d->parametersNode, d->GaussianKernelView->renderWindow()))
+  d->parametersNode->SetPreviewChannel(previewChannel);
+  const int success = logic->Apply(d->parametersNode, d->GaussianKernelView->renderWindow());
+  d->parametersNode->SetPreviewChannel(-1);
+
+  // a reused preview output is already shown in the views
+  if (success && !reuseOutput)
     {
     if (!strcmp(d->parametersNode->GetMasksCommand(), "Generate"))
       {
@@ -2075,9 +2236,10 @@ void qSlicerAstroSmoothingModuleWidget::onApply()
           (inputVolume->GetID(), outputVolume->GetID(), false);
       }
     }
-  else
+  else if (!success && !reuseOutput)
     {
-    scene->RemoveNode(outputVolume);
+    d->parametersNode->SetPreviewOutputVolumeNodeID(NULL);
+    logic->GetAstroVolumeLogic()->RemoveAstroVolume(scene, outputVolume);
     inputVolume->SetDisplayVisibility(1);
     }
 
@@ -2143,6 +2305,12 @@ void qSlicerAstroSmoothingModuleWidget::onAutoRunChanged(bool value)
 {
  Q_D(qSlicerAstroSmoothingModuleWidget);
  d->parametersNode->SetAutoRun(value);
+
+ // the cached results are useful only while AutoRun is on
+ if (!value && d->logic())
+   {
+   d->logic()->ClearCache();
+   }
 }
 
 //-----------------------------------------------------------------------------
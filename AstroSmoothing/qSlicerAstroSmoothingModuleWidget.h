@@ -52,6 +52,10 @@ public slots:
   /// It creates the output volume and calls the logic
   void onApply();
 
+  /// Smooth only the channel displayed in the red slice view.
+  /// The output volume of a previous preview is reused
+  void onPreview();
+
 protected:
   QScopedPointer<qSlicerAstroSmoothingModuleWidgetPrivate> d_ptr;
 
@@ -70,6 +74,19 @@ protected:
   /// Initialization of MRML camera nodes
   void initializeCameras();
 
+  /// Create the output volume and run the logic. If previewChannel is
+  /// not negative only that channel is computed
+  void runSmoothing(int previewChannel);
+
+  /// End the modification of the parameter node started by a parameter
+  /// slot: a running preview (or AutoRun) is cancelled and the preview
+  /// (or AutoRun) runs on the new parameters
+  void endParametersModify(int wasModifying);
+
+  /// Channel of the input volume displayed in the red slice view
+  /// \return -1 if the channel is outside the volume
+  int displayedChannel();
+
 protected slots:
 
   /// Set the MRML input node
@@ -103,9 +120,11 @@ protected slots:
   void onMasksCommandChanged();
   void onModeChanged();
   void onMRMLCameraNodeModified();
+  void onMRMLRedSliceNodeModified();
   void onParameterXChanged(double value);
   void onParameterYChanged(double value);
   void onParameterZChanged(double value);
+  void onPreviewChanged(bool value);
   void onRxChanged(double value);
   void onRyChanged(double value);
   void onRzChanged(double value);
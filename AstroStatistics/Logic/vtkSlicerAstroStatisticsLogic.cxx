@@ -23,6 +23,10 @@
 #include "vtkSlicerAstroConfigure.h"
 
 // MRML includes
+#include <vtkAstroCompensatedSum.h>
+#include <vtkAstroIntegralVolume.h>
+#include <vtkAstroProgressToken.h>
+#include <vtkAstroThreadBudget.h>
 #include <vtkMRMLAnnotationROINode.h>
 #include <vtkMRMLAstroLabelMapVolumeDisplayNode.h>
 #include <vtkMRMLAstroLabelMapVolumeNode.h>
@@ -32,24 +36,28 @@
 #include <vtkMRMLTableNode.h>
 
 // VTK includes
+#include <vtkAbstractArray.h>
 #include <vtkArrayData.h>
 #include <vtkCacheManager.h>
 #include <vtkDoubleArray.h>
-#include <vtkFloatArray.h>
 #include <vtkImageData.h>
 #include <vtkIntArray.h>
+#include <vtkMath.h>
 #include <vtkNew.h>
 #include <vtkObjectFactory.h>
 #include <vtkPointData.h>
 #include <vtkSmartPointer.h>
 #include <vtkStringArray.h>
 #include <vtkTable.h>
+#include <vtkVariant.h>
 #include <vtkVersion.h>
 
 // Std includes
 #include <algorithm>
 #include <cassert>
 #include <iostream>
+#include <sstream>
+#include <vector>
 #include <sys/time.h>
 
 // OpenMP includes
@@ -108,6 +116,795 @@ bool FloatIsNaN(float Value)
   return isNaN<float>(Value);
 }
 
+//----------------------------------------------------------------------------
+// Maximum number of segments of a mask with one bit per segment.
+const int MaximumNumberOfMaskSegments = 16;
+
+//----------------------------------------------------------------------------
+// Voxels selected by CalculateStatistics. In segmentation mode the mask labels
+// 1..NumLabels are mapped to the label indices 0..NumLabels-1, or, if MaskBits
+// is set, the bits 0..NumLabels-1 of the mask are the label indices (a voxel
+// can then belong to several labels). In ROI mode the voxels within the x/y
+// IJK extent of the ROI have label index 0 (the z extent is given by the range
+// of elements scanned). GetLabels returns the number of label indices of a voxel.
+struct StatisticsSelection
+{
+  const short* MaskPixel;
+  bool MaskBits;
+  int NumLabels;
+  const int* ROIExtent;
+  int Dim0;
+  int NumSlice;
+
+  int GetLabels(vtkIdType elementCnt, int labels[MaximumNumberOfMaskSegments]) const
+    {
+    if (this->MaskPixel)
+      {
+      const short label = *(this->MaskPixel + elementCnt);
+      if (!this->MaskBits)
+        {
+        labels[0] = label - 1;
+        return (label > 0 && label <= this->NumLabels) ? 1 : 0;
+        }
+      int numVoxelLabels = 0;
+      unsigned int bits = static_cast<unsigned short>(label);
+      for (int bitCnt = 0; bits && bitCnt < this->NumLabels; bitCnt++, bits >>= 1)
+        {
+        if (bits & 1)
+          {
+          labels[numVoxelLabels++] = bitCnt;
+          }
+        }
+      return numVoxelLabels;
+      }
+    const int x = elementCnt % this->Dim0;
+    const int y = (elementCnt % this->NumSlice) / this->Dim0;
+    labels[0] = 0;
+    return (x >= this->ROIExtent[0] && x <= this->ROIExtent[1] &&
+            y >= this->ROIExtent[2] && y <= this->ROIExtent[3]) ? 1 : 0;
+    }
+};
+
+//----------------------------------------------------------------------------
+// Running statistics of one label. Npixels, Mean and M2 are updated with
+// Welford's algorithm and partial results are merged with Chan's formula.
+// The Sum (i.e., the flux) is compensated.
+struct LabelStatistics
+{
+  vtkIdType Npixels;
+  double Min;
+  double Max;
+  vtkAstroCompensatedSum Sum;
+  double Mean;
+  double M2;
+
+  LabelStatistics()
+    : Npixels(0), Min(VTK_DOUBLE_MAX), Max(VTK_DOUBLE_MIN), Mean(0.), M2(0.)
+    {
+    }
+
+  // Set the moments (e.g., read from the integral volume).
+  void SetMoments(vtkIdType npixels, double sum, double m2)
+    {
+    this->Npixels = npixels;
+    this->Sum.Reset();
+    this->Sum.Add(sum);
+    this->Mean = npixels > 0 ? sum / npixels : 0.;
+    this->M2 = m2;
+    }
+
+  void Add(double value)
+    {
+    this->Npixels++;
+    if (value < this->Min)
+      {
+      this->Min = value;
+      }
+    if (value > this->Max)
+      {
+      this->Max = value;
+      }
+    this->Sum.Add(value);
+    const double delta = value - this->Mean;
+    this->Mean += delta / this->Npixels;
+    this->M2 += delta * (value - this->Mean);
+    }
+
+  void Merge(const LabelStatistics& other)
+    {
+    if (other.Npixels == 0)
+      {
+      return;
+      }
+    const double npixels = this->Npixels;
+    const double otherNpixels = other.Npixels;
+    const double delta = other.Mean - this->Mean;
+    this->Mean += delta * otherNpixels / (npixels + otherNpixels);
+    this->M2 += other.M2 + delta * delta * npixels * otherNpixels / (npixels + otherNpixels);
+    this->Npixels += other.Npixels;
+    this->Min = std::min(this->Min, other.Min);
+    this->Max = std::max(this->Max, other.Max);
+    this->Sum.Merge(other.Sum);
+    }
+};
+
+//----------------------------------------------------------------------------
+// Selection of ranks (positions in the sorted values of a label) without
+// copying and sorting the values. Each pass over the data fills per-thread
+// histograms of the value intervals still holding too many values and narrows
+// every interval to the bin containing its ranks. Intervals with at most
+// GatherSize values are copied in the following pass and resolved with
+// std::nth_element. The first pass histograms every label over the whole data
+// range, so that it can run together with the accumulation of the moments,
+// before the number of values (hence the ranks) of the labels is known.
+class RankSelector
+{
+public:
+  enum
+    {
+    NumberOfBins = 1024,
+    GatherSize = 65536,
+    MaxPasses = 8
+    };
+
+  RankSelector(int numLabels, int numThreads, double minValue, double maxValue)
+    : NumLabels(numLabels), NumThreads(numThreads), Passes(0)
+    {
+    for (int labelCnt = 0; labelCnt < numLabels; labelCnt++)
+      {
+      Interval root = {minValue, maxValue, true, 0, false, labelCnt};
+      this->Intervals.push_back(root);
+      }
+    }
+
+  /// Add a rank of a label. Return the index of the rank.
+  int AddRank(int label, vtkIdType rank)
+    {
+    this->Ranks.push_back(rank);
+    this->RankIntervals.push_back(label);
+    this->Values.push_back(this->Intervals[label].Lo);
+    return this->Ranks.size() - 1;
+    }
+
+  /// Value of a rank, once BeginPass() has returned false.
+  double GetValue(int rankIndex) const
+    {
+    return this->Values[rankIndex];
+    }
+
+  /// Prepare the intervals to fill during the next pass.
+  /// Return false when all the ranks have been resolved.
+  bool BeginPass()
+    {
+    this->Active.clear();
+    if (this->Passes == 0)
+      {
+      for (int labelCnt = 0; labelCnt < this->NumLabels; labelCnt++)
+        {
+        if (this->Intervals[labelCnt].Hi > this->Intervals[labelCnt].Lo)
+          {
+          this->Active.push_back(labelCnt);
+          }
+        }
+      }
+    else
+      {
+      for (size_t rankCnt = 0; rankCnt < this->Ranks.size(); rankCnt++)
+        {
+        const int intervalCnt = this->RankIntervals[rankCnt];
+        if (intervalCnt < 0)
+          {
+          continue;
+          }
+        // the intervals left after MaxPasses are narrower
+        // than the data range / NumberOfBins^(MaxPasses - 1)
+        if (this->Intervals[intervalCnt].Hi <= this->Intervals[intervalCnt].Lo ||
+            this->Passes >= MaxPasses)
+          {
+          this->Values[rankCnt] = this->Intervals[intervalCnt].Lo;
+          this->RankIntervals[rankCnt] = -1;
+          continue;
+          }
+        if (std::find(this->Active.begin(), this->Active.end(), intervalCnt) == this->Active.end())
+          {
+          this->Active.push_back(intervalCnt);
+          }
+        }
+      }
+
+    this->LabelSlots.assign(this->NumLabels, std::vector<int>());
+    for (size_t slotCnt = 0; slotCnt < this->Active.size(); slotCnt++)
+      {
+      this->LabelSlots[this->Intervals[this->Active[slotCnt]].Label].push_back(slotCnt);
+      }
+    this->Histograms.assign(this->NumThreads, std::vector<std::vector<vtkIdType> >(this->Active.size()));
+    this->Gathered.assign(this->NumThreads, std::vector<std::vector<double> >(this->Active.size()));
+
+    return !this->Active.empty();
+    }
+
+  /// Add a value of a label. Each thread has to use its own threadCnt.
+  void Add(int threadCnt, int label, double value)
+    {
+    const std::vector<int>& slots = this->LabelSlots[label];
+    for (size_t ii = 0; ii < slots.size(); ii++)
+      {
+      const int slotCnt = slots[ii];
+      const Interval& interval = this->Intervals[this->Active[slotCnt]];
+      if (!interval.Contains(value))
+        {
+        continue;
+        }
+      if (interval.Gather)
+        {
+        this->Gathered[threadCnt][slotCnt].push_back(value);
+        }
+      else
+        {
+        std::vector<vtkIdType>& histogram = this->Histograms[threadCnt][slotCnt];
+        if (histogram.empty())
+          {
+          histogram.assign(NumberOfBins, 0);
+          }
+        histogram[interval.Bin(value)]++;
+        }
+      return;
+      }
+    }
+
+  /// Merge the per-thread data and refine the intervals of the ranks.
+  void EndPass()
+    {
+    for (size_t slotCnt = 0; slotCnt < this->Active.size(); slotCnt++)
+      {
+      const int intervalCnt = this->Active[slotCnt];
+      const Interval interval = this->Intervals[intervalCnt];
+
+      if (interval.Gather)
+        {
+        std::vector<double> values;
+        for (int threadCnt = 0; threadCnt < this->NumThreads; threadCnt++)
+          {
+          const std::vector<double>& threadValues = this->Gathered[threadCnt][slotCnt];
+          values.insert(values.end(), threadValues.begin(), threadValues.end());
+          }
+        for (size_t rankCnt = 0; rankCnt < this->Ranks.size(); rankCnt++)
+          {
+          if (this->RankIntervals[rankCnt] != intervalCnt)
+            {
+            continue;
+            }
+          this->RankIntervals[rankCnt] = -1;
+          if (values.empty())
+            {
+            this->Values[rankCnt] = interval.Lo;
+            continue;
+            }
+          vtkIdType position = this->Ranks[rankCnt] - interval.Below;
+          position = std::max<vtkIdType>(0, std::min<vtkIdType>(position, values.size() - 1));
+          std::nth_element(values.begin(), values.begin() + position, values.end());
+          this->Values[rankCnt] = values[position];
+          }
+        continue;
+        }
+
+      std::vector<vtkIdType> counts(NumberOfBins, 0);
+      for (int threadCnt = 0; threadCnt < this->NumThreads; threadCnt++)
+        {
+        const std::vector<vtkIdType>& histogram = this->Histograms[threadCnt][slotCnt];
+        for (size_t binCnt = 0; binCnt < histogram.size(); binCnt++)
+          {
+          counts[binCnt] += histogram[binCnt];
+          }
+        }
+
+      std::vector<int> children(NumberOfBins, -1);
+      for (size_t rankCnt = 0; rankCnt < this->Ranks.size(); rankCnt++)
+        {
+        if (this->RankIntervals[rankCnt] != intervalCnt)
+          {
+          continue;
+          }
+
+        const vtkIdType position = this->Ranks[rankCnt] - interval.Below;
+        vtkIdType below = 0;
+        int binCnt = 0;
+        for (; binCnt < NumberOfBins - 1; binCnt++)
+          {
+          if (position < below + counts[binCnt])
+            {
+            break;
+            }
+          below += counts[binCnt];
+          }
+
+        if (children[binCnt] < 0)
+          {
+          Interval child;
+          child.Lo = interval.Edge(binCnt);
+          child.Hi = interval.Edge(binCnt + 1);
+          child.Closed = interval.Closed && binCnt == NumberOfBins - 1;
+          child.Below = interval.Below + below;
+          child.Gather = counts[binCnt] <= GatherSize;
+          child.Label = interval.Label;
+          children[binCnt] = this->Intervals.size();
+          this->Intervals.push_back(child);
+          }
+        this->RankIntervals[rankCnt] = children[binCnt];
+        }
+      }
+
+    this->Passes++;
+    }
+
+private:
+  // Value interval of a label: it holds the values Lo <= v < Hi
+  // (Lo <= v <= Hi if Closed), while Below values are lower than Lo.
+  struct Interval
+  {
+    double Lo;
+    double Hi;
+    bool Closed;
+    vtkIdType Below;
+    bool Gather;
+    int Label;
+
+    bool Contains(double value) const
+      {
+      return value >= this->Lo && (value < this->Hi || (this->Closed && value == this->Hi));
+      }
+
+    double Edge(int bin) const
+      {
+      return bin >= NumberOfBins ? this->Hi : this->Lo + (this->Hi - this->Lo) * bin / NumberOfBins;
+      }
+
+    // the bin is checked against the edges, so that the child intervals
+    // contain exactly the values counted in their bin
+    int Bin(double value) const
+      {
+      int bin = static_cast<int>((value - this->Lo) / (this->Hi - this->Lo) * NumberOfBins);
+      bin = std::max(0, std::min(bin, NumberOfBins - 1));
+      while (bin > 0 && value < this->Edge(bin))
+        {
+        bin--;
+        }
+      while (bin < NumberOfBins - 1 && value >= this->Edge(bin + 1))
+        {
+        bin++;
+        }
+      return bin;
+      }
+  };
+
+  int NumLabels;
+  int NumThreads;
+  int Passes;
+  std::vector<Interval> Intervals;
+  std::vector<vtkIdType> Ranks;
+  // interval of each rank, -1 once the rank has been resolved
+  std::vector<int> RankIntervals;
+  std::vector<double> Values;
+  // intervals filled in the current pass and their slots per label
+  std::vector<int> Active;
+  std::vector<std::vector<int> > LabelSlots;
+  std::vector<std::vector<std::vector<vtkIdType> > > Histograms;
+  std::vector<std::vector<std::vector<double> > > Gathered;
+};
+
+//----------------------------------------------------------------------------
+// Pairwise merge of the partial statistics of the chunks (numChunks x
+// numLabels). The merge tree depends only on the number of chunks.
+void MergeChunkStatistics(std::vector<LabelStatistics>& chunkStatistics,
+                          vtkIdType numChunks, int numLabels,
+                          std::vector<LabelStatistics>& statistics)
+{
+  for (vtkIdType stride = 1; stride < numChunks; stride *= 2)
+    {
+    for (vtkIdType chunkCnt = 0; chunkCnt + stride < numChunks; chunkCnt += 2 * stride)
+      {
+      for (int labelCnt = 0; labelCnt < numLabels; labelCnt++)
+        {
+        chunkStatistics[chunkCnt * numLabels + labelCnt].Merge
+          (chunkStatistics[(chunkCnt + stride) * numLabels + labelCnt]);
+        }
+      }
+    }
+
+  statistics.assign(numLabels, LabelStatistics());
+  if (numChunks > 0)
+    {
+    std::copy(chunkStatistics.begin(), chunkStatistics.begin() + numLabels, statistics.begin());
+    }
+}
+
+//----------------------------------------------------------------------------
+// Single pass over the data accumulating the moments, the extrema and the
+// sum of every label, together with the first pass of the rank selection.
+// The data are split in the chunks of vtkAstroCompensatedSum, which depend
+// only on the number of elements: the results are the same whatever the
+// number of threads.
+template <typename T>
+void AccumulateStatistics(const T* inPixel, const StatisticsSelection& selection,
+                          vtkIdType firstElement, vtkIdType lastElement,
+                          std::vector<LabelStatistics>& statistics, RankSelector* selector,
+                          vtkMRMLAstroStatisticsParametersNode* pnode,
+                          vtkAstroProgressToken& progress)
+{
+  const int numLabels = selection.NumLabels;
+  const vtkIdType chunkSize = vtkAstroCompensatedSum::GetChunkSize(lastElement - firstElement);
+  const vtkIdType numChunks = vtkAstroCompensatedSum::GetNumberOfChunks(lastElement - firstElement);
+
+  std::vector<LabelStatistics> chunkStatistics(numChunks * numLabels);
+
+  #ifdef VTK_SLICER_ASTRO_SUPPORT_OPENMP
+  #pragma omp parallel for schedule(static) shared(pnode, progress, chunkStatistics, selector)
+  #endif // VTK_SLICER_ASTRO_SUPPORT_OPENMP
+  for (vtkIdType chunkCnt = 0; chunkCnt < numChunks; chunkCnt++)
+    {
+    int threadCnt = 0;
+    #ifdef VTK_SLICER_ASTRO_SUPPORT_OPENMP
+    threadCnt = omp_get_thread_num();
+    if (threadCnt == 0)
+    #endif // VTK_SLICER_ASTRO_SUPPORT_OPENMP
+      {
+      progress.Synchronize(pnode);
+      }
+    if (progress.IsCancelled())
+      {
+      continue;
+      }
+
+    LabelStatistics *labelStatistics = &chunkStatistics[chunkCnt * numLabels];
+    const vtkIdType firstChunkElement = firstElement + chunkCnt * chunkSize;
+    const vtkIdType lastChunkElement = std::min<vtkIdType>(firstChunkElement + chunkSize, lastElement);
+    int labels[MaximumNumberOfMaskSegments];
+    for (vtkIdType elementCnt = firstChunkElement; elementCnt < lastChunkElement; elementCnt++)
+      {
+      const int numVoxelLabels = selection.GetLabels(elementCnt, labels);
+      if (numVoxelLabels == 0)
+        {
+        continue;
+        }
+
+      const T value = *(inPixel + elementCnt);
+      if (isNaN<T>(value))
+        {
+        continue;
+        }
+
+      for (int labelCnt = 0; labelCnt < numVoxelLabels; labelCnt++)
+        {
+        labelStatistics[labels[labelCnt]].Add(value);
+        if (selector)
+          {
+          selector->Add(threadCnt, labels[labelCnt], value);
+          }
+        }
+      }
+    progress.AddWork(lastChunkElement - firstChunkElement);
+    }
+
+  MergeChunkStatistics(chunkStatistics, numChunks, numLabels, statistics);
+}
+
+//----------------------------------------------------------------------------
+// Further passes of the rank selection, until all the ranks are resolved.
+// If centers is not NULL, the ranks are selected in the absolute deviations
+// of the values from the center of their label (e.g., the median).
+template <typename T>
+void RefineRanks(const T* inPixel, const StatisticsSelection& selection,
+                 vtkIdType firstElement, vtkIdType lastElement,
+                 RankSelector& selector, const double* centers,
+                 vtkMRMLAstroStatisticsParametersNode* pnode,
+                 vtkAstroProgressToken& progress)
+{
+  const vtkIdType blockSize = vtkAstroProgressToken::GetBlockSize();
+  const vtkIdType numBlocks = vtkAstroProgressToken::GetNumberOfBlocks(lastElement - firstElement);
+
+  while (selector.BeginPass())
+    {
+    #ifdef VTK_SLICER_ASTRO_SUPPORT_OPENMP
+    #pragma omp parallel for schedule(static) shared(pnode, progress, selector)
+    #endif // VTK_SLICER_ASTRO_SUPPORT_OPENMP
+    for (vtkIdType blockCnt = 0; blockCnt < numBlocks; blockCnt++)
+      {
+      int threadCnt = 0;
+      #ifdef VTK_SLICER_ASTRO_SUPPORT_OPENMP
+      threadCnt = omp_get_thread_num();
+      if (threadCnt == 0)
+      #endif // VTK_SLICER_ASTRO_SUPPORT_OPENMP
+        {
+        progress.Synchronize(pnode);
+        }
+      if (progress.IsCancelled())
+        {
+        continue;
+        }
+
+      const vtkIdType firstBlockElement = firstElement + blockCnt * blockSize;
+      const vtkIdType lastBlockElement = std::min<vtkIdType>(firstBlockElement + blockSize, lastElement);
+      int labels[MaximumNumberOfMaskSegments];
+      for (vtkIdType elementCnt = firstBlockElement; elementCnt < lastBlockElement; elementCnt++)
+        {
+        const int numVoxelLabels = selection.GetLabels(elementCnt, labels);
+        if (numVoxelLabels == 0)
+          {
+          continue;
+          }
+
+        const T value = *(inPixel + elementCnt);
+        if (isNaN<T>(value))
+          {
+          continue;
+          }
+
+        for (int labelCnt = 0; labelCnt < numVoxelLabels; labelCnt++)
+          {
+          const int label = labels[labelCnt];
+          selector.Add(threadCnt, label, centers ? fabs(value - centers[label]) : value);
+          }
+        }
+      progress.AddWork(lastBlockElement - firstBlockElement);
+      }
+
+    if (progress.IsCancelled())
+      {
+      return;
+      }
+
+    selector.EndPass();
+    }
+}
+
+//----------------------------------------------------------------------------
+// Conversion factor from Jy/beam to Jy of the volume (pixel area over beam
+// area). Return false if the beam or the pixel size are not available.
+bool GetBeamConversion(vtkMRMLAstroVolumeNode* volume, double& unitBeamConv)
+{
+  unitBeamConv = 1.;
+  const char* keywords[] = {"SlicerAstro.BMAJ", "SlicerAstro.BMIN",
+                            "SlicerAstro.CDELT1", "SlicerAstro.CDELT2"};
+  for (int ii = 0; ii < 4; ii++)
+    {
+    const char* value = volume->GetAttribute(keywords[ii]);
+    if (!value || !strcmp(value, "UNDEFINED"))
+      {
+      return false;
+      }
+    }
+
+  double BMAJ = StringToDouble(volume->GetAttribute("SlicerAstro.BMAJ"));
+  double BMIN = StringToDouble(volume->GetAttribute("SlicerAstro.BMIN"));
+  double CDELT1 = StringToDouble(volume->GetAttribute("SlicerAstro.CDELT1"));
+  double CDELT2 = StringToDouble(volume->GetAttribute("SlicerAstro.CDELT2"));
+  unitBeamConv = fabs((CDELT1 * CDELT2) / (1.13 * BMAJ * BMIN));
+  return true;
+}
+
+//----------------------------------------------------------------------------
+// Box of the batch statistics (IJK bounds included).
+struct BatchBox
+{
+  int Extent[6];
+
+  vtkIdType GetNumberOfVoxels() const
+    {
+    vtkIdType numVoxels = 1;
+    for (int axis = 0; axis < 3; axis++)
+      {
+      numVoxels *= std::max(0, this->Extent[2 * axis + 1] - this->Extent[2 * axis] + 1);
+      }
+    return numVoxels;
+    }
+
+  // Clamp the box to the volume; boxes outside the volume become empty.
+  void Clamp(const int dims[3])
+    {
+    for (int axis = 0; axis < 3; axis++)
+      {
+      this->Extent[2 * axis] = std::max(this->Extent[2 * axis], 0);
+      this->Extent[2 * axis + 1] = std::min(this->Extent[2 * axis + 1], dims[axis] - 1);
+      }
+    }
+};
+
+//----------------------------------------------------------------------------
+// Median (interpolated between the closest ranks) and robust RMS
+// (1.4826 x median absolute deviation) of values. The values are reordered.
+void CalculateMedianAndNoise(std::vector<double>& values, double& median, double& noise)
+{
+  const vtkIdType numValues = values.size();
+  const double position = 0.5 * (numValues - 1);
+  const vtkIdType lowerRank = static_cast<vtkIdType>(floor(position));
+  std::nth_element(values.begin(), values.begin() + lowerRank, values.end());
+  const double lowerValue = values[lowerRank];
+  const double upperValue = lowerRank + 1 < numValues ?
+    *std::min_element(values.begin() + lowerRank + 1, values.end()) : lowerValue;
+  median = lowerValue + (position - lowerRank) * (upperValue - lowerValue);
+
+  for (vtkIdType valueCnt = 0; valueCnt < numValues; valueCnt++)
+    {
+    values[valueCnt] = fabs(values[valueCnt] - median);
+    }
+  const vtkIdType rank = numValues / 2;
+  std::nth_element(values.begin(), values.begin() + rank, values.end());
+  // MAD of a Gaussian distribution = 0.6745 sigma
+  noise = 1.4826 * values[rank];
+}
+
+//----------------------------------------------------------------------------
+// Single parallel pass over the boxes: every thread takes whole boxes and
+// scans their voxels, so that the thousands of (small) boxes of a catalog
+// are evaluated without any merge of partial results.
+template <typename T>
+void AccumulateBatchStatistics(const T* inPixel, const int dims[3],
+                               const std::vector<BatchBox>& boxes, bool selectRanks,
+                               std::vector<LabelStatistics>& statistics,
+                               std::vector<double>& medians, std::vector<double>& noises,
+                               vtkMRMLAstroStatisticsParametersNode* pnode,
+                               vtkAstroProgressToken& progress)
+{
+  const int numBoxes = boxes.size();
+  statistics.assign(numBoxes, LabelStatistics());
+  medians.assign(numBoxes, sqrt(-1));
+  noises.assign(numBoxes, sqrt(-1));
+
+  #ifdef VTK_SLICER_ASTRO_SUPPORT_OPENMP
+  #pragma omp parallel shared(pnode, progress, statistics, medians, noises)
+  #endif // VTK_SLICER_ASTRO_SUPPORT_OPENMP
+  {
+  std::vector<double> values;
+
+  #ifdef VTK_SLICER_ASTRO_SUPPORT_OPENMP
+  #pragma omp for schedule(dynamic)
+  #endif // VTK_SLICER_ASTRO_SUPPORT_OPENMP
+  for (int boxCnt = 0; boxCnt < numBoxes; boxCnt++)
+    {
+    #ifdef VTK_SLICER_ASTRO_SUPPORT_OPENMP
+    if (omp_get_thread_num() == 0)
+    #endif // VTK_SLICER_ASTRO_SUPPORT_OPENMP
+      {
+      progress.Synchronize(pnode);
+      }
+    if (progress.IsCancelled())
+      {
+      continue;
+      }
+
+    const int *extent = boxes[boxCnt].Extent;
+    LabelStatistics boxStatistics;
+    values.clear();
+    for (int k = extent[4]; k <= extent[5]; k++)
+      {
+      for (int j = extent[2]; j <= extent[3]; j++)
+        {
+        const T* rowPixel = inPixel + ((vtkIdType) k * dims[1] + j) * dims[0];
+        for (int i = extent[0]; i <= extent[1]; i++)
+          {
+          const T value = *(rowPixel + i);
+          if (isNaN<T>(value))
+            {
+            continue;
+            }
+          boxStatistics.Add(value);
+          if (selectRanks)
+            {
+            values.push_back(value);
+            }
+          }
+        }
+      }
+
+    statistics[boxCnt] = boxStatistics;
+    if (selectRanks && !values.empty())
+      {
+      CalculateMedianAndNoise(values, medians[boxCnt], noises[boxCnt]);
+      }
+    progress.AddWork(boxes[boxCnt].GetNumberOfVoxels());
+    }
+  }
+}
+
+//----------------------------------------------------------------------------
+// Statistics of one channel (blank voxels excluded from the moments).
+// Mean and M2 (sum of the squared deviations from the mean) are updated
+// with the Welford recurrence, which does not lose the precision of the
+// standard deviation when the mean is large compared to it.
+struct ChannelStatistics
+{
+  vtkIdType Npixels;
+  vtkIdType Nblanks;
+  double Min;
+  double Max;
+  double Mean;
+  double M2;
+
+  ChannelStatistics()
+    : Npixels(0), Nblanks(0), Min(VTK_DOUBLE_MAX), Max(VTK_DOUBLE_MIN), Mean(0.), M2(0.)
+    {
+    }
+};
+
+//----------------------------------------------------------------------------
+// Single pass over the cube: every thread owns a contiguous range of
+// channels and scans their planes, so no merge of partial results is needed.
+template <typename T>
+void AccumulateChannelStatistics(const T* inPixel, vtkIdType numSlice, int numChannels,
+                                 std::vector<ChannelStatistics>& statistics,
+                                 vtkMRMLAstroStatisticsParametersNode* pnode,
+                                 vtkAstroProgressToken& progress)
+{
+  statistics.assign(numChannels, ChannelStatistics());
+
+  #ifdef VTK_SLICER_ASTRO_SUPPORT_OPENMP
+  #pragma omp parallel for schedule(static) shared(pnode, progress, statistics)
+  #endif // VTK_SLICER_ASTRO_SUPPORT_OPENMP
+  for (int channelCnt = 0; channelCnt < numChannels; channelCnt++)
+    {
+    #ifdef VTK_SLICER_ASTRO_SUPPORT_OPENMP
+    if (omp_get_thread_num() == 0)
+    #endif // VTK_SLICER_ASTRO_SUPPORT_OPENMP
+      {
+      progress.Synchronize(pnode);
+      }
+    if (progress.IsCancelled())
+      {
+      continue;
+      }
+
+    ChannelStatistics channelStatistics;
+    const T* channelPixel = inPixel + channelCnt * numSlice;
+    for (vtkIdType elementCnt = 0; elementCnt < numSlice; elementCnt++)
+      {
+      const T value = *(channelPixel + elementCnt);
+      if (isNaN<T>(value))
+        {
+        channelStatistics.Nblanks++;
+        continue;
+        }
+      channelStatistics.Npixels++;
+      if (value < channelStatistics.Min)
+        {
+        channelStatistics.Min = value;
+        }
+      if (value > channelStatistics.Max)
+        {
+        channelStatistics.Max = value;
+        }
+      const double delta = value - channelStatistics.Mean;
+      channelStatistics.Mean += delta / channelStatistics.Npixels;
+      channelStatistics.M2 += delta * (value - channelStatistics.Mean);
+      }
+    statistics[channelCnt] = channelStatistics;
+    progress.AddWork(numSlice);
+    }
+}
+
+//----------------------------------------------------------------------------
+// Parse a comma separated list of percentiles, skipping invalid entries.
+void ParsePercentiles(const char* str, std::vector<double>& percentiles)
+{
+  percentiles.clear();
+  if (!str)
+    {
+    return;
+    }
+
+  std::stringstream list(str);
+  std::string item;
+  while (std::getline(list, item, ','))
+    {
+    std::stringstream itemStream(item);
+    double percentile;
+    if (!(itemStream >> percentile) || percentile < 0. || percentile > 100.)
+      {
+      continue;
+      }
+    percentiles.push_back(percentile);
+    }
+}
+
 }// end namespace
 
 //----------------------------------------------------------------------------
@@ -117,15 +914,21 @@ public:
   vtkInternal();
   ~vtkInternal();
 
+  /// Build the integral volume of volume, unless it is already
+  /// built for the current data. Return false if it can not be built.
+  bool UpdateIntegralVolume(vtkMRMLAstroVolumeNode* volume);
+
   vtkSmartPointer<vtkSlicerAstroVolumeLogic> AstroVolumeLogic;
-  vtkSmartPointer<vtkFloatArray> MedianTempArray;
+  vtkAstroIntegralVolume IntegralVolume;
+  std::string IntegralVolumeNodeID;
+  vtkMTimeType IntegralVolumeMTime;
 };
 
 //----------------------------------------------------------------------------
 vtkSlicerAstroStatisticsLogic::vtkInternal::vtkInternal()
 {
   this->AstroVolumeLogic = 0;
-  this->MedianTempArray = vtkSmartPointer<vtkFloatArray>::New();
+  this->IntegralVolumeMTime = 0;
 }
 
 //---------------------------------------------------------------------------
@@ -133,6 +936,35 @@ vtkSlicerAstroStatisticsLogic::vtkInternal::~vtkInternal()
 {
 }
 
+//---------------------------------------------------------------------------
+bool vtkSlicerAstroStatisticsLogic::vtkInternal::UpdateIntegralVolume(vtkMRMLAstroVolumeNode* volume)
+{
+  vtkImageData* imageData = volume->GetImageData();
+  vtkMTimeType dataMTime = imageData->GetMTime();
+  if (imageData->GetPointData() && imageData->GetPointData()->GetScalars())
+    {
+    dataMTime = std::max(dataMTime, imageData->GetPointData()->GetScalars()->GetMTime());
+    }
+
+  if (this->IntegralVolume.IsValid() &&
+      this->IntegralVolumeNodeID == volume->GetID() &&
+      this->IntegralVolumeMTime == dataMTime)
+    {
+    return true;
+    }
+
+  this->IntegralVolumeNodeID.clear();
+  this->IntegralVolumeMTime = 0;
+  if (!this->IntegralVolume.Build(imageData))
+    {
+    return false;
+    }
+
+  this->IntegralVolumeNodeID = volume->GetID();
+  this->IntegralVolumeMTime = dataMTime;
+  return true;
+}
+
 //----------------------------------------------------------------------------
 vtkStandardNewMacro(vtkSlicerAstroStatisticsLogic);
 
@@ -180,6 +1012,12 @@ void vtkSlicerAstroStatisticsLogic::RegisterNodes()
   pNode->Delete();
 }
 
+//----------------------------------------------------------------------------
+int vtkSlicerAstroStatisticsLogic::GetMaximumNumberOfMaskSegments()
+{
+  return MaximumNumberOfMaskSegments;
+}
+
 //----------------------------------------------------------------------------
 bool vtkSlicerAstroStatisticsLogic::CalculateStatistics(vtkMRMLAstroStatisticsParametersNode *pnode)
 {
@@ -204,6 +1042,11 @@ bool vtkSlicerAstroStatisticsLogic::CalculateStatistics(vtkMRMLAstroStatisticsPa
     return false;
     }
 
+  if (!(strcmp(pnode->GetMode(), "Channels")))
+    {
+    return this->CalculateChannelStatistics(pnode);
+    }
+
   vtkMRMLAstroVolumeNode *inputVolume =
     vtkMRMLAstroVolumeNode::SafeDownCast
       (this->GetMRMLScene()->GetNodeByID(pnode->GetInputVolumeNodeID()));
@@ -267,41 +1110,32 @@ bool vtkSlicerAstroStatisticsLogic::CalculateStatistics(vtkMRMLAstroStatisticsPa
     return false;
     }
 
-  double BMAJ = StringToDouble(inputVolume->GetAttribute("SlicerAstro.BMAJ"));
-  double BMIN = StringToDouble(inputVolume->GetAttribute("SlicerAstro.BMIN"));
-  double CDELT1 = StringToDouble(inputVolume->GetAttribute("SlicerAstro.CDELT1"));
-  double CDELT2 = StringToDouble(inputVolume->GetAttribute("SlicerAstro.CDELT2"));
+  // the median is selected together with the percentiles
+  std::vector<double> percentiles;
+  ParsePercentiles(pnode->GetPercentiles(), percentiles);
+  const size_t numPercentiles = percentiles.size();
+  if (pnode->GetMedian())
+    {
+    percentiles.push_back(50.);
+    }
 
   double unitBeamConv = 1.;
-  if (pnode->GetTotalFlux())
+  if (pnode->GetTotalFlux() && !GetBeamConversion(inputVolume, unitBeamConv))
     {
-    if (!strcmp(inputVolume->GetAttribute("SlicerAstro.BMAJ"), "UNDEFINED") ||
-        !strcmp(inputVolume->GetAttribute("SlicerAstro.BMIN"), "UNDEFINED") ||
-        !strcmp(inputVolume->GetAttribute("SlicerAstro.CDELT1"), "UNDEFINED") ||
-        !strcmp(inputVolume->GetAttribute("SlicerAstro.CDELT2"), "UNDEFINED"))
-      {
-      vtkWarningMacro("vtkSlicerAstroStatisticsLogic::CalculateStatistics :"
-                      " Beam or CDELT information are not available."
-                      " The total flux can not be calculated!");
-      pnode->SetTotalFlux(false);
-      }
-    else
-      {
-      unitBeamConv = fabs((CDELT1 * CDELT2) / (1.13 * BMAJ * BMIN));
-      }
+    vtkWarningMacro("vtkSlicerAstroStatisticsLogic::CalculateStatistics :"
+                    " Beam or CDELT information are not available."
+                    " The total flux can not be calculated!");
+    pnode->SetTotalFlux(false);
     }
 
   const int *dims = inputVolume->GetImageData()->GetDimensions();
   const int numComponents = inputVolume->GetImageData()->GetNumberOfScalarComponents();
   const int numSlice = dims[0] * dims[1] * numComponents;
-  int numElements = dims[0] * dims[1] * dims[2] * numComponents;
+  const int numElements = dims[0] * dims[1] * dims[2] * numComponents;
 
   float *inFPixel = NULL;
   double *inDPixel = NULL;
   short *maskPixel = NULL;
-  double Max = inputVolume->GetImageData()->GetScalarTypeMin(), Min = inputVolume->GetImageData()->GetScalarTypeMax();
-  double Mean = 0., Median = 0., Std = 0., Sum = 0., TotalFlux = 0.;
-  int Npixels = 0;
 
   const int DataType = inputVolume->GetImageData()->GetPointData()->GetScalars()->GetDataType();
   switch (DataType)
@@ -317,21 +1151,86 @@ bool vtkSlicerAstroStatisticsLogic::CalculateStatistics(vtkMRMLAstroStatisticsPa
       return false;
     }
 
-  bool cancel = false;
-  int status = 0;
-
-  #ifdef VTK_SLICER_ASTRO_SUPPORT_OPENMP
-  int numProcs = 0;
-  if (pnode->GetCores() == 0)
+  // In segmentation mode every segment of a bit mask, or every non empty
+  // label of a label mask, gets its own row, in ROI mode the whole ROI is
+  // a single selection.
+  StatisticsSelection selection = {NULL, false, 1, NULL, dims[0], numSlice};
+  vtkIdType firstElement = 0, lastElement = numElements;
+  int roiExtent[6];
+  if(segmentationActive)
     {
-    numProcs = omp_get_num_procs();
+    const int *maskDims = maskVolume->GetImageData()->GetDimensions();
+    if (maskVolume->GetImageData()->GetScalarType() != VTK_SHORT ||
+        maskDims[0] != dims[0] || maskDims[1] != dims[1] || maskDims[2] != dims[2])
+      {
+      vtkErrorMacro("vtkSlicerAstroStatisticsLogic::CalculateStatistics :"
+                    " the maskVolume must have short scalars and"
+                    " the dimensions of the inputVolume!");
+      return false;
+      }
+    maskPixel = static_cast<short*> (maskVolume->GetImageData()->GetScalarPointer(0,0,0));
+    selection.MaskPixel = maskPixel;
+    if (pnode->GetNumberOfMaskSegments() > 0)
+      {
+      if (pnode->GetNumberOfMaskSegments() > MaximumNumberOfMaskSegments)
+        {
+        vtkErrorMacro("vtkSlicerAstroStatisticsLogic::CalculateStatistics :"
+                      " the mask can not hold more than "<<MaximumNumberOfMaskSegments<<
+                      " segments!");
+        return false;
+        }
+      selection.MaskBits = true;
+      selection.NumLabels = pnode->GetNumberOfMaskSegments();
+      }
+    else
+      {
+      double labelRange[2];
+      maskVolume->GetImageData()->GetScalarRange(labelRange);
+      selection.NumLabels = std::max(1, static_cast<int>(labelRange[1]));
+      }
     }
   else
     {
-    numProcs = pnode->GetCores();
+    vtkMRMLAnnotationROINode *roiNode = pnode->GetROINode();
+    if(!roiNode)
+      {
+      vtkErrorMacro("vtkSlicerAstroStatisticsLogic::CalculateStatistics :"
+                    " roiNode not found!");
+      return false;
+      }
+
+    // the voxels of the ROI are the voxels within the bounds (included),
+    // for the scan of the data as well as for the integral volume
+    double roiBounds[6];
+    this->GetAstroVolumeLogic()->CalculateROICropVolumeBounds(roiNode, inputVolume, roiBounds);
+    for (int ii = 0; ii < 6; ii += 2)
+      {
+      roiExtent[ii] = (int) ceil(roiBounds[ii]);
+      roiExtent[ii + 1] = (int) floor(roiBounds[ii + 1]);
+      }
+    selection.ROIExtent = roiExtent;
+
+    firstElement = roiExtent[0] + roiExtent[2] * dims[0] +
+                   (vtkIdType) roiExtent[4] * numSlice;
+
+    lastElement = roiExtent[1] + roiExtent[3] * dims[0] +
+                  (vtkIdType) roiExtent[5] * numSlice + 1;
+    if (lastElement <= firstElement)
+      {
+      vtkErrorMacro("vtkSlicerAstroStatisticsLogic::CalculateStatistics :"
+                    " the ROI does not contain any voxel!");
+      return false;
+      }
     }
 
-  omp_set_num_threads(numProcs);
+  const int numLabels = selection.NumLabels;
+  const vtkIdType numSelectionElements = lastElement - firstElement;
+
+  vtkAstroThreadBudget threadBudget(pnode->GetCores());
+
+  int numThreads = 1;
+  #ifdef VTK_SLICER_ASTRO_SUPPORT_OPENMP
+  numThreads = omp_get_max_threads();
   #endif // VTK_SLICER_ASTRO_SUPPORT_OPENMP
 
   struct timeval start, end;
@@ -342,584 +1241,519 @@ bool vtkSlicerAstroStatisticsLogic::CalculateStatistics(vtkMRMLAstroStatisticsPa
 
   pnode->SetStatus(1);
 
-  if(segmentationActive)
+  // In ROI mode the moments can be read in constant time from the integral
+  // volume, which is built at the first calculation on the current data.
+  bool useIntegralVolume = false;
+  if (!segmentationActive && this->CanUseIntegralVolume(pnode))
     {
-    maskPixel = static_cast<short*> (maskVolume->GetImageData()->GetScalarPointer(0,0,0));
-
-    // Calculate Max, Min, NPixels, Sum
-    if (pnode->GetMax() || pnode->GetMin() ||
-        pnode->GetNpixels() || pnode->GetSum() ||
-        pnode->GetMean() || pnode->GetStd() ||
-        pnode->GetTotalFlux() || pnode->GetMedian())
+    useIntegralVolume = this->Internal->UpdateIntegralVolume(inputVolume);
+    if (!useIntegralVolume)
       {
-      #ifdef VTK_SLICER_ASTRO_SUPPORT_OPENMP
-      #pragma omp parallel for schedule(static) shared(pnode, cancel, status) reduction(max : Max), reduction(min : Min), reduction(+:Sum), reduction(+:Npixels)
-      #endif // VTK_SLICER_ASTRO_SUPPORT_OPENMP
-      for (int elementCnt = 0; elementCnt < numElements; elementCnt++)
-        {
-        int stat = pnode->GetStatus();
+      vtkWarningMacro("vtkSlicerAstroStatisticsLogic::CalculateStatistics :"
+                      " unable to build the integral volume (not enough memory?)."
+                      " The voxels of the ROI will be scanned.");
+      }
+    }
 
-        #ifdef VTK_SLICER_ASTRO_SUPPORT_OPENMP
-        if (stat == -1 && omp_get_thread_num() == 0)
-        #else
-        if (stat == -1)
-        #endif // VTK_SLICER_ASTRO_SUPPORT_OPENMP
-          {
-          cancel = true;
-          }
-        #ifdef VTK_SLICER_ASTRO_SUPPORT_OPENMP
-        #pragma omp flush (cancel)
-        #endif // VTK_SLICER_ASTRO_SUPPORT_OPENMP
+  // The first histograms of the rank selection span the data range,
+  // so that they are filled in the same pass of the moments. The Noise
+  // needs the medians of the labels, then the median of the absolute
+  // deviations from them, selected in the same way.
+  double dataRange[2];
+  inputVolume->GetImageData()->GetScalarRange(dataRange);
+  const bool validRange = vtkMath::IsFinite(dataRange[0]) && vtkMath::IsFinite(dataRange[1]);
+  const bool selectNoise = pnode->GetNoise() && validRange;
+  const bool selectRanks = (!percentiles.empty() || selectNoise) && validRange;
+  RankSelector selector(numLabels, numThreads, dataRange[0], dataRange[1]);
+  if (selectRanks)
+    {
+    selector.BeginPass();
+    }
 
-        if (!cancel)
-          {
-          if (*(maskPixel + elementCnt) < 1)
-            {
-            continue;
-            }
+  const int ranksStatus = selectNoise ? 35 : 50;
+  const int noiseStatus = selectNoise ? 65 : 95;
 
-          switch (DataType)
-            {
-            case VTK_FLOAT:
-              if (FloatIsNaN(*(inFPixel + elementCnt)))
-                {
-                continue;
-                }
-              if (*(inFPixel + elementCnt) > Max)
-                {
-                Max = *(inFPixel + elementCnt);
-                }
-              if (*(inFPixel + elementCnt) < Min)
-                {
-                Min = *(inFPixel + elementCnt);
-                }
-              Sum += *(inFPixel + elementCnt);
-              break;
-            case VTK_DOUBLE:
-              if (DoubleIsNaN(*(inDPixel + elementCnt)))
-                {
-                continue;
-                }
-              if (*(inDPixel + elementCnt) > Max)
-                {
-                Max = *(inDPixel + elementCnt);
-                }
-              if (*(inDPixel + elementCnt) < Min)
-                {
-                Min = *(inDPixel + elementCnt);
-                }
-              Sum += *(inDPixel + elementCnt);
-              break;
-            }
-
-          Npixels += 1;
+  // Calculate Npixels, Min, Max, Sum, Mean and Std of all the labels
+  std::vector<LabelStatistics> statistics;
+  vtkAstroProgressToken progress(numSelectionElements, 1, selectRanks ? ranksStatus : 95);
+  if (useIntegralVolume)
+    {
+    vtkIdType Npixels = 0;
+    double sum = 0., M2 = 0.;
+    this->Internal->IntegralVolume.Query(roiExtent, Npixels, sum, M2);
+    statistics.assign(1, LabelStatistics());
+    statistics[0].SetMoments(Npixels, sum, M2);
+    }
+  else
+    {
+    switch (DataType)
+      {
+      case VTK_FLOAT:
+        AccumulateStatistics<float>(inFPixel, selection, firstElement, lastElement,
+                                    statistics, selectRanks ? &selector : NULL, pnode, progress);
+        break;
+      case VTK_DOUBLE:
+        AccumulateStatistics<double>(inDPixel, selection, firstElement, lastElement,
+                                     statistics, selectRanks ? &selector : NULL, pnode, progress);
+        break;
+      }
+    }
+  bool cancel = progress.IsCancelled();
 
-          #ifdef VTK_SLICER_ASTRO_SUPPORT_OPENMP
-          if (omp_get_thread_num() == 0)
-            {
-            if(elementCnt / (numElements / (numProcs * 33.)) > status)
-              {
-              status += 10;
-              pnode->SetStatus(status);
-              }
-            }
-          #else
-          if(elementCnt / (numElements / 33.) > status)
-            {
-            status += 10;
-            pnode->SetStatus(status);
-            }
-          #endif // VTK_SLICER_ASTRO_SUPPORT_OPENMP
-          }
+  // Calculate Median and percentiles of all the labels (and the
+  // medians used by the Noise, as in CalculateMedianAndNoise)
+  std::vector<int> rankIndices(numLabels * percentiles.size() * 2, -1);
+  std::vector<int> centerRankIndices(numLabels * 2, -1);
+  if (selectRanks && !cancel)
+    {
+    for (int labelCnt = 0; labelCnt < numLabels; labelCnt++)
+      {
+      const vtkIdType labelNpixels = statistics[labelCnt].Npixels;
+      if (labelNpixels < 1)
+        {
+        continue;
         }
-
-      if (cancel)
+      if (selectNoise)
+        {
+        const vtkIdType lowerRank = (labelNpixels - 1) / 2;
+        const vtkIdType upperRank = std::min<vtkIdType>(lowerRank + 1, labelNpixels - 1);
+        centerRankIndices[labelCnt * 2] = selector.AddRank(labelCnt, lowerRank);
+        centerRankIndices[labelCnt * 2 + 1] = selector.AddRank(labelCnt, upperRank);
+        }
+      for (size_t percentileCnt = 0; percentileCnt < percentiles.size(); percentileCnt++)
         {
-        inFPixel = NULL;
-        inDPixel = NULL;
-        maskPixel = NULL;
+        const double position = percentiles[percentileCnt] * 0.01 * (labelNpixels - 1);
+        const vtkIdType lowerRank = static_cast<vtkIdType>(floor(position));
+        const vtkIdType upperRank = std::min<vtkIdType>(lowerRank + 1, labelNpixels - 1);
+        const int index = (labelCnt * percentiles.size() + percentileCnt) * 2;
+        rankIndices[index] = selector.AddRank(labelCnt, lowerRank);
+        rankIndices[index + 1] = selector.AddRank(labelCnt, upperRank);
+        }
+      }
+    selector.EndPass();
 
-        delete inFPixel;
-        delete inDPixel;
-        delete maskPixel;
+    vtkAstroProgressToken refineProgress(3 * numSelectionElements, ranksStatus, noiseStatus);
+    switch (DataType)
+      {
+      case VTK_FLOAT:
+        RefineRanks<float>(inFPixel, selection, firstElement, lastElement,
+                           selector, NULL, pnode, refineProgress);
+        break;
+      case VTK_DOUBLE:
+        RefineRanks<double>(inDPixel, selection, firstElement, lastElement,
+                            selector, NULL, pnode, refineProgress);
+        break;
+      }
+    cancel = refineProgress.IsCancelled();
+    }
 
-        return false;
+  // Calculate Noise of all the labels: 1.4826 times the median absolute
+  // deviation from the median, selected for all the labels at once
+  std::vector<double> noises(numLabels, sqrt(-1));
+  if (selectNoise && !cancel)
+    {
+    std::vector<double> centers(numLabels, 0.);
+    double maxDeviation = 0.;
+    for (int labelCnt = 0; labelCnt < numLabels; labelCnt++)
+      {
+      if (centerRankIndices[labelCnt * 2] < 0)
+        {
+        continue;
         }
+      const double position = 0.5 * (statistics[labelCnt].Npixels - 1);
+      const double lowerValue = selector.GetValue(centerRankIndices[labelCnt * 2]);
+      const double upperValue = selector.GetValue(centerRankIndices[labelCnt * 2 + 1]);
+      centers[labelCnt] = lowerValue + (position - floor(position)) * (upperValue - lowerValue);
+      maxDeviation = std::max(maxDeviation, std::max(statistics[labelCnt].Max - centers[labelCnt],
+                                                     centers[labelCnt] - statistics[labelCnt].Min));
       }
 
-    // Calculate Mean
-    if (pnode->GetMean())
+    RankSelector deviationSelector(numLabels, numThreads, 0., maxDeviation);
+    std::vector<int> deviationRankIndices(numLabels, -1);
+    for (int labelCnt = 0; labelCnt < numLabels; labelCnt++)
       {
-      Mean = Sum / Npixels;
+      if (centerRankIndices[labelCnt * 2] >= 0)
+        {
+        deviationRankIndices[labelCnt] =
+          deviationSelector.AddRank(labelCnt, statistics[labelCnt].Npixels / 2);
+        }
       }
 
-    // Calculate TotalFlux
-    if (pnode->GetTotalFlux())
+    vtkAstroProgressToken noiseProgress(3 * numSelectionElements, noiseStatus, 95);
+    switch (DataType)
       {
-      TotalFlux = Sum * unitBeamConv;
+      case VTK_FLOAT:
+        RefineRanks<float>(inFPixel, selection, firstElement, lastElement,
+                           deviationSelector, &centers[0], pnode, noiseProgress);
+        break;
+      case VTK_DOUBLE:
+        RefineRanks<double>(inDPixel, selection, firstElement, lastElement,
+                            deviationSelector, &centers[0], pnode, noiseProgress);
+        break;
       }
+    cancel = noiseProgress.IsCancelled();
 
-    // Calculate Std
-    if (pnode->GetStd())
+    for (int labelCnt = 0; labelCnt < numLabels && !cancel; labelCnt++)
       {
-      #ifdef VTK_SLICER_ASTRO_SUPPORT_OPENMP
-      #pragma omp parallel for schedule(static) shared(pnode, cancel, status) reduction(+:Std)
-      #endif // VTK_SLICER_ASTRO_SUPPORT_OPENMP
-      for (int elementCnt = 0; elementCnt < numElements; elementCnt++)
+      if (deviationRankIndices[labelCnt] >= 0)
         {
-        int stat = pnode->GetStatus();
+        // MAD of a Gaussian distribution = 0.6745 sigma
+        noises[labelCnt] = 1.4826 * deviationSelector.GetValue(deviationRankIndices[labelCnt]);
+        }
+      }
+    }
 
-        #ifdef VTK_SLICER_ASTRO_SUPPORT_OPENMP
-        if (stat == -1 && omp_get_thread_num() == 0)
-        #else
-        if (stat == -1)
-        #endif // VTK_SLICER_ASTRO_SUPPORT_OPENMP
-          {
-          cancel = true;
-          }
-        #ifdef VTK_SLICER_ASTRO_SUPPORT_OPENMP
-        #pragma omp flush (cancel)
-        #endif // VTK_SLICER_ASTRO_SUPPORT_OPENMP
+  pnode->SetStatus(95);
 
-        if (!cancel)
-          {
-          if (*(maskPixel + elementCnt) < 1)
-            {
-            continue;
-            }
+  gettimeofday(&end, NULL);
 
-          switch (DataType)
-            {
-            case VTK_FLOAT:
-              if (FloatIsNaN(*(inFPixel + elementCnt)))
-                {
-                continue;
-                }
-              Std += (*(inFPixel + elementCnt) - Mean) * (*(inFPixel + elementCnt) - Mean);
-              break;
-            case VTK_DOUBLE:
-              if (DoubleIsNaN(*(inDPixel + elementCnt)))
-                {
-                continue;
-                }
-              Std += (*(inDPixel + elementCnt) - Mean) * (*(inDPixel + elementCnt) - Mean);
-              break;
-            }
+  seconds  = end.tv_sec  - start.tv_sec;
+  useconds = end.tv_usec - start.tv_usec;
 
-          #ifdef VTK_SLICER_ASTRO_SUPPORT_OPENMP
-          if (omp_get_thread_num() == 0)
-            {
-            if(33. + (elementCnt / (numElements / (numProcs * 33.))) > status)
-              {
-              status += 10;
-              pnode->SetStatus(status);
-              }
-            }
-          #else
-          if(33. + (elementCnt / (numElements / 33.)) > status)
-            {
-            status += 10;
-            pnode->SetStatus(status);
-            }
-          #endif // VTK_SLICER_ASTRO_SUPPORT_OPENMP
-          }
-        }
+  mtime = ((seconds) * 1000 + useconds/1000.0) + 0.5;
 
-      if (cancel)
-        {
-        inFPixel = NULL;
-        inDPixel = NULL;
-        maskPixel = NULL;
+  vtkDebugMacro("Statistics Kernel Time : "<<mtime<<" ms.");
 
-        delete inFPixel;
-        delete inDPixel;
-        delete maskPixel;
+  inFPixel = NULL;
+  inDPixel = NULL;
+  maskPixel = NULL;
 
-        return false;
-        }
+  delete inFPixel;
+  delete inDPixel;
+  delete maskPixel;
 
-      Std = sqrt(Std / Npixels);
-      }
+  pnode->SetStatus(100);
 
-    // Calculate Median
-    if (pnode->GetMedian())
-      {
-      this->Internal->MedianTempArray->Initialize();
-      this->Internal->MedianTempArray->SetNumberOfValues(Npixels);
+  if (cancel)
+    {
+    return false;
+    }
 
-      float *TempPixel = static_cast<float*> (this->Internal->MedianTempArray->GetPointer(0));
-      int TempCnt = 0;
-      for (int elementCnt = 0; elementCnt < numElements; elementCnt++)
-        {
+  gettimeofday(&start, NULL);
 
-        int status = pnode->GetStatus();
-        if (status < 0)
-          {
-          cancel = true;
-          break;
-          }
+  double NaN = sqrt(-1);
 
-        if (*(maskPixel + elementCnt) < 1)
-          {
-          continue;
-          }
+  std::vector<vtkDoubleArray*> PercentileArrays(numPercentiles);
+  for (size_t percentileCnt = 0; percentileCnt < numPercentiles; percentileCnt++)
+    {
+    std::string columnName = "P" + NumberToString<double>(percentiles[percentileCnt]);
+    PercentileArrays[percentileCnt] = vtkDoubleArray::SafeDownCast
+      (tableNode->GetTable()->GetColumnByName(columnName.c_str()));
+    if (PercentileArrays[percentileCnt])
+      {
+      continue;
+      }
+    vtkNew<vtkDoubleArray> newColumn;
+    newColumn->SetName(columnName.c_str());
+    newColumn->SetNumberOfValues(tableNode->GetNumberOfRows());
+    newColumn->FillComponent(0, NaN);
+    tableNode->AddColumn(newColumn.GetPointer());
+    tableNode->SetColumnUnitLabel(columnName.c_str(), "Jy/beam");
+    std::string longName = NumberToString<double>(percentiles[percentileCnt]) + "th percentile";
+    tableNode->SetColumnLongName(columnName.c_str(), longName.c_str());
+    PercentileArrays[percentileCnt] = newColumn.GetPointer();
+    }
 
-        switch (DataType)
-          {
-          case VTK_FLOAT:
-            if (FloatIsNaN(*(inFPixel + elementCnt)))
-              {
-              continue;
-              }
-            *(TempPixel + TempCnt) = *(inFPixel + elementCnt);
-            break;
-          case VTK_DOUBLE:
-            if (DoubleIsNaN(*(inDPixel + elementCnt)))
-              {
-              continue;
-              }
-            *(TempPixel + TempCnt) = *(inDPixel + elementCnt);
-            break;
-          }
+  vtkDoubleArray* NoiseArray = vtkDoubleArray::SafeDownCast
+    (tableNode->GetTable()->GetColumnByName("Noise"));
+  if (!NoiseArray && pnode->GetNoise())
+    {
+    vtkNew<vtkDoubleArray> newColumn;
+    newColumn->SetName("Noise");
+    newColumn->SetNumberOfValues(tableNode->GetNumberOfRows());
+    newColumn->FillComponent(0, NaN);
+    tableNode->AddColumn(newColumn.GetPointer());
+    tableNode->SetColumnUnitLabel("Noise", "Jy/beam");
+    tableNode->SetColumnLongName("Noise", "Robust RMS (median absolute deviation)");
+    NoiseArray = newColumn.GetPointer();
+    }
+
+  int serial = pnode->GetOutputSerial() - 1;
+  for (int labelCnt = 0; labelCnt < numLabels; labelCnt++)
+    {
+    const LabelStatistics& labelStatistics = statistics[labelCnt];
+    const int Npixels = labelStatistics.Npixels;
+    const bool empty = Npixels < 1;
+
+    // the labels of a label mask may not be contiguous: skip the missing ones
+    if (empty && segmentationActive && !selection.MaskBits)
+      {
+      continue;
+      }
 
-        TempCnt++;
+    tableNode->AddEmptyRow();
+    std::string CellText(inputVolume->GetName());
+    CellText += "_selection_";
+    CellText += IntToString(serial);
+    tableNode->SetCellText(serial, 0, CellText.c_str());
 
-        if(66. + (elementCnt / (numElements / 16.)) > status)
-          {
-          status += 10;
-          pnode->SetStatus(status);
-          }
-        }
+    if (!pnode->GetNpixels())
+      {
+      NpixelsArray->SetValue(serial, NaN);
+      }
+    else
+      {
+      NpixelsArray->SetValue(serial, Npixels);
+      }
 
-      std::sort(TempPixel, TempPixel + Npixels);
+    MinArray->SetValue(serial, (!pnode->GetMin() || empty) ? NaN : labelStatistics.Min);
+    MaxArray->SetValue(serial, (!pnode->GetMax() || empty) ? NaN : labelStatistics.Max);
+    MeanArray->SetValue(serial, (!pnode->GetMean() || empty) ? NaN : labelStatistics.Mean);
+    StdArray->SetValue(serial, (!pnode->GetStd() || empty) ?
+                                 NaN : sqrt(labelStatistics.M2 / Npixels));
+    SumArray->SetValue(serial, !pnode->GetSum() ? NaN : labelStatistics.Sum.GetSum());
+    TotalFluxArray->SetValue(serial, !pnode->GetTotalFlux() ?
+                                       NaN : labelStatistics.Sum.GetSum() * unitBeamConv);
+    if (NoiseArray)
+      {
+      NoiseArray->SetValue(serial, noises[labelCnt]);
+      }
 
-      pnode->SetStatus(95);
+    for (size_t percentileCnt = 0; percentileCnt < percentiles.size(); percentileCnt++)
+      {
+      double value = NaN;
+      const int index = (labelCnt * percentiles.size() + percentileCnt) * 2;
+      if (selectRanks && !empty)
+        {
+        // linear interpolation between the closest ranks
+        const double position = percentiles[percentileCnt] * 0.01 * (Npixels - 1);
+        const double lowerValue = selector.GetValue(rankIndices[index]);
+        const double upperValue = selector.GetValue(rankIndices[index + 1]);
+        value = lowerValue + (position - floor(position)) * (upperValue - lowerValue);
+        }
 
-      if((Npixels) % 2 == 0)
+      if (percentileCnt < numPercentiles)
         {
-        Median = (*(TempPixel + (int) (Npixels * 0.5)) + *(TempPixel + (int) ((Npixels * 0.5) - 1))) * 0.5;
+        PercentileArrays[percentileCnt]->SetValue(serial, value);
         }
       else
         {
-        Median = *(TempPixel + (int) ((Npixels - 1) * 0.5));
+        MedianArray->SetValue(serial, value);
         }
-
-      TempPixel = NULL;
-
-      delete TempPixel;
-
-      this->Internal->MedianTempArray->Initialize();
       }
-    }
-  else
-    {
-    vtkMRMLAnnotationROINode *roiNode = pnode->GetROINode();
-    if(!roiNode)
+
+    if (!pnode->GetMedian())
       {
-      vtkErrorMacro("vtkSlicerAstroStatisticsLogic::CalculateStatistics :"
-                    " roiNode not found!");
-      return false;
+      MedianArray->SetValue(serial, NaN);
       }
 
-    double roiBounds[6];
-    this->GetAstroVolumeLogic()->CalculateROICropVolumeBounds(roiNode, inputVolume, roiBounds);
+    serial++;
+    }
 
-    int firstElement = (roiBounds[0] + roiBounds[2] * dims[0] +
-                       roiBounds[4] * numSlice);
+  pnode->SetOutputSerial(serial + 1);
 
-    int lastElement = (roiBounds[1] + roiBounds[3] * dims[0] +
-                      roiBounds[5] * numSlice) + 1;
+  gettimeofday(&end, NULL);;
 
-    numElements = lastElement - firstElement;
+  seconds  = end.tv_sec  - start.tv_sec;
+  useconds = end.tv_usec - start.tv_usec;
 
-    // Calculate Max, Min, NPixels, Sum
-    if (pnode->GetMax() || pnode->GetMin() ||
-        pnode->GetNpixels() || pnode->GetSum() ||
-        pnode->GetMean() || pnode->GetStd() ||
-        pnode->GetTotalFlux() || pnode->GetMedian())
-      {
-      #ifdef VTK_SLICER_ASTRO_SUPPORT_OPENMP
-      #pragma omp parallel for schedule(static) shared(pnode, cancel, status) reduction(max : Max), reduction(min : Min), reduction(+:Sum), reduction(+:Npixels)
-      #endif // VTK_SLICER_ASTRO_SUPPORT_OPENMP
-      for (int elementCnt = firstElement; elementCnt < lastElement; elementCnt++)
-        {
-        int stat = pnode->GetStatus();
+  mtime = ((seconds) * 1000 + useconds/1000.0) + 0.5;
 
-        #ifdef VTK_SLICER_ASTRO_SUPPORT_OPENMP
-        if (stat == -1 && omp_get_thread_num() == 0)
-        #else
-        if (stat == -1)
-        #endif // VTK_SLICER_ASTRO_SUPPORT_OPENMP
-          {
-          cancel = true;
-          }
-        #ifdef VTK_SLICER_ASTRO_SUPPORT_OPENMP
-        #pragma omp flush (cancel)
-        #endif // VTK_SLICER_ASTRO_SUPPORT_OPENMP
+  vtkDebugMacro("Update Time : "<<mtime<<" ms.");
 
-        if (!cancel)
-          {
-          int ref  = (int) floor(elementCnt / dims[0]);
-          ref *= dims[0];
-          int x = elementCnt - ref;
-          ref = (int) floor(elementCnt / numSlice);
-          ref *= numSlice;
-          ref = elementCnt - ref;
-          int y = (int) floor(ref / dims[0]);
-          if (x < roiBounds[0] || x > roiBounds[1] ||
-              y < roiBounds[2] || y > roiBounds[3])
-            {
-            continue;
-            }
+  return true;
+}
 
-          switch (DataType)
-            {
-            case VTK_FLOAT:
-              if (FloatIsNaN(*(inFPixel + elementCnt)))
-                {
-                continue;
-                }
-              if (*(inFPixel + elementCnt) > Max)
-                {
-                Max = *(inFPixel + elementCnt);
-                }
-              if (*(inFPixel + elementCnt) < Min)
-                {
-                Min = *(inFPixel + elementCnt);
-                }
-              Sum += *(inFPixel + elementCnt);
-              break;
-            case VTK_DOUBLE:
-              if (DoubleIsNaN(*(inDPixel + elementCnt)))
-                {
-                continue;
-                }
-              if (*(inDPixel + elementCnt) > Max)
-                {
-                Max = *(inDPixel + elementCnt);
-                }
-              if (*(inDPixel + elementCnt) < Min)
-                {
-                Min = *(inDPixel + elementCnt);
-                }
-              Sum += *(inDPixel + elementCnt);
-              break;
-            }
+//----------------------------------------------------------------------------
+bool vtkSlicerAstroStatisticsLogic::CalculateBatchStatistics(vtkMRMLAstroStatisticsParametersNode *pnode,
+                                                             vtkMRMLTableNode *boxesTableNode,
+                                                             vtkMRMLTableNode *outputTableNode)
+{
+  if (!pnode)
+    {
+    vtkErrorMacro("vtkSlicerAstroStatisticsLogic::CalculateBatchStatistics : "
+                  "parameterNode not found.");
+    return false;
+    }
 
-          Npixels += 1;
+  if (!this->GetMRMLScene())
+    {
+    vtkErrorMacro("vtkSlicerAstroStatisticsLogic::CalculateBatchStatistics :"
+                  " scene not found.");
+    return false;
+    }
 
-          #ifdef VTK_SLICER_ASTRO_SUPPORT_OPENMP
-          if (omp_get_thread_num() == 0)
-            {
-            if((elementCnt - firstElement) / (numElements / (numProcs * 33.)) > status)
-              {
-              status += 10;
-              pnode->SetStatus(status);
-              }
-            }
-          #else
-          if((elementCnt - firstElement) / (numElements / 33.) > status)
-            {
-            status += 10;
-            pnode->SetStatus(status);
-            }
-          #endif // VTK_SLICER_ASTRO_SUPPORT_OPENMP
-          }
-        }
+  vtkMRMLAstroVolumeNode *inputVolume =
+    vtkMRMLAstroVolumeNode::SafeDownCast
+      (this->GetMRMLScene()->GetNodeByID(pnode->GetInputVolumeNodeID()));
+  if(!inputVolume || !inputVolume->GetImageData())
+    {
+    vtkErrorMacro("vtkSlicerAstroStatisticsLogic::CalculateBatchStatistics :"
+                  " inputVolume not found!");
+    return false;
+    }
 
-      if (cancel)
-        {
-        inFPixel = NULL;
-        inDPixel = NULL;
-        maskPixel = NULL;
+  if (!boxesTableNode || !boxesTableNode->GetTable())
+    {
+    vtkErrorMacro("vtkSlicerAstroStatisticsLogic::CalculateBatchStatistics :"
+                  " boxes tableNode not found!");
+    return false;
+    }
+
+  if (!outputTableNode)
+    {
+    vtkErrorMacro("vtkSlicerAstroStatisticsLogic::CalculateBatchStatistics :"
+                  " output tableNode not found!");
+    return false;
+    }
 
-        delete inFPixel;
-        delete inDPixel;
-        delete maskPixel;
+  const int DataType = inputVolume->GetImageData()->GetPointData()->GetScalars()->GetDataType();
+  if ((DataType != VTK_FLOAT && DataType != VTK_DOUBLE) ||
+      inputVolume->GetImageData()->GetNumberOfScalarComponents() != 1)
+    {
+    vtkErrorMacro("Attempt to allocate scalars of type not allowed");
+    return false;
+    }
 
-        return false;
-        }
-      }
+  int dims[3];
+  inputVolume->GetImageData()->GetDimensions(dims);
+
+  // The boxes are given either in IJK or in world coordinates
+  vtkTable* boxesTable = boxesTableNode->GetTable();
+  const char* ijkColumns[] = {"IMin", "IMax", "JMin", "JMax", "KMin", "KMax"};
+  const char* worldColumns[] = {"X", "Y", "Z", "Width", "Height", "Depth"};
+  vtkAbstractArray* columns[6];
+  bool ijkBoxes = true, worldBoxes = true;
+  for (int ii = 0; ii < 6; ii++)
+    {
+    ijkBoxes = ijkBoxes && boxesTable->GetColumnByName(ijkColumns[ii]);
+    worldBoxes = worldBoxes && boxesTable->GetColumnByName(worldColumns[ii]);
+    }
+  if (!ijkBoxes && !worldBoxes)
+    {
+    vtkErrorMacro("vtkSlicerAstroStatisticsLogic::CalculateBatchStatistics :"
+                  " the boxes table needs the columns IMin, IMax, JMin, JMax, KMin, KMax"
+                  " or the columns X, Y, Z, Width, Height, Depth.");
+    return false;
+    }
+  for (int ii = 0; ii < 6; ii++)
+    {
+    columns[ii] = boxesTable->GetColumnByName(ijkBoxes ? ijkColumns[ii] : worldColumns[ii]);
+    }
+
+  vtkMRMLAstroVolumeDisplayNode* displayNode = inputVolume->GetAstroVolumeDisplayNode();
+  if (!ijkBoxes && !displayNode)
+    {
+    vtkErrorMacro("vtkSlicerAstroStatisticsLogic::CalculateBatchStatistics :"
+                  " display node (WCS) not found!");
+    return false;
+    }
 
-    // Calculate Mean
-    if (pnode->GetMean())
+  const vtkIdType numBoxes = boxesTable->GetNumberOfRows();
+  std::vector<BatchBox> boxes(numBoxes);
+  vtkIdType numBoxesVoxels = 0;
+  for (vtkIdType boxCnt = 0; boxCnt < numBoxes; boxCnt++)
+    {
+    BatchBox& box = boxes[boxCnt];
+    double values[6];
+    bool valid = true;
+    for (int ii = 0; ii < 6; ii++)
       {
-      Mean = Sum / Npixels;
+      bool validValue = false;
+      values[ii] = columns[ii]->GetVariantValue(boxCnt).ToDouble(&validValue);
+      valid = valid && validValue && vtkMath::IsFinite(values[ii]);
       }
 
-    // Calculate TotalFlux
-    if (pnode->GetTotalFlux())
+    if (valid && ijkBoxes)
       {
-      TotalFlux = Sum * unitBeamConv;
+      for (int ii = 0; ii < 6; ii++)
+        {
+        box.Extent[ii] = (int) floor(values[ii] + 0.5);
+        }
       }
-
-    // Calculate Std
-    if (pnode->GetStd())
+    else if (valid)
       {
-      #ifdef VTK_SLICER_ASTRO_SUPPORT_OPENMP
-      #pragma omp parallel for schedule(static) shared(pnode, cancel, status) reduction(+:Std)
-      #endif // VTK_SLICER_ASTRO_SUPPORT_OPENMP
-      for (int elementCnt = firstElement; elementCnt < lastElement; elementCnt++)
+      // the corners of the box, converted to IJK with the WCS
+      double lowerWorld[3], upperWorld[3], lowerIJK[3], upperIJK[3];
+      for (int axis = 0; axis < 3; axis++)
         {
-        int stat = pnode->GetStatus();
-
-        #ifdef VTK_SLICER_ASTRO_SUPPORT_OPENMP
-        if (stat == -1 && omp_get_thread_num() == 0)
-        #else
-        if (stat == -1)
-        #endif // VTK_SLICER_ASTRO_SUPPORT_OPENMP
-          {
-          cancel = true;
-          }
-        #ifdef VTK_SLICER_ASTRO_SUPPORT_OPENMP
-        #pragma omp flush (cancel)
-        #endif // VTK_SLICER_ASTRO_SUPPORT_OPENMP
-
-        if (!cancel)
-          {
-          int ref  = (int) floor(elementCnt / dims[0]);
-          ref *= dims[0];
-          int x = elementCnt - ref;
-          ref = (int) floor(elementCnt / numSlice);
-          ref *= numSlice;
-          ref = elementCnt - ref;
-          int y = (int) floor(ref / dims[0]);
-          if (x < roiBounds[0] || x > roiBounds[1] ||
-              y < roiBounds[2] || y > roiBounds[3])
-            {
-            continue;
-            }
-
-          switch (DataType)
-            {
-            case VTK_FLOAT:
-              if (FloatIsNaN(*(inFPixel + elementCnt)))
-                {
-                continue;
-                }
-              Std += (*(inFPixel + elementCnt) - Mean) * (*(inFPixel + elementCnt) - Mean);
-              break;
-            case VTK_DOUBLE:
-              if (DoubleIsNaN(*(inDPixel + elementCnt)))
-                {
-                continue;
-                }
-              Std += (*(inDPixel + elementCnt) - Mean) * (*(inDPixel + elementCnt) - Mean);
-              break;
-            }
-
-          #ifdef VTK_SLICER_ASTRO_SUPPORT_OPENMP
-          if (omp_get_thread_num() == 0)
-            {
-            if(33. + ((elementCnt - firstElement) / (numElements / (numProcs * 33.))) > status)
-              {
-              status += 10;
-              pnode->SetStatus(status);
-              }
-            }
-          #else
-          if(33. + ((elementCnt - firstElement) / (numElements / 33.)) > status)
-            {
-            status += 10;
-            pnode->SetStatus(status);
-            }
-          #endif // VTK_SLICER_ASTRO_SUPPORT_OPENMP
-          }
+        lowerWorld[axis] = values[axis] - 0.5 * fabs(values[axis + 3]);
+        upperWorld[axis] = values[axis] + 0.5 * fabs(values[axis + 3]);
         }
-
-      if (cancel)
+      valid = displayNode->GetIJKSpace(lowerWorld, lowerIJK) &&
+              displayNode->GetIJKSpace(upperWorld, upperIJK);
+      for (int axis = 0; axis < 3 && valid; axis++)
         {
-        inFPixel = NULL;
-        inDPixel = NULL;
-        maskPixel = NULL;
-
-        delete inFPixel;
-        delete inDPixel;
-        delete maskPixel;
-
-        return false;
+        box.Extent[2 * axis] = (int) floor(std::min(lowerIJK[axis], upperIJK[axis]) + 0.5);
+        box.Extent[2 * axis + 1] = (int) floor(std::max(lowerIJK[axis], upperIJK[axis]) + 0.5);
         }
-
-      Std = sqrt(Std / Npixels);
       }
 
-    // Calculate Median
-    if (pnode->GetMedian())
+    if (!valid)
       {
-      this->Internal->MedianTempArray->Initialize();
-      this->Internal->MedianTempArray->SetNumberOfValues(Npixels);
-
-      float *TempPixel = static_cast<float*> (this->Internal->MedianTempArray->GetPointer(0));
-      int TempCnt = 0;
-      for (int elementCnt = firstElement; elementCnt < lastElement; elementCnt++)
-        {
-        int status = pnode->GetStatus();
-        if (status < 0)
-          {
-          cancel = true;
-          break;
-          }
-
-        int ref  = (int) floor(elementCnt / dims[0]);
-        ref *= dims[0];
-        int x = elementCnt - ref;
-        ref = (int) floor(elementCnt / numSlice);
-        ref *= numSlice;
-        ref = elementCnt - ref;
-        int y = (int) floor(ref / dims[0]);
-        if (x < roiBounds[0] || x > roiBounds[1] ||
-            y < roiBounds[2] || y > roiBounds[3])
-          {
-          continue;
-          }
-
-        switch (DataType)
-          {
-          case VTK_FLOAT:
-            if (FloatIsNaN(*(inFPixel + elementCnt)))
-              {
-              continue;
-              }
-            *(TempPixel + TempCnt) = *(inFPixel + elementCnt);
-            break;
-          case VTK_DOUBLE:
-            if (DoubleIsNaN(*(inDPixel + elementCnt)))
-              {
-              continue;
-              }
-            *(TempPixel + TempCnt) = *(inDPixel + elementCnt);
-            break;
-          }
+      vtkWarningMacro("vtkSlicerAstroStatisticsLogic::CalculateBatchStatistics :"
+                      " invalid box at row "<<boxCnt<<".");
+      box.Extent[0] = box.Extent[2] = box.Extent[4] = 0;
+      box.Extent[1] = box.Extent[3] = box.Extent[5] = -1;
+      }
+    box.Clamp(dims);
+    numBoxesVoxels += box.GetNumberOfVoxels();
+    }
 
-        TempCnt++;
+  // the parameter node is left untouched: the total flux is only
+  // skipped in this run
+  double unitBeamConv = 1.;
+  bool totalFlux = pnode->GetTotalFlux();
+  if (totalFlux && !GetBeamConversion(inputVolume, unitBeamConv))
+    {
+    vtkWarningMacro("vtkSlicerAstroStatisticsLogic::CalculateBatchStatistics :"
+                    " Beam or CDELT information are not available."
+                    " The total flux can not be calculated!");
+    totalFlux = false;
+    }
 
-        if(66. + ((elementCnt - firstElement) / (numElements / 16.)) > status)
-          {
-          status += 10;
-          pnode->SetStatus(status);
-          }
-        }
+  vtkAstroThreadBudget threadBudget(pnode->GetCores());
 
-      std::sort(TempPixel, TempPixel + Npixels);
+  struct timeval start, end;
 
-      pnode->SetStatus(95);
+  long mtime, seconds, useconds;
 
-      if((Npixels) % 2 == 0)
-        {
-        Median = (*(TempPixel + (int) (Npixels * 0.5)) + *(TempPixel + (int) ((Npixels * 0.5) - 1))) * 0.5;
-        }
-      else
-        {
-        Median = *(TempPixel + (int) ((Npixels - 1) * 0.5));
-        }
+  gettimeofday(&start, NULL);
 
-      TempPixel = NULL;
+  pnode->SetStatus(1);
 
-      delete TempPixel;
+  // The integral volume gives the moments of each box in constant time
+  // (the median and the noise need the values of the voxels).
+  const bool selectRanks = pnode->GetMedian() || pnode->GetNoise();
+  bool useIntegralVolume = false;
+  if (pnode->GetIntegralVolume() && !selectRanks && !pnode->GetMin() && !pnode->GetMax())
+    {
+    useIntegralVolume = this->Internal->UpdateIntegralVolume(inputVolume);
+    }
 
-      this->Internal->MedianTempArray->Initialize();
+  std::vector<LabelStatistics> statistics;
+  std::vector<double> medians, noises;
+  vtkAstroProgressToken progress(numBoxesVoxels, 1, 95);
+  if (useIntegralVolume)
+    {
+    statistics.assign(numBoxes, LabelStatistics());
+    for (vtkIdType boxCnt = 0; boxCnt < numBoxes; boxCnt++)
+      {
+      vtkIdType Npixels = 0;
+      double sum = 0., M2 = 0.;
+      this->Internal->IntegralVolume.Query(boxes[boxCnt].Extent, Npixels, sum, M2);
+      statistics[boxCnt].SetMoments(Npixels, sum, M2);
+      }
+    medians.assign(numBoxes, sqrt(-1));
+    noises.assign(numBoxes, sqrt(-1));
+    }
+  else
+    {
+    switch (DataType)
+      {
+      case VTK_FLOAT:
+        AccumulateBatchStatistics<float>(static_cast<float*> (inputVolume->GetImageData()->GetScalarPointer(0,0,0)),
+                                         dims, boxes, selectRanks, statistics, medians, noises,
+                                         pnode, progress);
+        break;
+      case VTK_DOUBLE:
+        AccumulateBatchStatistics<double>(static_cast<double*> (inputVolume->GetImageData()->GetScalarPointer(0,0,0)),
+                                          dims, boxes, selectRanks, statistics, medians, noises,
+                                          pnode, progress);
+        break;
       }
     }
+  bool cancel = progress.IsCancelled();
 
   gettimeofday(&end, NULL);
 
@@ -928,15 +1762,7 @@ bool vtkSlicerAstroStatisticsLogic::CalculateStatistics(vtkMRMLAstroStatisticsPa
 
   mtime = ((seconds) * 1000 + useconds/1000.0) + 0.5;
 
-  vtkDebugMacro("Statistics Kernel Time : "<<mtime<<" ms.");
-
-  inFPixel = NULL;
-  inDPixel = NULL;
-  maskPixel = NULL;
-
-  delete inFPixel;
-  delete inDPixel;
-  delete maskPixel;
+  vtkDebugMacro("Batch Statistics Kernel Time : "<<mtime<<" ms.");
 
   pnode->SetStatus(100);
 
@@ -945,78 +1771,256 @@ bool vtkSlicerAstroStatisticsLogic::CalculateStatistics(vtkMRMLAstroStatisticsPa
     return false;
     }
 
-  gettimeofday(&start, NULL);
-
   double NaN = sqrt(-1);
-  int serial = pnode->GetOutputSerial() - 1;
-  tableNode->AddEmptyRow();
-  std::string CellText(inputVolume->GetName());
-  CellText += "_selection_";
-  CellText += IntToString(serial);
-  tableNode->SetCellText(serial, 0, CellText.c_str());
 
-  if (!pnode->GetNpixels())
+  // optional names of the boxes (e.g. the catalog names of the sources)
+  vtkAbstractArray* NameArray = boxesTable->GetColumnByName("Name");
+
+  int wasModifying = outputTableNode->StartModify();
+  if (!outputTableNode->GetTable())
     {
-    NpixelsArray->SetValue(serial, NaN);
+    vtkNew<vtkTable> table;
+    outputTableNode->SetAndObserveTable(table.GetPointer());
     }
-  else
+  outputTableNode->RemoveAllColumns();
+  outputTableNode->SetUseColumnNameAsColumnHeader(true);
+
+  vtkNew<vtkStringArray> SelectionArray;
+  SelectionArray->SetName("Selection");
+  SelectionArray->SetNumberOfValues(numBoxes);
+  vtkNew<vtkIntArray> NpixelsArray;
+  NpixelsArray->SetName("Npixels");
+  NpixelsArray->SetNumberOfValues(numBoxes);
+
+  const char* names[] = {"Min", "Max", "Mean", "Std", "Median", "Sum", "TotalFlux", "Noise"};
+  const char* longNames[] = {"Minimum", "Maximum", "Mean", "Standard deviation", "Median",
+                             "Sum", "Total flux", "Robust RMS (median absolute deviation)"};
+  const char* units[] = {"Jy/beam", "Jy/beam", "Jy/beam", "Jy/beam", "Jy/beam",
+                         "Jy/beam", "Jy", "Jy/beam"};
+  const bool enabled[] = {pnode->GetMin(), pnode->GetMax(), pnode->GetMean(), pnode->GetStd(),
+                          pnode->GetMedian(), pnode->GetSum(), totalFlux, pnode->GetNoise()};
+  vtkSmartPointer<vtkDoubleArray> arrays[8];
+  for (int ii = 0; ii < 8; ii++)
+    {
+    arrays[ii] = vtkSmartPointer<vtkDoubleArray>::New();
+    arrays[ii]->SetName(names[ii]);
+    arrays[ii]->SetNumberOfValues(numBoxes);
+    }
+
+  for (vtkIdType boxCnt = 0; boxCnt < numBoxes; boxCnt++)
     {
-    NpixelsArray->SetValue(serial, Npixels);
+    const LabelStatistics& boxStatistics = statistics[boxCnt];
+    const vtkIdType Npixels = boxStatistics.Npixels;
+    const bool empty = Npixels < 1;
+
+    std::string CellText;
+    if (NameArray)
+      {
+      CellText = NameArray->GetVariantValue(boxCnt).ToString();
+      }
+    if (CellText.empty())
+      {
+      CellText = inputVolume->GetName();
+      CellText += "_box_";
+      CellText += IntToString(boxCnt + 1);
+      }
+    SelectionArray->SetValue(boxCnt, CellText.c_str());
+    NpixelsArray->SetValue(boxCnt, Npixels);
+
+    const double values[] = {boxStatistics.Min, boxStatistics.Max, boxStatistics.Mean,
+                             empty ? NaN : sqrt(boxStatistics.M2 / Npixels),
+                             medians[boxCnt], boxStatistics.Sum.GetSum(),
+                             boxStatistics.Sum.GetSum() * unitBeamConv, noises[boxCnt]};
+    for (int ii = 0; ii < 8; ii++)
+      {
+      arrays[ii]->SetValue(boxCnt, (!enabled[ii] || empty) ? NaN : values[ii]);
+      }
     }
 
-  if (!pnode->GetMin())
+  outputTableNode->AddColumn(SelectionArray.GetPointer());
+  outputTableNode->SetColumnLongName("Selection", "Selection");
+  outputTableNode->AddColumn(NpixelsArray.GetPointer());
+  outputTableNode->SetColumnLongName("Npixels", "Number of pixels");
+  for (int ii = 0; ii < 8; ii++)
     {
-    Min = NaN;
+    outputTableNode->AddColumn(arrays[ii]);
+    outputTableNode->SetColumnUnitLabel(names[ii], units[ii]);
+    outputTableNode->SetColumnLongName(names[ii], longNames[ii]);
     }
-  MinArray->SetValue(serial, Min);
+  outputTableNode->EndModify(wasModifying);
+
+  return true;
+}
 
-  if (!pnode->GetMax())
+//----------------------------------------------------------------------------
+bool vtkSlicerAstroStatisticsLogic::CanUseIntegralVolume(vtkMRMLAstroStatisticsParametersNode *pnode)
+{
+  if (!pnode || !pnode->GetIntegralVolume() || !pnode->GetMode() ||
+      strcmp(pnode->GetMode(), "ROI"))
     {
-    Max = NaN;
+    return false;
     }
-  MaxArray->SetValue(serial, Max);
 
-  if (!pnode->GetMean())
+  // the extrema, the ranks and the noise need the values of the voxels
+  std::vector<double> percentiles;
+  ParsePercentiles(pnode->GetPercentiles(), percentiles);
+  return !pnode->GetMin() && !pnode->GetMax() && !pnode->GetMedian() &&
+         !pnode->GetNoise() && percentiles.empty();
+}
+
+//----------------------------------------------------------------------------
+bool vtkSlicerAstroStatisticsLogic::CalculateChannelStatistics(vtkMRMLAstroStatisticsParametersNode *pnode)
+{
+  if (!pnode)
     {
-    Mean = NaN;
+    vtkErrorMacro("vtkSlicerAstroStatisticsLogic::CalculateChannelStatistics : "
+                  "parameterNode not found.");
+    return false;
     }
-  MeanArray->SetValue(serial, Mean);
 
-  if (!pnode->GetStd())
+  if (!this->GetMRMLScene())
     {
-    Std = NaN;
+    vtkErrorMacro("vtkSlicerAstroStatisticsLogic::CalculateChannelStatistics :"
+                  " scene not found.");
+    return false;
     }
-  StdArray->SetValue(serial, Std);
 
-  if (!pnode->GetMedian())
+  vtkMRMLAstroVolumeNode *inputVolume =
+    vtkMRMLAstroVolumeNode::SafeDownCast
+      (this->GetMRMLScene()->GetNodeByID(pnode->GetInputVolumeNodeID()));
+  if(!inputVolume || !inputVolume->GetImageData())
     {
-    Median = NaN;
+    vtkErrorMacro("vtkSlicerAstroStatisticsLogic::CalculateChannelStatistics :"
+                  " inputVolume not found!");
+    return false;
     }
-  MedianArray->SetValue(serial, Median);
 
-  if (!pnode->GetSum())
+  vtkMRMLTableNode* tableNode = pnode->GetChannelTableNode();
+  if(!tableNode)
     {
-    Sum = NaN;
+    vtkErrorMacro("vtkSlicerAstroStatisticsLogic::CalculateChannelStatistics :"
+                  " channel tableNode not found!");
+    return false;
     }
-  SumArray->SetValue(serial, Sum);
 
-  if (!pnode->GetTotalFlux())
+  const int *dims = inputVolume->GetImageData()->GetDimensions();
+  const int numComponents = inputVolume->GetImageData()->GetNumberOfScalarComponents();
+  const vtkIdType numSlice = (vtkIdType) dims[0] * dims[1] * numComponents;
+  const int numChannels = dims[2];
+
+  const int DataType = inputVolume->GetImageData()->GetPointData()->GetScalars()->GetDataType();
+  if (DataType != VTK_FLOAT && DataType != VTK_DOUBLE)
     {
-    TotalFlux = NaN;
+    vtkErrorMacro("Attempt to allocate scalars of type not allowed");
+    return false;
     }
-  TotalFluxArray->SetValue(serial, TotalFlux);
 
-  serial++;
-  pnode->SetOutputSerial(serial + 1);
+  vtkAstroThreadBudget threadBudget(pnode->GetCores());
 
-  gettimeofday(&end, NULL);;
+  struct timeval start, end;
+
+  long mtime, seconds, useconds;
+
+  gettimeofday(&start, NULL);
+
+  pnode->SetStatus(1);
+
+  std::vector<ChannelStatistics> statistics;
+  vtkAstroProgressToken progress(numSlice * numChannels, 1, 95);
+  switch (DataType)
+    {
+    case VTK_FLOAT:
+      AccumulateChannelStatistics<float>(static_cast<float*> (inputVolume->GetImageData()->GetScalarPointer(0,0,0)),
+                                         numSlice, numChannels, statistics, pnode, progress);
+      break;
+    case VTK_DOUBLE:
+      AccumulateChannelStatistics<double>(static_cast<double*> (inputVolume->GetImageData()->GetScalarPointer(0,0,0)),
+                                          numSlice, numChannels, statistics, pnode, progress);
+      break;
+    }
+  bool cancel = progress.IsCancelled();
+
+  gettimeofday(&end, NULL);
 
   seconds  = end.tv_sec  - start.tv_sec;
   useconds = end.tv_usec - start.tv_usec;
 
   mtime = ((seconds) * 1000 + useconds/1000.0) + 0.5;
 
-  vtkDebugMacro("Update Time : "<<mtime<<" ms.");
+  vtkDebugMacro("Channel Statistics Kernel Time : "<<mtime<<" ms.");
+
+  pnode->SetStatus(100);
+
+  if (cancel)
+    {
+    return false;
+    }
+
+  double NaN = sqrt(-1);
+
+  int wasModifying = tableNode->StartModify();
+  if (!tableNode->GetTable())
+    {
+    vtkNew<vtkTable> table;
+    tableNode->SetAndObserveTable(table.GetPointer());
+    }
+  tableNode->RemoveAllColumns();
+  tableNode->SetUseColumnNameAsColumnHeader(true);
+
+  vtkNew<vtkIntArray> ChannelArray;
+  ChannelArray->SetName("Channel");
+  vtkNew<vtkDoubleArray> MinArray;
+  MinArray->SetName("Min");
+  vtkNew<vtkDoubleArray> MaxArray;
+  MaxArray->SetName("Max");
+  vtkNew<vtkDoubleArray> MeanArray;
+  MeanArray->SetName("Mean");
+  vtkNew<vtkDoubleArray> RMSArray;
+  RMSArray->SetName("RMS");
+  vtkNew<vtkDoubleArray> BlankFractionArray;
+  BlankFractionArray->SetName("BlankFraction");
+
+  ChannelArray->SetNumberOfValues(numChannels);
+  MinArray->SetNumberOfValues(numChannels);
+  MaxArray->SetNumberOfValues(numChannels);
+  MeanArray->SetNumberOfValues(numChannels);
+  RMSArray->SetNumberOfValues(numChannels);
+  BlankFractionArray->SetNumberOfValues(numChannels);
+
+  for (int channelCnt = 0; channelCnt < numChannels; channelCnt++)
+    {
+    const ChannelStatistics& channelStatistics = statistics[channelCnt];
+    const vtkIdType Npixels = channelStatistics.Npixels;
+    const bool empty = Npixels < 1;
+
+    ChannelArray->SetValue(channelCnt, channelCnt);
+    MinArray->SetValue(channelCnt, empty ? NaN : channelStatistics.Min);
+    MaxArray->SetValue(channelCnt, empty ? NaN : channelStatistics.Max);
+    MeanArray->SetValue(channelCnt, empty ? NaN : channelStatistics.Mean);
+    RMSArray->SetValue(channelCnt, empty ? NaN : sqrt(channelStatistics.M2 / Npixels));
+    BlankFractionArray->SetValue(channelCnt, numSlice > 0 ?
+                                   (double) channelStatistics.Nblanks / numSlice : NaN);
+    }
+
+  tableNode->AddColumn(ChannelArray.GetPointer());
+  tableNode->SetColumnUnitLabel("Channel", "");
+  tableNode->SetColumnLongName("Channel", "Channel");
+  tableNode->AddColumn(MinArray.GetPointer());
+  tableNode->SetColumnUnitLabel("Min", "Jy/beam");
+  tableNode->SetColumnLongName("Min", "Minimum");
+  tableNode->AddColumn(MaxArray.GetPointer());
+  tableNode->SetColumnUnitLabel("Max", "Jy/beam");
+  tableNode->SetColumnLongName("Max", "Maximum");
+  tableNode->AddColumn(MeanArray.GetPointer());
+  tableNode->SetColumnUnitLabel("Mean", "Jy/beam");
+  tableNode->SetColumnLongName("Mean", "Mean");
+  tableNode->AddColumn(RMSArray.GetPointer());
+  tableNode->SetColumnUnitLabel("RMS", "Jy/beam");
+  tableNode->SetColumnLongName("RMS", "Standard deviation");
+  tableNode->AddColumn(BlankFractionArray.GetPointer());
+  tableNode->SetColumnUnitLabel("BlankFraction", "");
+  tableNode->SetColumnLongName("BlankFraction", "Fraction of blank pixels");
+  tableNode->EndModify(wasModifying);
 
   return true;
 }
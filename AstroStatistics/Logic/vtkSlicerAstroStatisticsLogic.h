@@ -28,6 +28,7 @@ class vtkSlicerAstroVolumeLogic;
 // AstroStatisticss includes
 #include "vtkSlicerAstroStatisticsModuleLogicExport.h"
 class vtkMRMLAstroStatisticsParametersNode;
+class vtkMRMLTableNode;
 
 /// \class vtkSlicerAstroStatisticsLogic
 /// \brief Calculate statistics given selection (ROI or segmentation).
@@ -52,11 +53,50 @@ public:
   /// Gets called automatically when the MRMLScene is attached to this logic class
   virtual void RegisterNodes() VTK_OVERRIDE;
 
-  /// Run statistics calculation algorithm
+  /// Run statistics calculation algorithm. In "ROI" mode a row is added
+  /// for the ROI. In "Segmentation" mode a row is added for each segment
+  /// of the mask, in the order of its bits, if NumberOfMaskSegments is set,
+  /// otherwise for each label value (in increasing order) with at least
+  /// one valid voxel
   /// \param MRML parameter node
   /// \return Success flag
   bool CalculateStatistics(vtkMRMLAstroStatisticsParametersNode *pnode);
 
+  /// Maximum number of segments of a mask with one bit per segment (16)
+  static int GetMaximumNumberOfMaskSegments();
+
+  /// Run the per-channel statistics ("Channels" mode): min, max, mean,
+  /// RMS (standard deviation about the mean) and fraction of blank pixels
+  /// of every channel, calculated in a single pass and written in the
+  /// ChannelTableNode of the parameter node
+  /// \param MRML parameter node
+  /// \return Success flag
+  bool CalculateChannelStatistics(vtkMRMLAstroStatisticsParametersNode *pnode);
+
+  /// Run the statistics of many boxes (e.g. at the positions of the
+  /// sources of a catalog) in a single parallel pass. Each row of
+  /// boxesTableNode is a box, given either by the IJK bounds (columns
+  /// IMin, IMax, JMin, JMax, KMin, KMax, bounds included) or by the world
+  /// coordinates of the center (columns X, Y, Z) and the sizes (columns
+  /// Width, Height, Depth), in the units of the WCS of the input volume.
+  /// An optional Name column labels the rows of outputTableNode, which is
+  /// reset with one row per box and the statistics selected in the
+  /// parameter node (the percentiles are not calculated). The TotalFlux
+  /// column is blank if the beam is not available.
+  /// \param MRML parameter node
+  /// \param MRML table node of the boxes
+  /// \param MRML output table node
+  /// \return Success flag
+  bool CalculateBatchStatistics(vtkMRMLAstroStatisticsParametersNode *pnode,
+                                vtkMRMLTableNode *boxesTableNode,
+                                vtkMRMLTableNode *outputTableNode);
+
+  /// Check if CalculateStatistics can read the statistics from the
+  /// integral volume: IntegralVolume is on, the mode is "ROI" and only
+  /// Npixels, Mean, Std, Sum and TotalFlux are requested
+  /// \param MRML parameter node
+  bool CanUseIntegralVolume(vtkMRMLAstroStatisticsParametersNode *pnode);
+
   /// Sets ROI to fit to input volume.
   /// If ROI is under a non-linear transform then the ROI transform will be reset to RAS.
   /// \param MRML parameter node
@@ -147,6 +147,16 @@ class AstroStatisticsSelfTestTest(unittest.TestCase):
   def runTest(self):
     self.setUp()
     self.test_AstroStatisticsSelfTest()
+    self.setUp()
+    self.test_SegmentationMask()
+    self.setUp()
+    self.test_ChannelStatistics()
+    self.setUp()
+    self.test_IntegralVolume()
+    self.setUp()
+    self.test_BatchStatistics()
+    self.setUp()
+    self.test_Percentiles()
 
   def test_AstroStatisticsSelfTest(self):
     print("Running AstroStatisticsSelfTest Test case:")
@@ -195,6 +205,398 @@ class AstroStatisticsSelfTestTest(unittest.TestCase):
        sys.exit()
 
 
+  def test_SegmentationMask(self):
+    print("Running SegmentationMask Test case:")
+
+    import numpy
+
+    astroVolume = self.downloadWEIN069()
+
+    mainWindow = slicer.util.mainWindow()
+    mainWindow.moduleSelector().selectModule('AstroVolume')
+    mainWindow.moduleSelector().selectModule('AstroStatistics')
+
+    AstroStatisticsParameterNode = slicer.util.getNode("AstroStatisticsParameters")
+    logic = slicer.modules.astrostatistics.logic()
+    astroVolumeLogic = slicer.modules.astrovolume.logic()
+
+    # mask with short scalars, filled below with numpy (Z, Y, X)
+    maskVolume = astroVolumeLogic.CreateAndAddLabelVolume(slicer.mrmlScene, astroVolume, "WEIN069_mask")
+    maskImageData = vtk.vtkImageData()
+    maskImageData.SetDimensions(astroVolume.GetImageData().GetDimensions())
+    maskImageData.AllocateScalars(vtk.VTK_SHORT, 1)
+    maskVolume.SetAndObserveImageData(maskImageData)
+    mask = slicer.util.arrayFromVolume(maskVolume)
+    data = slicer.util.arrayFromVolume(astroVolume).astype(numpy.float64)
+
+    # two overlapping boxes, the second also containing the first one
+    box0 = numpy.zeros(data.shape, dtype=bool)
+    box0[10:30, 20:60, 20:60] = True
+    box1 = numpy.zeros(data.shape, dtype=bool)
+    box1[5:35, 30:80, 30:80] = True
+    box1[10:30, 20:60, 20:60] = True
+
+    AstroStatisticsParameterNode.SetMode("Segmentation")
+    AstroStatisticsParameterNode.SetMaskVolumeNodeID(maskVolume.GetID())
+    AstroStatisticsParameterNode.SetNoise(True)
+    Table = AstroStatisticsParameterNode.GetTableNode().GetTable()
+
+    def checkRows(firstRow, boxes):
+      if Table.GetNumberOfRows() != firstRow + len(boxes):
+        return False
+      for boxCnt, box in enumerate(boxes):
+        values = data[box]
+        values = values[~numpy.isnan(values)]
+        row = firstRow + boxCnt
+        N = Table.GetValue(row, 1).ToFloat()
+        Mean = Table.GetValue(row, 4).ToFloat()
+        Sum = Table.GetValue(row, 7).ToFloat()
+        Noise = Table.GetColumnByName("Noise").GetValue(row)
+        # robust RMS: 1.4826 times the median absolute deviation from the median
+        deviations = numpy.abs(values - numpy.median(values))
+        noise = 1.4826 * numpy.partition(deviations, values.size // 2)[values.size // 2]
+        if (math.fabs(N - values.size) > 1.e-1 or \
+            math.fabs(Mean - values.mean()) > 1.e-9 or \
+            math.fabs(Sum - values.sum()) > 1.e-5 or \
+            math.fabs(Noise - noise) > 1.e-10):
+          print("row", row, ":", N, Mean, Sum, Noise, "expected", values.size, values.mean(), values.sum(), noise)
+          return False
+      return True
+
+    # one bit per segment: the overlapping voxels are counted in both rows
+    self.delayDisplay('Calculating statistics of a mask with one bit per segment', 700)
+    mask[:] = 0
+    mask[box0] |= 1
+    mask[box1] |= 2
+    slicer.util.arrayFromVolumeModified(maskVolume)
+    AstroStatisticsParameterNode.SetNumberOfMaskSegments(2)
+    firstRow = Table.GetNumberOfRows()
+    if not logic.CalculateStatistics(AstroStatisticsParameterNode) or \
+       not checkRows(firstRow, [box0, box1]):
+      self.delayDisplay('Test failed', 700)
+      # if run from Slicer interface remove the followinf exit
+      sys.exit()
+
+    # label values: the missing label 2 does not get a row
+    self.delayDisplay('Calculating statistics of a mask with label values', 700)
+    mask[:] = 0
+    mask[box1] = 1
+    mask[box0] = 3
+    slicer.util.arrayFromVolumeModified(maskVolume)
+    AstroStatisticsParameterNode.SetNumberOfMaskSegments(0)
+    firstRow = Table.GetNumberOfRows()
+    if not logic.CalculateStatistics(AstroStatisticsParameterNode) or \
+       not checkRows(firstRow, [box1 & ~box0, box0]):
+      self.delayDisplay('Test failed', 700)
+      # if run from Slicer interface remove the followinf exit
+      sys.exit()
+
+    self.delayDisplay('Test passed', 700)
+
+  def test_ChannelStatistics(self):
+    print("Running ChannelStatistics Test case:")
+
+    import numpy
+
+    astroVolume = self.downloadWEIN069()
+
+    mainWindow = slicer.util.mainWindow()
+    mainWindow.moduleSelector().selectModule('AstroVolume')
+    mainWindow.moduleSelector().selectModule('AstroStatistics')
+
+    astroStatisticsModuleWidget = slicer.modules.astrostatistics.widgetRepresentation()
+    AstroStatisticsParameterNode = slicer.util.getNode("AstroStatisticsParameters")
+    AstroStatisticsParameterNode.SetMode("Channels")
+
+    QPushButtonList = astroStatisticsModuleWidget.findChildren(qt.QPushButton)
+    for QPushButton in (QPushButtonList):
+        if QPushButton.name == "ApplyButton":
+            ApplyPushButton = QPushButton
+
+    self.delayDisplay('Calculating the statistics of each channel', 700)
+    ApplyPushButton.click()
+
+    tableNode = AstroStatisticsParameterNode.GetChannelTableNode()
+    Table = tableNode.GetTable()
+    data = slicer.util.arrayFromVolume(astroVolume).astype(numpy.float64)
+    passed = Table.GetNumberOfRows() == data.shape[0]
+    for channel in range(data.shape[0]) if passed else []:
+      values = data[channel].ravel()
+      blanks = numpy.isnan(values)
+      values = values[~blanks]
+      # RMS is the standard deviation about the mean of the channel
+      if (math.fabs(Table.GetColumnByName("Min").GetValue(channel) - values.min()) > 1.e-12 or \
+          math.fabs(Table.GetColumnByName("Max").GetValue(channel) - values.max()) > 1.e-12 or \
+          math.fabs(Table.GetColumnByName("Mean").GetValue(channel) - values.mean()) > 1.e-12 or \
+          math.fabs(Table.GetColumnByName("RMS").GetValue(channel) - values.std()) > 1.e-12 or \
+          math.fabs(Table.GetColumnByName("BlankFraction").GetValue(channel) - blanks.mean()) > 1.e-12):
+        print("channel", channel, "expected", values.min(), values.max(), values.mean(), values.std(), blanks.mean())
+        passed = False
+        break
+
+    # RMS and maximum plotted versus the channel
+    plotChartNodes = slicer.mrmlScene.GetNodesByClassByName("vtkMRMLPlotChartNode", tableNode.GetName())
+    if plotChartNodes.GetNumberOfItems() != 1 or \
+       plotChartNodes.GetItemAsObject(0).GetNumberOfPlotSeriesNodes() != 2:
+      passed = False
+
+    if passed:
+       self.delayDisplay('Test passed', 700)
+    else:
+       self.delayDisplay('Test failed', 700)
+       # if run from Slicer interface remove the followinf exit
+       sys.exit()
+
+  def test_IntegralVolume(self):
+    print("Running IntegralVolume Test case:")
+
+    import numpy
+
+    astroVolume = self.downloadWEIN069()
+
+    mainWindow = slicer.util.mainWindow()
+    mainWindow.moduleSelector().selectModule('AstroVolume')
+    mainWindow.moduleSelector().selectModule('AstroStatistics')
+
+    AstroStatisticsParameterNode = slicer.util.getNode("AstroStatisticsParameters")
+    logic = slicer.modules.astrostatistics.logic()
+
+    # blanks inside the ROIs (the array axes are Z, Y, X)
+    array = slicer.util.arrayFromVolume(astroVolume)
+    array[2, 3:6, 4] = numpy.nan
+    array[:, 50, 10] = numpy.nan
+    astroVolume.GetImageData().Modified()
+    data = numpy.array(array, dtype=numpy.float64)
+    dims = astroVolume.GetImageData().GetDimensions()
+
+    # the integral volume can answer only Npixels, Mean, Std, Sum and TotalFlux
+    AstroStatisticsParameterNode.SetMode("ROI")
+    AstroStatisticsParameterNode.SetMin(False)
+    AstroStatisticsParameterNode.SetMax(False)
+    AstroStatisticsParameterNode.SetMedian(False)
+    AstroStatisticsParameterNode.SetNoise(False)
+    AstroStatisticsParameterNode.SetPercentiles("")
+    Table = AstroStatisticsParameterNode.GetTableNode().GetTable()
+
+    # ROIs crossing the borders (clipped to the volume) and an inner one
+    extents = [(-3, 30, 40, dims[1] + 2, -1, 10),
+               (dims[0] - 20, dims[0] + 5, -2, 15, dims[2] - 8, dims[2] + 1),
+               (5, 20, 45, 60, 30, 40)]
+    passed = True
+    for extent in extents:
+      self.setROI(astroVolume, AstroStatisticsParameterNode, extent)
+      rows = []
+      for integralVolume in (False, True):
+        AstroStatisticsParameterNode.SetIntegralVolume(integralVolume)
+        if not logic.CalculateStatistics(AstroStatisticsParameterNode):
+          passed = False
+          break
+        rows.append(Table.GetNumberOfRows() - 1)
+      if not passed:
+        break
+
+      clipped = [max(extent[0], 0), min(extent[1], dims[0] - 1),
+                 max(extent[2], 0), min(extent[3], dims[1] - 1),
+                 max(extent[4], 0), min(extent[5], dims[2] - 1)]
+      values = data[clipped[4]:clipped[5] + 1, clipped[2]:clipped[3] + 1, clipped[0]:clipped[1] + 1]
+      values = values[~numpy.isnan(values)]
+      reference = {"Npixels": values.size, "Mean": values.mean(),
+                   "Std": values.std(), "Sum": values.sum()}
+      for row in rows:
+        for name, value in reference.items():
+          tolerance = 1.e-1 if name == "Npixels" else 1.e-6 * max(math.fabs(value), data[~numpy.isnan(data)].std())
+          if math.fabs(Table.GetColumnByName(name).GetValue(row) - value) > tolerance:
+            print("row", row, name, Table.GetColumnByName(name).GetValue(row), "expected", value)
+            passed = False
+
+    AstroStatisticsParameterNode.SetIntegralVolume(False)
+
+    if passed:
+       self.delayDisplay('Test passed', 700)
+    else:
+       self.delayDisplay('Test failed', 700)
+       # if run from Slicer interface remove the followinf exit
+       sys.exit()
+
+  def test_BatchStatistics(self):
+    print("Running BatchStatistics Test case:")
+
+    import numpy
+
+    astroVolume = self.downloadWEIN069()
+
+    mainWindow = slicer.util.mainWindow()
+    mainWindow.moduleSelector().selectModule('AstroVolume')
+    mainWindow.moduleSelector().selectModule('AstroStatistics')
+
+    AstroStatisticsParameterNode = slicer.util.getNode("AstroStatisticsParameters")
+    logic = slicer.modules.astrostatistics.logic()
+
+    # blanks inside the boxes (the array axes are Z, Y, X)
+    array = slicer.util.arrayFromVolume(astroVolume)
+    array[10, 20, 12] = numpy.nan
+    array[25, 35, 40:45] = numpy.nan
+    astroVolume.GetImageData().Modified()
+    data = numpy.array(array, dtype=numpy.float64)
+    dims = astroVolume.GetImageData().GetDimensions()
+
+    # IJK extents (bounds included), the second box crosses the borders
+    # and has no name
+    extents = [(10, 20, 15, 25, 5, 15),
+               (-5, 8, 60, dims[1] + 3, 30, 35),
+               (40, 50, 30, 40, 20, 30)]
+    names = ["SourceA", "", "SourceC"]
+    expectedNames = ["SourceA", astroVolume.GetName() + "_box_2", "SourceC"]
+
+    def boxesTableNode(columnNames, rows):
+      tableNode = slicer.vtkMRMLTableNode()
+      slicer.mrmlScene.AddNode(tableNode)
+      table = tableNode.GetTable()
+      for column, columnName in enumerate(columnNames):
+        array = vtk.vtkDoubleArray()
+        array.SetName(columnName)
+        for row in rows:
+          array.InsertNextValue(row[column])
+        table.AddColumn(array)
+      nameArray = vtk.vtkStringArray()
+      nameArray.SetName("Name")
+      for name in names:
+        nameArray.InsertNextValue(name)
+      table.AddColumn(nameArray)
+      return tableNode
+
+    ijkTableNode = boxesTableNode(["IMin", "IMax", "JMin", "JMax", "KMin", "KMax"], extents)
+
+    # the same boxes by the world coordinates of the center and the sizes
+    astroDisplay = astroVolume.GetAstroVolumeDisplayNode()
+    worldRows = []
+    for extent in extents:
+      lowerWorld = [0., 0., 0.]
+      upperWorld = [0., 0., 0.]
+      astroDisplay.GetReferenceSpace([float(extent[0]), float(extent[2]), float(extent[4])], lowerWorld)
+      astroDisplay.GetReferenceSpace([float(extent[1]), float(extent[3]), float(extent[5])], upperWorld)
+      worldRows.append([(lowerWorld[ii] + upperWorld[ii]) * 0.5 for ii in range(3)] +
+                       [math.fabs(upperWorld[ii] - lowerWorld[ii]) for ii in range(3)])
+    worldTableNode = boxesTableNode(["X", "Y", "Z", "Width", "Height", "Depth"], worldRows)
+
+    # without beam the total flux is skipped, the parameter node is not modified
+    astroVolume.SetAttribute("SlicerAstro.BMAJ", "UNDEFINED")
+    AstroStatisticsParameterNode.SetTotalFlux(True)
+    AstroStatisticsParameterNode.SetMedian(True)
+    AstroStatisticsParameterNode.SetIntegralVolume(False)
+
+    passed = True
+    for tableNode in (ijkTableNode, worldTableNode):
+      self.delayDisplay('Calculating the statistics of a batch of boxes', 700)
+      outputTableNode = slicer.vtkMRMLTableNode()
+      slicer.mrmlScene.AddNode(outputTableNode)
+      if not logic.CalculateBatchStatistics(AstroStatisticsParameterNode, tableNode, outputTableNode):
+        passed = False
+        break
+      Table = outputTableNode.GetTable()
+      if Table.GetNumberOfRows() != len(extents) or \
+         not AstroStatisticsParameterNode.GetTotalFlux():
+        passed = False
+        break
+
+      for row, extent in enumerate(extents):
+        values = data[max(extent[4], 0):min(extent[5], dims[2] - 1) + 1,
+                      max(extent[2], 0):min(extent[3], dims[1] - 1) + 1,
+                      max(extent[0], 0):min(extent[1], dims[0] - 1) + 1]
+        values = values[~numpy.isnan(values)]
+        if (Table.GetColumnByName("Selection").GetValue(row) != expectedNames[row] or \
+            Table.GetColumnByName("Npixels").GetValue(row) != values.size or \
+            math.fabs(Table.GetColumnByName("Mean").GetValue(row) - values.mean()) > 1.e-12 or \
+            math.fabs(Table.GetColumnByName("Sum").GetValue(row) - values.sum()) > 1.e-9 or \
+            math.fabs(Table.GetColumnByName("Median").GetValue(row) - numpy.median(values)) > 1.e-12 or \
+            not math.isnan(Table.GetColumnByName("TotalFlux").GetValue(row))):
+          print("row", row, "expected", expectedNames[row], values.size, values.mean(), values.sum(), numpy.median(values))
+          passed = False
+
+    if passed:
+       self.delayDisplay('Test passed', 700)
+    else:
+       self.delayDisplay('Test failed', 700)
+       # if run from Slicer interface remove the followinf exit
+       sys.exit()
+
+  def test_Percentiles(self):
+    print("Running Percentiles Test case:")
+
+    import numpy
+
+    astroVolume = self.downloadWEIN069()
+
+    mainWindow = slicer.util.mainWindow()
+    mainWindow.moduleSelector().selectModule('AstroVolume')
+    mainWindow.moduleSelector().selectModule('AstroStatistics')
+
+    AstroStatisticsParameterNode = slicer.util.getNode("AstroStatisticsParameters")
+    logic = slicer.modules.astrostatistics.logic()
+    astroVolumeLogic = slicer.modules.astrovolume.logic()
+
+    # label mask with an even number of valid voxels: the median and the
+    # percentiles fall between two ranks (the array axes are Z, Y, X)
+    maskVolume = astroVolumeLogic.CreateAndAddLabelVolume(slicer.mrmlScene, astroVolume, "WEIN069_mask")
+    maskImageData = vtk.vtkImageData()
+    maskImageData.SetDimensions(astroVolume.GetImageData().GetDimensions())
+    maskImageData.AllocateScalars(vtk.VTK_SHORT, 1)
+    maskVolume.SetAndObserveImageData(maskImageData)
+    mask = slicer.util.arrayFromVolume(maskVolume)
+    mask[:] = 0
+    mask[10:30, 20:51, 20:60] = 1
+    array = slicer.util.arrayFromVolume(astroVolume)
+    array[15, 30, 30:32] = numpy.nan
+    astroVolume.GetImageData().Modified()
+    slicer.util.arrayFromVolumeModified(maskVolume)
+    data = numpy.array(array, dtype=numpy.float64)
+    values = data[mask == 1]
+    values = values[~numpy.isnan(values)]
+
+    AstroStatisticsParameterNode.SetMode("Segmentation")
+    AstroStatisticsParameterNode.SetMaskVolumeNodeID(maskVolume.GetID())
+    AstroStatisticsParameterNode.SetNumberOfMaskSegments(0)
+    AstroStatisticsParameterNode.SetMedian(True)
+    AstroStatisticsParameterNode.SetPercentiles("2.5, 25,75,95")
+    Table = AstroStatisticsParameterNode.GetTableNode().GetTable()
+
+    self.delayDisplay('Calculating the percentiles', 700)
+    passed = values.size % 2 == 0 and logic.CalculateStatistics(AstroStatisticsParameterNode)
+    if passed:
+      row = Table.GetNumberOfRows() - 1
+      references = [("P2.5", 2.5), ("P25", 25.), ("P75", 75.), ("P95", 95.), ("Median", 50.)]
+      for columnName, percentile in references:
+        column = Table.GetColumnByName(columnName)
+        # numpy.percentile interpolates linearly between the closest ranks
+        reference = numpy.percentile(values, percentile)
+        if not column or math.fabs(column.GetValue(row) - reference) > 1.e-12:
+          print(columnName, column.GetValue(row) if column else None, "expected", reference)
+          passed = False
+
+    AstroStatisticsParameterNode.SetPercentiles("")
+
+    if passed:
+       self.delayDisplay('Test passed', 700)
+    else:
+       self.delayDisplay('Test failed', 700)
+       # if run from Slicer interface remove the followinf exit
+       sys.exit()
+
+  def setROI(self, astroVolume, AstroStatisticsParameterNode, extent):
+    # ROI covering the voxels of the IJK extent (bounds included): its
+    # faces lie half a voxel outside the first and the last voxel
+    IJKToRAS = vtk.vtkMatrix4x4()
+    astroVolume.GetIJKToRASMatrix(IJKToRAS)
+    firstRAS = IJKToRAS.MultiplyPoint((extent[0] - 0.5, extent[2] - 0.5, extent[4] - 0.5, 1.))
+    lastRAS = IJKToRAS.MultiplyPoint((extent[1] + 0.5, extent[3] + 0.5, extent[5] + 0.5, 1.))
+    roiNode = AstroStatisticsParameterNode.GetROINode()
+    if not roiNode:
+      roiNode = slicer.vtkMRMLAnnotationROINode()
+      slicer.mrmlScene.AddNode(roiNode)
+      AstroStatisticsParameterNode.SetROINode(roiNode)
+    roiNode.SetXYZ([(firstRAS[ii] + lastRAS[ii]) * 0.5 for ii in range(3)])
+    roiNode.SetRadiusXYZ([math.fabs(lastRAS[ii] - firstRAS[ii]) * 0.5 for ii in range(3)])
+
   def downloadWEIN069(self):
     import AstroSampleData
     astroSampleDataLogic = AstroSampleData.AstroSampleDataLogic()
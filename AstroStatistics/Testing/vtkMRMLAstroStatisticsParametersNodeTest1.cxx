@@ -32,6 +32,7 @@ int vtkMRMLAstroStatisticsParametersNodeTest1(int , char * [] )
   TEST_SET_GET_STRING(node1.GetPointer(), Mode);
 
   TEST_SET_GET_INT(node1.GetPointer(), Cores, 0);
+  TEST_SET_GET_INT(node1.GetPointer(), NumberOfMaskSegments, 0);
 
   TEST_SET_GET_BOOLEAN(node1.GetPointer(), Max);
   TEST_SET_GET_BOOLEAN(node1.GetPointer(), Mean);
@@ -40,6 +41,9 @@ int vtkMRMLAstroStatisticsParametersNodeTest1(int , char * [] )
   TEST_SET_GET_BOOLEAN(node1.GetPointer(), Std);
   TEST_SET_GET_BOOLEAN(node1.GetPointer(), Sum);
   TEST_SET_GET_BOOLEAN(node1.GetPointer(), TotalFlux);
+  TEST_SET_GET_BOOLEAN(node1.GetPointer(), Noise);
+  TEST_SET_GET_BOOLEAN(node1.GetPointer(), IntegralVolume);
+  TEST_SET_GET_STRING(node1.GetPointer(), Percentiles);
 
   TEST_SET_GET_INT(node1.GetPointer(), OutputSerial, 1);
   TEST_SET_GET_INT(node1.GetPointer(), Status, 0);
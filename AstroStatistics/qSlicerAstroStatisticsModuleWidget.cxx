@@ -31,6 +31,7 @@
 // VTK includes
 #include <vtkCollection.h>
 #include <vtkCommand.h>
+#include <vtkDataArray.h>
 #include <vtkDoubleArray.h>
 #include <vtkImageData.h>
 #include <vtkImageReslice.h>
@@ -75,6 +76,8 @@
 #include <vtkMRMLDoubleArrayNode.h>
 #include <vtkMRMLLayoutLogic.h>
 #include <vtkMRMLLayoutNode.h>
+#include <vtkMRMLPlotChartNode.h>
+#include <vtkMRMLPlotSeriesNode.h>
 #include <vtkMRMLSelectionNode.h>
 #include <vtkMRMLSegmentationDisplayNode.h>
 #include <vtkMRMLSegmentationNode.h>
@@ -87,6 +90,10 @@
 #include <vtkMRMLVolumeNode.h>
 #include <vtkMRMLVolumeRenderingDisplayNode.h>
 
+// Segmentations includes
+#include <vtkSegment.h>
+#include <vtkSegmentation.h>
+
 #include <sys/time.h>
 
 //-----------------------------------------------------------------------------
@@ -107,12 +114,15 @@ public:
   vtkSlicerAstroStatisticsLogic* logic() const;
   vtkSmartPointer<vtkMRMLAstroStatisticsParametersNode> parametersNode;
   vtkSmartPointer<vtkMRMLAnnotationROINode> InputROINode;
+  vtkSmartPointer<vtkMRMLAnnotationROINode> ObservedROINode;
   vtkSmartPointer<vtkMRMLTableNode> astroTableNode;
   vtkSmartPointer<vtkMRMLSelectionNode> selectionNode;
   vtkSmartPointer<vtkMRMLSegmentEditorNode> segmentEditorNode;
   QAction *CopyAction;
   QAction *PasteAction;
   QAction *PlotAction;
+  // table row updated while the ROI is dragged (-1 if none)
+  int LiveROIRow;
 };
 
 //-----------------------------------------------------------------------------
@@ -124,12 +134,14 @@ qSlicerAstroStatisticsModuleWidgetPrivate::qSlicerAstroStatisticsModuleWidgetPri
 {
   this->parametersNode = 0;
   this->InputROINode = 0;
+  this->ObservedROINode = 0;
   this->astroTableNode = 0;
   this->selectionNode = 0;
   this->segmentEditorNode = 0;
   this->CopyAction = 0;
   this->PasteAction = 0;
   this->PlotAction = 0;
+  this->LiveROIRow = -1;
 }
 
 //-----------------------------------------------------------------------------
@@ -170,6 +182,9 @@ void qSlicerAstroStatisticsModuleWidgetPrivate::init()
   QObject::connect(this->SegmentationModeRadioButton, SIGNAL(toggled(bool)),
                    q, SLOT(onModeChanged()));
 
+  QObject::connect(this->ChannelsModeRadioButton, SIGNAL(toggled(bool)),
+                   q, SLOT(onModeChanged()));
+
   QObject::connect(q, SIGNAL(mrmlSceneChanged(vtkMRMLScene*)),
                    this->SegmentsTableView, SLOT(setMRMLScene(vtkMRMLScene*)));
 
@@ -197,6 +212,12 @@ void qSlicerAstroStatisticsModuleWidgetPrivate::init()
   QObject::connect(this->TotalFluxCheckBox, SIGNAL(toggled(bool)),
                    q, SLOT(onTotalFluxToggled(bool)));
 
+  QObject::connect(this->NoiseCheckBox, SIGNAL(toggled(bool)),
+                   q, SLOT(onNoiseToggled(bool)));
+
+  QObject::connect(this->IntegralVolumeCheckBox, SIGNAL(toggled(bool)),
+                   q, SLOT(onIntegralVolumeToggled(bool)));
+
   QObject::connect(this->MedianCheckBox, SIGNAL(toggled(bool)),
                    q, SLOT(onMedianToggled(bool)));
 
@@ -253,6 +274,8 @@ void qSlicerAstroStatisticsModuleWidgetPrivate::cleanPointers()
     q->mrmlScene()->RemoveNode(this->InputROINode);
     }
   this->InputROINode = 0;
+  this->ObservedROINode = 0;
+  this->LiveROIRow = -1;
 
   if (this->astroTableNode)
     {
@@ -710,6 +733,17 @@ void qSlicerAstroStatisticsModuleWidget::initializeTableNode(bool forceNew /*= f
   d->astroTableNode->SetColumnUnitLabel("TotalFlux", "Jy");
   d->astroTableNode->SetColumnLongName("TotalFlux", "Total Flux");
 
+  vtkDoubleArray* Noise = vtkDoubleArray::SafeDownCast(d->astroTableNode->AddColumn());
+  if (!Noise)
+    {
+    qCritical() <<"qSlicerAstroModelingModuleWidget::initializeTableNode : "
+                  "Unable to find the Noise Column.";
+    return;
+    }
+  Noise->SetName("Noise");
+  d->astroTableNode->SetColumnUnitLabel("Noise", "Jy/beam");
+  d->astroTableNode->SetColumnLongName("Noise", "Robust RMS (median absolute deviation)");
+
   d->astroTableNode->EndModify(wasModifying);
 
   d->parametersNode->SetTableNode(d->astroTableNode);
@@ -760,7 +794,7 @@ void qSlicerAstroStatisticsModuleWidget::initializeSegmentations(bool forceNew /
 }
 
 //-----------------------------------------------------------------------------
-bool qSlicerAstroStatisticsModuleWidget::convertSelectedSegmentToLabelMap()
+bool qSlicerAstroStatisticsModuleWidget::convertSelectedSegmentToLabelMap(const QStringList& segmentIDs)
 {
   Q_D(qSlicerAstroStatisticsModuleWidget);
 
@@ -784,24 +818,14 @@ bool qSlicerAstroStatisticsModuleWidget::convertSelectedSegmentToLabelMap()
     return false;
     }
 
-  // Export selected segments into a multi-label labelmap volume
-  std::vector<std::string> segmentIDs;
-  currentSegmentationNode->GetSegmentation()->GetSegmentIDs(segmentIDs);
-
-  vtkSmartPointer<vtkMRMLAstroLabelMapVolumeNode> labelMapNode;
-
-  QStringList selectedSegmentIDs = d->SegmentsTableView->selectedSegmentIDs();
-
-  if (selectedSegmentIDs.size() < 1)
+  if (segmentIDs.size() < 1 ||
+      segmentIDs.size() > vtkSlicerAstroStatisticsLogic::GetMaximumNumberOfMaskSegments())
     {
-    QString message = QString("No segment selected from the segmentation node! Please provide a segment.");
-    qCritical() << Q_FUNC_INFO << ": " << message;
-    QMessageBox::warning(NULL, tr("Failed to select a segment"), message);
+    qCritical() << Q_FUNC_INFO << ": invalid number of segments (" << segmentIDs.size() << ").";
     return false;
     }
 
-  segmentIDs.clear();
-  segmentIDs.push_back(selectedSegmentIDs[0].toStdString());
+  vtkSmartPointer<vtkMRMLAstroLabelMapVolumeNode> labelMapNode;
 
   vtkMRMLAstroVolumeNode* activeVolumeNode = vtkMRMLAstroVolumeNode::SafeDownCast(
      d->InputVolumeNodeSelector->currentNode());
@@ -833,20 +857,70 @@ bool qSlicerAstroStatisticsModuleWidget::convertSelectedSegmentToLabelMap()
     return false;
     }
 
-  if (!vtkSlicerSegmentationsModuleLogic::ExportSegmentsToLabelmapNode(currentSegmentationNode, segmentIDs, labelMapNode, activeVolumeNode))
+  if (!labelMapNode)
     {
-    QString message = QString("Failed to export segments from segmentation %1 to representation node %2!\n\n"
-                              "Be sure that segment to export has been selected in the table view (left click). \n\n").
-                              arg(currentSegmentationNode->GetName()).arg(labelMapNode->GetName());
-    qCritical() << Q_FUNC_INFO << ": " << message;
-    QMessageBox::warning(NULL, tr("Failed to export segment"), message);
-    this->mrmlScene()->RemoveNode(labelMapNode);
+    qCritical() << Q_FUNC_INFO << ": unable to create the labelMap Node (Mask)!";
     return false;
     }
 
-  labelMapNode->UpdateRangeAttributes();
+  // Export the segments one at a time and set the bit of each segment
+  // (bit i for the i-th segment) in the mask: the voxels shared by
+  // overlapping segments are then counted in all of them
+  vtkNew<vtkImageData> bitMask;
+  for (int segmentIndex = 0; segmentIndex < segmentIDs.size(); segmentIndex++)
+    {
+    std::vector<std::string> segmentID(1, segmentIDs[segmentIndex].toStdString());
+    if (!vtkSlicerSegmentationsModuleLogic::ExportSegmentsToLabelmapNode(currentSegmentationNode, segmentID, labelMapNode, activeVolumeNode))
+      {
+      QString message = QString("Failed to export segments from segmentation %1 to representation node %2!\n\n"
+                                "Be sure that segment to export has been selected in the table view (left click). \n\n").
+                                arg(currentSegmentationNode->GetName()).arg(labelMapNode->GetName());
+      qCritical() << Q_FUNC_INFO << ": " << message;
+      QMessageBox::warning(NULL, tr("Failed to export segment"), message);
+      this->mrmlScene()->RemoveNode(labelMapNode);
+      return false;
+      }
+
+    vtkImageData* segmentImageData = labelMapNode->GetImageData();
+    if (!segmentImageData || !segmentImageData->GetPointData() ||
+        !segmentImageData->GetPointData()->GetScalars())
+      {
+      qCritical() << Q_FUNC_INFO << ": exported segment not found!";
+      this->mrmlScene()->RemoveNode(labelMapNode);
+      return false;
+      }
+
+    if (segmentIndex == 0)
+      {
+      bitMask->CopyStructure(segmentImageData);
+      bitMask->AllocateScalars(VTK_SHORT, 1);
+      bitMask->GetPointData()->GetScalars()->FillComponent(0, 0.);
+      }
+
+    vtkDataArray* segmentScalars = segmentImageData->GetPointData()->GetScalars();
+    const vtkIdType numElements = bitMask->GetNumberOfPoints();
+    if (segmentScalars->GetNumberOfTuples() != numElements)
+      {
+      qCritical() << Q_FUNC_INFO << ": the exported segments have different extents!";
+      this->mrmlScene()->RemoveNode(labelMapNode);
+      return false;
+      }
+
+    short *maskPixel = static_cast<short*> (bitMask->GetScalarPointer());
+    const short segmentBit = static_cast<short>(1 << segmentIndex);
+    for (vtkIdType elementCnt = 0; elementCnt < numElements; elementCnt++)
+      {
+      if (segmentScalars->GetTuple1(elementCnt) > 0.)
+        {
+        *(maskPixel + elementCnt) |= segmentBit;
+        }
+      }
+    }
+
+  labelMapNode->SetAndObserveImageData(bitMask.GetPointer());
 
   d->parametersNode->SetMaskVolumeNodeID(labelMapNode->GetID());
+  d->parametersNode->SetNumberOfMaskSegments(segmentIDs.size());
 
   return true;
 }
@@ -989,6 +1063,48 @@ void qSlicerAstroStatisticsModuleWidget::onROIFit()
   d->logic()->FitROIToInputVolume(d->parametersNode);
 }
 
+//-----------------------------------------------------------------------------
+void qSlicerAstroStatisticsModuleWidget::onROIModified()
+{
+  Q_D(qSlicerAstroStatisticsModuleWidget);
+
+  if (!d->parametersNode || !this->isEntered() ||
+      d->parametersNode->GetStatus() != 0)
+    {
+    return;
+    }
+
+  vtkSlicerAstroStatisticsLogic *logic = d->logic();
+  vtkMRMLTableNode* tableNode = d->parametersNode->GetTableNode();
+  if (!logic || !logic->CanUseIntegralVolume(d->parametersNode) ||
+      !tableNode || !tableNode->GetTable())
+    {
+    return;
+    }
+
+  // the events of the parameter node are compressed,
+  // so that the progress bar does not flicker while dragging
+  int wasModifying = d->parametersNode->StartModify();
+
+  // replace the row written by the previous update, if it is still the last one
+  const int lastRow = d->parametersNode->GetOutputSerial() - 2;
+  if (d->LiveROIRow >= 0 && d->LiveROIRow == lastRow &&
+      tableNode->GetNumberOfRows() == lastRow + 1)
+    {
+    tableNode->GetTable()->RemoveRow(lastRow);
+    d->parametersNode->SetOutputSerial(lastRow + 1);
+    }
+
+  d->LiveROIRow = -1;
+  if (logic->CalculateStatistics(d->parametersNode))
+    {
+    d->LiveROIRow = d->parametersNode->GetOutputSerial() - 2;
+    }
+
+  d->parametersNode->SetStatus(0);
+  d->parametersNode->EndModify(wasModifying);
+}
+
 //-----------------------------------------------------------------------------
 void qSlicerAstroStatisticsModuleWidget::onROIVisibilityChanged(bool visible)
 {
@@ -1095,6 +1211,19 @@ void qSlicerAstroStatisticsModuleWidget::onMedianToggled(bool toggled)
   d->parametersNode->SetMedian(toggled);
 }
 
+//-----------------------------------------------------------------------------
+void qSlicerAstroStatisticsModuleWidget::onIntegralVolumeToggled(bool toggled)
+{
+  Q_D(qSlicerAstroStatisticsModuleWidget);
+
+  if (!d->parametersNode)
+    {
+    return;
+    }
+
+  d->parametersNode->SetIntegralVolume(toggled);
+}
+
 //-----------------------------------------------------------------------------
 void qSlicerAstroStatisticsModuleWidget::onMinToggled(bool toggled)
 {
@@ -1127,6 +1256,10 @@ void qSlicerAstroStatisticsModuleWidget::onModeChanged()
     {
     d->parametersNode->SetMode("Segmentation");
     }
+  if (d->ChannelsModeRadioButton->isChecked())
+    {
+    d->parametersNode->SetMode("Channels");
+    }
 
   d->parametersNode->EndModify(wasModifying);
 }
@@ -1147,6 +1280,15 @@ void qSlicerAstroStatisticsModuleWidget::onMRMLAstroStatisticsParametersNodeModi
   d->InputVolumeNodeSelector->setCurrentNode(inputVolumeNode);
 
   d->ROINodeComboBox->setCurrentNode(d->parametersNode->GetROINode());
+
+  vtkMRMLAnnotationROINode* ROINode = d->parametersNode->GetROINode();
+  if (d->ObservedROINode != ROINode)
+    {
+    this->qvtkReconnect(d->ObservedROINode, ROINode, vtkCommand::ModifiedEvent,
+                        this, SLOT(onROIModified()));
+    d->ObservedROINode = ROINode;
+    d->LiveROIRow = -1;
+    }
   d->TableNodeComboBox->setCurrentNode(d->parametersNode->GetTableNode());
 
   if (!(strcmp(d->parametersNode->GetMode(), "ROI")))
@@ -1204,8 +1346,22 @@ void qSlicerAstroStatisticsModuleWidget::onMRMLAstroStatisticsParametersNodeModi
         }
       }
     }
+  else if (!(strcmp(d->parametersNode->GetMode(), "Channels")))
+    {
+    d->ChannelsModeRadioButton->setChecked(true);
+    d->SegmentsTableView->hide();
+    this->onROIVisibilityChanged(false);
+    }
 
-  d->TableView->setMRMLTableNode(d->parametersNode->GetTableNode());
+  if (!(strcmp(d->parametersNode->GetMode(), "Channels")) &&
+      d->parametersNode->GetChannelTableNode())
+    {
+    d->TableView->setMRMLTableNode(d->parametersNode->GetChannelTableNode());
+    }
+  else
+    {
+    d->TableView->setMRMLTableNode(d->parametersNode->GetTableNode());
+    }
 
   d->MaxCheckBox->setChecked(d->parametersNode->GetMax());
   d->MeanCheckBox->setChecked(d->parametersNode->GetMean());
@@ -1215,6 +1371,8 @@ void qSlicerAstroStatisticsModuleWidget::onMRMLAstroStatisticsParametersNodeModi
   d->StdCheckBox->setChecked(d->parametersNode->GetStd());
   d->SumCheckBox->setChecked(d->parametersNode->GetSum());
   d->TotalFluxCheckBox->setChecked(d->parametersNode->GetTotalFlux());
+  d->NoiseCheckBox->setChecked(d->parametersNode->GetNoise());
+  d->IntegralVolumeCheckBox->setChecked(d->parametersNode->GetIntegralVolume());
 
   int status = d->parametersNode->GetStatus();
 
@@ -1300,26 +1458,219 @@ void qSlicerAstroStatisticsModuleWidget::onCalculate()
 
   d->parametersNode->SetStatus(1);
 
-  if (!(strcmp(d->parametersNode->GetMode(), "Segmentation")))
+  // the rows of explicit calculations are not replaced while the ROI is dragged
+  d->LiveROIRow = -1;
+
+  if (!(strcmp(d->parametersNode->GetMode(), "Channels")))
     {
-    if (!this->convertSelectedSegmentToLabelMap())
-      {
-      qCritical() <<"qSlicerAstroStatisticsModuleWidget::onCalculate : "
-                    "convertSelectedSegmentToLabelMap failed!";
-      d->parametersNode->SetStatus(0);
-      return;
-      }
+    this->initializeChannelTableNode();
     }
 
   // Run computation
-  if (!logic->CalculateStatistics(d->parametersNode))
+  if (!(strcmp(d->parametersNode->GetMode(), "Segmentation")))
+    {
+    this->calculateSegmentStatistics();
+    }
+  else if (!logic->CalculateStatistics(d->parametersNode))
     {
     qCritical() <<"qSlicerAstroStatisticsModuleWidget::onCalculate : "
                   "CalculateStatistics error!";
     }
+  else if (!(strcmp(d->parametersNode->GetMode(), "Channels")))
+    {
+    d->TableView->setMRMLTableNode(d->parametersNode->GetChannelTableNode());
+    this->plotChannelStatistics();
+    }
 
-  if (!(strcmp(d->parametersNode->GetMode(), "Segmentation")))
+  d->parametersNode->SetStatus(0);
+  d->OutputCollapsibleButton->setCollapsed(false);
+}
+
+//-----------------------------------------------------------------------------
+void qSlicerAstroStatisticsModuleWidget::initializeChannelTableNode()
+{
+  Q_D(qSlicerAstroStatisticsModuleWidget);
+
+  if (!d->parametersNode || !this->mrmlScene())
     {
+    return;
+    }
+
+  vtkMRMLAstroVolumeNode* inputVolume = vtkMRMLAstroVolumeNode::SafeDownCast(
+    this->mrmlScene()->GetNodeByID(d->parametersNode->GetInputVolumeNodeID()));
+  if (!inputVolume)
+    {
+    return;
+    }
+
+  std::string name(inputVolume->GetName());
+  name += "_ChannelStatistics";
+
+  vtkSmartPointer<vtkCollection> TableNodes = vtkSmartPointer<vtkCollection>::Take
+      (this->mrmlScene()->GetNodesByClassByName("vtkMRMLTableNode", name.c_str()));
+  vtkMRMLTableNode *tableNode = NULL;
+  if (TableNodes->GetNumberOfItems() == 0)
+    {
+    vtkNew<vtkMRMLTableNode> newTableNode;
+    newTableNode->SetName(name.c_str());
+    this->mrmlScene()->AddNode(newTableNode.GetPointer());
+    tableNode = newTableNode.GetPointer();
+    }
+  else
+    {
+    tableNode = vtkMRMLTableNode::SafeDownCast(TableNodes->GetItemAsObject(0));
+    }
+
+  d->parametersNode->SetChannelTableNode(tableNode);
+}
+
+//-----------------------------------------------------------------------------
+void qSlicerAstroStatisticsModuleWidget::plotChannelStatistics()
+{
+  Q_D(qSlicerAstroStatisticsModuleWidget);
+
+  if (!d->parametersNode || !this->mrmlScene())
+    {
+    return;
+    }
+
+  vtkMRMLTableNode* tableNode = d->parametersNode->GetChannelTableNode();
+  if (!tableNode || tableNode->GetNumberOfColumns() < 1)
+    {
+    return;
+    }
+
+  vtkMRMLScene* scene = this->mrmlScene();
+
+  // the noise (RMS) and the peaks (Max) of the channels,
+  // e.g. to spot the channels affected by RFI
+  const int numberOfSeries = 2;
+  const char* columnNames[numberOfSeries] = {"RMS", "Max"};
+  double colors[numberOfSeries][3] = {{0., 0., 0.}, {1., 0., 0.}};
+  vtkMRMLPlotSeriesNode *PlotSeriesNodes[numberOfSeries];
+  for (int seriesCnt = 0; seriesCnt < numberOfSeries; seriesCnt++)
+    {
+    std::string name(tableNode->GetName());
+    name += "_";
+    name += columnNames[seriesCnt];
+
+    vtkSmartPointer<vtkCollection> SeriesNodes = vtkSmartPointer<vtkCollection>::Take
+        (scene->GetNodesByClassByName("vtkMRMLPlotSeriesNode", name.c_str()));
+    vtkMRMLPlotSeriesNode *PlotSeriesNode = NULL;
+    if (SeriesNodes->GetNumberOfItems() == 0)
+      {
+      vtkNew<vtkMRMLPlotSeriesNode> newPlotSeriesNode;
+      newPlotSeriesNode->SetName(name.c_str());
+      newPlotSeriesNode->SetPlotType(vtkMRMLPlotSeriesNode::PlotTypeScatter);
+      newPlotSeriesNode->SetMarkerStyle(vtkMRMLPlotSeriesNode::MarkerStyleNone);
+      newPlotSeriesNode->SetColor(colors[seriesCnt]);
+      scene->AddNode(newPlotSeriesNode.GetPointer());
+      PlotSeriesNode = newPlotSeriesNode.GetPointer();
+      }
+    else
+      {
+      PlotSeriesNode = vtkMRMLPlotSeriesNode::SafeDownCast
+        (SeriesNodes->GetItemAsObject(0));
+      }
+
+    PlotSeriesNode->SetAndObserveTableNodeID(tableNode->GetID());
+    PlotSeriesNode->SetXColumnName("Channel");
+    PlotSeriesNode->SetYColumnName(columnNames[seriesCnt]);
+    PlotSeriesNodes[seriesCnt] = PlotSeriesNode;
+    }
+
+  vtkSmartPointer<vtkCollection> PlotChartNodes = vtkSmartPointer<vtkCollection>::Take
+      (scene->GetNodesByClassByName("vtkMRMLPlotChartNode", tableNode->GetName()));
+  vtkMRMLPlotChartNode *PlotChartNode = NULL;
+  if (PlotChartNodes->GetNumberOfItems() == 0)
+    {
+    vtkNew<vtkMRMLPlotChartNode> newPlotChartNode;
+    newPlotChartNode->SetName(tableNode->GetName());
+    newPlotChartNode->SetXAxisTitle("Channel");
+    newPlotChartNode->SetYAxisTitle("Intensity (Jy/beam)");
+    scene->AddNode(newPlotChartNode.GetPointer());
+    PlotChartNode = newPlotChartNode.GetPointer();
+    }
+  else
+    {
+    PlotChartNode = vtkMRMLPlotChartNode::SafeDownCast
+      (PlotChartNodes->GetItemAsObject(0));
+    }
+
+  PlotChartNode->RemoveAllPlotSeriesNodeIDs();
+  for (int seriesCnt = 0; seriesCnt < numberOfSeries; seriesCnt++)
+    {
+    PlotChartNode->AddAndObservePlotSeriesNodeID(PlotSeriesNodes[seriesCnt]->GetID());
+    }
+
+  vtkMRMLLayoutNode* layoutNode = vtkMRMLLayoutNode::SafeDownCast(
+    scene->GetFirstNodeByClass("vtkMRMLLayoutNode"));
+  if (layoutNode)
+    {
+    int viewArra = layoutNode->GetViewArrangement();
+    if (viewArra != vtkMRMLLayoutNode::SlicerLayoutConventionalPlotView  &&
+        viewArra != vtkMRMLLayoutNode::SlicerLayoutFourUpPlotView        &&
+        viewArra != vtkMRMLLayoutNode::SlicerLayoutFourUpPlotTableView   &&
+        viewArra != vtkMRMLLayoutNode::SlicerLayoutOneUpPlotView         &&
+        viewArra != vtkMRMLLayoutNode::SlicerLayoutThreeOverThreePlotView)
+      {
+      layoutNode->SetViewArrangement(vtkMRMLLayoutNode::SlicerLayoutConventionalPlotView);
+      }
+    }
+
+  if (d->selectionNode)
+    {
+    d->selectionNode->SetActivePlotChartID(PlotChartNode->GetID());
+    d->selectionNode->SetActiveTableID(tableNode->GetID());
+    }
+
+  vtkSlicerApplicationLogic *appLogic = this->module()->appLogic();
+  if (!appLogic)
+    {
+    qCritical() << "qSlicerAstroStatisticsModuleWidget::plotChannelStatistics"
+                   " : appLogic not found!";
+    return;
+    }
+
+  appLogic->PropagatePlotChartSelection();
+}
+
+//-----------------------------------------------------------------------------
+void qSlicerAstroStatisticsModuleWidget::calculateSegmentStatistics()
+{
+  Q_D(qSlicerAstroStatisticsModuleWidget);
+
+  vtkSlicerAstroStatisticsLogic *logic = d->logic();
+  if (!d->parametersNode || !logic || !this->mrmlScene())
+    {
+    return;
+    }
+
+  QStringList selectedSegmentIDs = d->SegmentsTableView->selectedSegmentIDs();
+  if (selectedSegmentIDs.size() < 1)
+    {
+    QString message = QString("No segment selected from the segmentation node! Please provide a segment.");
+    qCritical() << Q_FUNC_INFO << ": " << message;
+    QMessageBox::warning(NULL, tr("Failed to select a segment"), message);
+    return;
+    }
+
+  // the mask holds one bit per segment: the selected segments
+  // are processed in groups of at most 16 segments
+  const int maxNumberOfSegments = vtkSlicerAstroStatisticsLogic::GetMaximumNumberOfMaskSegments();
+  for (int firstSegment = 0; firstSegment < selectedSegmentIDs.size(); firstSegment += maxNumberOfSegments)
+    {
+    QStringList segmentIDs = selectedSegmentIDs.mid(firstSegment, maxNumberOfSegments);
+    if (!this->convertSelectedSegmentToLabelMap(segmentIDs))
+      {
+      qCritical() <<"qSlicerAstroStatisticsModuleWidget::calculateSegmentStatistics : "
+                    "convertSelectedSegmentToLabelMap failed!";
+      break;
+      }
+
+    const int firstSerial = d->parametersNode->GetOutputSerial() - 1;
+    const bool success = logic->CalculateStatistics(d->parametersNode);
+
     vtkMRMLAstroLabelMapVolumeNode *maskVolume =
       vtkMRMLAstroLabelMapVolumeNode::SafeDownCast
         (this->mrmlScene()->GetNodeByID(d->parametersNode->GetMaskVolumeNodeID()));
@@ -1327,10 +1678,55 @@ void qSlicerAstroStatisticsModuleWidget::onCalculate()
       {
       this->mrmlScene()->RemoveNode(maskVolume);
       }
+
+    if (!success)
+      {
+      qCritical() <<"qSlicerAstroStatisticsModuleWidget::calculateSegmentStatistics : "
+                    "CalculateStatistics error!";
+      break;
+      }
+
+    this->setSelectionNamesFromSegments(firstSerial, segmentIDs);
     }
 
-  d->parametersNode->SetStatus(0);
-  d->OutputCollapsibleButton->setCollapsed(false);
+  d->parametersNode->SetNumberOfMaskSegments(0);
+}
+
+//-----------------------------------------------------------------------------
+void qSlicerAstroStatisticsModuleWidget::setSelectionNamesFromSegments(int firstSerial,
+                                                                       const QStringList& segmentIDs)
+{
+  Q_D(qSlicerAstroStatisticsModuleWidget);
+
+  if (!d->parametersNode || !d->segmentEditorNode || !d->astroTableNode)
+    {
+    return;
+    }
+
+  vtkMRMLSegmentationNode* currentSegmentationNode = d->segmentEditorNode->GetSegmentationNode();
+  vtkMRMLAstroVolumeNode* inputVolume = vtkMRMLAstroVolumeNode::SafeDownCast(
+    this->mrmlScene()->GetNodeByID(d->parametersNode->GetInputVolumeNodeID()));
+  if (!currentSegmentationNode || !currentSegmentationNode->GetSegmentation() || !inputVolume)
+    {
+    return;
+    }
+
+  // the rows follow the bits of the mask, i.e. the order of the segments
+  int lastSerial = d->parametersNode->GetOutputSerial() - 1;
+  for (int segmentIndex = 0; segmentIndex < segmentIDs.size(); segmentIndex++)
+    {
+    int serial = firstSerial + segmentIndex;
+    vtkSegment* segment = currentSegmentationNode->GetSegmentation()->GetSegment(
+      segmentIDs[segmentIndex].toStdString());
+    if (serial >= lastSerial || !segment)
+      {
+      continue;
+      }
+    std::string CellText(inputVolume->GetName());
+    CellText += "_";
+    CellText += segment->GetName();
+    d->astroTableNode->SetCellText(serial, 0, CellText.c_str());
+    }
 }
 
 //-----------------------------------------------------------------------------
@@ -1434,6 +1830,19 @@ void qSlicerAstroStatisticsModuleWidget::onTotalFluxToggled(bool toggled)
   d->parametersNode->SetTotalFlux(toggled);
 }
 
+//-----------------------------------------------------------------------------
+void qSlicerAstroStatisticsModuleWidget::onNoiseToggled(bool toggled)
+{
+  Q_D(qSlicerAstroStatisticsModuleWidget);
+
+  if (!d->parametersNode)
+    {
+    return;
+    }
+
+  d->parametersNode->SetNoise(toggled);
+}
+
 //-----------------------------------------------------------------------------
 void qSlicerAstroStatisticsModuleWidget::onComputationCancelled()
 {
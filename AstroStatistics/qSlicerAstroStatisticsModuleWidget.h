@@ -76,10 +76,25 @@ protected:
   /// Initialization of MRML table node
   void initializeTableNode(bool forceNew = false);
 
-  /// Convert a segmentation to LabelMap volume (a mask).
-  /// The LabelMap ID is stored in the MRML parameter node of the module
+  /// Convert the segments (at most 16) to a LabelMap volume (a mask),
+  /// with one bit per segment, so that overlapping segments share voxels.
+  /// The LabelMap ID and the number of segments are stored in the
+  /// MRML parameter node of the module
   /// \return Success flag
-  bool convertSelectedSegmentToLabelMap();
+  bool convertSelectedSegmentToLabelMap(const QStringList& segmentIDs);
+
+  /// Calculate the statistics of the selected segments, one row per segment
+  void calculateSegmentStatistics();
+
+  /// Name the table rows written from firstSerial after the segments
+  void setSelectionNamesFromSegments(int firstSerial, const QStringList& segmentIDs);
+
+  /// Create (or reuse) the table node of the per-channel statistics
+  /// and set it in the MRML parameter node
+  void initializeChannelTableNode();
+
+  /// Plot the RMS and the maximum of the per-channel statistics versus the channel
+  void plotChannelStatistics();
 
   /// Initialization of module widgets
   virtual void setup();
@@ -111,10 +126,16 @@ protected slots:
   void onMaxToggled(bool toggled);
   void onMeanToggled(bool toggled);
   void onMedianToggled(bool toggled);
+  void onIntegralVolumeToggled(bool toggled);
   void onMinToggled(bool toggled);
   void onModeChanged();
+  void onNoiseToggled(bool toggled);
   void onNpixelsToggled(bool toggled);
   void onROIFit();
+
+  /// Update the statistics of the ROI from the integral volume
+  /// while the ROI is modified (e.g. dragged)
+  void onROIModified();
   void onROIVisibilityChanged(bool visible);
   void onSumToggled(bool toggled);
   void onStdToggled(bool toggled);
@@ -19,6 +19,9 @@
 
 // STD includes
 #include <algorithm>
+#include <cmath>
+#include <limits>
+#include <vector>
 
 // Slicer includes
 #include <vtkSlicerVolumesLogic.h>
@@ -28,9 +31,13 @@
 #include <vtkSlicerAstroConfigure.h>
 
 // MRML nodes includes
+#include <vtkAstroProgressToken.h>
+#include <vtkAstroRobustNoise.h>
+#include <vtkAstroThreadBudget.h>
 #include <vtkMRMLAnnotationROINode.h>
 #include <vtkMRMLAstroLabelMapVolumeNode.h>
 #include <vtkMRMLAstroLabelMapVolumeDisplayNode.h>
+#include <vtkMRMLAstroMaskingParametersNode.h>
 #include <vtkMRMLAstroReprojectParametersNode.h>
 #include <vtkMRMLAstroVolumeNode.h>
 #include <vtkMRMLAstroVolumeDisplayNode.h>
@@ -60,6 +67,7 @@
 #include <vtkCacheManager.h>
 #include <vtkCollection.h>
 #include <vtkColorTransferFunction.h>
+#include <vtkDoubleArray.h>
 #include <vtkGeneralTransform.h>
 #include <vtkImageData.h>
 #include <vtkIntArray.h>
@@ -135,6 +143,48 @@ bool FloatIsNaN(float Value)
   return isNaN<float>(Value);
 }
 
+//----------------------------------------------------------------------------
+// Copy numElements values in parallel with the static partition used by
+// the processing loops. The memory pages of outPixel are physically
+// allocated at the first write, therefore each page ends on the NUMA node
+// of the thread which will process it.
+template <typename T> void ParallelCopy(const T *inPixel, T *outPixel, vtkIdType numElements)
+{
+  #ifdef VTK_SLICER_ASTRO_SUPPORT_OPENMP
+  #pragma omp parallel for schedule(static)
+  #endif // VTK_SLICER_ASTRO_SUPPORT_OPENMP
+  for (vtkIdType elemCnt = 0; elemCnt < numElements; elemCnt++)
+    {
+    *(outPixel + elemCnt) = *(inPixel + elemCnt);
+    }
+}
+
+//----------------------------------------------------------------------------
+// Copy the scalars of inData in outData (same number of values and data type)
+// with ParallelCopy. Returns false if the data type is not supported.
+bool ParallelCopyScalars(vtkImageData *inData, vtkImageData *outData)
+{
+  vtkDataArray *inScalars = inData->GetPointData()->GetScalars();
+  vtkDataArray *outScalars = outData->GetPointData()->GetScalars();
+  const vtkIdType numElements = inScalars->GetNumberOfTuples() * inScalars->GetNumberOfComponents();
+  switch (inScalars->GetDataType())
+    {
+    case VTK_FLOAT:
+      ParallelCopy<float>(static_cast<float*> (inScalars->GetVoidPointer(0)),
+                          static_cast<float*> (outScalars->GetVoidPointer(0)), numElements);
+      return true;
+    case VTK_DOUBLE:
+      ParallelCopy<double>(static_cast<double*> (inScalars->GetVoidPointer(0)),
+                           static_cast<double*> (outScalars->GetVoidPointer(0)), numElements);
+      return true;
+    case VTK_SHORT:
+      ParallelCopy<short>(static_cast<short*> (inScalars->GetVoidPointer(0)),
+                          static_cast<short*> (outScalars->GetVoidPointer(0)), numElements);
+      return true;
+    }
+  return false;
+}
+
 }// end namespace
 
 //----------------------------------------------------------------------------
@@ -626,7 +676,7 @@ vtkMRMLAstroVolumeNode* vtkSlicerAstroVolumeLogic::CloneAstroVolume(vtkMRMLScene
                                                                     vtkMRMLAstroVolumeNode *inputVolume,
                                                                     vtkMRMLAstroVolumeNode *outputVolume,
                                                                     const char *outputNameReference,
-                                                                    const char *name, bool cloneImageData /* = true */)
+                                                                    const char *name, CloneImageDataType cloneImageData /* = CopyImageData */)
 {
   if (!scene || !inputVolume || !outputNameReference || !name)
     {
@@ -659,8 +709,33 @@ vtkMRMLAstroVolumeNode* vtkSlicerAstroVolumeLogic::CloneAstroVolume(vtkMRMLScene
       }
     }
 
+  // The image data are not deep-copied by CloneVolume: the buffer is
+  // allocated and then filled in parallel by ParallelCopyScalars.
   outputVolume = vtkMRMLAstroVolumeNode::SafeDownCast
-     (this->CloneVolume(scene, inputVolume, name, cloneImageData));
+     (this->CloneVolume(scene, inputVolume, name, false));
+
+  vtkImageData *inputImage = inputVolume->GetImageData();
+  if (cloneImageData != NoImageData && inputImage && inputImage->GetPointData()->GetScalars())
+    {
+    vtkNew<vtkImageData> imageData;
+    imageData->CopyStructure(inputImage);
+    imageData->AllocateScalars(inputImage->GetScalarType(),
+                               inputImage->GetNumberOfScalarComponents());
+    imageData->GetPointData()->GetScalars()->SetName
+      (inputImage->GetPointData()->GetScalars()->GetName());
+
+    // the pages of an allocated buffer are first touched by the operation
+    // filling it, i.e. with the partition of its processing loops.
+    if (cloneImageData == CopyImageData)
+      {
+      vtkAstroThreadBudget threadBudget;
+      if (!ParallelCopyScalars(inputImage, imageData.GetPointer()))
+        {
+        imageData->DeepCopy(inputImage);
+        }
+      }
+    outputVolume->SetAndObserveImageData(imageData.GetPointer());
+    }
 
   int ndnodes = outputVolume->GetNumberOfDisplayNodes();
   for (int ii = 0; ii < ndnodes; ii++)
@@ -682,6 +757,36 @@ vtkMRMLAstroVolumeNode* vtkSlicerAstroVolumeLogic::CloneAstroVolume(vtkMRMLScene
   return outputVolume;
 }
 
+//---------------------------------------------------------------------------
+void vtkSlicerAstroVolumeLogic::RemoveAstroVolume(vtkMRMLScene *scene,
+                                                  vtkMRMLAstroVolumeNode *volumeNode)
+{
+  if (!scene || !volumeNode)
+    {
+    return;
+    }
+
+  scene->RemoveNode(volumeNode->GetStorageNode());
+
+  std::vector<vtkMRMLDisplayNode*> displayNodes;
+  for (int ii = 0; ii < volumeNode->GetNumberOfDisplayNodes(); ii++)
+    {
+    displayNodes.push_back(volumeNode->GetNthDisplayNode(ii));
+    }
+  for (size_t ii = 0; ii < displayNodes.size(); ii++)
+    {
+    vtkMRMLVolumeRenderingDisplayNode *volumeRenderingDisplay =
+      vtkMRMLVolumeRenderingDisplayNode::SafeDownCast(displayNodes[ii]);
+    if (volumeRenderingDisplay)
+      {
+      scene->RemoveNode(volumeRenderingDisplay->GetROINode());
+      }
+    scene->RemoveNode(displayNodes[ii]);
+    }
+
+  scene->RemoveNode(volumeNode);
+}
+
 //---------------------------------------------------------------------------
 vtkMRMLAstroLabelMapVolumeNode *vtkSlicerAstroVolumeLogic::CreateAndAddLabelVolume(vtkMRMLScene *scene,
                                                                                    vtkMRMLAstroVolumeNode *volumeNode,
@@ -1149,11 +1254,9 @@ double vtkSlicerAstroVolumeLogic::CalculateDisplayThresholdInROI(vtkMRMLAnnotati
    return 0.;
    }
 
-  // Calculate the noise as the std in a roi.
+  // Calculate the noise as the sigma-clipped RMS in a roi.
   // The DisplayThreshold = noise
   // 3D color function starts from 3 times the value of DisplayThreshold.
-
-  int *dims = inputVolume->GetImageData()->GetDimensions();
   int numComponents = inputVolume->GetImageData()->GetNumberOfScalarComponents();
   if (numComponents > 1)
     {
@@ -1161,171 +1264,220 @@ double vtkSlicerAstroVolumeLogic::CalculateDisplayThresholdInROI(vtkMRMLAnnotati
                   "imageData with more than one components.");
     return 0.;
     }
-  int numSlice = dims[0] * dims[1];
   const int DataType = inputVolume->GetImageData()->GetPointData()->GetScalars()->GetDataType();
-  float *inFPixel = NULL;
-  double *inDPixel = NULL;
-  switch (DataType)
+  if (DataType != VTK_FLOAT && DataType != VTK_DOUBLE)
     {
-    case VTK_FLOAT:
-      inFPixel = static_cast<float*> (inputVolume->GetImageData()->GetScalarPointer(0,0,0));
-      break;
-    case VTK_DOUBLE:
-      inDPixel = static_cast<double*> (inputVolume->GetImageData()->GetScalarPointer(0,0,0));
-      break;
-    default:
-      vtkErrorMacro("vtkSlicerAstroVolumeLogic::CalculateRMSinROI : "
-                    "attempt to allocate scalars of type not allowed");
-      return 0.;
+    vtkErrorMacro("vtkSlicerAstroVolumeLogic::CalculateRMSinROI : "
+                  "attempt to allocate scalars of type not allowed");
+    return 0.;
     }
 
-  double noise = 0., mean = 0., roiBounds[6];
-  int cont = 0, firstElement, lastElement;
-
+  double roiBounds[6];
   this->CalculateROICropVolumeBounds(roiNode, inputVolume, roiBounds);
 
-  cont = (roiBounds[1] - roiBounds[0]) *
-         (roiBounds[3] - roiBounds[2]) *
-         (roiBounds[5] - roiBounds[4]);
+  // the voxels within the bounds (included), as in the statistics module
+  int roiExtent[6];
+  for (int ii = 0; ii < 6; ii += 2)
+    {
+    roiExtent[ii] = (int) ceil(roiBounds[ii]);
+    roiExtent[ii + 1] = (int) floor(roiBounds[ii + 1]);
+    }
 
-  firstElement = roiBounds[0] + roiBounds[2] * dims[0] +
-                 roiBounds[4] * numSlice;
+  vtkAstroRobustNoise noiseEstimator;
+  noiseEstimator.SetEstimator(vtkAstroRobustNoise::SigmaClipping);
+  noiseEstimator.SetExtent(roiExtent);
+  double noise = noiseEstimator.Estimate(inputVolume->GetImageData());
 
-  lastElement = (roiBounds[1] + roiBounds[3] * dims[0] +
-                roiBounds[5] * numSlice) + 1;
+  inputVolume->SetDisplayThreshold(noise);
+
+  return noise;
+}
+
+namespace
+{
+//----------------------------------------------------------------------------
+// Linear bins of width 1 / InverseWidth starting at Origin. Values beyond
+// the last bin are discarded, except the upper edge of the range (DATAMAX)
+// which belongs to the last bin.
+struct LinearBinner
+{
+  double Origin;
+  double InverseWidth;
+  int NumberOfBins;
+
+  int operator()(double value) const
+  {
+    double position = (value - this->Origin) * this->InverseWidth;
+    if (position < 0. || position > this->NumberOfBins)
+      {
+      return -1;
+      }
+    int binIndex = (int) position;
+    return binIndex < this->NumberOfBins ? binIndex : this->NumberOfBins - 1;
+  }
+};
+
+//----------------------------------------------------------------------------
+// Bins linear in sign(x) * log10(1 + |x| / Scale): logarithmic for
+// |x| >> Scale and linear within the noise (Scale = DisplayThreshold).
+struct LogarithmicBinner
+{
+  double Scale;
+  LinearBinner Linear;
+
+  static double Transform(double value, double scale)
+  {
+    double transformed = log10(1. + fabs(value) / scale);
+    return value < 0. ? -transformed : transformed;
+  }
+
+  static double InverseTransform(double transformed, double scale)
+  {
+    double value = (pow(10., fabs(transformed)) - 1.) * scale;
+    return transformed < 0. ? -value : value;
+  }
+
+  int operator()(double value) const
+  {
+    return this->Linear(Transform(value, this->Scale));
+  }
+};
+
+//----------------------------------------------------------------------------
+// Bins with arbitrary (non decreasing) edges, located by binary search.
+struct EdgesBinner
+{
+  const double* Edges;
+  int NumberOfBins;
+
+  int operator()(double value) const
+  {
+    if (value < this->Edges[0] || value > this->Edges[this->NumberOfBins])
+      {
+      return -1;
+      }
+    return (int) (std::upper_bound(this->Edges + 1, this->Edges + this->NumberOfBins, value)
+                  - (this->Edges + 1));
+  }
+};
+
+//----------------------------------------------------------------------------
+// Histogram of the non blank voxels. Every thread fills a private histogram
+// over a static block of voxels; the private histograms are summed at the end.
+template <typename T, typename Binner>
+void AccumulateHistogram(const T* inPixel, vtkIdType numElements,
+                         const Binner& binner, int numberOfBins,
+                         std::vector<vtkIdType>& counts)
+{
+  counts.assign(numberOfBins, 0);
 
   #ifdef VTK_SLICER_ASTRO_SUPPORT_OPENMP
-  omp_set_num_threads(omp_get_num_procs());
+  #pragma omp parallel
   #endif // VTK_SLICER_ASTRO_SUPPORT_OPENMP
+  {
+  std::vector<vtkIdType> threadCounts(numberOfBins, 0);
 
-  switch (DataType)
+  #ifdef VTK_SLICER_ASTRO_SUPPORT_OPENMP
+  #pragma omp for schedule(static)
+  #endif // VTK_SLICER_ASTRO_SUPPORT_OPENMP
+  for (vtkIdType elemCnt = 0; elemCnt < numElements; elemCnt++)
     {
-    case VTK_FLOAT:
-      #ifdef VTK_SLICER_ASTRO_SUPPORT_OPENMP
-      #pragma omp parallel for schedule(static) reduction(+:mean)
-      #endif // VTK_SLICER_ASTRO_SUPPORT_OPENMP
-      for (int elemCnt = firstElement; elemCnt < lastElement; elemCnt++)
-        { 
-        int ref  = (int) floor(elemCnt / dims[0]);
-        ref *= dims[0];
-        int x = elemCnt - ref;
-        ref = (int) floor(elemCnt / numSlice);
-        ref *= numSlice;
-        ref = elemCnt - ref;
-        int y = (int) floor(ref / dims[0]);
-        if (x < roiBounds[0] || x > roiBounds[1] ||
-            y < roiBounds[2] || y > roiBounds[3])
-          {
-          continue;
-          }
-        if (FloatIsNaN(*(inFPixel + elemCnt)))
-          {
-          continue;
-          }
-        mean += *(inFPixel + elemCnt);
-        }
-      mean /= cont;
+    const T value = *(inPixel + elemCnt);
+    if (value != value)
+      {
+      continue;
+      }
+    int binIndex = binner(value);
+    if (binIndex >= 0)
+      {
+      threadCounts[binIndex]++;
+      }
+    }
 
-      #ifdef VTK_SLICER_ASTRO_SUPPORT_OPENMP
-      #pragma omp parallel for schedule(static) reduction(+:noise)
-      #endif // VTK_SLICER_ASTRO_SUPPORT_OPENMP
-      for (int elemCnt = firstElement; elemCnt < lastElement; elemCnt++)
-        {
-        int ref  = (int) floor(elemCnt / dims[0]);
-        ref *= dims[0];
-        int x = elemCnt - ref;
-        ref = (int) floor(elemCnt / numSlice);
-        ref *= numSlice;
-        ref = elemCnt - ref;
-        int y = (int) floor(ref / dims[0]);
-        if (x < roiBounds[0] || x > roiBounds[1] ||
-            y < roiBounds[2] || y > roiBounds[3])
-          {
-          continue;
-          }
-        if (FloatIsNaN(*(inFPixel + elemCnt)))
-          {
-          continue;
-          }
-        noise += (*(inFPixel + elemCnt) - mean) * (*(inFPixel + elemCnt) - mean);
-        }
-      noise = sqrt(noise / cont);
-      break;
-    case VTK_DOUBLE:
-      #ifdef VTK_SLICER_ASTRO_SUPPORT_OPENMP
-      #pragma omp parallel for schedule(static) reduction(+:mean)
-      #endif // VTK_SLICER_ASTRO_SUPPORT_OPENMP
-      for (int elemCnt = firstElement; elemCnt < lastElement; elemCnt++)
-        {
-        int ref  = (int) floor(elemCnt / dims[0]);
-        ref *= dims[0];
-        int x = elemCnt - ref;
-        ref = (int) floor(elemCnt / numSlice);
-        ref *= numSlice;
-        ref = elemCnt - ref;
-        int y = (int) floor(ref / dims[0]);
-        if (x < roiBounds[0] || x > roiBounds[1] ||
-            y < roiBounds[2] || y > roiBounds[3])
-          {
-          continue;
-          }
-        if (DoubleIsNaN(*(inDPixel + elemCnt)))
-          {
-          continue;
-          }
-        mean += *(inDPixel + elemCnt);
-        }
-      mean /= cont;
+  #ifdef VTK_SLICER_ASTRO_SUPPORT_OPENMP
+  #pragma omp critical
+  #endif // VTK_SLICER_ASTRO_SUPPORT_OPENMP
+  for (int binCnt = 0; binCnt < numberOfBins; binCnt++)
+    {
+    counts[binCnt] += threadCounts[binCnt];
+    }
+  }
+}
 
-      #ifdef VTK_SLICER_ASTRO_SUPPORT_OPENMP
-      #pragma omp parallel for schedule(static) reduction(+:noise)
-      #endif // VTK_SLICER_ASTRO_SUPPORT_OPENMP
-      for (int elemCnt = firstElement; elemCnt < lastElement; elemCnt++)
-        {
-        int ref  = (int) floor(elemCnt / dims[0]);
-        ref *= dims[0];
-        int x = elemCnt - ref;
-        ref = (int) floor(elemCnt / numSlice);
-        ref *= numSlice;
-        ref = elemCnt - ref;
-        int y = (int) floor(ref / dims[0]);
-        if (x < roiBounds[0] || x > roiBounds[1] ||
-            y < roiBounds[2] || y > roiBounds[3])
-          {
-          continue;
-          }
-        if (DoubleIsNaN(*(inDPixel + elemCnt)))
-          {
-          continue;
-          }
-        noise += (*(inDPixel + elemCnt) - mean) * (*(inDPixel + elemCnt) - mean);
-        }
-      noise = sqrt(noise / cont);
-      break;
+//----------------------------------------------------------------------------
+template <typename Binner>
+bool AccumulateHistogram(vtkImageData* imageData, const Binner& binner,
+                         int numberOfBins, std::vector<vtkIdType>& counts)
+{
+  int *dims = imageData->GetDimensions();
+  vtkIdType numElements = (vtkIdType) dims[0] * dims[1] * dims[2];
+  switch (imageData->GetPointData()->GetScalars()->GetDataType())
+    {
+    case VTK_FLOAT:
+      AccumulateHistogram(static_cast<float*> (imageData->GetScalarPointer(0,0,0)),
+                          numElements, binner, numberOfBins, counts);
+      return true;
+    case VTK_DOUBLE:
+      AccumulateHistogram(static_cast<double*> (imageData->GetScalarPointer(0,0,0)),
+                          numElements, binner, numberOfBins, counts);
+      return true;
+    default:
+      return false;
     }
+}
 
-  inFPixel = NULL;
-  inDPixel = NULL;
-  delete inFPixel;
-  delete inDPixel;
+//----------------------------------------------------------------------------
+// Number of fine linear bins per adaptive bin used to locate the edges
+const int AdaptiveBinsOversampling = 64;
 
-  inputVolume->SetDisplayThreshold(noise);
+//----------------------------------------------------------------------------
+// Edges of bins holding (about) the same number of voxels: the quantiles
+// of the data are interpolated in a fine linear histogram of the data range.
+void CalculateAdaptiveBinEdges(const std::vector<vtkIdType>& fineCounts,
+                               double DATAMIN, double fineWidth,
+                               int numberOfBins, std::vector<double>& edges)
+{
+  vtkIdType total = 0;
+  for (size_t fineCnt = 0; fineCnt < fineCounts.size(); fineCnt++)
+    {
+    total += fineCounts[fineCnt];
+    }
 
-  return noise;
+  edges.resize(numberOfBins + 1);
+  edges[0] = DATAMIN;
+  edges[numberOfBins] = DATAMIN + fineWidth * fineCounts.size();
+
+  size_t fineCnt = 0;
+  vtkIdType below = 0;
+  for (int binCnt = 1; binCnt < numberOfBins; binCnt++)
+    {
+    double rank = (double) total * binCnt / numberOfBins;
+    while (fineCnt < fineCounts.size() - 1 && below + fineCounts[fineCnt] <= rank)
+      {
+      below += fineCounts[fineCnt];
+      fineCnt++;
+      }
+    double fraction = fineCounts[fineCnt] > 0 ?
+      (rank - below) / fineCounts[fineCnt] : 0.;
+    edges[binCnt] = std::max(edges[binCnt - 1],
+                             DATAMIN + fineWidth * (fineCnt + std::min(fraction, 1.)));
+    }
 }
 
+}// end namespace
+
 //---------------------------------------------------------------------------
 void vtkSlicerAstroVolumeLogic::CalculateHistogram(vtkMRMLAstroVolumeNode *inputVolume,
                                                    vtkIntArray *histoArray,
                                                    double binSpacing,
                                                    int numberOfBins)
 {
-  if (!inputVolume || !inputVolume->GetImageData())
+  if (!inputVolume || !inputVolume->GetImageData() || !histoArray ||
+      binSpacing <= 0. || numberOfBins < 1)
    {
    return;
    }
 
-  int *dims = inputVolume->GetImageData()->GetDimensions();
   int numComponents = inputVolume->GetImageData()->GetNumberOfScalarComponents();
   if (numComponents > 1)
     {
@@ -1333,63 +1485,504 @@ void vtkSlicerAstroVolumeLogic::CalculateHistogram(vtkMRMLAstroVolumeNode *input
                   "imageData with more than one components.");
     return;
     }
-  int numElements = dims[0] * dims[1] * dims[2];
-  const int DataType = inputVolume->GetImageData()->GetPointData()->GetScalars()->GetDataType();
-  float *inFPixel = NULL;
-  double *inDPixel = NULL;
-  switch (DataType)
+
+  LinearBinner binner;
+  binner.Origin = StringToDouble(inputVolume->GetAttribute("SlicerAstro.DATAMIN"));
+  binner.InverseWidth = 1. / binSpacing;
+  binner.NumberOfBins = numberOfBins;
+
+  vtkAstroThreadBudget threadBudget;
+
+  std::vector<vtkIdType> counts;
+  if (!AccumulateHistogram(inputVolume->GetImageData(), binner, numberOfBins, counts))
     {
-    case VTK_FLOAT:
-      inFPixel = static_cast<float*> (inputVolume->GetImageData()->GetScalarPointer(0,0,0));
+    vtkErrorMacro("vtkSlicerAstroVolumeLogic::CalculateHistogram : "
+                  "attempt to allocate scalars of type not allowed");
+    return;
+    }
+
+  histoArray->SetNumberOfValues(numberOfBins);
+  for (int histoIndex = 0; histoIndex < numberOfBins; histoIndex++)
+    {
+    histoArray->SetValue(histoIndex, counts[histoIndex]);
+    }
+}
+
+//---------------------------------------------------------------------------
+bool vtkSlicerAstroVolumeLogic::CalculateHistogram(vtkMRMLAstroVolumeNode *inputVolume,
+                                                   vtkIntArray *histoArray,
+                                                   vtkDoubleArray *binEdges,
+                                                   int numberOfBins,
+                                                   int binning)
+{
+  if (!inputVolume || !inputVolume->GetImageData() ||
+      !histoArray || !binEdges || numberOfBins < 1)
+   {
+   return false;
+   }
+
+  int numComponents = inputVolume->GetImageData()->GetNumberOfScalarComponents();
+  if (numComponents > 1)
+    {
+    vtkErrorMacro("vtkSlicerAstroVolumeLogic::CalculateHistogram : "
+                  "imageData with more than one components.");
+    return false;
+    }
+
+  double DATAMIN = StringToDouble(inputVolume->GetAttribute("SlicerAstro.DATAMIN"));
+  double DATAMAX = StringToDouble(inputVolume->GetAttribute("SlicerAstro.DATAMAX"));
+  double DisplayThreshold = StringToDouble(inputVolume->GetAttribute("SlicerAstro.DisplayThreshold"));
+  if (DisplayThreshold < 1.E-6)
+    {
+    DisplayThreshold = (DATAMAX - DATAMIN) * 0.01;
+    }
+  if (!(DATAMAX > DATAMIN))
+    {
+    vtkErrorMacro("vtkSlicerAstroVolumeLogic::CalculateHistogram : "
+                  "invalid data range.");
+    return false;
+    }
+
+  const double parameters[3] = {DATAMIN, DATAMAX, DisplayThreshold};
+  if (inputVolume->GetCachedHistogram(histoArray, binEdges, binning, numberOfBins, parameters))
+    {
+    return true;
+    }
+
+  vtkAstroThreadBudget threadBudget;
+
+  struct timeval start, end;
+
+  long mtime, seconds, useconds;
+
+  gettimeofday(&start, NULL);
+
+  std::vector<vtkIdType> counts;
+  std::vector<double> edges(numberOfBins + 1);
+  bool supported = false;
+  switch (binning)
+    {
+    case LinearBins:
+      {
+      LinearBinner binner;
+      binner.Origin = DATAMIN;
+      binner.InverseWidth = numberOfBins / (DATAMAX - DATAMIN);
+      binner.NumberOfBins = numberOfBins;
+      for (int binCnt = 0; binCnt <= numberOfBins; binCnt++)
+        {
+        edges[binCnt] = DATAMIN + (DATAMAX - DATAMIN) * binCnt / numberOfBins;
+        }
+      supported = AccumulateHistogram(inputVolume->GetImageData(), binner, numberOfBins, counts);
       break;
-    case VTK_DOUBLE:
-      inDPixel = static_cast<double*> (inputVolume->GetImageData()->GetScalarPointer(0,0,0));
+      }
+    case LogarithmicBins:
+      {
+      LogarithmicBinner binner;
+      binner.Scale = DisplayThreshold;
+      double lower = LogarithmicBinner::Transform(DATAMIN, DisplayThreshold);
+      double upper = LogarithmicBinner::Transform(DATAMAX, DisplayThreshold);
+      binner.Linear.Origin = lower;
+      binner.Linear.InverseWidth = numberOfBins / (upper - lower);
+      binner.Linear.NumberOfBins = numberOfBins;
+      for (int binCnt = 1; binCnt < numberOfBins; binCnt++)
+        {
+        edges[binCnt] = LogarithmicBinner::InverseTransform
+          (lower + (upper - lower) * binCnt / numberOfBins, DisplayThreshold);
+        }
+      edges[0] = DATAMIN;
+      edges[numberOfBins] = DATAMAX;
+      supported = AccumulateHistogram(inputVolume->GetImageData(), binner, numberOfBins, counts);
       break;
+      }
+    case AdaptiveBins:
+      {
+      int numberOfFineBins = numberOfBins * AdaptiveBinsOversampling;
+      LinearBinner fineBinner;
+      fineBinner.Origin = DATAMIN;
+      fineBinner.InverseWidth = numberOfFineBins / (DATAMAX - DATAMIN);
+      fineBinner.NumberOfBins = numberOfFineBins;
+      std::vector<vtkIdType> fineCounts;
+      supported = AccumulateHistogram(inputVolume->GetImageData(), fineBinner,
+                                      numberOfFineBins, fineCounts);
+      if (!supported)
+        {
+        break;
+        }
+      CalculateAdaptiveBinEdges(fineCounts, DATAMIN, (DATAMAX - DATAMIN) / numberOfFineBins,
+                                numberOfBins, edges);
+      edges[numberOfBins] = DATAMAX;
+      EdgesBinner binner;
+      binner.Edges = &edges[0];
+      binner.NumberOfBins = numberOfBins;
+      AccumulateHistogram(inputVolume->GetImageData(), binner, numberOfBins, counts);
+      break;
+      }
     default:
       vtkErrorMacro("vtkSlicerAstroVolumeLogic::CalculateHistogram : "
-                    "attempt to allocate scalars of type not allowed");
-      return;
+                    "unknown binning.");
+      return false;
+    }
+
+  if (!supported)
+    {
+    vtkErrorMacro("vtkSlicerAstroVolumeLogic::CalculateHistogram : "
+                  "attempt to allocate scalars of type not allowed");
+    return false;
     }
 
   histoArray->SetNumberOfValues(numberOfBins);
-  for (int histoIndex = 0; histoIndex < histoArray->GetNumberOfValues(); histoIndex++)
+  binEdges->SetNumberOfValues(numberOfBins + 1);
+  for (int binCnt = 0; binCnt < numberOfBins; binCnt++)
     {
-    histoArray->SetValue(histoIndex, 0);
+    histoArray->SetValue(binCnt, counts[binCnt]);
+    binEdges->SetValue(binCnt, edges[binCnt]);
     }
+  binEdges->SetValue(numberOfBins, edges[numberOfBins]);
 
-  double DATAMIN = StringToDouble(inputVolume->GetAttribute("SlicerAstro.DATAMIN"));
+  inputVolume->SetCachedHistogram(histoArray, binEdges, binning, parameters);
 
-  #ifdef VTK_SLICER_ASTRO_SUPPORT_OPENMP
-  omp_set_num_threads(omp_get_num_procs());
-  #endif // VTK_SLICER_ASTRO_SUPPORT_OPENMP
+  gettimeofday(&end, NULL);
+
+  seconds  = end.tv_sec  - start.tv_sec;
+  useconds = end.tv_usec - start.tv_usec;
 
+  mtime = ((seconds) * 1000 + useconds/1000.0) + 0.5;
+  vtkDebugMacro("Histogram Time : "<<mtime<<" ms.");
+
+  return true;
+}
+
+namespace
+{
+//----------------------------------------------------------------------------
+// Grid of the local noise along one axis: the noise is evaluated every
+// step voxels, on windows of size voxels centred on the grid nodes.
+// A non positive size (or larger than the axis) gives a single node
+// whose window covers the whole axis.
+struct NoiseGridAxis
+{
+  std::vector<int> Nodes;
+  int HalfWindow;
+};
+
+//----------------------------------------------------------------------------
+NoiseGridAxis CreateNoiseGridAxis(int length, int size)
+{
+  NoiseGridAxis axis;
+  if (size <= 0 || size >= length)
+    {
+    axis.Nodes.push_back(length / 2);
+    axis.HalfWindow = length;
+    return axis;
+    }
+
+  axis.HalfWindow = size / 2;
+  const int step = std::max(size / 2, 1);
+  for (int node = 0; node < length - 1; node += step)
+    {
+    axis.Nodes.push_back(node);
+    }
+  axis.Nodes.push_back(length - 1);
+  return axis;
+}
+
+//----------------------------------------------------------------------------
+// Position of the voxels of an axis with respect to the grid nodes
+// (lower node and weight of the upper one) for the linear interpolation.
+void NoiseGridInterpolation(const NoiseGridAxis &axis, int length,
+                            std::vector<int> &lowerNode,
+                            std::vector<double> &upperWeight)
+{
+  lowerNode.assign(length, 0);
+  upperWeight.assign(length, 0.);
+  const int numNodes = (int) axis.Nodes.size();
+  if (numNodes < 2)
+    {
+    return;
+    }
+  int node = 0;
+  for (int ii = 0; ii < length; ii++)
+    {
+    while (node < numNodes - 2 && ii > axis.Nodes[node + 1])
+      {
+      node++;
+      }
+    lowerNode[ii] = node;
+    upperWeight[ii] = (double) (ii - axis.Nodes[node]) /
+                      (axis.Nodes[node + 1] - axis.Nodes[node]);
+    }
+}
+
+//----------------------------------------------------------------------------
+// Maximum number of voxels sampled to evaluate the noise of a grid node.
+// Larger windows (e.g., a size <= 0, which covers the whole axis) are
+// sampled every few rows by vtkAstroRobustNoise.
+const vtkIdType SignalToNoiseMaximumNumberOfSamples = 262144;
+
+//----------------------------------------------------------------------------
+// Divide the data by the local noise. The noise of each grid node is the
+// robust RMS (median absolute deviation, see vtkAstroRobustNoise) of the
+// valid voxels of its window; the noise of each voxel is interpolated
+// trilinearly from the grid nodes with a valid noise. Blanked (NaN) voxels
+// stay blanked. If pnode is not NULL, the progress is reported in its Status
+// and a Status of -1 cancels the computation (the function returns false).
+template <typename T> bool SignalToNoise(vtkImageData *inputImageData, T *outPixel, T *noisePixel,
+                                         const int *window,
+                                         vtkMRMLAstroMaskingParametersNode *pnode,
+                                         int firstStatus, int lastStatus)
+{
+  const T *inPixel = static_cast<T*> (inputImageData->GetScalarPointer(0,0,0));
+  const int *dims = inputImageData->GetDimensions();
+  NoiseGridAxis grid[3];
+  std::vector<int> lowerNode[3];
+  std::vector<double> upperWeight[3];
+  for (int axis = 0; axis < 3; axis++)
+    {
+    grid[axis] = CreateNoiseGridAxis(dims[axis], window[axis]);
+    NoiseGridInterpolation(grid[axis], dims[axis], lowerNode[axis], upperWeight[axis]);
+    }
+  const int gridDims[3] = {(int) grid[0].Nodes.size(),
+                           (int) grid[1].Nodes.size(),
+                           (int) grid[2].Nodes.size()};
+  const int numNodes = gridDims[0] * gridDims[1] * gridDims[2];
+  std::vector<double> gridNoise(numNodes, 0.);
+
+  const vtkIdType numLines = (vtkIdType) dims[1] * dims[2];
+  const int middleStatus = (firstStatus + lastStatus) / 2;
+  vtkAstroProgressToken nodesProgress(numNodes, firstStatus, middleStatus);
+  vtkAstroProgressToken linesProgress(numLines, middleStatus, lastStatus);
+
+  // noise on the grid nodes (the passes of the estimator run in parallel)
+  vtkAstroRobustNoise noiseEstimator;
+  noiseEstimator.SetEstimator(vtkAstroRobustNoise::MedianAbsoluteDeviation);
+  noiseEstimator.SetMaximumNumberOfSamples(SignalToNoiseMaximumNumberOfSamples);
+  for (int nodeCnt = 0; nodeCnt < numNodes; nodeCnt++)
+    {
+    nodesProgress.Synchronize(pnode);
+    if (nodesProgress.IsCancelled())
+      {
+      break;
+      }
+
+    const int node[3] = {nodeCnt % gridDims[0],
+                         (nodeCnt / gridDims[0]) % gridDims[1],
+                         nodeCnt / (gridDims[0] * gridDims[1])};
+    int extent[6];
+    for (int axis = 0; axis < 3; axis++)
+      {
+      const int center = grid[axis].Nodes[node[axis]];
+      extent[2 * axis] = std::max(center - grid[axis].HalfWindow, 0);
+      extent[2 * axis + 1] = std::min(center + grid[axis].HalfWindow, dims[axis] - 1);
+      }
+    noiseEstimator.SetExtent(extent);
+
+    // 0 if the window has no valid voxels
+    gridNoise[nodeCnt] = noiseEstimator.Estimate(inputImageData);
+    nodesProgress.AddWork(1);
+    }
+
+  if (nodesProgress.IsCancelled())
+    {
+    return false;
+    }
+
+  // interpolation of the noise and S/N in one pass over the data
+  const T NaN = std::numeric_limits<T>::quiet_NaN();
   #ifdef VTK_SLICER_ASTRO_SUPPORT_OPENMP
-  #pragma omp parallel for schedule(dynamic)
+  #pragma omp parallel for schedule(static)
   #endif // VTK_SLICER_ASTRO_SUPPORT_OPENMP
-  for (int elemCnt = 0; elemCnt < numElements; elemCnt++)
+  for (vtkIdType lineCnt = 0; lineCnt < numLines; lineCnt++)
     {
-    int histoIndex = 0;
-    switch (DataType)
+    #ifdef VTK_SLICER_ASTRO_SUPPORT_OPENMP
+    if (omp_get_thread_num() == 0)
+    #endif // VTK_SLICER_ASTRO_SUPPORT_OPENMP
       {
-      case VTK_FLOAT:
-        if (FloatIsNaN(*(inFPixel + elemCnt)))
+      linesProgress.Synchronize(pnode);
+      }
+    if (linesProgress.IsCancelled())
+      {
+      continue;
+      }
+
+    const int jj = lineCnt % dims[1];
+    const int kk = lineCnt / dims[1];
+    const vtkIdType start = lineCnt * dims[0];
+    for (int ii = 0; ii < dims[0]; ii++)
+      {
+      const int position[3] = {ii, jj, kk};
+      double noise = 0., weightSum = 0.;
+      for (int corner = 0; corner < 8; corner++)
+        {
+        double weight = 1.;
+        int nodeIndex = 0, stride = 1;
+        for (int axis = 0; axis < 3; axis++)
+          {
+          const bool upper = (corner >> axis) & 1;
+          int node = lowerNode[axis][position[axis]];
+          double axisWeight = 1. - upperWeight[axis][position[axis]];
+          if (upper)
+            {
+            if (gridDims[axis] < 2)
+              {
+              weight = 0.;
+              break;
+              }
+            node++;
+            axisWeight = upperWeight[axis][position[axis]];
+            }
+          weight *= axisWeight;
+          nodeIndex += node * stride;
+          stride *= gridDims[axis];
+          }
+        if (weight <= 0. || gridNoise[nodeIndex] <= 0.)
           {
           continue;
           }
-        histoIndex = (int) ((*(inFPixel + elemCnt) - DATAMIN) / binSpacing);
-        break;
-      case VTK_DOUBLE:
-        if (DoubleIsNaN(*(inDPixel + elemCnt)))
+        noise += weight * gridNoise[nodeIndex];
+        weightSum += weight;
+        }
+
+      const T value = *(inPixel + start + ii);
+      if (weightSum <= 0.)
+        {
+        *(outPixel + start + ii) = NaN;
+        if (noisePixel)
           {
-          continue;
+          *(noisePixel + start + ii) = NaN;
           }
-        histoIndex = (int) ((*(inDPixel + elemCnt) - DATAMIN) / binSpacing);
-        break;
+        continue;
+        }
+      noise /= weightSum;
+      *(outPixel + start + ii) = isNaN<T>(value) ? NaN : static_cast<T>(value / noise);
+      if (noisePixel)
+        {
+        *(noisePixel + start + ii) = static_cast<T>(noise);
+        }
       }
+    linesProgress.AddWork(1);
+    }
 
-    #pragma omp critical
-    histoArray->SetValue(histoIndex, histoArray->GetValue(histoIndex) + 1);
-  }
+  return !linesProgress.IsCancelled();
+}
+
+}// end namespace
+
+//---------------------------------------------------------------------------
+bool vtkSlicerAstroVolumeLogic::CalculateSignalToNoise(vtkMRMLAstroVolumeNode *inputVolume,
+                                                       vtkMRMLAstroVolumeNode *outputVolume,
+                                                       int windowXY, int windowZ,
+                                                       vtkMRMLAstroVolumeNode *noiseVolume,
+                                                       vtkMRMLAstroMaskingParametersNode *pnode,
+                                                       bool updateAttributes)
+{
+  if (!inputVolume || !inputVolume->GetImageData())
+    {
+    vtkErrorMacro("vtkSlicerAstroVolumeLogic::CalculateSignalToNoise : "
+                  "inputVolume not found.");
+    return false;
+    }
+
+  if (!outputVolume || !outputVolume->GetImageData())
+    {
+    vtkErrorMacro("vtkSlicerAstroVolumeLogic::CalculateSignalToNoise : "
+                  "outputVolume not found.");
+    return false;
+    }
+
+  if (inputVolume->GetImageData()->GetNumberOfScalarComponents() > 1)
+    {
+    vtkErrorMacro("vtkSlicerAstroVolumeLogic::CalculateSignalToNoise : "
+                  "imageData with more than one components.");
+    return false;
+    }
+
+  int dims[3];
+  inputVolume->GetImageData()->GetDimensions(dims);
+  const int DataType = inputVolume->GetImageData()->GetScalarType();
+
+  vtkMRMLAstroVolumeNode *volumes[2] = {outputVolume, noiseVolume};
+  for (int volumeCnt = 0; volumeCnt < 2; volumeCnt++)
+    {
+    if (!volumes[volumeCnt])
+      {
+      continue;
+      }
+    vtkImageData *imageData = volumes[volumeCnt]->GetImageData();
+    if (!imageData || imageData->GetScalarType() != DataType ||
+        imageData->GetNumberOfScalarComponents() != 1 ||
+        imageData->GetDimensions()[0] != dims[0] ||
+        imageData->GetDimensions()[1] != dims[1] ||
+        imageData->GetDimensions()[2] != dims[2])
+      {
+      vtkErrorMacro("vtkSlicerAstroVolumeLogic::CalculateSignalToNoise : "
+                    "the output volumes must have the dimensions and "
+                    "the data type of the inputVolume.");
+      return false;
+      }
+    }
+
+  const int window[3] = {windowXY, windowXY, windowZ};
+
+  vtkAstroThreadBudget threadBudget;
+
+  struct timeval start, end;
+
+  long mtime, seconds, useconds;
+
+  gettimeofday(&start, NULL);
+
+  bool success = false;
+  switch (DataType)
+    {
+    case VTK_FLOAT:
+      success = SignalToNoise<float>(inputVolume->GetImageData(),
+                           static_cast<float*> (outputVolume->GetImageData()->GetScalarPointer(0,0,0)),
+                           noiseVolume ? static_cast<float*> (noiseVolume->GetImageData()->GetScalarPointer(0,0,0)) : NULL,
+                           window, pnode, 1, 90);
+      break;
+    case VTK_DOUBLE:
+      success = SignalToNoise<double>(inputVolume->GetImageData(),
+                            static_cast<double*> (outputVolume->GetImageData()->GetScalarPointer(0,0,0)),
+                            noiseVolume ? static_cast<double*> (noiseVolume->GetImageData()->GetScalarPointer(0,0,0)) : NULL,
+                            window, pnode, 1, 90);
+      break;
+    default:
+      vtkErrorMacro("vtkSlicerAstroVolumeLogic::CalculateSignalToNoise : "
+                    "attempt to allocate scalars of type not allowed");
+      return false;
+    }
+
+  gettimeofday(&end, NULL);
+
+  seconds  = end.tv_sec  - start.tv_sec;
+  useconds = end.tv_usec - start.tv_usec;
+
+  mtime = ((seconds) * 1000 + useconds/1000.0) + 0.5;
+  vtkDebugMacro("Signal to Noise Time : "<<mtime<<" ms.");
+
+  if (!success)
+    {
+    return false;
+    }
+
+  for (int volumeCnt = 0; volumeCnt < 2; volumeCnt++)
+    {
+    if (!volumes[volumeCnt])
+      {
+      continue;
+      }
+    volumes[volumeCnt]->GetImageData()->Modified();
+    if (!updateAttributes)
+      {
+      continue;
+      }
+    int wasModifying = volumes[volumeCnt]->StartModify();
+    volumes[volumeCnt]->UpdateRangeAttributes();
+    volumes[volumeCnt]->UpdateDisplayThresholdAttributes();
+    volumes[volumeCnt]->EndModify(wasModifying);
+    }
+
+  return true;
 }
 
 //---------------------------------------------------------------------------
@@ -1631,19 +2224,7 @@ bool vtkSlicerAstroVolumeLogic::Reproject(vtkMRMLAstroReprojectParametersNode *p
   int status = 0;
   const double NaN = sqrt(-1);
 
-  #ifdef VTK_SLICER_ASTRO_SUPPORT_OPENMP
-  int numProcs = 0;
-  if (pnode->GetCores() == 0)
-    {
-    numProcs = omp_get_num_procs();
-    }
-  else
-    {
-    numProcs = pnode->GetCores();
-    }
-
-  omp_set_num_threads(1);
-  #endif // VTK_SLICER_ASTRO_SUPPORT_OPENMP
+  vtkAstroThreadBudget threadBudget(1);
 
   struct timeval start, end;
 
@@ -1715,29 +2296,31 @@ bool vtkSlicerAstroVolumeLogic::Reproject(vtkMRMLAstroReprojectParametersNode *p
 
   // Interpolate
   int numElements = referenceLengthX * referenceLengthY * inputDims[2];
+  vtkAstroProgressToken progress(numElements, 10, 99);
+  const vtkIdType blockSize = vtkAstroProgressToken::GetBlockSize();
+  const vtkIdType numBlocks = vtkAstroProgressToken::GetNumberOfBlocks(numElements);
 
   if (pnode->GetInterpolationOrder() == vtkMRMLAstroReprojectParametersNode::NearestNeighbour)
     {
     #ifdef VTK_SLICER_ASTRO_SUPPORT_OPENMP
-    #pragma omp parallel for schedule(static) shared(pnode, inFPixel, inDPixel, outFPixel, outDPixel, cancel, status)
+    #pragma omp parallel for schedule(static) shared(pnode, inFPixel, inDPixel, outFPixel, outDPixel, progress)
     #endif // VTK_SLICER_ASTRO_SUPPORT_OPENMP
-    for (int elemCnt = 0; elemCnt < numElements; elemCnt++)
+    for (vtkIdType blockCnt = 0; blockCnt < numBlocks; blockCnt++)
       {
-      int stat = pnode->GetStatus();
-
       #ifdef VTK_SLICER_ASTRO_SUPPORT_OPENMP
-      if (stat == -1 && omp_get_thread_num() == 0)
-      #else
-      if (stat == -1)
+      if (omp_get_thread_num() == 0)
       #endif // VTK_SLICER_ASTRO_SUPPORT_OPENMP
         {
-        cancel = true;
+        progress.Synchronize(pnode);
+        }
+      if (progress.IsCancelled())
+        {
+        continue;
         }
-      #ifdef VTK_SLICER_ASTRO_SUPPORT_OPENMP
-      #pragma omp flush (cancel)
-      #endif // VTK_SLICER_ASTRO_SUPPORT_OPENMP
 
-      if (!cancel)
+      const int firstElem = blockCnt * blockSize;
+      const int lastElem = std::min<vtkIdType>(firstElem + blockSize, numElements);
+      for (int elemCnt = firstElem; elemCnt < lastElem; elemCnt++)
         {
         int ref  = (int) floor(elemCnt / referenceLengthX);
         ref *= referenceLengthX;
@@ -1778,48 +2361,31 @@ bool vtkSlicerAstroVolumeLogic::Reproject(vtkMRMLAstroReprojectParametersNode *p
            *(outDPixel + elemCnt) = *(inDPixel + inputSliceDim * kk + inputDims[0] * y + x);
            break;
           }
-
-        #ifdef VTK_SLICER_ASTRO_SUPPORT_OPENMP
-        if (omp_get_thread_num() == 0)
-          {
-          if(10. + (elemCnt / (numElements / (numProcs * 90.))) > status)
-            {
-            status += 10.;
-            pnode->SetStatus(status);
-            }
-          }
-        #else
-        if(10. + (elemCnt / (numElements / 90.)) > status)
-          {
-          status += 10.;
-          pnode->SetStatus(status);
-          }
-        #endif // VTK_SLICER_ASTRO_SUPPORT_OPENMP
         }
+      progress.AddWork(lastElem - firstElem);
       }
     }
   else if (pnode->GetInterpolationOrder() == vtkMRMLAstroReprojectParametersNode::Bilinear)
     {
     #ifdef VTK_SLICER_ASTRO_SUPPORT_OPENMP
-    #pragma omp parallel for schedule(static) shared(pnode, inFPixel, inDPixel, outFPixel, outDPixel, cancel, status)
+    #pragma omp parallel for schedule(static) shared(pnode, inFPixel, inDPixel, outFPixel, outDPixel, progress)
     #endif // VTK_SLICER_ASTRO_SUPPORT_OPENMP
-    for (int elemCnt = 0; elemCnt < numElements; elemCnt++)
+    for (vtkIdType blockCnt = 0; blockCnt < numBlocks; blockCnt++)
       {
-      int stat = pnode->GetStatus();
-
       #ifdef VTK_SLICER_ASTRO_SUPPORT_OPENMP
-      if (stat == -1 && omp_get_thread_num() == 0)
-      #else
-      if (stat == -1)
+      if (omp_get_thread_num() == 0)
       #endif // VTK_SLICER_ASTRO_SUPPORT_OPENMP
         {
-        cancel = true;
+        progress.Synchronize(pnode);
+        }
+      if (progress.IsCancelled())
+        {
+        continue;
         }
-      #ifdef VTK_SLICER_ASTRO_SUPPORT_OPENMP
-      #pragma omp flush (cancel)
-      #endif // VTK_SLICER_ASTRO_SUPPORT_OPENMP
 
-      if (!cancel)
+      const int firstElem = blockCnt * blockSize;
+      const int lastElem = std::min<vtkIdType>(firstElem + blockSize, numElements);
+      for (int elemCnt = firstElem; elemCnt < lastElem; elemCnt++)
         {
         int ref  = (int) floor(elemCnt / referenceLengthX);
         ref *= referenceLengthX;
@@ -1945,48 +2511,31 @@ bool vtkSlicerAstroVolumeLogic::Reproject(vtkMRMLAstroReprojectParametersNode *p
            *(outDPixel + elemCnt) =  (y2 - y) * deltay * F1 + (y - y1) * deltay * F2;
            break;
           }
-
-        #ifdef VTK_SLICER_ASTRO_SUPPORT_OPENMP
-        if (omp_get_thread_num() == 0)
-          {
-          if(10. + (elemCnt / (numElements / (numProcs * 90.))) > status)
-            {
-            status += 10.;
-            pnode->SetStatus(status);
-            }
-          }
-        #else
-        if(10. + (elemCnt / (numElements / 90.)) > status)
-          {
-          status += 10.;
-          pnode->SetStatus(status);
-          }
-        #endif // VTK_SLICER_ASTRO_SUPPORT_OPENMP
         }
+      progress.AddWork(lastElem - firstElem);
       }
     }
   else if (pnode->GetInterpolationOrder() == vtkMRMLAstroReprojectParametersNode::Bicubic)
     {
     #ifdef VTK_SLICER_ASTRO_SUPPORT_OPENMP
-    #pragma omp parallel for schedule(static) shared(pnode, inFPixel, inDPixel, outFPixel, outDPixel, cancel, status)
+    #pragma omp parallel for schedule(static) shared(pnode, inFPixel, inDPixel, outFPixel, outDPixel, progress)
     #endif // VTK_SLICER_ASTRO_SUPPORT_OPENMP
-    for (int elemCnt = 0; elemCnt < numElements; elemCnt++)
+    for (vtkIdType blockCnt = 0; blockCnt < numBlocks; blockCnt++)
       {
-      int stat = pnode->GetStatus();
-
       #ifdef VTK_SLICER_ASTRO_SUPPORT_OPENMP
-      if (stat == -1 && omp_get_thread_num() == 0)
-      #else
-      if (stat == -1)
+      if (omp_get_thread_num() == 0)
       #endif // VTK_SLICER_ASTRO_SUPPORT_OPENMP
         {
-        cancel = true;
+        progress.Synchronize(pnode);
+        }
+      if (progress.IsCancelled())
+        {
+        continue;
         }
-      #ifdef VTK_SLICER_ASTRO_SUPPORT_OPENMP
-      #pragma omp flush (cancel)
-      #endif // VTK_SLICER_ASTRO_SUPPORT_OPENMP
 
-      if (!cancel)
+      const int firstElem = blockCnt * blockSize;
+      const int lastElem = std::min<vtkIdType>(firstElem + blockSize, numElements);
+      for (int elemCnt = firstElem; elemCnt < lastElem; elemCnt++)
         {
         int ref  = (int) floor(elemCnt / referenceLengthX);
         ref *= referenceLengthX;
@@ -2327,26 +2876,11 @@ bool vtkSlicerAstroVolumeLogic::Reproject(vtkMRMLAstroReprojectParametersNode *p
            *(outDPixel + elemCnt) = F;
            break;
           }
-
-        #ifdef VTK_SLICER_ASTRO_SUPPORT_OPENMP
-        if (omp_get_thread_num() == 0)
-          {
-          if(10. + (elemCnt / (numElements / (numProcs * 90.))) > status)
-            {
-            status += 10.;
-            pnode->SetStatus(status);
-            }
-          }
-        #else
-        if(10. + (elemCnt / (numElements / 90.)) > status)
-          {
-          status += 10.;
-          pnode->SetStatus(status);
-          }
-        #endif // VTK_SLICER_ASTRO_SUPPORT_OPENMP
         }
+      progress.AddWork(lastElem - firstElem);
       }
     }
+  cancel = progress.IsCancelled();
 
   gettimeofday(&end, NULL);
 
@@ -36,11 +36,13 @@
 
 class vtkMRMLAnnotationROINode;
 class vtkMRMLAstroLabelMapVolumeNode;
+class vtkMRMLAstroMaskingParametersNode;
 class vtkMRMLAstroReprojectParametersNode;
 class vtkMRMLAstroVolumeNode;
 class vtkMRMLSegmentationNode;
 class vtkMRMLVolumeNode;
 class vtkSegment;
+class vtkDoubleArray;
 class vtkIntArray;
 
 /// \class vtkSlicerAstroVolumeLogic
@@ -78,15 +80,33 @@ public:
   /// \param astroVolumeNode,
   void updateIntensityUnitsNode(vtkMRMLNode *astroVolumeNode);
 
-  /// Create a deep copy of a \a astroVolumeNode and add it to the \a scene
+  enum CloneImageDataType
+  {
+    NoImageData = 0,
+    CopyImageData,
+    AllocateImageData
+  };
+
+  /// Create a copy of a \a astroVolumeNode and add it to the \a scene
   /// Only works for vtkMRMLAstroVolumeNode.
+  /// \a cloneImageData selects the image data of the copy: none (NoImageData),
+  /// a copy of the input data (CopyImageData, default) or an uninitialized
+  /// buffer with the same dimensions and data type of the input data
+  /// (AllocateImageData). The last one avoids copying a cube which will be
+  /// overwritten by the operation filling the output volume.
   /// \sa CloneVolumeGeneric, \sa CloneVolume
   vtkMRMLAstroVolumeNode *CloneAstroVolume(vtkMRMLScene *scene,
                                            vtkMRMLAstroVolumeNode *inputVolumeNode,
                                            vtkMRMLAstroVolumeNode *outputVolumeNode,
                                            const char *outputNameReference,
                                            const char *name,
-                                           bool cloneImageData = true);
+                                           CloneImageDataType cloneImageData = CopyImageData);
+
+  /// Remove \a volumeNode from the \a scene together with its storage
+  /// and display nodes (e.g., an output volume left incomplete by a
+  /// failed or cancelled operation).
+  void RemoveAstroVolume(vtkMRMLScene *scene,
+                         vtkMRMLAstroVolumeNode *volumeNode);
 
   /// Create a label map volume to match the given \a volumeNode and add it to the \a scene
   vtkMRMLAstroLabelMapVolumeNode *CreateAndAddLabelVolume(vtkMRMLScene *scene,
@@ -126,16 +146,64 @@ public:
                                                 vtkMRMLAstroVolumeNode *inputVolume,
                                                 double outputExtent[6]);
 
-  /// Calculate STD given a ROI node
+  /// Calculate the noise (sigma-clipped RMS, see vtkAstroRobustNoise)
+  /// given a ROI node and set it as DisplayThreshold of the volume
   virtual double CalculateDisplayThresholdInROI(vtkMRMLAnnotationROINode* roiNode,
                                                   vtkMRMLAstroVolumeNode *inputVolume);
 
-  /// Calculate an histogram of a astroVolumeNode
+  /// Calculate an histogram of a astroVolumeNode with \a numberOfBins
+  /// linear bins of width \a binSpacing starting at DATAMIN
   virtual void CalculateHistogram(vtkMRMLAstroVolumeNode *Volume,
                                   vtkIntArray *histoArray,
                                   double binSpacing,
                                   int numberOfBins);
 
+  enum HistogramBinningType
+  {
+    LinearBins = 0,
+    LogarithmicBins,
+    AdaptiveBins
+  };
+
+  /// Calculate an histogram of a astroVolumeNode over the range
+  /// DATAMIN - DATAMAX. \a binEdges gets the \a numberOfBins + 1 edges of
+  /// the bins. LinearBins have the same width; LogarithmicBins are linear
+  /// in sign(x) * log10(1 + |x| / DisplayThreshold), i.e. linear within the
+  /// noise and logarithmic in the emission; AdaptiveBins hold about the
+  /// same number of voxels. The histogram is cached on the volume node and
+  /// recalculated only if the data, the range or the binning change.
+  /// \sa vtkMRMLAstroVolumeNode::GetCachedHistogram
+  /// \return success
+  virtual bool CalculateHistogram(vtkMRMLAstroVolumeNode *Volume,
+                                  vtkIntArray *histoArray,
+                                  vtkDoubleArray *binEdges,
+                                  int numberOfBins,
+                                  int binning = LinearBins);
+
+  /// Calculate the signal-to-noise (S/N) cube of \a inputVolume in \a outputVolume.
+  /// The local noise is the robust RMS (median absolute deviation, estimated
+  /// by vtkAstroRobustNoise) of the voxels in a window of windowXY x windowXY
+  /// x windowZ voxels. It is evaluated on a grid with a spacing of half
+  /// a window, interpolated trilinearly and the data are divided by it in
+  /// one pass over the cube.
+  /// A window size <= 0 covers the whole axis (e.g., windowXY = 0 gives
+  /// a noise varying only along the spectral axis). Large windows are sampled
+  /// (at most 262144 voxels per grid node). Blanked (NaN) voxels are
+  /// ignored and stay blanked. The noise cube is stored in \a noiseVolume,
+  /// if not NULL. The output volumes must have the dimensions and the data
+  /// type of the input volume. If \a pnode is not NULL, the progress is
+  /// reported in its Status (from 1 to 90) and a Status of -1 cancels
+  /// the computation. If \a updateAttributes, the range and the noise
+  /// attributes of the output volumes are updated; callers overwriting
+  /// the output (e.g., the S/N masking) skip this pass over the cube.
+  /// \return Success flag
+  bool CalculateSignalToNoise(vtkMRMLAstroVolumeNode *inputVolume,
+                              vtkMRMLAstroVolumeNode *outputVolume,
+                              int windowXY, int windowZ,
+                              vtkMRMLAstroVolumeNode *noiseVolume = NULL,
+                              vtkMRMLAstroMaskingParametersNode *pnode = NULL,
+                              bool updateAttributes = true);
+
   /// Reproject an astroVolumeNode over another
   bool Reproject(vtkMRMLAstroReprojectParametersNode *pnode);
 
@@ -0,0 +1,54 @@
+/*==============================================================================
+
+  Copyright (c) Kapteyn Astronomical Institute
+  University of Groningen, Groningen, Netherlands. All Rights Reserved.
+
+  See COPYRIGHT.txt
+  or http://www.slicer.org/copyright/copyright.txt for details.
+
+  Unless required by applicable law or agreed to in writing, software
+  distributed under the License is distributed on an "AS IS" BASIS,
+  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+  See the License for the specific language governing permissions and
+  limitations under the License.
+
+  This file was originally developed by Davide Punzo, Kapteyn Astronomical Institute,
+  and was supported through the European Research Council grant nr. 291531.
+
+==============================================================================*/
+
+#include "vtkAstroCompensatedSum.h"
+
+// STD includes
+#include <algorithm>
+
+//----------------------------------------------------------------------------
+vtkIdType vtkAstroCompensatedSum::GetMinimumChunkSize()
+{
+  return 65536;
+}
+
+//----------------------------------------------------------------------------
+vtkIdType vtkAstroCompensatedSum::GetMaximumNumberOfChunks()
+{
+  return 1024;
+}
+
+//----------------------------------------------------------------------------
+vtkIdType vtkAstroCompensatedSum::GetChunkSize(vtkIdType numberOfElements)
+{
+  const vtkIdType maxChunks = vtkAstroCompensatedSum::GetMaximumNumberOfChunks();
+  return std::max(vtkAstroCompensatedSum::GetMinimumChunkSize(),
+                  (numberOfElements + maxChunks - 1) / maxChunks);
+}
+
+//----------------------------------------------------------------------------
+vtkIdType vtkAstroCompensatedSum::GetNumberOfChunks(vtkIdType numberOfElements)
+{
+  if (numberOfElements <= 0)
+    {
+    return 0;
+    }
+  const vtkIdType chunkSize = vtkAstroCompensatedSum::GetChunkSize(numberOfElements);
+  return (numberOfElements + chunkSize - 1) / chunkSize;
+}
@@ -0,0 +1,89 @@
+/*==============================================================================
+
+  Copyright (c) Kapteyn Astronomical Institute
+  University of Groningen, Groningen, Netherlands. All Rights Reserved.
+
+  See COPYRIGHT.txt
+  or http://www.slicer.org/copyright/copyright.txt for details.
+
+  Unless required by applicable law or agreed to in writing, software
+  distributed under the License is distributed on an "AS IS" BASIS,
+  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+  See the License for the specific language governing permissions and
+  limitations under the License.
+
+  This file was originally developed by Davide Punzo, Kapteyn Astronomical Institute,
+  and was supported through the European Research Council grant nr. 291531.
+
+==============================================================================*/
+
+#ifndef __vtkAstroCompensatedSum_h
+#define __vtkAstroCompensatedSum_h
+
+// VTK includes
+#include <vtkType.h>
+
+#include <vtkSlicerAstroVolumeModuleMRMLExport.h>
+
+/// \brief Compensated sum and deterministic partitioning for the parallel reductions.
+///
+/// The sum is accumulated with the branch-free two-sum of Knuth (the error-free
+/// transformation behind the Kahan-Babuska-Neumaier algorithm): the rounding
+/// error of every addition is carried in a compensation term, therefore the
+/// result is accurate to the last bits whatever the number and the order of
+/// magnitude of the values (e.g., the flux of a large selection). Unlike the
+/// Neumaier comparison of the magnitudes, it has no data dependent branch in
+/// the inner loops of the callers.
+///
+/// The parallel loops are made reproducible by partitioning the data in chunks
+/// whose size depends only on the number of elements (GetNumberOfChunks()):
+/// every chunk is reduced by a single thread and the partial results of the
+/// chunks are merged pairwise in chunk order, so that the result does not
+/// depend on the number of threads (i.e., on the Cores setting).
+///
+/// \ingroup SlicerAstro_QtModules_AstroVolume
+class VTK_MRML_ASTRO_EXPORT vtkAstroCompensatedSum
+{
+public:
+  vtkAstroCompensatedSum() : Sum(0.), Compensation(0.) {};
+
+  /// Add a value.
+  void Add(double value)
+    {
+    const double sum = this->Sum + value;
+    const double rounded = sum - this->Sum;
+    this->Compensation += (this->Sum - (sum - rounded)) + (value - rounded);
+    this->Sum = sum;
+    }
+
+  /// Add the partial sum of another accumulator.
+  void Merge(const vtkAstroCompensatedSum& other)
+    {
+    this->Add(other.Sum);
+    this->Compensation += other.Compensation;
+    }
+
+  /// Return the compensated sum.
+  double GetSum() const {return this->Sum + this->Compensation;};
+
+  /// Reset the sum to zero.
+  void Reset() {this->Sum = this->Compensation = 0.;};
+
+  /// Number of chunks of the fixed partitioning of numberOfElements:
+  /// chunks of GetMinimumChunkSize() elements, or larger ones if the
+  /// chunks would be more than GetMaximumNumberOfChunks().
+  static vtkIdType GetNumberOfChunks(vtkIdType numberOfElements);
+
+  /// Size of the chunks of the fixed partitioning of numberOfElements
+  /// (the last chunk can be smaller).
+  static vtkIdType GetChunkSize(vtkIdType numberOfElements);
+
+  static vtkIdType GetMinimumChunkSize();
+  static vtkIdType GetMaximumNumberOfChunks();
+
+private:
+  double Sum;
+  double Compensation;
+};
+
+#endif
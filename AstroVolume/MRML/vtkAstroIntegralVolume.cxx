@@ -0,0 +1,321 @@
+/*==============================================================================
+
+  Copyright (c) Kapteyn Astronomical Institute
+  University of Groningen, Groningen, Netherlands. All Rights Reserved.
+
+  See COPYRIGHT.txt
+  or http://www.slicer.org/copyright/copyright.txt for details.
+
+  Unless required by applicable law or agreed to in writing, software
+  distributed under the License is distributed on an "AS IS" BASIS,
+  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+  See the License for the specific language governing permissions and
+  limitations under the License.
+
+  This file was originally developed by Davide Punzo, Kapteyn Astronomical Institute,
+  and was supported through the European Research Council grant nr. 291531.
+
+==============================================================================*/
+
+#include "vtkAstroCompensatedSum.h"
+#include "vtkAstroIntegralVolume.h"
+#include "vtkAstroThreadBudget.h"
+
+#include <vtkSlicerAstroConfigure.h>
+
+// VTK includes
+#include <vtkDataArray.h>
+#include <vtkImageData.h>
+#include <vtkPointData.h>
+
+// STD includes
+#include <algorithm>
+#include <new>
+
+// OpenMP includes
+#ifdef VTK_SLICER_ASTRO_SUPPORT_OPENMP
+#include <omp.h>
+#endif // VTK_SLICER_ASTRO_SUPPORT_OPENMP
+
+namespace
+{
+//----------------------------------------------------------------------------
+template <typename T> bool isNaN(T value)
+{
+  return value != value;
+}
+
+//----------------------------------------------------------------------------
+// Mean of the valid voxels, used as shift of the accumulated values.
+// The chunks of vtkAstroCompensatedSum make it independent of the threads.
+template <typename T>
+double CalculateMean(const T *inPixel, vtkIdType numElements)
+{
+  const vtkIdType chunkSize = vtkAstroCompensatedSum::GetChunkSize(numElements);
+  const vtkIdType numChunks = vtkAstroCompensatedSum::GetNumberOfChunks(numElements);
+  std::vector<vtkAstroCompensatedSum> chunkSums(numChunks);
+  std::vector<vtkIdType> chunkCounts(numChunks, 0);
+
+  #ifdef VTK_SLICER_ASTRO_SUPPORT_OPENMP
+  #pragma omp parallel for schedule(static)
+  #endif // VTK_SLICER_ASTRO_SUPPORT_OPENMP
+  for (vtkIdType chunkCnt = 0; chunkCnt < numChunks; chunkCnt++)
+    {
+    const vtkIdType firstElement = chunkCnt * chunkSize;
+    const vtkIdType lastElement = std::min(firstElement + chunkSize, numElements);
+    vtkAstroCompensatedSum sum;
+    vtkIdType count = 0;
+    for (vtkIdType elementCnt = firstElement; elementCnt < lastElement; elementCnt++)
+      {
+      const T value = *(inPixel + elementCnt);
+      if (isNaN<T>(value))
+        {
+        continue;
+        }
+      sum.Add(value);
+      count++;
+      }
+    chunkSums[chunkCnt] = sum;
+    chunkCounts[chunkCnt] = count;
+    }
+
+  vtkAstroCompensatedSum sum;
+  vtkIdType count = 0;
+  for (vtkIdType chunkCnt = 0; chunkCnt < numChunks; chunkCnt++)
+    {
+    sum.Merge(chunkSums[chunkCnt]);
+    count += chunkCounts[chunkCnt];
+    }
+
+  return count > 0 ? sum.GetSum() / count : 0.;
+}
+
+//----------------------------------------------------------------------------
+// Running sums along x of every row, stored shifted by one voxel on each
+// axis (the first row, column and plane of the tables are zero).
+template <typename T>
+void AccumulateRows(const T *inPixel, const int dims[3], double shift,
+                    vtkIdType *counts, double *sums, double *sumSquares)
+{
+  const vtkIdType numRows = (vtkIdType) dims[1] * dims[2];
+  const vtkIdType rowLength = dims[0] + 1;
+  const vtkIdType planeSize = rowLength * (dims[1] + 1);
+
+  #ifdef VTK_SLICER_ASTRO_SUPPORT_OPENMP
+  #pragma omp parallel for schedule(static)
+  #endif // VTK_SLICER_ASTRO_SUPPORT_OPENMP
+  for (vtkIdType rowCnt = 0; rowCnt < numRows; rowCnt++)
+    {
+    const vtkIdType j = rowCnt % dims[1];
+    const vtkIdType k = rowCnt / dims[1];
+    const T *rowPixel = inPixel + rowCnt * dims[0];
+    const vtkIdType rowStart = (k + 1) * planeSize + (j + 1) * rowLength;
+
+    vtkIdType count = 0;
+    double sum = 0., sumSquare = 0.;
+    for (int i = 0; i < dims[0]; i++)
+      {
+      const T value = *(rowPixel + i);
+      if (!isNaN<T>(value))
+        {
+        const double deviation = value - shift;
+        count++;
+        sum += deviation;
+        sumSquare += deviation * deviation;
+        }
+      counts[rowStart + i + 1] = count;
+      sums[rowStart + i + 1] = sum;
+      sumSquares[rowStart + i + 1] = sumSquare;
+      }
+    }
+}
+
+}// end namespace
+
+//----------------------------------------------------------------------------
+vtkAstroIntegralVolume::vtkAstroIntegralVolume()
+{
+  this->Dims[0] = this->Dims[1] = this->Dims[2] = 0;
+  this->Shift = 0.;
+}
+
+//----------------------------------------------------------------------------
+void vtkAstroIntegralVolume::Reset()
+{
+  std::vector<vtkIdType>().swap(this->Counts);
+  std::vector<double>().swap(this->Sums);
+  std::vector<double>().swap(this->SumSquares);
+  this->Dims[0] = this->Dims[1] = this->Dims[2] = 0;
+  this->Shift = 0.;
+}
+
+//----------------------------------------------------------------------------
+vtkIdType vtkAstroIntegralVolume::GetMemorySize() const
+{
+  return (vtkIdType) this->Counts.size() * (sizeof(vtkIdType) + 2 * sizeof(double));
+}
+
+//----------------------------------------------------------------------------
+bool vtkAstroIntegralVolume::Build(vtkImageData *imageData)
+{
+  this->Reset();
+
+  if (!imageData || !imageData->GetPointData() ||
+      !imageData->GetPointData()->GetScalars() ||
+      imageData->GetNumberOfScalarComponents() != 1)
+    {
+    return false;
+    }
+
+  const int DataType = imageData->GetScalarType();
+  if (DataType != VTK_FLOAT && DataType != VTK_DOUBLE)
+    {
+    return false;
+    }
+
+  int dims[3];
+  imageData->GetDimensions(dims);
+  if (dims[0] < 1 || dims[1] < 1 || dims[2] < 1)
+    {
+    return false;
+    }
+
+  const vtkIdType rowLength = dims[0] + 1;
+  const vtkIdType planeSize = rowLength * (dims[1] + 1);
+  const vtkIdType tableSize = planeSize * (dims[2] + 1);
+  const vtkIdType numElements = (vtkIdType) dims[0] * dims[1] * dims[2];
+
+  try
+    {
+    this->Counts.assign(tableSize, 0);
+    this->Sums.assign(tableSize, 0.);
+    this->SumSquares.assign(tableSize, 0.);
+    }
+  catch (std::bad_alloc&)
+    {
+    this->Reset();
+    return false;
+    }
+
+  vtkAstroThreadBudget threadBudget;
+
+  vtkIdType *counts = &this->Counts[0];
+  double *sums = &this->Sums[0];
+  double *sumSquares = &this->SumSquares[0];
+
+  void *inPixel = imageData->GetScalarPointer();
+  switch (DataType)
+    {
+    case VTK_FLOAT:
+      this->Shift = CalculateMean<float>(static_cast<float*> (inPixel), numElements);
+      AccumulateRows<float>(static_cast<float*> (inPixel), dims, this->Shift,
+                            counts, sums, sumSquares);
+      break;
+    case VTK_DOUBLE:
+      this->Shift = CalculateMean<double>(static_cast<double*> (inPixel), numElements);
+      AccumulateRows<double>(static_cast<double*> (inPixel), dims, this->Shift,
+                             counts, sums, sumSquares);
+      break;
+    }
+
+  // Running sums along y: every plane is independent
+  #ifdef VTK_SLICER_ASTRO_SUPPORT_OPENMP
+  #pragma omp parallel for schedule(static)
+  #endif // VTK_SLICER_ASTRO_SUPPORT_OPENMP
+  for (int k = 1; k <= dims[2]; k++)
+    {
+    for (int j = 2; j <= dims[1]; j++)
+      {
+      const vtkIdType rowStart = k * planeSize + j * rowLength;
+      for (vtkIdType i = 1; i < rowLength; i++)
+        {
+        counts[rowStart + i] += counts[rowStart - rowLength + i];
+        sums[rowStart + i] += sums[rowStart - rowLength + i];
+        sumSquares[rowStart + i] += sumSquares[rowStart - rowLength + i];
+        }
+      }
+    }
+
+  // Running sums along z: the planes are added in order,
+  // the voxels of a plane are split among the threads
+  for (int k = 2; k <= dims[2]; k++)
+    {
+    const vtkIdType planeStart = k * planeSize;
+    #ifdef VTK_SLICER_ASTRO_SUPPORT_OPENMP
+    #pragma omp parallel for schedule(static)
+    #endif // VTK_SLICER_ASTRO_SUPPORT_OPENMP
+    for (vtkIdType elementCnt = rowLength; elementCnt < planeSize; elementCnt++)
+      {
+      counts[planeStart + elementCnt] += counts[planeStart - planeSize + elementCnt];
+      sums[planeStart + elementCnt] += sums[planeStart - planeSize + elementCnt];
+      sumSquares[planeStart + elementCnt] += sumSquares[planeStart - planeSize + elementCnt];
+      }
+    }
+
+  this->Dims[0] = dims[0];
+  this->Dims[1] = dims[1];
+  this->Dims[2] = dims[2];
+
+  return true;
+}
+
+//----------------------------------------------------------------------------
+bool vtkAstroIntegralVolume::Query(const int extent[6], vtkIdType& numberOfVoxels,
+                                   double& sum, double& sumSquaredDeviations) const
+{
+  numberOfVoxels = 0;
+  sum = 0.;
+  sumSquaredDeviations = 0.;
+
+  if (!this->IsValid())
+    {
+    return false;
+    }
+
+  // corners of the box in the (shifted) tables
+  int lo[3], hi[3];
+  for (int axis = 0; axis < 3; axis++)
+    {
+    lo[axis] = std::max(extent[2 * axis], 0);
+    hi[axis] = std::min(extent[2 * axis + 1], this->Dims[axis] - 1) + 1;
+    if (hi[axis] <= lo[axis])
+      {
+      return true;
+      }
+    }
+
+  vtkIdType count = 0;
+  double shiftedSum = 0., shiftedSumSquares = 0.;
+  for (int corner = 0; corner < 8; corner++)
+    {
+    const int i = (corner & 1) ? hi[0] : lo[0];
+    const int j = (corner & 2) ? hi[1] : lo[1];
+    const int k = (corner & 4) ? hi[2] : lo[2];
+    // corners with an odd number of lower bounds are subtracted
+    const int numLower = !(corner & 1) + !(corner & 2) + !(corner & 4);
+    const vtkIdType index = this->GetIndex(i, j, k);
+    if (numLower % 2)
+      {
+      count -= this->Counts[index];
+      shiftedSum -= this->Sums[index];
+      shiftedSumSquares -= this->SumSquares[index];
+      }
+    else
+      {
+      count += this->Counts[index];
+      shiftedSum += this->Sums[index];
+      shiftedSumSquares += this->SumSquares[index];
+      }
+    }
+
+  numberOfVoxels = count;
+  if (count < 1)
+    {
+    return true;
+    }
+
+  sum = shiftedSum + count * this->Shift;
+  sumSquaredDeviations = std::max(0., shiftedSumSquares - shiftedSum * shiftedSum / count);
+
+  return true;
+}
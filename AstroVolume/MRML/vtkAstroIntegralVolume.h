@@ -0,0 +1,88 @@
+/*==============================================================================
+
+  Copyright (c) Kapteyn Astronomical Institute
+  University of Groningen, Groningen, Netherlands. All Rights Reserved.
+
+  See COPYRIGHT.txt
+  or http://www.slicer.org/copyright/copyright.txt for details.
+
+  Unless required by applicable law or agreed to in writing, software
+  distributed under the License is distributed on an "AS IS" BASIS,
+  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+  See the License for the specific language governing permissions and
+  limitations under the License.
+
+  This file was originally developed by Davide Punzo, Kapteyn Astronomical Institute,
+  and was supported through the European Research Council grant nr. 291531.
+
+==============================================================================*/
+
+#ifndef __vtkAstroIntegralVolume_h
+#define __vtkAstroIntegralVolume_h
+
+// VTK includes
+#include <vtkType.h>
+class vtkImageData;
+
+// STD includes
+#include <vector>
+
+#include <vtkSlicerAstroVolumeModuleMRMLExport.h>
+
+/// \brief Integral volume (3D summed-area table) of astronomical data.
+///
+/// The integral volume stores, for every voxel (i, j, k), the number of valid
+/// (not blanked) voxels, the sum of their values and the sum of their squared
+/// values in the box [0, i] x [0, j] x [0, k]. Once built, the number of
+/// valid voxels, the sum, the mean and the standard deviation of any
+/// axis-aligned box are obtained in constant time from the eight corners
+/// of the box, whatever its size.
+///
+/// The values are accumulated relative to the mean of the volume, to limit
+/// the cancellation in the differences of the large sums of squares.
+///
+/// The tables take three doubles per voxel (i.e. six times the memory of a
+/// float volume): the integral volume is meant to be built once and queried
+/// many times, e.g. while an ROI is dragged. The build runs with the OpenMP
+/// threads of the current vtkAstroThreadBudget.
+///
+/// \ingroup SlicerAstro_QtModules_AstroVolume
+class VTK_MRML_ASTRO_EXPORT vtkAstroIntegralVolume
+{
+public:
+  vtkAstroIntegralVolume();
+
+  /// Build the integral volume of imageData (float or double scalars,
+  /// one component). Return false if the data are not supported or
+  /// the memory can not be allocated; the integral volume is then empty.
+  bool Build(vtkImageData* imageData);
+
+  /// Release the memory of the integral volume.
+  void Reset();
+
+  /// Return true if the integral volume has been built.
+  bool IsValid() const {return !this->Counts.empty();};
+
+  /// Number of valid voxels, sum and sum of the squared deviations from the
+  /// mean of the voxels in the IJK extent (bounds included, clamped to the
+  /// volume). Return false if the integral volume is empty.
+  bool Query(const int extent[6], vtkIdType& numberOfVoxels,
+             double& sum, double& sumSquaredDeviations) const;
+
+  /// Memory used by the tables, in bytes.
+  vtkIdType GetMemorySize() const;
+
+private:
+  vtkIdType GetIndex(int i, int j, int k) const
+    {
+    return ((vtkIdType) k * (this->Dims[1] + 1) + j) * (this->Dims[0] + 1) + i;
+    }
+
+  int Dims[3];
+  double Shift;
+  std::vector<vtkIdType> Counts;
+  std::vector<double> Sums;
+  std::vector<double> SumSquares;
+};
+
+#endif
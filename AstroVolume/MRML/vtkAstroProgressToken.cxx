@@ -0,0 +1,63 @@
+/*==============================================================================
+
+  Copyright (c) Kapteyn Astronomical Institute
+  University of Groningen, Groningen, Netherlands. All Rights Reserved.
+
+  See COPYRIGHT.txt
+  or http://www.slicer.org/copyright/copyright.txt for details.
+
+  Unless required by applicable law or agreed to in writing, software
+  distributed under the License is distributed on an "AS IS" BASIS,
+  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+  See the License for the specific language governing permissions and
+  limitations under the License.
+
+  This file was originally developed by Davide Punzo, Kapteyn Astronomical Institute,
+  and was supported through the European Research Council grant nr. 291531.
+
+==============================================================================*/
+
+#include "vtkAstroProgressToken.h"
+
+//----------------------------------------------------------------------------
+vtkAstroProgressToken::vtkAstroProgressToken(vtkIdType totalWork,
+                                             int firstStatus,
+                                             int lastStatus)
+  : WorkDone(0),
+    Cancelled(false),
+    TotalWork(totalWork > 0 ? totalWork : 1),
+    FirstStatus(firstStatus),
+    LastStatus(lastStatus),
+    ReportedStatus(firstStatus),
+    StatusStep(1)
+{
+}
+
+//----------------------------------------------------------------------------
+vtkIdType vtkAstroProgressToken::GetBlockSize()
+{
+  return 16384;
+}
+
+//----------------------------------------------------------------------------
+vtkIdType vtkAstroProgressToken::GetNumberOfBlocks(vtkIdType numberOfElements)
+{
+  if (numberOfElements <= 0)
+    {
+    return 0;
+    }
+  const vtkIdType blockSize = vtkAstroProgressToken::GetBlockSize();
+  return (numberOfElements + blockSize - 1) / blockSize;
+}
+
+//----------------------------------------------------------------------------
+int vtkAstroProgressToken::GetStatus() const
+{
+  vtkIdType workDone = this->WorkDone.load(std::memory_order_relaxed);
+  if (workDone > this->TotalWork)
+    {
+    workDone = this->TotalWork;
+    }
+  return this->FirstStatus + static_cast<int>(
+    (static_cast<double>(workDone) / this->TotalWork) * (this->LastStatus - this->FirstStatus));
+}
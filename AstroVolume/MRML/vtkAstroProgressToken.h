@@ -0,0 +1,123 @@
+/*==============================================================================
+
+  Copyright (c) Kapteyn Astronomical Institute
+  University of Groningen, Groningen, Netherlands. All Rights Reserved.
+
+  See COPYRIGHT.txt
+  or http://www.slicer.org/copyright/copyright.txt for details.
+
+  Unless required by applicable law or agreed to in writing, software
+  distributed under the License is distributed on an "AS IS" BASIS,
+  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+  See the License for the specific language governing permissions and
+  limitations under the License.
+
+  This file was originally developed by Davide Punzo, Kapteyn Astronomical Institute,
+  and was supported through the European Research Council grant nr. 291531.
+
+==============================================================================*/
+
+#ifndef __vtkAstroProgressToken_h
+#define __vtkAstroProgressToken_h
+
+// VTK includes
+#include <vtkType.h>
+
+// STD includes
+#include <atomic>
+
+#include <vtkSlicerAstroVolumeModuleMRMLExport.h>
+
+/// \brief Shared progress and cancel token for the OpenMP loops of the Astro logics.
+///
+/// The worker threads process the data in blocks of GetBlockSize() elements:
+/// before each block they test IsCancelled() and after it they report the
+/// processed elements with AddWork(). Both calls are relaxed atomic operations,
+/// therefore no flush or MRML access is needed inside the hot loops.
+///
+/// Only the main thread (omp thread 0) is allowed to call Synchronize(), which
+/// reads the cancel request from the parameters node (Status == -1) and
+/// forwards the percentage progress to it.
+///
+/// \ingroup SlicerAstro_QtModules_AstroVolume
+class VTK_MRML_ASTRO_EXPORT vtkAstroProgressToken
+{
+public:
+  /// Create a token for totalWork elements. The reported status
+  /// is linearly mapped in the range [firstStatus, lastStatus].
+  vtkAstroProgressToken(vtkIdType totalWork, int firstStatus = 1, int lastStatus = 99);
+
+  /// Number of elements processed between two checks of the token.
+  static vtkIdType GetBlockSize();
+
+  /// Number of blocks needed to cover numberOfElements.
+  static vtkIdType GetNumberOfBlocks(vtkIdType numberOfElements);
+
+  /// Report work done by the calling thread.
+  void AddWork(vtkIdType work)
+  {
+    this->WorkDone.fetch_add(work, std::memory_order_relaxed);
+  }
+
+  /// Request the cancel of the operation.
+  void Cancel()
+  {
+    this->Cancelled.store(true, std::memory_order_relaxed);
+  }
+
+  /// Return true if the operation has been cancelled.
+  bool IsCancelled() const
+  {
+    return this->Cancelled.load(std::memory_order_relaxed);
+  }
+
+  /// Return the current status in the range [FirstStatus, LastStatus].
+  int GetStatus() const;
+
+  /// Poll the parameters node for a cancel request and update its Status.
+  /// To be called only from the main thread.
+  /// Return false if the operation has been cancelled.
+  template <class ParametersNodeType>
+  bool Synchronize(ParametersNodeType *pnode)
+  {
+    if (this->IsCancelled())
+      {
+      return false;
+      }
+    if (!pnode)
+      {
+      return true;
+      }
+    if (pnode->GetStatus() == -1)
+      {
+      this->Cancel();
+      return false;
+      }
+    int status = this->GetStatus();
+    if (status >= this->ReportedStatus + this->StatusStep)
+      {
+      this->ReportedStatus = status;
+      pnode->SetStatus(status);
+      }
+    return true;
+  }
+
+  /// Set/Get the minimum status increment forwarded to the parameters node.
+  /// Default is 1.
+  void SetStatusStep(int step) {this->StatusStep = step > 0 ? step : 1;};
+  int GetStatusStep() const {return this->StatusStep;};
+
+private:
+  vtkAstroProgressToken(const vtkAstroProgressToken&);
+  void operator=(const vtkAstroProgressToken&);
+
+  std::atomic<vtkIdType> WorkDone;
+  std::atomic<bool> Cancelled;
+  vtkIdType TotalWork;
+  int FirstStatus;
+  int LastStatus;
+  int ReportedStatus;
+  int StatusStep;
+};
+
+#endif
@@ -0,0 +1,522 @@
+/*==============================================================================
+
+  Copyright (c) Kapteyn Astronomical Institute
+  University of Groningen, Groningen, Netherlands. All Rights Reserved.
+
+  See COPYRIGHT.txt
+  or http://www.slicer.org/copyright/copyright.txt for details.
+
+  Unless required by applicable law or agreed to in writing, software
+  distributed under the License is distributed on an "AS IS" BASIS,
+  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+  See the License for the specific language governing permissions and
+  limitations under the License.
+
+  This file was originally developed by Davide Punzo, Kapteyn Astronomical Institute,
+  and was supported through the European Research Council grant nr. 291531.
+
+==============================================================================*/
+
+#include "vtkAstroProgressToken.h"
+#include "vtkAstroRobustNoise.h"
+#include "vtkAstroThreadBudget.h"
+
+#include <vtkSlicerAstroConfigure.h>
+
+// VTK includes
+#include <vtkDataArray.h>
+#include <vtkImageData.h>
+#include <vtkMath.h>
+#include <vtkPointData.h>
+
+// STD includes
+#include <algorithm>
+#include <cmath>
+#include <vector>
+
+// OpenMP includes
+#ifdef VTK_SLICER_ASTRO_SUPPORT_OPENMP
+#include <omp.h>
+#endif // VTK_SLICER_ASTRO_SUPPORT_OPENMP
+
+namespace
+{
+//----------------------------------------------------------------------------
+template <typename T> bool isNaN(T value)
+{
+  return value != value;
+}
+
+//----------------------------------------------------------------------------
+vtkIdType GreatestCommonDivisor(vtkIdType a, vtkIdType b)
+{
+  while (b != 0)
+    {
+    const vtkIdType rest = a % b;
+    a = b;
+    b = rest;
+    }
+  return a;
+}
+
+//----------------------------------------------------------------------------
+// Voxels used by the estimators: the x rows of Extent, one every Step rows,
+// with the optional mask label. Step is co-prime with the number of rows
+// along y: the sampled rows move along y from a plane to the next one.
+// The rows are skipped once the (optional) Token has been cancelled.
+struct NoiseSampling
+{
+  const int *Dims;
+  int Extent[6];
+  vtkIdType Step;
+  const short *MaskPixel;
+  int Label;
+  const vtkAstroProgressToken *Token;
+
+  vtkIdType GetNumberOfRows() const
+    {
+    return (vtkIdType) (this->Extent[3] - this->Extent[2] + 1) *
+                       (this->Extent[5] - this->Extent[4] + 1);
+    }
+
+  int GetRowLength() const
+    {
+    return this->Extent[1] - this->Extent[0] + 1;
+    }
+
+  vtkIdType GetRowStart(vtkIdType row) const
+    {
+    const int numRowsY = this->Extent[3] - this->Extent[2] + 1;
+    const vtkIdType y = this->Extent[2] + row % numRowsY;
+    const vtkIdType z = this->Extent[4] + row / numRowsY;
+    return (z * this->Dims[1] + y) * this->Dims[0] + this->Extent[0];
+    }
+
+  bool IsSelected(vtkIdType elementCnt) const
+    {
+    if (!this->MaskPixel)
+      {
+      return true;
+      }
+    const short label = *(this->MaskPixel + elementCnt);
+    return this->Label > 0 ? label == this->Label : label > 0;
+    }
+};
+
+//----------------------------------------------------------------------------
+// Add every sampled valid voxel to the accumulator. Each thread fills a copy
+// of the (empty) accumulator, the copies are merged at the end.
+template <typename T, typename Accumulator>
+void Accumulate(const T *inPixel, const NoiseSampling& sampling, Accumulator& accumulator)
+{
+  const vtkIdType numRows = sampling.GetNumberOfRows();
+  const int rowLength = sampling.GetRowLength();
+
+  #ifdef VTK_SLICER_ASTRO_SUPPORT_OPENMP
+  #pragma omp parallel shared(accumulator)
+  #endif // VTK_SLICER_ASTRO_SUPPORT_OPENMP
+  {
+  Accumulator threadAccumulator(accumulator);
+
+  #ifdef VTK_SLICER_ASTRO_SUPPORT_OPENMP
+  #pragma omp for schedule(static)
+  #endif // VTK_SLICER_ASTRO_SUPPORT_OPENMP
+  for (vtkIdType rowCnt = 0; rowCnt < numRows; rowCnt += sampling.Step)
+    {
+    if (sampling.Token && sampling.Token->IsCancelled())
+      {
+      continue;
+      }
+    const vtkIdType firstElement = sampling.GetRowStart(rowCnt);
+    for (vtkIdType elementCnt = firstElement; elementCnt < firstElement + rowLength; elementCnt++)
+      {
+      if (!sampling.IsSelected(elementCnt))
+        {
+        continue;
+        }
+      const T value = *(inPixel + elementCnt);
+      if (isNaN<T>(value))
+        {
+        continue;
+        }
+      threadAccumulator.Add(value);
+      }
+    }
+
+  #ifdef VTK_SLICER_ASTRO_SUPPORT_OPENMP
+  #pragma omp critical
+  #endif // VTK_SLICER_ASTRO_SUPPORT_OPENMP
+  accumulator.Merge(threadAccumulator);
+  }
+}
+
+//----------------------------------------------------------------------------
+struct RangeAccumulator
+{
+  vtkIdType Count;
+  double Min;
+  double Max;
+
+  RangeAccumulator() : Count(0), Min(VTK_DOUBLE_MAX), Max(VTK_DOUBLE_MIN) {}
+
+  void Add(double value)
+    {
+    this->Count++;
+    this->Min = std::min(this->Min, value);
+    this->Max = std::max(this->Max, value);
+    }
+
+  void Merge(const RangeAccumulator& other)
+    {
+    this->Count += other.Count;
+    this->Min = std::min(this->Min, other.Min);
+    this->Max = std::max(this->Max, other.Max);
+    }
+};
+
+//----------------------------------------------------------------------------
+// Histogram of the values (or of their absolute deviations from Center) in
+// [Lo, Hi]; Below counts the values lower than Lo.
+struct HistogramAccumulator
+{
+  enum
+    {
+    NumberOfBins = 4096
+    };
+
+  double Lo;
+  double Hi;
+  double Scale;
+  double Center;
+  bool Absolute;
+  vtkIdType Below;
+  std::vector<vtkIdType> Counts;
+
+  HistogramAccumulator(double lo, double hi, double center, bool absolute)
+    : Lo(lo), Hi(hi), Scale(NumberOfBins / (hi - lo)), Center(center),
+      Absolute(absolute), Below(0), Counts(NumberOfBins, 0)
+    {
+    }
+
+  void Add(double value)
+    {
+    if (this->Absolute)
+      {
+      value = fabs(value - this->Center);
+      }
+    if (value < this->Lo)
+      {
+      this->Below++;
+      return;
+      }
+    if (value > this->Hi)
+      {
+      return;
+      }
+    const int bin = static_cast<int>((value - this->Lo) * this->Scale);
+    this->Counts[std::min(bin, static_cast<int>(NumberOfBins) - 1)]++;
+    }
+
+  void Merge(const HistogramAccumulator& other)
+    {
+    this->Below += other.Below;
+    for (int binCnt = 0; binCnt < NumberOfBins; binCnt++)
+      {
+      this->Counts[binCnt] += other.Counts[binCnt];
+      }
+    }
+};
+
+//----------------------------------------------------------------------------
+// Count, sum and sum of squares of the values (relative to Shift) in [Lo, Hi].
+struct MomentsAccumulator
+{
+  double Lo;
+  double Hi;
+  double Shift;
+  vtkIdType Count;
+  double Sum;
+  double SumSquares;
+
+  MomentsAccumulator(double lo, double hi, double shift)
+    : Lo(lo), Hi(hi), Shift(shift), Count(0), Sum(0.), SumSquares(0.)
+    {
+    }
+
+  void Add(double value)
+    {
+    if (value < this->Lo || value > this->Hi)
+      {
+      return;
+      }
+    value -= this->Shift;
+    this->Count++;
+    this->Sum += value;
+    this->SumSquares += value * value;
+    }
+
+  void Merge(const MomentsAccumulator& other)
+    {
+    this->Count += other.Count;
+    this->Sum += other.Sum;
+    this->SumSquares += other.SumSquares;
+    }
+};
+
+//----------------------------------------------------------------------------
+// Value at rank of the values (or of their absolute deviations from center)
+// in [lo, hi]. Two histogram passes narrow the range to 1 / 4096^2 of the
+// initial one, the value is then interpolated within the last bin.
+template <typename T>
+double SelectRank(const T *inPixel, const NoiseSampling& sampling,
+                  double lo, double hi, double center, bool absolute, vtkIdType rank)
+{
+  for (int passCnt = 0; passCnt < 2 && hi > lo; passCnt++)
+    {
+    HistogramAccumulator histogram(lo, hi, center, absolute);
+    Accumulate<T>(inPixel, sampling, histogram);
+
+    vtkIdType below = histogram.Below;
+    int binCnt = 0;
+    for (; binCnt < HistogramAccumulator::NumberOfBins - 1; binCnt++)
+      {
+      if (rank < below + histogram.Counts[binCnt])
+        {
+        break;
+        }
+      below += histogram.Counts[binCnt];
+      }
+
+    const double width = (hi - lo) / HistogramAccumulator::NumberOfBins;
+    lo += binCnt * width;
+    hi = lo + width;
+    if (passCnt == 1 && histogram.Counts[binCnt] > 0)
+      {
+      return lo + width * (rank - below + 0.5) / histogram.Counts[binCnt];
+      }
+    }
+
+  return lo;
+}
+
+//----------------------------------------------------------------------------
+template <typename T>
+double EstimateMedianAbsoluteDeviation(const T *inPixel, const NoiseSampling& sampling,
+                                       vtkIdType& numSamples, double& center)
+{
+  RangeAccumulator range;
+  Accumulate<T>(inPixel, sampling, range);
+  numSamples = range.Count;
+  if (range.Count < 1)
+    {
+    return 0.;
+    }
+
+  const vtkIdType rank = range.Count / 2;
+  center = SelectRank<T>(inPixel, sampling, range.Min, range.Max, 0., false, rank);
+  const double maxDeviation = std::max(range.Max - center, center - range.Min);
+  const double mad = SelectRank<T>(inPixel, sampling, 0., maxDeviation, center, true, rank);
+
+  // MAD of a Gaussian distribution = 0.6745 sigma
+  return 1.4826 * mad;
+}
+
+//----------------------------------------------------------------------------
+template <typename T>
+double EstimateSigmaClipping(const T *inPixel, const NoiseSampling& sampling,
+                             double clipSigma, int maxIterations,
+                             vtkIdType& numSamples, double& center)
+{
+  double lo = VTK_DOUBLE_MIN, hi = VTK_DOUBLE_MAX, shift = 0., sigma = 0.;
+  numSamples = 0;
+
+  for (int iterationCnt = 0; iterationCnt <= maxIterations; iterationCnt++)
+    {
+    MomentsAccumulator moments(lo, hi, shift);
+    Accumulate<T>(inPixel, sampling, moments);
+    if (moments.Count < 1)
+      {
+      break;
+      }
+
+    const double mean = moments.Sum / moments.Count;
+    const double previousSigma = sigma;
+    sigma = sqrt(std::max(0., moments.SumSquares / moments.Count - mean * mean));
+    numSamples = moments.Count;
+    center = shift + mean;
+
+    if (sigma <= 0. || (iterationCnt > 0 && fabs(sigma - previousSigma) <= 1.E-4 * sigma))
+      {
+      break;
+      }
+
+    shift = center;
+    lo = center - clipSigma * sigma;
+    hi = center + clipSigma * sigma;
+    }
+
+  return sigma;
+}
+
+//----------------------------------------------------------------------------
+template <typename T>
+double EstimateNegativeTail(const T *inPixel, const NoiseSampling& sampling,
+                            vtkIdType& numSamples, double& center)
+{
+  MomentsAccumulator moments(VTK_DOUBLE_MIN, 0., 0.);
+  Accumulate<T>(inPixel, sampling, moments);
+  // the zero values are shared with the positive half
+  numSamples = moments.Count;
+  center = 0.;
+  if (moments.Count < 1)
+    {
+    return 0.;
+    }
+
+  return sqrt(moments.SumSquares / moments.Count);
+}
+
+//----------------------------------------------------------------------------
+template <typename T>
+double EstimateNoise(const T *inPixel, const NoiseSampling& sampling, int estimator,
+                     double clipSigma, int maxIterations,
+                     vtkIdType& numSamples, double& center)
+{
+  switch (estimator)
+    {
+    case vtkAstroRobustNoise::SigmaClipping:
+      return EstimateSigmaClipping<T>(inPixel, sampling, clipSigma, maxIterations,
+                                      numSamples, center);
+    case vtkAstroRobustNoise::NegativeTail:
+      return EstimateNegativeTail<T>(inPixel, sampling, numSamples, center);
+    default:
+      return EstimateMedianAbsoluteDeviation<T>(inPixel, sampling, numSamples, center);
+    }
+}
+
+}// end namespace
+
+//----------------------------------------------------------------------------
+vtkAstroRobustNoise::vtkAstroRobustNoise()
+  : Estimator(MedianAbsoluteDeviation),
+    UseExtent(false),
+    MaximumNumberOfSamples(0),
+    Mask(0),
+    Label(0),
+    ClipSigma(3.),
+    MaximumIterations(10),
+    ProgressToken(0),
+    NumberOfSamples(0),
+    Center(0.)
+{
+  for (int ii = 0; ii < 6; ii++)
+    {
+    this->Extent[ii] = 0;
+    }
+}
+
+//----------------------------------------------------------------------------
+void vtkAstroRobustNoise::SetExtent(const int extent[6])
+{
+  for (int ii = 0; ii < 6; ii++)
+    {
+    this->Extent[ii] = extent[ii];
+    }
+  this->UseExtent = true;
+}
+
+//----------------------------------------------------------------------------
+void vtkAstroRobustNoise::SetMask(vtkImageData *mask, int label)
+{
+  this->Mask = mask;
+  this->Label = label;
+}
+
+//----------------------------------------------------------------------------
+double vtkAstroRobustNoise::Estimate(vtkImageData *imageData)
+{
+  this->NumberOfSamples = 0;
+  this->Center = 0.;
+
+  if (!imageData || !imageData->GetPointData() || !imageData->GetPointData()->GetScalars() ||
+      imageData->GetNumberOfScalarComponents() != 1)
+    {
+    return 0.;
+    }
+
+  NoiseSampling sampling;
+  sampling.Dims = imageData->GetDimensions();
+  sampling.Extent[0] = 0;
+  sampling.Extent[1] = sampling.Dims[0] - 1;
+  sampling.Extent[2] = 0;
+  sampling.Extent[3] = sampling.Dims[1] - 1;
+  sampling.Extent[4] = 0;
+  sampling.Extent[5] = sampling.Dims[2] - 1;
+  if (this->UseExtent)
+    {
+    for (int axis = 0; axis < 3; axis++)
+      {
+      sampling.Extent[2 * axis] = std::max(sampling.Extent[2 * axis], this->Extent[2 * axis]);
+      sampling.Extent[2 * axis + 1] = std::min(sampling.Extent[2 * axis + 1], this->Extent[2 * axis + 1]);
+      if (sampling.Extent[2 * axis] > sampling.Extent[2 * axis + 1])
+        {
+        return 0.;
+        }
+      }
+    }
+
+  sampling.MaskPixel = 0;
+  sampling.Label = this->Label;
+  sampling.Token = this->ProgressToken;
+  if (this->Mask)
+    {
+    const int *maskDims = this->Mask->GetDimensions();
+    if (!this->Mask->GetPointData() || !this->Mask->GetPointData()->GetScalars() ||
+        this->Mask->GetScalarType() != VTK_SHORT ||
+        maskDims[0] != sampling.Dims[0] || maskDims[1] != sampling.Dims[1] ||
+        maskDims[2] != sampling.Dims[2])
+      {
+      return 0.;
+      }
+    sampling.MaskPixel = static_cast<short*> (this->Mask->GetScalarPointer());
+    }
+
+  sampling.Step = 1;
+  const vtkIdType numVoxels = sampling.GetNumberOfRows() * sampling.GetRowLength();
+  if (this->MaximumNumberOfSamples > 0 && numVoxels > this->MaximumNumberOfSamples)
+    {
+    sampling.Step = (numVoxels + this->MaximumNumberOfSamples - 1) / this->MaximumNumberOfSamples;
+    const vtkIdType numRowsY = sampling.Extent[3] - sampling.Extent[2] + 1;
+    while (sampling.Step > 1 && GreatestCommonDivisor(sampling.Step, numRowsY) != 1)
+      {
+      sampling.Step++;
+      }
+    }
+
+  vtkAstroThreadBudget threadBudget;
+
+  double noise = 0.;
+  void *inPixel = imageData->GetScalarPointer();
+  switch (imageData->GetScalarType())
+    {
+    case VTK_SHORT:
+      noise = EstimateNoise<short>(static_cast<short*> (inPixel), sampling, this->Estimator,
+                                   this->ClipSigma, this->MaximumIterations,
+                                   this->NumberOfSamples, this->Center);
+      break;
+    case VTK_FLOAT:
+      noise = EstimateNoise<float>(static_cast<float*> (inPixel), sampling, this->Estimator,
+                                   this->ClipSigma, this->MaximumIterations,
+                                   this->NumberOfSamples, this->Center);
+      break;
+    case VTK_DOUBLE:
+      noise = EstimateNoise<double>(static_cast<double*> (inPixel), sampling, this->Estimator,
+                                    this->ClipSigma, this->MaximumIterations,
+                                    this->NumberOfSamples, this->Center);
+      break;
+    default:
+      return 0.;
+    }
+
+  return vtkMath::IsFinite(noise) ? noise : 0.;
+}
@@ -0,0 +1,126 @@
+/*==============================================================================
+
+  Copyright (c) Kapteyn Astronomical Institute
+  University of Groningen, Groningen, Netherlands. All Rights Reserved.
+
+  See COPYRIGHT.txt
+  or http://www.slicer.org/copyright/copyright.txt for details.
+
+  Unless required by applicable law or agreed to in writing, software
+  distributed under the License is distributed on an "AS IS" BASIS,
+  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+  See the License for the specific language governing permissions and
+  limitations under the License.
+
+  This file was originally developed by Davide Punzo, Kapteyn Astronomical Institute,
+  and was supported through the European Research Council grant nr. 291531.
+
+==============================================================================*/
+
+#ifndef __vtkAstroRobustNoise_h
+#define __vtkAstroRobustNoise_h
+
+// VTK includes
+#include <vtkType.h>
+class vtkImageData;
+
+class vtkAstroProgressToken;
+
+#include <vtkSlicerAstroVolumeModuleMRMLExport.h>
+
+/// \brief Robust estimators of the noise of astronomical data.
+///
+/// The estimators return the standard deviation of the Gaussian noise of a
+/// volume, ignoring the blanked (NaN) voxels and, as far as possible, the
+/// emission:
+/// - MedianAbsoluteDeviation: 1.4826 times the median of the absolute
+///   deviations from the median. Both medians are located with histogram
+///   refinement passes, without copying or sorting the data.
+/// - SigmaClipping: standard deviation of the voxels within ClipSigma
+///   standard deviations from the mean, iterated until convergence.
+/// - NegativeTail: RMS of the negative voxels, i.e. the fit of a zero-mean
+///   Gaussian to the negative half of the distribution, which is not
+///   affected by the (positive) emission.
+///
+/// The passes over the data run with the OpenMP threads of the current
+/// vtkAstroThreadBudget. The voxels can be restricted to an IJK extent and
+/// to a label of a mask, and sampled taking one x row every few rows.
+///
+/// \ingroup SlicerAstro_QtModules_AstroVolume
+class VTK_MRML_ASTRO_EXPORT vtkAstroRobustNoise
+{
+public:
+  enum EstimatorType
+    {
+    MedianAbsoluteDeviation = 0,
+    SigmaClipping,
+    NegativeTail
+    };
+
+  vtkAstroRobustNoise();
+
+  /// Set/Get the estimator.
+  /// Default is MedianAbsoluteDeviation.
+  void SetEstimator(int estimator) {this->Estimator = estimator;};
+  int GetEstimator() const {return this->Estimator;};
+
+  /// Set the IJK extent (bounds included) of the voxels to use.
+  /// Default is the whole volume.
+  void SetExtent(const int extent[6]);
+
+  /// Use the whole volume (default).
+  void ResetExtent() {this->UseExtent = false;};
+
+  /// Set/Get the maximum number of voxels to use. If the selected
+  /// voxels are more, the estimators use one x row every few rows, with
+  /// a row step co-prime with the number of rows along y, so that the
+  /// sampled rows do not align with the planes of the volume.
+  /// Default is 0 (all the voxels are used).
+  void SetMaximumNumberOfSamples(vtkIdType samples) {this->MaximumNumberOfSamples = samples;};
+  vtkIdType GetMaximumNumberOfSamples() const {return this->MaximumNumberOfSamples;};
+
+  /// Restrict the estimate to the voxels of mask (short scalars) equal to
+  /// label, or greater than zero if label is 0. NULL disables the mask (default).
+  void SetMask(vtkImageData* mask, int label = 0);
+
+  /// Set/Get the clipping threshold, in standard deviations, of SigmaClipping.
+  /// Default is 3.
+  void SetClipSigma(double clip) {this->ClipSigma = clip;};
+  double GetClipSigma() const {return this->ClipSigma;};
+
+  /// Set/Get the maximum number of iterations of SigmaClipping.
+  /// Default is 10.
+  void SetMaximumIterations(int iterations) {this->MaximumIterations = iterations;};
+  int GetMaximumIterations() const {return this->MaximumIterations;};
+
+  /// Set the token whose cancel request stops the passes over the data:
+  /// the estimate is then meaningless. NULL disables it (default).
+  void SetProgressToken(vtkAstroProgressToken* token) {this->ProgressToken = token;};
+
+  /// Estimate the noise of imageData (short, float or double scalars).
+  /// Return 0 if there are no valid voxels.
+  double Estimate(vtkImageData* imageData);
+
+  /// Number of valid voxels used by the last estimate.
+  vtkIdType GetNumberOfSamples() const {return this->NumberOfSamples;};
+
+  /// Location of the noise of the last estimate: the median
+  /// (MedianAbsoluteDeviation), the clipped mean (SigmaClipping) or 0 (NegativeTail).
+  double GetCenter() const {return this->Center;};
+
+private:
+  int Estimator;
+  bool UseExtent;
+  int Extent[6];
+  vtkIdType MaximumNumberOfSamples;
+  vtkImageData* Mask;
+  int Label;
+  double ClipSigma;
+  int MaximumIterations;
+  vtkAstroProgressToken* ProgressToken;
+
+  vtkIdType NumberOfSamples;
+  double Center;
+};
+
+#endif
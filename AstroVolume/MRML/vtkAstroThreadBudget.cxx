@@ -0,0 +1,106 @@
+/*==============================================================================
+
+  Copyright (c) Kapteyn Astronomical Institute
+  University of Groningen, Groningen, Netherlands. All Rights Reserved.
+
+  See COPYRIGHT.txt
+  or http://www.slicer.org/copyright/copyright.txt for details.
+
+  Unless required by applicable law or agreed to in writing, software
+  distributed under the License is distributed on an "AS IS" BASIS,
+  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+  See the License for the specific language governing permissions and
+  limitations under the License.
+
+  This file was originally developed by Davide Punzo, Kapteyn Astronomical Institute,
+  and was supported through the European Research Council grant nr. 291531.
+
+==============================================================================*/
+
+#include "vtkAstroThreadBudget.h"
+
+#include <vtkSlicerAstroConfigure.h>
+
+// STD includes
+#include <algorithm>
+#include <mutex>
+
+// OpenMP includes
+#ifdef VTK_SLICER_ASTRO_SUPPORT_OPENMP
+#include <omp.h>
+#endif // VTK_SLICER_ASTRO_SUPPORT_OPENMP
+
+namespace
+{
+std::mutex BudgetMutex;
+int ReservedThreadsCount = 0;
+
+// innermost budget alive in the calling thread
+thread_local vtkAstroThreadBudget *CurrentBudget = 0;
+}// end namespace
+
+//----------------------------------------------------------------------------
+vtkAstroThreadBudget::vtkAstroThreadBudget(int requestedThreads)
+  : Outer(CurrentBudget),
+    NumberOfThreads(1),
+    ReservedThreads(0),
+    PreviousMaxThreads(1)
+{
+  const int numProcs = vtkAstroThreadBudget::GetNumberOfProcessors();
+  if (requestedThreads <= 0 || requestedThreads > numProcs)
+    {
+    requestedThreads = numProcs;
+    }
+
+  if (this->Outer)
+    {
+    this->NumberOfThreads = std::min(requestedThreads, this->Outer->NumberOfThreads);
+    }
+  else
+    {
+    std::lock_guard<std::mutex> lock(BudgetMutex);
+    const int available = numProcs - ReservedThreadsCount;
+    this->NumberOfThreads = std::max(1, std::min(requestedThreads, available));
+    this->ReservedThreads = this->NumberOfThreads;
+    ReservedThreadsCount += this->ReservedThreads;
+    }
+  CurrentBudget = this;
+
+  #ifdef VTK_SLICER_ASTRO_SUPPORT_OPENMP
+  this->PreviousMaxThreads = omp_get_max_threads();
+  omp_set_num_threads(this->NumberOfThreads);
+  #endif // VTK_SLICER_ASTRO_SUPPORT_OPENMP
+}
+
+//----------------------------------------------------------------------------
+vtkAstroThreadBudget::~vtkAstroThreadBudget()
+{
+  #ifdef VTK_SLICER_ASTRO_SUPPORT_OPENMP
+  omp_set_num_threads(this->PreviousMaxThreads);
+  #endif // VTK_SLICER_ASTRO_SUPPORT_OPENMP
+
+  CurrentBudget = this->Outer;
+
+  if (this->ReservedThreads > 0)
+    {
+    std::lock_guard<std::mutex> lock(BudgetMutex);
+    ReservedThreadsCount -= this->ReservedThreads;
+    }
+}
+
+//----------------------------------------------------------------------------
+int vtkAstroThreadBudget::GetNumberOfProcessors()
+{
+  #ifdef VTK_SLICER_ASTRO_SUPPORT_OPENMP
+  return omp_get_num_procs();
+  #else
+  return 1;
+  #endif // VTK_SLICER_ASTRO_SUPPORT_OPENMP
+}
+
+//----------------------------------------------------------------------------
+int vtkAstroThreadBudget::GetNumberOfReservedThreads()
+{
+  std::lock_guard<std::mutex> lock(BudgetMutex);
+  return ReservedThreadsCount;
+}
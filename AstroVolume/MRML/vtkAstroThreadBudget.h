@@ -0,0 +1,70 @@
+/*==============================================================================
+
+  Copyright (c) Kapteyn Astronomical Institute
+  University of Groningen, Groningen, Netherlands. All Rights Reserved.
+
+  See COPYRIGHT.txt
+  or http://www.slicer.org/copyright/copyright.txt for details.
+
+  Unless required by applicable law or agreed to in writing, software
+  distributed under the License is distributed on an "AS IS" BASIS,
+  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+  See the License for the specific language governing permissions and
+  limitations under the License.
+
+  This file was originally developed by Davide Punzo, Kapteyn Astronomical Institute,
+  and was supported through the European Research Council grant nr. 291531.
+
+==============================================================================*/
+
+#ifndef __vtkAstroThreadBudget_h
+#define __vtkAstroThreadBudget_h
+
+#include <vtkSlicerAstroVolumeModuleMRMLExport.h>
+
+/// \brief Scoped reservation of OpenMP threads from a budget shared by the Astro operations.
+///
+/// All the logics and nodes create a budget at the beginning of a computation,
+/// instead of setting the number of OpenMP threads themselves. The threads are
+/// reserved from the processors of the machine which are not yet reserved by
+/// other running operations (e.g., the modeling in the background and the moment
+/// maps in the foreground), therefore concurrent operations do not oversubscribe
+/// the cores. At least one thread is always granted.
+///
+/// The granted threads are set as the number of threads of the OpenMP regions
+/// started by the calling thread; the previous setting and the reservation
+/// are restored when the budget goes out of scope. A budget created while
+/// another budget is alive in the same thread (e.g., the range update called
+/// at the end of a filter) shares the threads of the outer budget.
+///
+/// Without OpenMP support the budget always grants one thread.
+///
+/// \ingroup SlicerAstro_QtModules_AstroVolume
+class VTK_MRML_ASTRO_EXPORT vtkAstroThreadBudget
+{
+public:
+  /// Reserve up to requestedThreads threads (0 requests all the processors,
+  /// as the Cores parameter of the parameter nodes).
+  explicit vtkAstroThreadBudget(int requestedThreads = 0);
+  ~vtkAstroThreadBudget();
+
+  /// Number of threads granted to the operation.
+  int GetNumberOfThreads() const {return this->NumberOfThreads;};
+
+  /// Number of processors of the machine.
+  static int GetNumberOfProcessors();
+
+  /// Number of threads currently reserved by all the operations.
+  static int GetNumberOfReservedThreads();
+
+private:
+  vtkAstroThreadBudget(const vtkAstroThreadBudget&);
+  void operator=(const vtkAstroThreadBudget&);
+
+  vtkAstroThreadBudget *Outer;
+  int NumberOfThreads;
+  int ReservedThreads;
+  int PreviousMaxThreads;
+};
+
+#endif
@@ -21,6 +21,7 @@
 #include <string>
 
 // MRML includes
+#include <vtkAstroThreadBudget.h>
 #include <vtkMRMLAstroLabelMapVolumeDisplayNode.h>
 #include <vtkMRMLAstroLabelMapVolumeNode.h>
 #include <vtkMRMLAstroVolumeStorageNode.h>
@@ -176,9 +177,7 @@ bool vtkMRMLAstroLabelMapVolumeNode::UpdateRangeAttributes()
   double max_val = this->GetImageData()->GetScalarTypeMin(), min_val = this->GetImageData()->GetScalarTypeMax();
   short *inSPixel = NULL;
 
-  #ifdef VTK_SLICER_ASTRO_SUPPORT_OPENMP
-  omp_set_num_threads(omp_get_num_procs());
-  #endif // VTK_SLICER_ASTRO_SUPPORT_OPENMP
+  vtkAstroThreadBudget threadBudget;
 
   switch (DataType)
     {
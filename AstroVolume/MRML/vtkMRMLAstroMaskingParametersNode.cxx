@@ -58,6 +58,9 @@ vtkMRMLAstroMaskingParametersNode::vtkMRMLAstroMaskingParametersNode()
   this->SetBlankRegion("Outside");
   this->BlankValue = NULL;
   this->SetBlankValue("NaN");
+  this->SignalToNoiseThreshold = 3.;
+  this->NoiseWindowXY = 0;
+  this->NoiseWindowZ = 1;
   this->OutputSerial = 1;
   this->Status = 0;
 }
@@ -130,6 +133,12 @@ int StringToInt(const char* str)
 {
   return StringToNumber<int>(str);
 }
+
+//----------------------------------------------------------------------------
+double StringToDouble(const char* str)
+{
+  return StringToNumber<double>(str);
+}
 }// end namespace
 
 //----------------------------------------------------------------------------
@@ -202,6 +211,24 @@ void vtkMRMLAstroMaskingParametersNode::ReadXMLAttributes(const char** atts)
       continue;
       }
 
+    if (!strcmp(attName, "SignalToNoiseThreshold"))
+      {
+      this->SignalToNoiseThreshold = StringToDouble(attValue);
+      continue;
+      }
+
+    if (!strcmp(attName, "NoiseWindowXY"))
+      {
+      this->NoiseWindowXY = StringToInt(attValue);
+      continue;
+      }
+
+    if (!strcmp(attName, "NoiseWindowZ"))
+      {
+      this->NoiseWindowZ = StringToInt(attValue);
+      continue;
+      }
+
     if (!strcmp(attName, "OutputSerial"))
       {
       this->OutputSerial = StringToInt(attValue);
@@ -258,6 +285,9 @@ void vtkMRMLAstroMaskingParametersNode::WriteXML(ostream& of, int nIndent)
     of << indent << " BlankValue=\"" << this->BlankValue << "\"";
     }
 
+  of << indent << " SignalToNoiseThreshold=\"" << this->SignalToNoiseThreshold << "\"";
+  of << indent << " NoiseWindowXY=\"" << this->NoiseWindowXY << "\"";
+  of << indent << " NoiseWindowZ=\"" << this->NoiseWindowZ << "\"";
   of << indent << " OutputSerial=\"" << this->OutputSerial << "\"";
   of << indent << " Status=\"" << this->Status << "\"";
 }
@@ -279,6 +309,9 @@ void vtkMRMLAstroMaskingParametersNode::Copy(vtkMRMLNode *anode)
   this->SetOperation(node->GetOperation());
   this->SetBlankRegion(node->GetBlankRegion());
   this->SetBlankValue(node->GetBlankValue());
+  this->SetSignalToNoiseThreshold(node->GetSignalToNoiseThreshold());
+  this->SetNoiseWindowXY(node->GetNoiseWindowXY());
+  this->SetNoiseWindowZ(node->GetNoiseWindowZ());
   this->SetOutputSerial(node->GetOutputSerial());
   this->SetStatus(node->GetStatus());
 
@@ -297,6 +330,9 @@ void vtkMRMLAstroMaskingParametersNode::PrintSelf(ostream& os, vtkIndent indent)
   os << indent << "Operation: " << ( (this->Operation) ? this->Operation : "None" ) << "\n";
   os << indent << "BlankRegion: " << ( (this->BlankRegion) ? this->BlankRegion : "None" ) << "\n";
   os << indent << "BlankValue: " << ( (this->BlankValue) ? this->BlankValue : "None" ) << "\n";
+  os << indent << "SignalToNoiseThreshold: " << this->SignalToNoiseThreshold << "\n";
+  os << indent << "NoiseWindowXY: " << this->NoiseWindowXY << "\n";
+  os << indent << "NoiseWindowZ: " << this->NoiseWindowZ << "\n";
   os << indent << "OutputSerial: " << this->OutputSerial << "\n";
   os << indent << "Status: " << this->Status << "\n";
 }
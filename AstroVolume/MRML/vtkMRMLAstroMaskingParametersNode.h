@@ -78,7 +78,9 @@ class VTK_MRML_ASTRO_EXPORT vtkMRMLAstroMaskingParametersNode : public vtkMRMLNo
   /// Set MRML ROI node
   void SetROINode(vtkMRMLAnnotationROINode* node);
 
-  /// Set/Get the Mode.
+  /// Set/Get the Mode: "ROI", "Segmentation" or "SignalToNoise".
+  /// In the "SignalToNoise" mode the mask is given by the voxels
+  /// with a signal-to-noise ratio larger than SignalToNoiseThreshold.
   /// Default is "ROI"
   /// \sa SetMode(), GetMode()
   vtkSetStringMacro(Mode);
@@ -102,6 +104,22 @@ class VTK_MRML_ASTRO_EXPORT vtkMRMLAstroMaskingParametersNode : public vtkMRMLNo
   vtkSetStringMacro(BlankValue);
   vtkGetStringMacro(BlankValue);
 
+  /// Set/Get the SignalToNoiseThreshold used in the "SignalToNoise" mode.
+  /// Default is 3.
+  /// \sa SetSignalToNoiseThreshold(), GetSignalToNoiseThreshold()
+  vtkSetMacro(SignalToNoiseThreshold,double);
+  vtkGetMacro(SignalToNoiseThreshold,double);
+
+  /// Set/Get the spatial and spectral sizes (in voxels) of the windows
+  /// over which the local noise is evaluated in the "SignalToNoise" mode.
+  /// A size <= 0 covers the whole axis.
+  /// Default are 0 (spatial) and 1 (spectral), i.e. one noise per channel.
+  /// \sa vtkSlicerAstroVolumeLogic::CalculateSignalToNoise()
+  vtkSetMacro(NoiseWindowXY,int);
+  vtkGetMacro(NoiseWindowXY,int);
+  vtkSetMacro(NoiseWindowZ,int);
+  vtkGetMacro(NoiseWindowZ,int);
+
   /// Set/Get the OutputSerial.
   /// \sa SetOutputSerial(), GetOutputSerial()
   vtkSetMacro(OutputSerial,int);
@@ -133,6 +151,10 @@ protected:
   char *BlankRegion;
   char *BlankValue;
 
+  double SignalToNoiseThreshold;
+  int NoiseWindowXY;
+  int NoiseWindowZ;
+
   int OutputSerial;
   int Status;
 };
@@ -23,6 +23,7 @@
 #include <vtkObjectFactory.h>
 
 // MRML includes
+#include <vtkMRMLAnnotationROINode.h>
 #include <vtkMRMLVolumeNode.h>
 
 // CropModuleMRML includes
@@ -33,6 +34,9 @@
 
 #define SigmatoFWHM 2.3548200450309493
 
+//------------------------------------------------------------------------------
+const char* vtkMRMLAstroSmoothingParametersNode::ROI_REFERENCE_ROLE = "ROI";
+
 //----------------------------------------------------------------------------
 vtkMRMLNodeNewMacro(vtkMRMLAstroSmoothingParametersNode);
 
@@ -43,10 +47,15 @@ vtkMRMLAstroSmoothingParametersNode::vtkMRMLAstroSmoothingParametersNode()
 
   this->InputVolumeNodeID = NULL;
   this->OutputVolumeNodeID = NULL;
+  this->PreviewOutputVolumeNodeID = NULL;
+  this->MaskVolumeNodeID = NULL;
   this->Mode = NULL;
   this->MasksCommand = NULL;
   this->SetMode("Automatic");
   this->SetMasksCommand("Skip");
+  this->Region = NULL;
+  this->SetRegion("None");
+  this->CropOutput = false;
   this->OutputSerial = 1;
   this->Status = 0;
   this->Filter = 2;
@@ -54,8 +63,11 @@ vtkMRMLAstroSmoothingParametersNode::vtkMRMLAstroSmoothingParametersNode()
   this->Cores = 0;
   this->Link = false;
   this->AutoRun = false;
+  this->Preview = false;
+  this->PreviewChannel = -1;
   this->Accuracy = 20;
   this->TimeStep = 0.0325;
+  this->ConvergenceTolerance = 0.;
   this->K = 2.;
   this->ParameterX = 5.;
   this->ParameterY = 5.;
@@ -88,6 +100,18 @@ vtkMRMLAstroSmoothingParametersNode::~vtkMRMLAstroSmoothingParametersNode()
     this->OutputVolumeNodeID = NULL;
     }
 
+  if (this->PreviewOutputVolumeNodeID)
+    {
+    delete [] this->PreviewOutputVolumeNodeID;
+    this->PreviewOutputVolumeNodeID = NULL;
+    }
+
+  if (this->MaskVolumeNodeID)
+    {
+    delete [] this->MaskVolumeNodeID;
+    this->MaskVolumeNodeID = NULL;
+    }
+
   if (this->Mode)
     {
     delete [] this->Mode;
@@ -99,6 +123,18 @@ vtkMRMLAstroSmoothingParametersNode::~vtkMRMLAstroSmoothingParametersNode()
     delete [] this->MasksCommand;
     this->MasksCommand = NULL;
     }
+
+  if (this->Region)
+    {
+    delete [] this->Region;
+    this->Region = NULL;
+    }
+}
+
+//----------------------------------------------------------------------------
+const char *vtkMRMLAstroSmoothingParametersNode::GetROINodeReferenceRole()
+{
+  return vtkMRMLAstroSmoothingParametersNode::ROI_REFERENCE_ROLE;
 }
 
 namespace
@@ -126,6 +162,23 @@ int StringToInt(const char* str)
 
 }// end namespace
 
+//----------------------------------------------------------------------------
+void vtkMRMLAstroSmoothingParametersNode::SetROINode(vtkMRMLAnnotationROINode* node)
+{
+  this->SetNodeReferenceID(this->GetROINodeReferenceRole(), (node ? node->GetID() : NULL));
+}
+
+//----------------------------------------------------------------------------
+vtkMRMLAnnotationROINode *vtkMRMLAstroSmoothingParametersNode::GetROINode()
+{
+  if (!this->Scene)
+    {
+    return NULL;
+    }
+
+  return vtkMRMLAnnotationROINode::SafeDownCast(this->GetNodeReference(this->GetROINodeReferenceRole()));
+}
+
 //----------------------------------------------------------------------------
 void vtkMRMLAstroSmoothingParametersNode::ReadXMLAttributes(const char** atts)
 {
@@ -149,6 +202,18 @@ void vtkMRMLAstroSmoothingParametersNode::ReadXMLAttributes(const char** atts)
       continue;
       }
 
+    if (!strcmp(attName, "previewOutputVolumeNodeID"))
+      {
+      this->SetPreviewOutputVolumeNodeID(attValue);
+      continue;
+      }
+
+    if (!strcmp(attName, "MaskVolumeNodeID"))
+      {
+      this->SetMaskVolumeNodeID(attValue);
+      continue;
+      }
+
     if (!strcmp(attName, "Mode"))
       {
       this->SetMode(attValue);
@@ -161,6 +226,18 @@ void vtkMRMLAstroSmoothingParametersNode::ReadXMLAttributes(const char** atts)
       continue;
       }
 
+    if (!strcmp(attName, "Region"))
+      {
+      this->SetRegion(attValue);
+      continue;
+      }
+
+    if (!strcmp(attName, "CropOutput"))
+      {
+      this->CropOutput = StringToInt(attValue);
+      continue;
+      }
+
     if (!strcmp(attName, "OutputSerial"))
       {
       this->OutputSerial = StringToInt(attValue);
@@ -197,6 +274,18 @@ void vtkMRMLAstroSmoothingParametersNode::ReadXMLAttributes(const char** atts)
       continue;
       }
 
+    if (!strcmp(attName, "Preview"))
+      {
+      this->Preview = StringToInt(attValue);
+      continue;
+      }
+
+    if (!strcmp(attName, "PreviewChannel"))
+      {
+      this->PreviewChannel = StringToInt(attValue);
+      continue;
+      }
+
     if (!strcmp(attName, "Rx"))
       {
       this->Rx = StringToInt(attValue);
@@ -233,6 +322,12 @@ void vtkMRMLAstroSmoothingParametersNode::ReadXMLAttributes(const char** atts)
       continue;
       }
 
+    if (!strcmp(attName, "ConvergenceTolerance"))
+      {
+      this->ConvergenceTolerance = StringToDouble(attValue);
+      continue;
+      }
+
     if (!strcmp(attName, "K"))
       {
       this->K = StringToDouble(attValue);
@@ -295,6 +390,16 @@ void vtkMRMLAstroSmoothingParametersNode::WriteXML(ostream& of, int nIndent)
     of << indent << " outputVolumeNodeID=\"" << this->OutputVolumeNodeID << "\"";
     }
 
+  if (this->PreviewOutputVolumeNodeID != NULL)
+    {
+    of << indent << " previewOutputVolumeNodeID=\"" << this->PreviewOutputVolumeNodeID << "\"";
+    }
+
+  if (this->MaskVolumeNodeID != NULL)
+    {
+    of << indent << " MaskVolumeNodeID=\"" << this->MaskVolumeNodeID << "\"";
+    }
+
   if (this->Mode != NULL)
     {
     of << indent << " Mode=\"" << this->Mode << "\"";
@@ -305,18 +410,28 @@ void vtkMRMLAstroSmoothingParametersNode::WriteXML(ostream& of, int nIndent)
     of << indent << " MasksCommand=\"" << this->MasksCommand << "\"";
     }
 
+  if (this->Region != NULL)
+    {
+    of << indent << " Region=\"" << this->Region << "\"";
+    }
+
+  of << indent << " CropOutput=\"" << this->CropOutput << "\"";
+
   of << indent << " OutputSerial=\"" << this->OutputSerial << "\"";
   of << indent << " Filter=\"" << this->Filter << "\"";
   of << indent << " Hardware=\"" << this->Hardware << "\"";
   of << indent << " Cores=\"" << this->Cores << "\"";
   of << indent << " Link=\"" << this->Link << "\"";
   of << indent << " AutoRun=\"" << this->AutoRun << "\"";
+  of << indent << " Preview=\"" << this->Preview << "\"";
+  of << indent << " PreviewChannel=\"" << this->PreviewChannel << "\"";
   of << indent << " Rx=\"" << this->Rx << "\"";
   of << indent << " Ry=\"" << this->Ry << "\"";
   of << indent << " Rz=\"" << this->Rz << "\"";
   of << indent << " Status=\"" << this->Status << "\"";
   of << indent << " Accuracy=\"" << this->Accuracy << "\"";
   of << indent << " TimeStep=\"" << this->TimeStep << "\"";
+  of << indent << " ConvergenceTolerance=\"" << this->ConvergenceTolerance << "\"";
   of << indent << " K=\"" << this->K << "\"";
   of << indent << " ParameterX=\"" << this->ParameterX << "\"";
   of << indent << " ParameterY=\"" << this->ParameterY << "\"";
@@ -338,14 +453,20 @@ void vtkMRMLAstroSmoothingParametersNode::Copy(vtkMRMLNode *anode)
 
   this->SetInputVolumeNodeID(node->GetInputVolumeNodeID());
   this->SetOutputVolumeNodeID(node->GetOutputVolumeNodeID());
+  this->SetPreviewOutputVolumeNodeID(node->GetPreviewOutputVolumeNodeID());
+  this->SetMaskVolumeNodeID(node->GetMaskVolumeNodeID());
   this->SetMode(node->GetMode());
   this->SetMasksCommand(node->GetMasksCommand());
+  this->SetRegion(node->GetRegion());
+  this->SetCropOutput(node->GetCropOutput());
   this->SetOutputSerial(node->GetOutputSerial());
   this->SetFilter(node->GetFilter());
   this->SetHardware(node->GetHardware());
   this->SetCores(node->GetCores());
   this->SetLink(node->GetLink());
   this->SetAutoRun(node->GetAutoRun());
+  this->SetPreview(node->GetPreview());
+  this->SetPreviewChannel(node->GetPreviewChannel());
   this->SetRx(node->GetRx());
   this->SetRy(node->GetRy());
   this->SetRz(node->GetRz());
@@ -353,6 +474,7 @@ void vtkMRMLAstroSmoothingParametersNode::Copy(vtkMRMLNode *anode)
   this->SetAccuracy(node->GetAccuracy());
   this->SetK(node->GetK());
   this->SetTimeStep(node->GetTimeStep());
+  this->SetConvergenceTolerance(node->GetConvergenceTolerance());
   this->SetParameterX(node->GetParameterX());
   this->SetParameterY(node->GetParameterY());
   this->SetParameterZ(node->GetParameterZ());
@@ -577,6 +699,8 @@ void vtkMRMLAstroSmoothingParametersNode::PrintSelf(ostream& os, vtkIndent inden
 
   os << indent << "InputVolumeNodeID: " << ( (this->InputVolumeNodeID) ? this->InputVolumeNodeID : "None" ) << "\n";
   os << indent << "OutputVolumeNodeID: " << ( (this->OutputVolumeNodeID) ? this->OutputVolumeNodeID : "None" ) << "\n";
+  os << indent << "PreviewOutputVolumeNodeID: " << ( (this->PreviewOutputVolumeNodeID) ? this->PreviewOutputVolumeNodeID : "None" ) << "\n";
+  os << indent << "MaskVolumeNodeID: " << ( (this->MaskVolumeNodeID) ? this->MaskVolumeNodeID : "None" ) << "\n";
   os << indent << "Mode: " << ( (this->Mode) ? this->Mode : "None" ) << "\n";
   os << indent << "MasksCommand: " << ( (this->MasksCommand) ? this->MasksCommand : "None" ) << "\n";
   os << indent << "OutputSerial: " << this->OutputSerial << "\n";
@@ -599,6 +723,21 @@ void vtkMRMLAstroSmoothingParametersNode::PrintSelf(ostream& os, vtkIndent inden
       os << indent << "Filter: Intensity Driven Gradient\n";
       break;
       }
+    case 3:
+      {
+      os << indent << "Filter: Wavelet\n";
+      break;
+      }
+    }
+
+  os << indent << "Region: " << ( (this->Region) ? this->Region : "None" ) << "\n";
+  if (this->CropOutput)
+    {
+    os << indent << "CropOutput: Active\n";
+    }
+  else
+    {
+    os << indent << "CropOutput: Inactive\n";
     }
 
   switch (this->Hardware)
@@ -628,6 +767,17 @@ void vtkMRMLAstroSmoothingParametersNode::PrintSelf(ostream& os, vtkIndent inden
     os << indent << "AutoRun: Inactive\n";
     }
 
+  if(this->Preview)
+    {
+    os << indent << "Preview: Active\n";
+    }
+  else
+    {
+    os << indent << "Preview: Inactive\n";
+    }
+
+  os << indent << "PreviewChannel: " << this->PreviewChannel << "\n";
+
   if(this->Link)
     {
     os << indent << "Link: Active\n";
@@ -663,6 +813,7 @@ void vtkMRMLAstroSmoothingParametersNode::PrintSelf(ostream& os, vtkIndent inden
   if (this->Filter == 2)
     {
     os << indent << "TimeStep: " << this->TimeStep << "\n";
+    os << indent << "ConvergenceTolerance: " << this->ConvergenceTolerance << "\n";
     os << indent << "K: " << this->K << "\n";
     }
 
@@ -27,6 +27,7 @@
 #include <vtkSlicerAstroVolumeModuleMRMLExport.h>
 
 class vtkDoubleArray;
+class vtkMRMLAnnotationROINode;
 
 /// \brief MRML parameter node for the AstroMSmoothing module.
 ///
@@ -63,6 +64,12 @@ class VTK_MRML_ASTRO_EXPORT vtkMRMLAstroSmoothingParametersNode : public vtkMRML
   vtkSetStringMacro(OutputVolumeNodeID);
   vtkGetStringMacro(OutputVolumeNodeID);
 
+  /// Set/Get the PreviewOutputVolumeNodeID: the output volume created by
+  /// the module, which the preview updates in place (NULL if none).
+  /// \sa SetPreviewOutputVolumeNodeID(), GetPreviewOutputVolumeNodeID()
+  vtkSetStringMacro(PreviewOutputVolumeNodeID);
+  vtkGetStringMacro(PreviewOutputVolumeNodeID);
+
   /// Set/Get the Mode.
   /// Default is "Automatic"
   /// \sa SetMode(), GetMode()
@@ -75,6 +82,34 @@ class VTK_MRML_ASTRO_EXPORT vtkMRMLAstroSmoothingParametersNode : public vtkMRML
   vtkSetStringMacro(MasksCommand);
   vtkGetStringMacro(MasksCommand);
 
+  /// Set/Get the Region: the selection to which the smoothing is
+  /// restricted ("None", "ROI" or "Segmentation").
+  /// Default is "None"
+  /// \sa SetRegion(), GetRegion()
+  vtkSetStringMacro(Region);
+  vtkGetStringMacro(Region);
+
+  /// Set/Get the MaskVolumeNodeID (label map of the segmentation
+  /// used when the Region is "Segmentation").
+  /// \sa SetMaskVolumeNodeID(), GetMaskVolumeNodeID()
+  vtkSetStringMacro(MaskVolumeNodeID);
+  vtkGetStringMacro(MaskVolumeNodeID);
+
+  /// Get MRML ROI node
+  vtkMRMLAnnotationROINode* GetROINode();
+
+  /// Set MRML ROI node
+  void SetROINode(vtkMRMLAnnotationROINode* node);
+
+  /// Set/Get the CropOutput. If true the output volume is cropped to
+  /// the bounding box of the Region, otherwise it has the size of the input
+  /// and the voxels outside the Region are copied from the input.
+  /// Default is false
+  /// \sa SetCropOutput(), GetCropOutput()
+  vtkSetMacro(CropOutput,bool);
+  vtkGetMacro(CropOutput,bool);
+  vtkBooleanMacro(CropOutput,bool);
+
   /// Set/Get the OutputSerial
   /// \sa SetOutputSerial(), GetOutputSerial()
   vtkSetMacro(OutputSerial,int);
@@ -112,6 +147,22 @@ class VTK_MRML_ASTRO_EXPORT vtkMRMLAstroSmoothingParametersNode : public vtkMRML
   vtkGetMacro(AutoRun,bool);
   vtkBooleanMacro(AutoRun,bool);
 
+  /// Set/Get the Preview. If true, the changes of the parameters
+  /// run the filter only on the channel displayed in the slice view.
+  /// Default is false
+  /// \sa SetPreview(), GetPreview()
+  vtkSetMacro(Preview,bool);
+  vtkGetMacro(Preview,bool);
+  vtkBooleanMacro(Preview,bool);
+
+  /// Set/Get the PreviewChannel. If positive, Apply computes only this
+  /// channel (and the channels within the half-width of the kernel
+  /// needed to compute it); the other voxels of the output are not changed.
+  /// Default is -1 (the whole volume is computed)
+  /// \sa SetPreviewChannel(), GetPreviewChannel()
+  vtkSetMacro(PreviewChannel,int);
+  vtkGetMacro(PreviewChannel,int);
+
   /// Set/Get the ParameterX.
   /// Default is 5
   /// \sa SetParameterX(), GetParameterX()
@@ -171,6 +222,23 @@ class VTK_MRML_ASTRO_EXPORT vtkMRMLAstroSmoothingParametersNode : public vtkMRML
   vtkSetMacro(TimeStep,double);
   vtkGetMacro(TimeStep,double);
 
+  /// Set/Get the ConvergenceTolerance (intensity-driven gradient parameter),
+  /// in units of the noise. Rows of voxels changing less than
+  /// ConvergenceTolerance * noise / Accuracy in an iteration are not
+  /// recomputed and the iterations stop when no row changes; the result
+  /// then differs from the full computation by less than
+  /// ConvergenceTolerance * noise. Default is 0 (all the iterations are done
+  /// on all the voxels). Only the CPU filter uses it.
+  /// It is a scripting-only parameter: the module GUI has no widget for it
+  /// and does not reset it when the filter or the mode change. From Python:
+  /// \code
+  /// pnode = slicer.modules.astrosmoothing.widgetRepresentation().mrmlAstroSmoothingParametersNode()
+  /// pnode.SetConvergenceTolerance(0.01)
+  /// \endcode
+  /// \sa SetConvergenceTolerance(), GetConvergenceTolerance()
+  vtkSetClampMacro(ConvergenceTolerance,double,0.,1.);
+  vtkGetMacro(ConvergenceTolerance,double);
+
   /// Set/Get the KernelLengthX (Gaussian parameter).
   /// \sa SetKernelLengthX(), GetKernelLengthX()
   vtkSetMacro(KernelLengthX,int);
@@ -208,16 +276,24 @@ protected:
   vtkMRMLAstroSmoothingParametersNode(const vtkMRMLAstroSmoothingParametersNode&);
   void operator=(const vtkMRMLAstroSmoothingParametersNode&);
 
+  static const char* ROI_REFERENCE_ROLE;
+  const char *GetROINodeReferenceRole();
+
   char *InputVolumeNodeID;
   char *OutputVolumeNodeID;
+  char *PreviewOutputVolumeNodeID;
+  char *MaskVolumeNodeID;
   char *Mode;
   char *MasksCommand;
+  char *Region;
+  bool CropOutput;
   int OutputSerial;
 
   /// Filter method
   /// 0: Box
   /// 1: Gaussian
   /// 2: Intensity-driven gradient
+  /// 3: A trous (starlet) wavelet
   int Filter;
 
   int Hardware;
@@ -226,6 +302,8 @@ protected:
 
   bool Link;
   bool AutoRun;
+  bool Preview;
+  int PreviewChannel;
 
   int Accuracy;
   int Status;
@@ -236,6 +314,7 @@ protected:
 
   double K;
   double TimeStep;
+  double ConvergenceTolerance;
 
   double ParameterX;
   double ParameterY;
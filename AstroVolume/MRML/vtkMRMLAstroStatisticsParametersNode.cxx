@@ -38,6 +38,7 @@
 
 //------------------------------------------------------------------------------
 const char* vtkMRMLAstroStatisticsParametersNode::TABLE_REFERENCE_ROLE = "Table";
+const char* vtkMRMLAstroStatisticsParametersNode::CHANNELTABLE_REFERENCE_ROLE = "ChannelTable";
 const char* vtkMRMLAstroStatisticsParametersNode::ROI_REFERENCE_ROLE = "ROI";
 
 //----------------------------------------------------------------------------
@@ -53,6 +54,7 @@ vtkMRMLAstroStatisticsParametersNode::vtkMRMLAstroStatisticsParametersNode()
   this->Mode = NULL;
   this->SetMode("ROI");
   this->Cores = 0;
+  this->NumberOfMaskSegments = 0;
   this->Max = true;
   this->Mean = true;
   this->Median = true;
@@ -61,6 +63,10 @@ vtkMRMLAstroStatisticsParametersNode::vtkMRMLAstroStatisticsParametersNode()
   this->Std = true;
   this->Sum = true;
   this->TotalFlux = true;
+  this->Noise = false;
+  this->IntegralVolume = false;
+  this->Percentiles = NULL;
+  this->SetPercentiles("");
   this->OutputSerial = 1;
   this->Status = 0;
 }
@@ -85,6 +91,12 @@ vtkMRMLAstroStatisticsParametersNode::~vtkMRMLAstroStatisticsParametersNode()
     delete [] this->Mode;
     this->Mode = NULL;
     }
+
+  if (this->Percentiles)
+    {
+    delete [] this->Percentiles;
+    this->Percentiles = NULL;
+    }
 }
 
 //----------------------------------------------------------------------------
@@ -93,6 +105,12 @@ const char *vtkMRMLAstroStatisticsParametersNode::GetTableNodeReferenceRole()
   return vtkMRMLAstroStatisticsParametersNode::TABLE_REFERENCE_ROLE;
 }
 
+//----------------------------------------------------------------------------
+const char *vtkMRMLAstroStatisticsParametersNode::GetChannelTableNodeReferenceRole()
+{
+  return vtkMRMLAstroStatisticsParametersNode::CHANNELTABLE_REFERENCE_ROLE;
+}
+
 //----------------------------------------------------------------------------
 const char *vtkMRMLAstroStatisticsParametersNode::GetROINodeReferenceRole()
 {
@@ -134,6 +152,23 @@ vtkMRMLTableNode *vtkMRMLAstroStatisticsParametersNode::GetTableNode()
   return vtkMRMLTableNode::SafeDownCast(this->GetNodeReference(this->GetTableNodeReferenceRole()));
 }
 
+//----------------------------------------------------------------------------
+void vtkMRMLAstroStatisticsParametersNode::SetChannelTableNode(vtkMRMLTableNode* node)
+{
+  this->SetNodeReferenceID(this->GetChannelTableNodeReferenceRole(), (node ? node->GetID() : NULL));
+}
+
+//----------------------------------------------------------------------------
+vtkMRMLTableNode *vtkMRMLAstroStatisticsParametersNode::GetChannelTableNode()
+{
+  if (!this->Scene)
+    {
+    return NULL;
+    }
+
+  return vtkMRMLTableNode::SafeDownCast(this->GetNodeReference(this->GetChannelTableNodeReferenceRole()));
+}
+
 //----------------------------------------------------------------------------
 void vtkMRMLAstroStatisticsParametersNode::SetROINode(vtkMRMLAnnotationROINode* node)
 {
@@ -186,6 +221,12 @@ void vtkMRMLAstroStatisticsParametersNode::ReadXMLAttributes(const char** atts)
       continue;
       }
 
+    if (!strcmp(attName, "NumberOfMaskSegments"))
+      {
+      this->NumberOfMaskSegments = StringToInt(attValue);
+      continue;
+      }
+
     if (!strcmp(attName, "Max"))
       {
       this->Max = StringToInt(attValue);
@@ -234,6 +275,24 @@ void vtkMRMLAstroStatisticsParametersNode::ReadXMLAttributes(const char** atts)
       continue;
       }
 
+    if (!strcmp(attName, "Noise"))
+      {
+      this->Noise = StringToInt(attValue);
+      continue;
+      }
+
+    if (!strcmp(attName, "Percentiles"))
+      {
+      this->SetPercentiles(attValue);
+      continue;
+      }
+
+    if (!strcmp(attName, "IntegralVolume"))
+      {
+      this->IntegralVolume = StringToInt(attValue);
+      continue;
+      }
+
     if (!strcmp(attName, "OutputSerial"))
       {
       this->OutputSerial = StringToInt(attValue);
@@ -271,6 +330,7 @@ void vtkMRMLAstroStatisticsParametersNode::WriteXML(ostream& of, int nIndent)
     }
 
   of << indent << " Cores=\"" << this->Cores << "\"";
+  of << indent << " NumberOfMaskSegments=\"" << this->NumberOfMaskSegments << "\"";
   of << indent << " Max=\"" << this->Max << "\"";
   of << indent << " Mean=\"" << this->Mean << "\"";
   of << indent << " Median=\"" << this->Median << "\"";
@@ -279,6 +339,12 @@ void vtkMRMLAstroStatisticsParametersNode::WriteXML(ostream& of, int nIndent)
   of << indent << " Std=\"" << this->Std << "\"";
   of << indent << " Sum=\"" << this->Sum << "\"";
   of << indent << " TotalFlux=\"" << this->TotalFlux << "\"";
+  of << indent << " Noise=\"" << this->Noise << "\"";
+  if (this->Percentiles != NULL)
+    {
+    of << indent << " Percentiles=\"" << this->Percentiles << "\"";
+    }
+  of << indent << " IntegralVolume=\"" << this->IntegralVolume << "\"";
   of << indent << " OutputSerial=\"" << this->OutputSerial << "\"";
   of << indent << " Status=\"" << this->Status << "\"";
 }
@@ -297,6 +363,7 @@ void vtkMRMLAstroStatisticsParametersNode::Copy(vtkMRMLNode *anode)
   this->SetMaskVolumeNodeID(node->GetMaskVolumeNodeID());
   this->SetMode(node->GetMode());
   this->SetCores(node->GetCores());
+  this->SetNumberOfMaskSegments(node->GetNumberOfMaskSegments());
   this->SetMax(node->GetMax());
   this->SetMean(node->GetMean());
   this->SetMedian(node->GetMedian());
@@ -305,6 +372,9 @@ void vtkMRMLAstroStatisticsParametersNode::Copy(vtkMRMLNode *anode)
   this->SetStd(node->GetStd());
   this->SetSum(node->GetSum());
   this->SetTotalFlux(node->GetTotalFlux());
+  this->SetNoise(node->GetNoise());
+  this->SetPercentiles(node->GetPercentiles());
+  this->SetIntegralVolume(node->GetIntegralVolume());
   this->SetOutputSerial(node->GetOutputSerial());
   this->SetStatus(node->GetStatus());
 
@@ -319,6 +389,7 @@ void vtkMRMLAstroStatisticsParametersNode::PrintSelf(ostream& os, vtkIndent inde
   os << indent << "InputVolumeNodeID: " << ( (this->InputVolumeNodeID) ? this->InputVolumeNodeID : "None" ) << "\n";
   os << indent << "MaskVolumeNodeID: " << ( (this->MaskVolumeNodeID) ? this->MaskVolumeNodeID : "None" ) << "\n";
   os << indent << "Mode: " << ( (this->Mode) ? this->Mode : "None" ) << "\n";
+  os << indent << "NumberOfMaskSegments: " << this->NumberOfMaskSegments << "\n";
   os << indent << "Max: " << this->Max << "\n";
   os << indent << "Mean: " << this->Mean << "\n";
   os << indent << "Median: " << this->Median << "\n";
@@ -327,6 +398,9 @@ void vtkMRMLAstroStatisticsParametersNode::PrintSelf(ostream& os, vtkIndent inde
   os << indent << "Std: " << this->Std << "\n";
   os << indent << "Sum: " << this->Sum << "\n";
   os << indent << "TotalFlux: " << this->TotalFlux << "\n";
+  os << indent << "Noise: " << this->Noise << "\n";
+  os << indent << "Percentiles: " << ( (this->Percentiles) ? this->Percentiles : "None" ) << "\n";
+  os << indent << "IntegralVolume: " << this->IntegralVolume << "\n";
   os << indent << "OutputSerial: " << this->OutputSerial << "\n";
   os << indent << "Status: " << this->Status << "\n";
   if (this->Cores != 0)
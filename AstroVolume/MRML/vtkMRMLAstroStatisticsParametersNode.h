@@ -79,7 +79,14 @@ class VTK_MRML_ASTRO_EXPORT vtkMRMLAstroStatisticsParametersNode : public vtkMRM
   /// Set MRML table node
   void SetTableNode(vtkMRMLTableNode* node);
 
-  /// Set/Get the Mode.
+  /// Get MRML table node of the per-channel statistics ("Channels" mode)
+  vtkMRMLTableNode* GetChannelTableNode();
+
+  /// Set MRML table node of the per-channel statistics ("Channels" mode)
+  void SetChannelTableNode(vtkMRMLTableNode* node);
+
+  /// Set/Get the Mode: "ROI", "Segmentation" or "Channels"
+  /// (statistics of every channel of the whole cube).
   /// Default is "ROI"
   /// \sa SetMode(), GetMode()
   vtkSetStringMacro(Mode);
@@ -133,6 +140,42 @@ class VTK_MRML_ASTRO_EXPORT vtkMRMLAstroStatisticsParametersNode : public vtkMRM
   vtkGetMacro(TotalFlux,bool);
   vtkBooleanMacro(TotalFlux,bool);
 
+  /// Set/Get calculate Noise (true/false), the robust RMS
+  /// (median absolute deviation) of the selection.
+  /// Default is false.
+  /// \sa SetNoise(), GetNoise()
+  vtkSetMacro(Noise,bool);
+  vtkGetMacro(Noise,bool);
+  vtkBooleanMacro(Noise,bool);
+
+  /// Set/Get the comma separated list of percentiles (0-100)
+  /// to add as "P<q>" columns to the table (e.g. "5,25,75,95").
+  /// Default is "" (no percentile columns)
+  /// \sa SetPercentiles(), GetPercentiles()
+  vtkSetStringMacro(Percentiles);
+  vtkGetStringMacro(Percentiles);
+
+  /// Set/Get use the integral volume (true/false). In ROI mode, Npixels,
+  /// Mean, Std, Sum and TotalFlux are then obtained in constant time from
+  /// an integral volume of the input volume, built at the first calculation,
+  /// and the statistics can be updated while the ROI is dragged.
+  /// Default is false.
+  /// \sa SetIntegralVolume(), GetIntegralVolume()
+  vtkSetMacro(IntegralVolume,bool);
+  vtkGetMacro(IntegralVolume,bool);
+  vtkBooleanMacro(IntegralVolume,bool);
+
+  /// Set/Get the NumberOfMaskSegments. If > 0, each voxel of the mask
+  /// holds one bit per segment (bit i is set when the voxel belongs to
+  /// the i-th segment, at most 16 segments), and a row is added for each
+  /// segment, also for empty ones, counting overlapping voxels in all their
+  /// segments. If 0, the mask holds label values and a row is added for
+  /// each label value with at least one voxel.
+  /// Default is 0
+  /// \sa SetNumberOfMaskSegments(), GetNumberOfMaskSegments()
+  vtkSetMacro(NumberOfMaskSegments,int);
+  vtkGetMacro(NumberOfMaskSegments,int);
+
   /// Set/Get the Cores.
   /// Default is 0 (all the free cores will be used)
   /// \sa SetCores(), GetCores()
@@ -159,6 +202,9 @@ protected:
   static const char* TABLE_REFERENCE_ROLE;
   const char *GetTableNodeReferenceRole();
 
+  static const char* CHANNELTABLE_REFERENCE_ROLE;
+  const char *GetChannelTableNodeReferenceRole();
+
   static const char* ROI_REFERENCE_ROLE;
   const char *GetROINodeReferenceRole();
 
@@ -170,6 +216,7 @@ protected:
   char *Mode;
 
   int Cores;
+  int NumberOfMaskSegments;
 
   bool Max;
   bool Mean;
@@ -179,6 +226,10 @@ protected:
   bool Std;
   bool Sum;
   bool TotalFlux;
+  bool Noise;
+  bool IntegralVolume;
+
+  char *Percentiles;
 
   int OutputSerial;
 
@@ -18,12 +18,16 @@
 ==============================================================================*/
 
 // STD includes
+#include <algorithm>
 #include <string>
 #include <cstdlib>
 #include <math.h>
+#include <random>
+#include <vector>
 
 // VTK includes
 #include <vtkImageData.h>
+#include <vtkIntArray.h>
 #include <vtkNew.h>
 #include <vtkObjectFactory.h>
 #include <vtkPointData.h>
@@ -32,6 +36,9 @@
 #include <vtkSlicerAstroConfigure.h>
 
 // MRML includes
+#include <vtkAstroProgressToken.h>
+#include <vtkAstroRobustNoise.h>
+#include <vtkAstroThreadBudget.h>
 #include <vtkMRMLAnnotationROINode.h>
 #include <vtkMRMLAstroLabelMapVolumeNode.h>
 #include <vtkMRMLAstroVolumeDisplayNode.h>
@@ -59,6 +66,15 @@ vtkMRMLNodeNewMacro(vtkMRMLAstroVolumeNode);
 //----------------------------------------------------------------------------
 vtkMRMLAstroVolumeNode::vtkMRMLAstroVolumeNode()
 {
+  this->HistogramBinning = -1;
+  this->HistogramParameters[0] = 0.;
+  this->HistogramParameters[1] = 0.;
+  this->HistogramParameters[2] = 0.;
+  this->HistogramMTime = 0;
+  this->RangeSampled = false;
+  this->DisplayThresholdSampled = false;
+  this->RangeUncertainty = 0.;
+  this->DisplayThresholdUncertainty = 0.;
 }
 
 //----------------------------------------------------------------------------
@@ -117,12 +133,6 @@ template <typename T> T StringToNumber(const char* num)
   return ss >> result ? result : 0;
 }
 
-//----------------------------------------------------------------------------
-int StringToInt(const char* str)
-{
-  return StringToNumber<int>(str);
-}
-
 //----------------------------------------------------------------------------
 double StringToDouble(const char* str)
 {
@@ -136,21 +146,47 @@ template <typename T> bool isNaN(T value)
 }
 
 //----------------------------------------------------------------------------
-bool DoubleIsNaN(double Value)
-{
-  return isNaN<double>(Value);
-}
+// Number of contiguous voxels of the blocks of the sampled range
+const vtkIdType RangeBlockSize = 1024;
 
 //----------------------------------------------------------------------------
-bool FloatIsNaN(float Value)
+// Range of the valid voxels of the blocks of RangeBlockSize voxels.
+// If sampledBlocks is NULL all the blocks are used. The blocks are
+// skipped once the (optional) token has been cancelled.
+template <typename T>
+void CalculateBlocksRange(const T *inPixel, vtkIdType numElements, vtkIdType numBlocks,
+                          const vtkIdType *sampledBlocks, const vtkAstroProgressToken *token,
+                          double& min_val, double& max_val)
 {
-  return isNaN<float>(Value);
-}
-
-//----------------------------------------------------------------------------
-bool ShortIsNaN(short Value)
-{
-  return isNaN<short>(Value);
+  #ifdef VTK_SLICER_ASTRO_SUPPORT_OPENMP
+  #pragma omp parallel for schedule(static) reduction(max : max_val), reduction(min : min_val)
+  #endif // VTK_SLICER_ASTRO_SUPPORT_OPENMP
+  for (vtkIdType blockCnt = 0; blockCnt < numBlocks; blockCnt++)
+    {
+    if (token && token->IsCancelled())
+      {
+      continue;
+      }
+    const vtkIdType block = sampledBlocks ? sampledBlocks[blockCnt] : blockCnt;
+    const vtkIdType firstElement = block * RangeBlockSize;
+    const vtkIdType lastElement = std::min(firstElement + RangeBlockSize, numElements);
+    for (vtkIdType elementCnt = firstElement; elementCnt < lastElement; elementCnt++)
+      {
+      const T value = *(inPixel + elementCnt);
+      if (isNaN<T>(value))
+        {
+        continue;
+        }
+      if (value > max_val)
+        {
+        max_val = value;
+        }
+      if (value < min_val)
+        {
+        min_val = value;
+        }
+      }
+    }
 }
 
 }// end namespace
@@ -183,6 +219,11 @@ void vtkMRMLAstroVolumeNode::Copy(vtkMRMLNode *anode)
 void vtkMRMLAstroVolumeNode::PrintSelf(ostream& os, vtkIndent indent)
 {
   this->Superclass::PrintSelf(os,indent);
+
+  os << indent << "RangeSampled: " << this->RangeSampled << "\n";
+  os << indent << "RangeUncertainty: " << this->RangeUncertainty << "\n";
+  os << indent << "DisplayThresholdSampled: " << this->DisplayThresholdSampled << "\n";
+  os << indent << "DisplayThresholdUncertainty: " << this->DisplayThresholdUncertainty << "\n";
 }
 
 //---------------------------------------------------------------------------
@@ -198,97 +239,131 @@ vtkMRMLVolumeRenderingDisplayNode *vtkMRMLAstroVolumeNode::GetAstroVolumeRenderi
 }
 
 //---------------------------------------------------------------------------
-bool vtkMRMLAstroVolumeNode::UpdateRangeAttributes()
-{     
-  if (!this->GetImageData())
-   {
-   return false;
-   }
+vtkIdType vtkMRMLAstroVolumeNode::GetMaximumNumberOfRangeSamples()
+{
+  return 1048576;
+}
 
-  this->GetImageData()->Modified();
-  int *dims = this->GetImageData()->GetDimensions();
-  int numElements = dims[0] * dims[1] * dims[2];
-  const int DataType = this->GetImageData()->GetPointData()->GetScalars()->GetDataType();
-  double max_val = this->GetImageData()->GetScalarTypeMin(), min_val = this->GetImageData()->GetScalarTypeMax();
-  short *inSPixel = NULL;
-  float *inFPixel = NULL;
-  double *inDPixel = NULL;
+//---------------------------------------------------------------------------
+vtkIdType vtkMRMLAstroVolumeNode::GetMaximumNumberOfNoiseSamples()
+{
+  return 262144;
+}
 
-  #ifdef VTK_SLICER_ASTRO_SUPPORT_OPENMP
-  omp_set_num_threads(omp_get_num_procs());
-  #endif // VTK_SLICER_ASTRO_SUPPORT_OPENMP
+//---------------------------------------------------------------------------
+bool vtkMRMLAstroVolumeNode::CalculateRange(vtkImageData *imageData, double range[2],
+                                            vtkIdType maximumNumberOfSamples,
+                                            double *uncertainty,
+                                            vtkAstroProgressToken *token)
+{
+  if (uncertainty)
+    {
+    *uncertainty = 0.;
+    }
+
+  if (!imageData || !imageData->GetPointData() ||
+      !imageData->GetPointData()->GetScalars())
+    {
+    return false;
+    }
+
+  int *dims = imageData->GetDimensions();
+  const vtkIdType numElements = (vtkIdType) dims[0] * dims[1] * dims[2];
+  const int DataType = imageData->GetPointData()->GetScalars()->GetDataType();
+  double max_val = imageData->GetScalarTypeMin(), min_val = imageData->GetScalarTypeMax();
+
+  // Blocks of contiguous voxels (i.e., pieces of rows) are sampled, one at
+  // random in each of numSampledBlocks equal strides of the data.
+  vtkIdType numBlocks = (numElements + RangeBlockSize - 1) / RangeBlockSize;
+  const vtkIdType numSampledBlocks = maximumNumberOfSamples / RangeBlockSize;
+  std::vector<vtkIdType> sampledBlocks;
+  if (maximumNumberOfSamples > 0 && numSampledBlocks > 0 && numSampledBlocks < numBlocks)
+    {
+    std::minstd_rand generator(1);
+    sampledBlocks.resize(numSampledBlocks);
+    for (vtkIdType sampleCnt = 0; sampleCnt < numSampledBlocks; sampleCnt++)
+      {
+      const vtkIdType firstBlock = sampleCnt * numBlocks / numSampledBlocks;
+      const vtkIdType lastBlock = (sampleCnt + 1) * numBlocks / numSampledBlocks;
+      sampledBlocks[sampleCnt] = firstBlock + generator() % (lastBlock - firstBlock);
+      }
+    numBlocks = numSampledBlocks;
+
+    // With n random blocks, the fraction of the blocks containing voxels
+    // outside the sampled range is below 3 / n with 95% confidence.
+    if (uncertainty)
+      {
+      *uncertainty = std::min(1., 3. / numSampledBlocks);
+      }
+    }
+  const vtkIdType *blocks = sampledBlocks.empty() ? NULL : &sampledBlocks[0];
+
+  vtkAstroThreadBudget threadBudget;
 
   switch (DataType)
     {
     case VTK_SHORT:
-      inSPixel = static_cast<short*> (this->GetImageData()->GetScalarPointer());
-      #ifdef VTK_SLICER_ASTRO_SUPPORT_OPENMP
-      #pragma omp parallel for schedule(static) reduction(max : max_val), reduction(min : min_val)
-      #endif // VTK_SLICER_ASTRO_SUPPORT_OPENMP
-      for (int elementCnt = 0; elementCnt < numElements; elementCnt++)
-        {
-        if (ShortIsNaN(*(inSPixel + elementCnt)))
-          {
-          continue;
-          }
-        if (*(inSPixel + elementCnt) > max_val)
-          {
-          max_val = *(inSPixel + elementCnt);
-          }
-        if (*(inSPixel + elementCnt) < min_val)
-          {
-          min_val = *(inSPixel + elementCnt);
-          }
-        }
-    break;
+      CalculateBlocksRange<short>(static_cast<short*> (imageData->GetScalarPointer()),
+                                  numElements, numBlocks, blocks, token, min_val, max_val);
+      break;
     case VTK_FLOAT:
-      inFPixel = static_cast<float*> (this->GetImageData()->GetScalarPointer());
-      #ifdef VTK_SLICER_ASTRO_SUPPORT_OPENMP
-      #pragma omp parallel for schedule(static) reduction(max : max_val), reduction(min : min_val)
-      #endif // VTK_SLICER_ASTRO_SUPPORT_OPENMP
-      for (int elementCnt = 0; elementCnt < numElements; elementCnt++)
-        {
-        if (FloatIsNaN(*(inFPixel + elementCnt)))
-          {
-          continue;
-          }
-        if (*(inFPixel + elementCnt) > max_val)
-          {
-          max_val = *(inFPixel + elementCnt);
-          }
-        if (*(inFPixel + elementCnt) < min_val)
-          {
-          min_val = *(inFPixel + elementCnt);
-          }
-        }
+      CalculateBlocksRange<float>(static_cast<float*> (imageData->GetScalarPointer()),
+                                  numElements, numBlocks, blocks, token, min_val, max_val);
       break;
     case VTK_DOUBLE:
-      inDPixel = static_cast<double*> (this->GetImageData()->GetScalarPointer());
-      #ifdef VTK_SLICER_ASTRO_SUPPORT_OPENMP
-      #pragma omp parallel for schedule(static) reduction(max : max_val), reduction(min : min_val)
-      #endif // VTK_SLICER_ASTRO_SUPPORT_OPENMP
-      for (int elementCnt = 0; elementCnt < numElements; elementCnt++)
-        {
-        if (DoubleIsNaN(*(inDPixel + elementCnt)))
-          {
-          continue;
-          }
-        if (*(inDPixel + elementCnt) > max_val)
-          {
-          max_val = *(inDPixel + elementCnt);
-          }
-        if (*(inDPixel + elementCnt) < min_val)
-          {
-          min_val = *(inDPixel + elementCnt);
-          }
-        }
+      CalculateBlocksRange<double>(static_cast<double*> (imageData->GetScalarPointer()),
+                                   numElements, numBlocks, blocks, token, min_val, max_val);
       break;
     default:
-      vtkErrorMacro("vtkSlicerAstroVolumeLogic::UpdateRangeAttributes : "
-                    "attempt to allocate scalars of type not allowed");
       return false;
     }
 
+  if (token && token->IsCancelled())
+    {
+    return false;
+    }
+
+  range[0] = min_val;
+  range[1] = max_val;
+
+  return true;
+}
+
+//---------------------------------------------------------------------------
+double vtkMRMLAstroVolumeNode::CalculateNoise(vtkImageData *imageData,
+                                              vtkIdType maximumNumberOfSamples,
+                                              double *uncertainty,
+                                              vtkAstroProgressToken *token)
+{
+  // Calculate the noise as the robust RMS (median absolute deviation)
+  // of a sample of the datacube (blanked voxels and emission are not
+  // taken into account).
+  vtkAstroRobustNoise noiseEstimator;
+  noiseEstimator.SetEstimator(vtkAstroRobustNoise::MedianAbsoluteDeviation);
+  noiseEstimator.SetMaximumNumberOfSamples(maximumNumberOfSamples);
+  noiseEstimator.SetProgressToken(token);
+  double noise = noiseEstimator.Estimate(imageData);
+  if (token && token->IsCancelled())
+    {
+    noise = 0.;
+    }
+
+  // The relative standard error of the MAD estimator
+  // of Gaussian noise is 1.166 / sqrt(n)
+  if (uncertainty)
+    {
+    const vtkIdType numSamples = noiseEstimator.GetNumberOfSamples();
+    *uncertainty = numSamples > 0 ? 1.166 / sqrt((double) numSamples) : 0.;
+    }
+
+  return noise;
+}
+
+//---------------------------------------------------------------------------
+void vtkMRMLAstroVolumeNode::SetRangeAttributes(const double range[2])
+{
+  const double min_val = range[0], max_val = range[1];
+
   int wasModifying = this->StartModify();
   this->SetAttribute("SlicerAstro.DATAMAX", DoubleToString(max_val).c_str());
   this->SetAttribute("SlicerAstro.DATAMIN", DoubleToString(min_val).c_str());
@@ -305,281 +380,202 @@ bool vtkMRMLAstroVolumeNode::UpdateRangeAttributes()
     }
 
   this->EndModify(wasModifying);
+}
 
-  inSPixel = NULL;
-  inFPixel = NULL;
-  inDPixel = NULL;
-  delete inSPixel;
-  delete inFPixel;
-  delete inDPixel;
+//---------------------------------------------------------------------------
+bool vtkMRMLAstroVolumeNode::UpdateRangeAttributes(bool sampled)
+{     
+  if (!this->GetImageData())
+   {
+   return false;
+   }
+
+  this->GetImageData()->Modified();
+
+  double range[2], uncertainty = 0.;
+  if (!vtkMRMLAstroVolumeNode::CalculateRange(this->GetImageData(), range,
+        sampled ? vtkMRMLAstroVolumeNode::GetMaximumNumberOfRangeSamples() : 0,
+        &uncertainty))
+    {
+    vtkErrorMacro("vtkSlicerAstroVolumeLogic::UpdateRangeAttributes : "
+                  "attempt to allocate scalars of type not allowed");
+    return false;
+    }
+
+  int wasModifying = this->StartModify();
+  this->SetRangeAttributes(range);
+  this->RangeSampled = uncertainty > 0.;
+  this->RangeUncertainty = uncertainty;
+  if (this->RangeSampled)
+    {
+    this->InvokeCustomModifiedEvent(vtkMRMLAstroVolumeNode::AttributesSampledEvent);
+    }
+  this->EndModify(wasModifying);
 
   return true;
 }
 
 //---------------------------------------------------------------------------
-bool vtkMRMLAstroVolumeNode::UpdateDisplayThresholdAttributes()
+bool vtkMRMLAstroVolumeNode::UpdateDisplayThresholdAttributes(bool sampled)
 {
   if (!this->GetImageData())
    {
    return false;
    }
 
-  // Calculate the noise as the std of 6 slices of the datacube.
+  int *dims = this->GetImageData()->GetDimensions();
+  const vtkIdType numElements = (vtkIdType) dims[0] * dims[1] * dims[2];
+  sampled = sampled && numElements > vtkMRMLAstroVolumeNode::GetMaximumNumberOfNoiseSamples();
+
   // The DisplayThreshold = noise
   // 3D color function starts from 3 times the value of DisplayThreshold.
-  int *dims = this->GetImageData()->GetDimensions();
-  const int DataType = this->GetImageData()->GetPointData()->GetScalars()->GetDataType();
-  short *outSPixel = NULL;
-  float *outFPixel = NULL;
-  double *outDPixel = NULL;
-  switch (DataType)
-    {
-    case VTK_SHORT:
-      outSPixel = static_cast<short*> (this->GetImageData()->GetScalarPointer(0,0,0));
-      break;
-    case VTK_FLOAT:
-      outFPixel = static_cast<float*> (this->GetImageData()->GetScalarPointer(0,0,0));
-      break;
-    case VTK_DOUBLE:
-      outDPixel = static_cast<double*> (this->GetImageData()->GetScalarPointer(0,0,0));
-      break;
-    default:
-      vtkErrorMacro("vtkMRMLAstroVolumeNode::UpdateDisplayThresholdAttributes : "
-                    "attempt to allocate scalars of type not allowed");
-      return false;
-    }
-  double sum = 0., noise1 = 0., noise2 = 0, noise = 0.;
-  int lowBoundary;
-  int highBoundary;
+  double uncertainty = 0.;
+  double noise = vtkMRMLAstroVolumeNode::CalculateNoise(this->GetImageData(),
+    sampled ? vtkMRMLAstroVolumeNode::GetMaximumNumberOfNoiseSamples() : 0,
+    &uncertainty);
 
-  if (StringToInt(this->GetAttribute("SlicerAstro.NAXIS")) == 3)
-    {
-    lowBoundary = dims[0] * dims[1] * 2;
-    highBoundary = dims[0] * dims[1] * 4;
-    }
-  else if (StringToInt(this->GetAttribute("SlicerAstro.NAXIS")) == 2)
+  if (noise < 1.E-6)
     {
-    lowBoundary = dims[0] * 2;
-    highBoundary = dims[0] * 4;
+    double MAX = StringToDouble(this->GetAttribute("SlicerAstro.DATAMAX"));
+    double MIN = StringToDouble(this->GetAttribute("SlicerAstro.DATAMIN"));
+    noise = (MAX - MIN) * 0.01;
     }
-  else
+
+  int wasModifying = this->StartModify();
+  this->SetDisplayThreshold(noise);
+  this->DisplayThresholdSampled = sampled;
+  this->DisplayThresholdUncertainty = sampled ? uncertainty : 0.;
+  if (this->DisplayThresholdSampled)
     {
-    lowBoundary = 2;
-    highBoundary = 4;
+    this->InvokeCustomModifiedEvent(vtkMRMLAstroVolumeNode::AttributesSampledEvent);
     }
+  this->EndModify(wasModifying);
 
-  int cont = highBoundary - lowBoundary;
+  return true;
+}
 
-  #ifdef VTK_SLICER_ASTRO_SUPPORT_OPENMP
-  omp_set_num_threads(omp_get_num_procs());
-  #endif // VTK_SLICER_ASTRO_SUPPORT_OPENMP
+//---------------------------------------------------------------------------
+bool vtkMRMLAstroVolumeNode::GetAttributesSampled()
+{
+  return this->RangeSampled || this->DisplayThresholdSampled;
+}
 
-  switch (DataType)
+//---------------------------------------------------------------------------
+bool vtkMRMLAstroVolumeNode::SetRefinedAttributes(vtkImageData *imageData,
+                                                  vtkMTimeType imageDataMTime,
+                                                  const double range[2],
+                                                  double noise)
+{
+  if (!this->GetAttributesSampled() || !imageData ||
+      imageData != this->GetImageData() ||
+      imageDataMTime != this->GetImageDataMTime())
     {
-    case VTK_SHORT:
-      #ifdef VTK_SLICER_ASTRO_SUPPORT_OPENMP
-      #pragma omp parallel for schedule(static) reduction(+:sum)
-      #endif // VTK_SLICER_ASTRO_SUPPORT_OPENMP
-      for (int elemCnt = lowBoundary; elemCnt <= highBoundary; elemCnt++)
-        {
-        if (ShortIsNaN(*(outSPixel + elemCnt)))
-           {
-           continue;
-           }
-        sum += *(outSPixel + elemCnt);
-        }
-      sum /= cont;
-
-      #ifdef VTK_SLICER_ASTRO_SUPPORT_OPENMP
-      #pragma omp parallel for schedule(static) reduction(+:noise1)
-      #endif // VTK_SLICER_ASTRO_SUPPORT_OPENMP
-      for (int elemCnt = lowBoundary; elemCnt <= highBoundary; elemCnt++)
-        {
-        if (ShortIsNaN(*(outSPixel + elemCnt)))
-           {
-           continue;
-           }
-        noise1 += (*(outSPixel + elemCnt) - sum) * (*(outSPixel + elemCnt) - sum);
-        }
-      noise1 = sqrt(noise1 / cont);
-      break;
-    case VTK_FLOAT:
-      #ifdef VTK_SLICER_ASTRO_SUPPORT_OPENMP
-      #pragma omp parallel for schedule(static) reduction(+:sum)
-      #endif // VTK_SLICER_ASTRO_SUPPORT_OPENMP
-      for (int elemCnt = lowBoundary; elemCnt <= highBoundary; elemCnt++)
-        {
-        if (FloatIsNaN(*(outFPixel + elemCnt)))
-           {
-           continue;
-           }
-        sum += *(outFPixel + elemCnt);
-        }
-      sum /= cont;
-
-      #ifdef VTK_SLICER_ASTRO_SUPPORT_OPENMP
-      #pragma omp parallel for schedule(static) reduction(+:noise1)
-      #endif // VTK_SLICER_ASTRO_SUPPORT_OPENMP
-      for (int elemCnt = lowBoundary; elemCnt <= highBoundary; elemCnt++)
-        {
-        if (FloatIsNaN(*(outFPixel + elemCnt)))
-           {
-           continue;
-           }
-        noise1 += (*(outFPixel + elemCnt) - sum) * (*(outFPixel + elemCnt) - sum);
-        }
-      noise1 = sqrt(noise1 / cont);
-      break;
-    case VTK_DOUBLE:
-      #ifdef VTK_SLICER_ASTRO_SUPPORT_OPENMP
-      #pragma omp parallel for schedule(static) reduction(+:sum)
-      #endif // VTK_SLICER_ASTRO_SUPPORT_OPENMP
-      for (int elemCnt = lowBoundary; elemCnt <= highBoundary; elemCnt++)
-        {
-        if (DoubleIsNaN(*(outDPixel + elemCnt)))
-           {
-           continue;
-           }
-        sum += *(outDPixel + elemCnt);
-        }
-      sum /= cont;
-
-      #ifdef VTK_SLICER_ASTRO_SUPPORT_OPENMP
-      #pragma omp parallel for schedule(static) reduction(+:noise1)
-      #endif // VTK_SLICER_ASTRO_SUPPORT_OPENMP
-      for (int elemCnt = lowBoundary; elemCnt <= highBoundary; elemCnt++)
-        {
-        if (DoubleIsNaN(*(outDPixel + elemCnt)))
-           {
-           continue;
-           }
-        noise1 += (*(outDPixel + elemCnt) - sum) * (*(outDPixel + elemCnt) - sum);
-        }
-      noise1 = sqrt(noise1 / cont);
-      break;
+    return false;
     }
 
-  if (StringToInt(this->GetAttribute("SlicerAstro.NAXIS")) == 3)
+  int wasModifying = this->StartModify();
+  if (this->RangeSampled)
     {
-    lowBoundary = dims[0] * dims[1] * (dims[2] - 4);
-    highBoundary = dims[0] * dims[1] * (dims[2] - 2);
+    this->SetRangeAttributes(range);
+    this->RangeSampled = false;
+    this->RangeUncertainty = 0.;
     }
-  else if (StringToInt(this->GetAttribute("SlicerAstro.NAXIS")) == 2)
+  if (this->DisplayThresholdSampled)
     {
-    lowBoundary = dims[0] * (dims[1] - 4);
-    highBoundary = dims[0] * (dims[1] - 2);
+    if (noise < 1.E-6)
+      {
+      double MAX = StringToDouble(this->GetAttribute("SlicerAstro.DATAMAX"));
+      double MIN = StringToDouble(this->GetAttribute("SlicerAstro.DATAMIN"));
+      noise = (MAX - MIN) * 0.01;
+      }
+    this->SetDisplayThreshold(noise);
+    this->DisplayThresholdSampled = false;
+    this->DisplayThresholdUncertainty = 0.;
     }
-  else
+  this->EndModify(wasModifying);
+
+  return true;
+}
+
+//----------------------------------------------------------------------------
+vtkMTimeType vtkMRMLAstroVolumeNode::GetImageDataMTime()
+{
+  vtkImageData* imageData = this->GetImageData();
+  if (!imageData)
     {
-    lowBoundary = dims[0] - 4;
-    highBoundary = dims[0] - 2;
+    return 0;
     }
 
-  sum = 0.;
-
-  switch (DataType)
+  vtkMTimeType mTime = imageData->GetMTime();
+  if (imageData->GetPointData() && imageData->GetPointData()->GetScalars() &&
+      imageData->GetPointData()->GetScalars()->GetMTime() > mTime)
     {
-    case VTK_SHORT:
-      #ifdef VTK_SLICER_ASTRO_SUPPORT_OPENMP
-      #pragma omp parallel for schedule(static) reduction(+:sum)
-      #endif // VTK_SLICER_ASTRO_SUPPORT_OPENMP
-      for (int elemCnt = lowBoundary; elemCnt <= highBoundary; elemCnt++)
-        {
-        if (ShortIsNaN(*(outSPixel + elemCnt)))
-           {
-           continue;
-           }
-        sum += *(outSPixel + elemCnt);
-        }
-      sum /= cont;
+    mTime = imageData->GetPointData()->GetScalars()->GetMTime();
+    }
 
-      #ifdef VTK_SLICER_ASTRO_SUPPORT_OPENMP
-      #pragma omp parallel for schedule(static) reduction(+:noise2)
-      #endif // VTK_SLICER_ASTRO_SUPPORT_OPENMP
-      for (int elemCnt = lowBoundary; elemCnt <= highBoundary; elemCnt++)
-        {
-        if (ShortIsNaN(*(outSPixel + elemCnt)))
-           {
-           continue;
-           }
-        noise2 += (*(outSPixel + elemCnt) - sum) * (*(outSPixel + elemCnt) - sum);
-        }
-      noise2 = sqrt(noise2 / cont);
-      break;
-    case VTK_FLOAT:
-      #ifdef VTK_SLICER_ASTRO_SUPPORT_OPENMP
-      #pragma omp parallel for schedule(static) reduction(+:sum)
-      #endif // VTK_SLICER_ASTRO_SUPPORT_OPENMP
-      for (int elemCnt = lowBoundary; elemCnt <= highBoundary; elemCnt++)
-        {
-        if (FloatIsNaN(*(outFPixel + elemCnt)))
-           {
-           continue;
-           }
-        sum += *(outFPixel + elemCnt);
-        }
-      sum /= cont;
+  return mTime;
+}
 
-      #ifdef VTK_SLICER_ASTRO_SUPPORT_OPENMP
-      #pragma omp parallel for schedule(static) reduction(+:noise2)
-      #endif // VTK_SLICER_ASTRO_SUPPORT_OPENMP
-      for (int elemCnt = lowBoundary; elemCnt <= highBoundary; elemCnt++)
-        {
-        if (FloatIsNaN(*(outFPixel + elemCnt)))
-           {
-           continue;
-           }
-        noise2 += (*(outFPixel + elemCnt) - sum) * (*(outFPixel + elemCnt) - sum);
-        }
-      noise2 = sqrt(noise2 / cont);
-      break;
-    case VTK_DOUBLE:
-      #ifdef VTK_SLICER_ASTRO_SUPPORT_OPENMP
-      #pragma omp parallel for schedule(static) reduction(+:sum)
-      #endif // VTK_SLICER_ASTRO_SUPPORT_OPENMP
-      for (int elemCnt = lowBoundary; elemCnt <= highBoundary; elemCnt++)
-        {
-        if (DoubleIsNaN(*(outDPixel + elemCnt)))
-           {
-           continue;
-           }
-        sum += *(outDPixel + elemCnt);
-        }
-      sum /= cont;
+//----------------------------------------------------------------------------
+void vtkMRMLAstroVolumeNode::CancelAttributesRefinement()
+{
+  // not deferred by StartModify: the writer goes on only
+  // once the observers have stopped reading the scalars
+  this->InvokeEvent(vtkMRMLAstroVolumeNode::AttributesRefinementCancelEvent);
+}
 
-      #ifdef VTK_SLICER_ASTRO_SUPPORT_OPENMP
-      #pragma omp parallel for schedule(static) reduction(+:noise2)
-      #endif // VTK_SLICER_ASTRO_SUPPORT_OPENMP
-      for (int elemCnt = lowBoundary; elemCnt <= highBoundary; elemCnt++)
-        {
-        if (DoubleIsNaN(*(outDPixel + elemCnt)))
-           {
-           continue;
-           }
-        noise2 += (*(outDPixel + elemCnt) - sum) * (*(outDPixel + elemCnt) - sum);
-        }
-      noise2 = sqrt(noise2 / cont);
-      break;
+//----------------------------------------------------------------------------
+void vtkMRMLAstroVolumeNode::SetCachedHistogram(vtkIntArray *counts,
+                                                vtkDoubleArray *binEdges,
+                                                int binning,
+                                                const double parameters[3])
+{
+  if (!counts || !binEdges ||
+      binEdges->GetNumberOfValues() != counts->GetNumberOfValues() + 1)
+    {
+    this->HistogramCounts = NULL;
+    this->HistogramBinEdges = NULL;
+    return;
     }
 
-  noise = (noise1 + noise2) * 0.5;
+  if (!this->HistogramCounts)
+    {
+    this->HistogramCounts = vtkSmartPointer<vtkIntArray>::New();
+    }
+  if (!this->HistogramBinEdges)
+    {
+    this->HistogramBinEdges = vtkSmartPointer<vtkDoubleArray>::New();
+    }
 
-  outSPixel = NULL;
-  outFPixel = NULL;
-  outDPixel = NULL;
-  delete outSPixel;
-  delete outFPixel;
-  delete outDPixel;
+  this->HistogramCounts->DeepCopy(counts);
+  this->HistogramBinEdges->DeepCopy(binEdges);
+  this->HistogramBinning = binning;
+  this->HistogramParameters[0] = parameters[0];
+  this->HistogramParameters[1] = parameters[1];
+  this->HistogramParameters[2] = parameters[2];
+  this->HistogramMTime = this->GetImageDataMTime();
+}
 
-  if (noise < 1.E-6)
+//----------------------------------------------------------------------------
+bool vtkMRMLAstroVolumeNode::GetCachedHistogram(vtkIntArray *counts,
+                                                vtkDoubleArray *binEdges,
+                                                int binning,
+                                                int numberOfBins,
+                                                const double parameters[3])
+{
+  if (!counts || !binEdges || !this->HistogramCounts ||
+      this->HistogramBinning != binning ||
+      this->HistogramCounts->GetNumberOfValues() != numberOfBins ||
+      this->HistogramParameters[0] != parameters[0] ||
+      this->HistogramParameters[1] != parameters[1] ||
+      this->HistogramParameters[2] != parameters[2] ||
+      this->HistogramMTime != this->GetImageDataMTime())
     {
-    double MAX = StringToDouble(this->GetAttribute("SlicerAstro.DATAMAX"));
-    double MIN = StringToDouble(this->GetAttribute("SlicerAstro.DATAMIN"));
-    noise = (MAX - MIN) * 0.01;
+    return false;
     }
 
-  this->SetDisplayThreshold(noise);
-
+  counts->DeepCopy(this->HistogramCounts);
+  binEdges->DeepCopy(this->HistogramBinEdges);
   return true;
 }
 
@@ -32,6 +32,9 @@
 
 #include <vtkSlicerAstroVolumeModuleMRMLExport.h>
 
+class vtkAstroProgressToken;
+class vtkImageData;
+class vtkIntArray;
 class vtkMRMLAnnotationROINode;
 class vtkMRMLAstroVolumeDisplayNode;
 class vtkMRMLAstroLabelMapVolumeNode;
@@ -99,17 +102,105 @@ class VTK_MRML_ASTRO_EXPORT vtkMRMLAstroVolumeNode : public vtkMRMLScalarVolumeN
   /// Delete MRML ROI alignment transform node
   void DeleteROIAlignmentTransformNode();
 
-  /// Update Max and Min Attributes
-  virtual bool UpdateRangeAttributes();
-
-  /// Update DisplayThreshold Attribute
-   virtual bool UpdateDisplayThresholdAttributes();
+  /// Update Max and Min Attributes.
+  /// If sampled is true and the volume is large, the range is estimated
+  /// from a random subset of blocks of voxels (GetMaximumNumberOfRangeSamples()),
+  /// the attributes are marked as sampled and AttributesSampledEvent is invoked,
+  /// so that the exact values can be calculated in the background.
+  /// \sa GetRangeUncertainty, SetRefinedAttributes
+  virtual bool UpdateRangeAttributes(bool sampled = false);
+
+  /// Update DisplayThreshold Attribute.
+  /// If sampled is true and the volume is large, the noise is estimated
+  /// from GetMaximumNumberOfNoiseSamples() voxels (see UpdateRangeAttributes),
+  /// otherwise all the voxels are used.
+  /// \sa GetDisplayThresholdUncertainty
+  virtual bool UpdateDisplayThresholdAttributes(bool sampled = false);
+
+  /// Calculate the range of the valid voxels of imageData. If
+  /// maximumNumberOfSamples is not 0, the range is estimated from a random
+  /// subset of blocks of voxels and uncertainty (if not NULL) is set to the
+  /// upper bound (95% confidence) of the fraction of the voxels which can be
+  /// outside the estimated range; it is 0 if all the voxels have been used.
+  /// The image data is not modified: the method can run in any thread.
+  /// If token is not NULL, its cancel request stops the calculation
+  /// and false is returned.
+  static bool CalculateRange(vtkImageData* imageData, double range[2],
+                             vtkIdType maximumNumberOfSamples = 0,
+                             double* uncertainty = NULL,
+                             vtkAstroProgressToken* token = NULL);
+
+  /// Calculate the noise (robust RMS) of imageData from at most
+  /// maximumNumberOfSamples voxels (0 means all the voxels). If uncertainty
+  /// is not NULL, it is set to the relative standard error of the estimate
+  /// (uncorrelated noise). The image data is not modified: the method can
+  /// run in any thread. If token is not NULL, its cancel request stops
+  /// the calculation and 0 is returned.
+  static double CalculateNoise(vtkImageData* imageData,
+                               vtkIdType maximumNumberOfSamples,
+                               double* uncertainty = NULL,
+                               vtkAstroProgressToken* token = NULL);
+
+  /// Number of voxels used by the sampled range (1048576).
+  static vtkIdType GetMaximumNumberOfRangeSamples();
+
+  /// Number of voxels used by the sampled noise (262144).
+  static vtkIdType GetMaximumNumberOfNoiseSamples();
+
+  /// Return true if the range or the DisplayThreshold attributes are
+  /// sampled estimates which have not been refined yet.
+  bool GetAttributesSampled();
+
+  /// Upper bound of the fraction of the voxels outside the
+  /// range attributes (0 if the range is exact).
+  double GetRangeUncertainty() {return this->RangeUncertainty;};
+
+  /// Relative standard error of the DisplayThreshold
+  /// attribute (0 if it has not been sampled).
+  double GetDisplayThresholdUncertainty() {return this->DisplayThresholdUncertainty;};
+
+  /// Replace the sampled attributes with the exact range and noise
+  /// calculated (e.g., in a background thread) on imageData when its
+  /// modification time was imageDataMTime. The values are discarded if the
+  /// image data has been replaced or modified in the meantime.
+  /// 
+eturn true if the attributes and the display node have been updated
+  bool SetRefinedAttributes(vtkImageData* imageData, vtkMTimeType imageDataMTime,
+                            const double range[2], double noise);
+
+  /// Modification time of the image data and of its scalars
+  vtkMTimeType GetImageDataMTime();
+
+  /// Stop the background refinements reading the scalars of the image
+  /// data (AttributesRefinementCancelEvent is invoked and the observers
+  /// wait for them). Call it before writing in place in the scalars;
+  /// the refinement starts again on the new data.
+  void CancelAttributesRefinement();
 
   enum
      {
      DisplayThresholdModifiedEvent = 71000,
+     AttributesSampledEvent = 71001,
+     AttributesRefinementCancelEvent = 71002,
      };
 
+  /// Store an histogram of the image data: the counts of the bins and
+  /// their edges (number of bins + 1 values). The histogram is tagged with
+  /// the \a binning mode, the \a parameters which the bins have been
+  /// derived from (e.g., data range and noise) and the modification time
+  /// of the image data.
+  /// \sa GetCachedHistogram, vtkSlicerAstroVolumeLogic::CalculateHistogram
+  void SetCachedHistogram(vtkIntArray* counts, vtkDoubleArray* binEdges,
+                          int binning, const double parameters[3]);
+
+  /// Copy the stored histogram in \a counts and \a binEdges if it has
+  /// been calculated on the current image data with the same \a binning,
+  /// \a numberOfBins and \a parameters.
+  /// \return true if the stored histogram is valid
+  bool GetCachedHistogram(vtkIntArray* counts, vtkDoubleArray* binEdges,
+                          int binning, int numberOfBins,
+                          const double parameters[3]);
+
   /// Set the SlicerAstro.DisplayThreshold keyword and fire the signal
   void SetDisplayThreshold(double DisplayThreshold);
 
@@ -165,6 +256,21 @@ protected:
   static const char* ROI_ALIGNMENTTRANSFORM_REFERENCE_ROLE;
   const char *GetROIAlignmentTransformNodeReferenceRole();
 
+  /// Set the range attributes and the window/level and
+  /// threshold of the display node
+  void SetRangeAttributes(const double range[2]);
+
+  vtkSmartPointer<vtkIntArray> HistogramCounts;
+  vtkSmartPointer<vtkDoubleArray> HistogramBinEdges;
+  int HistogramBinning;
+  double HistogramParameters[3];
+  vtkMTimeType HistogramMTime;
+
+  bool RangeSampled;
+  bool DisplayThresholdSampled;
+  double RangeUncertainty;
+  double DisplayThresholdUncertainty;
+
   vtkMRMLAstroVolumeNode(const vtkMRMLAstroVolumeNode&);
   void operator=(const vtkMRMLAstroVolumeNode&);
 };
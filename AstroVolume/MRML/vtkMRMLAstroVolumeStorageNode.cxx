@@ -32,8 +32,10 @@
 
 // VTK includes
 #include <vtkDataSetAttributes.h>
+#include <vtkDoubleArray.h>
 #include <vtkImageChangeInformation.h>
 #include <vtkImageData.h>
+#include <vtkIntArray.h>
 #include <vtkNew.h>
 #include <vtkObjectFactory.h>
 #include <vtkType.h>
@@ -196,6 +198,12 @@ int vtkMRMLAstroVolumeStorageNode::ReadDataInternal(vtkMRMLNode *refNode)
     reader->SetUseNativeOriginOn();
     }
 
+  // accumulate the default histogram of the histogram panel while reading
+  if (refNode->IsA("vtkMRMLAstroVolumeNode"))
+    {
+    reader->SetNumberOfHistogramBins(100);
+    }
+
   if (refNode->IsA("vtkMRMLAstroVolumeNode"))
     {
     if (volNode->GetImageData())
@@ -383,10 +391,28 @@ int vtkMRMLAstroVolumeStorageNode::ReadDataInternal(vtkMRMLNode *refNode)
   if (refNode->IsA("vtkMRMLAstroVolumeNode"))
     {
     volNode->SetImageDataConnection(ici->GetOutputPort());
+
+    // The range and the histogram have been calculated by the reader
+    // in the same pass which loaded the data. Otherwise, the range is
+    // estimated from a sample of the data and refined in the background
+    // (see AttributesSampledEvent). The noise is always estimated by
+    // vtkMRMLAstroVolumeNode (robust RMS of vtkAstroRobustNoise), sampled
+    // and refined in the same way, so that the DisplayThreshold does not
+    // depend on how the volume has been loaded.
+    double dataRange[2];
+    reader->GetDataRange(dataRange);
+    bool validStatistics = dataRange[0] <= dataRange[1] &&
+      strcmp(reader->GetHeaderValue("SlicerAstro.BUNIT"), "W.U.");
+
     if(!strcmp(reader->GetHeaderValue("SlicerAstro.DATAMAX"), "0.") ||
        !strcmp(reader->GetHeaderValue("SlicerAstro.DATAMIN"), "0."))
-      {  
-      if (!volNode->UpdateRangeAttributes())
+      {
+      if (validStatistics)
+        {
+        volNode->SetAttribute("SlicerAstro.DATAMAX", DoubleToString(dataRange[1]).c_str());
+        volNode->SetAttribute("SlicerAstro.DATAMIN", DoubleToString(dataRange[0]).c_str());
+        }
+      else if (!volNode->UpdateRangeAttributes(true))
         {
         vtkErrorMacro("vtkMRMLAstroVolumeStorageNode::ReadDataInternal :"
                       "could not calculate range attributes.");
@@ -395,7 +421,7 @@ int vtkMRMLAstroVolumeStorageNode::ReadDataInternal(vtkMRMLNode *refNode)
       }
     if (!strcmp(reader->GetHeaderValue("SlicerAstro.DisplayThreshold"), "0."))
       {
-      if (!volNode->UpdateDisplayThresholdAttributes())
+      if (!volNode->UpdateDisplayThresholdAttributes(true))
         {
         vtkErrorMacro("vtkMRMLAstroVolumeStorageNode::ReadDataInternal :"
                       "could not calculate noise attributes.");
@@ -403,6 +429,26 @@ int vtkMRMLAstroVolumeStorageNode::ReadDataInternal(vtkMRMLNode *refNode)
         }
       }
 
+    vtkNew<vtkIntArray> histoArray;
+    vtkNew<vtkDoubleArray> binEdges;
+    if (validStatistics && reader->GetHistogram(histoArray.GetPointer(), binEdges.GetPointer()))
+      {
+      // same parameters of vtkSlicerAstroVolumeLogic::CalculateHistogram
+      double parameters[3];
+      parameters[0] = StringToDouble(volNode->GetAttribute("SlicerAstro.DATAMIN"));
+      parameters[1] = StringToDouble(volNode->GetAttribute("SlicerAstro.DATAMAX"));
+      parameters[2] = StringToDouble(volNode->GetAttribute("SlicerAstro.DisplayThreshold"));
+      if (parameters[2] < 1.E-6)
+        {
+        parameters[2] = (parameters[1] - parameters[0]) * 0.01;
+        }
+      // binning 0: vtkSlicerAstroVolumeLogic::LinearBins
+      volNode->SetCachedHistogram(histoArray.GetPointer(), binEdges.GetPointer(), 0, parameters);
+      }
+
+    vtkDebugMacro("vtkMRMLAstroVolumeStorageNode::ReadDataInternal : "
+                  << reader->GetNumberOfBlanks() << " blank voxels.");
+
     // set range in display
     double min = StringToDouble(volNode->GetAttribute("SlicerAstro.DATAMIN"));
     double max = StringToDouble(volNode->GetAttribute("SlicerAstro.DATAMAX"));
@@ -417,10 +463,17 @@ int vtkMRMLAstroVolumeStorageNode::ReadDataInternal(vtkMRMLNode *refNode)
   else if (refNode->IsA("vtkMRMLAstroLabelMapVolumeNode"))
     {
     labvolNode->SetImageDataConnection(ici->GetOutputPort());
+    double dataRange[2];
+    reader->GetDataRange(dataRange);
     if(!strcmp(reader->GetHeaderValue("SlicerAstro.DATAMAX"), "0.") ||
        !strcmp(reader->GetHeaderValue("SlicerAstro.DATAMIN"), "0."))
       {
-      if (!labvolNode->UpdateRangeAttributes())
+      if (dataRange[0] <= dataRange[1])
+        {
+        labvolNode->SetAttribute("SlicerAstro.DATAMAX", DoubleToString(dataRange[1]).c_str());
+        labvolNode->SetAttribute("SlicerAstro.DATAMIN", DoubleToString(dataRange[0]).c_str());
+        }
+      else if (!labvolNode->UpdateRangeAttributes())
         {
         vtkErrorMacro("vtkMRMLAstroVolumeStorageNode::ReadDataInternal :"
                       "could not calculate noise attributes.");
@@ -147,6 +147,8 @@ class AstroVolumeSelfTestTest(unittest.TestCase):
   def runTest(self):
     self.setUp()
     self.test_AstroVolumeSelfTest()
+    self.setUp()
+    self.test_AttributesRefinement()
 
   def test_AstroVolumeSelfTest(self):
     print("Running AstroVolumeSelfTest Test case:")
@@ -213,6 +215,56 @@ class AstroVolumeSelfTestTest(unittest.TestCase):
 
     self.delayDisplay('Test passed', 700)
 
+  def test_AttributesRefinement(self):
+    print("Running AttributesRefinement Test case:")
+    import time
+    from vtk.util import numpy_support
+
+    self.downloadWEIN069()
+    astroVolume = slicer.util.getNode("WEIN069")
+
+    # WEIN069 is large enough for the noise to be sampled at loading
+    if not astroVolume.GetAttributesSampled():
+       self.delayDisplay('Test failed', 700)
+       # if run from Slicer interface remove the followinf exit
+       sys.exit()
+
+    # writing in place in the scalars: the running refinement is cancelled
+    # and the new data are refined
+    astroVolume.CancelAttributesRefinement()
+    array = numpy_support.vtk_to_numpy(astroVolume.GetImageData().GetPointData().GetScalars())
+    array *= 2.
+    astroVolume.GetImageData().Modified()
+    astroVolume.UpdateRangeAttributes(True)
+    astroVolume.UpdateDisplayThresholdAttributes(True)
+
+    start = time.time()
+    while astroVolume.GetAttributesSampled() and time.time() - start < 60.:
+      slicer.app.processEvents()
+      time.sleep(0.05)
+
+    # reference: exact calculation on a copy of the modified data
+    astroVolumeLogic = slicer.modules.astrovolume.logic()
+    referenceVolume = astroVolumeLogic.CloneAstroVolume(slicer.mrmlScene, astroVolume, None,
+                                                        astroVolume.GetName(), "WEIN069_reference")
+    referenceVolume.UpdateRangeAttributes()
+    referenceVolume.UpdateDisplayThresholdAttributes()
+
+    passed = not astroVolume.GetAttributesSampled()
+    for attribute in ["SlicerAstro.DATAMIN", "SlicerAstro.DATAMAX"]:
+      if abs(float(astroVolume.GetAttribute(attribute)) -
+             float(referenceVolume.GetAttribute(attribute))) > 1.e-6:
+        passed = False
+    if abs(astroVolume.GetDisplayThreshold() - referenceVolume.GetDisplayThreshold()) > 1.e-6:
+      passed = False
+
+    if passed:
+       self.delayDisplay('Test passed', 700)
+    else:
+       self.delayDisplay('Test failed', 700)
+       # if run from Slicer interface remove the followinf exit
+       sys.exit()
+
   def downloadWEIN069(self):
     import AstroSampleData
     astroSampleDataLogic = AstroSampleData.AstroSampleDataLogic()
@@ -4069,8 +4069,7 @@ void qSlicerAstroVolumeModuleWidget::onCreateHistogram()
   double DATAMAX = StringToDouble(d->astroVolumeNode->GetAttribute("SlicerAstro.DATAMAX"));
   double DATAMIN = StringToDouble(d->astroVolumeNode->GetAttribute("SlicerAstro.DATAMIN"));
   double DisplayThreshold = StringToDouble(d->astroVolumeNode->GetAttribute("SlicerAstro.DisplayThreshold"));
-  double nBins = d->BinSliderWidget->value();
-  double binFlux = (DATAMAX - DATAMIN) / (nBins - 1);
+  int nBins = d->BinSliderWidget->value();
 
   vtkSlicerAstroVolumeLogic* astroVolumeLogic =
     vtkSlicerAstroVolumeLogic::SafeDownCast(this->logic());
@@ -4081,7 +4080,14 @@ void qSlicerAstroVolumeModuleWidget::onCreateHistogram()
     }
 
   vtkNew<vtkIntArray> histoArray;
-  astroVolumeLogic->CalculateHistogram(d->astroVolumeNode, histoArray, binFlux, nBins);
+  vtkNew<vtkDoubleArray> binEdges;
+  if (!astroVolumeLogic->CalculateHistogram(d->astroVolumeNode, histoArray, binEdges,
+                                            nBins, d->BinningComboBox->currentIndex()))
+    {
+    qCritical() <<"qSlicerAstroVolumeModuleWidget::onCreateHistogram : "
+                  "Unable to calculate the Histogram.";
+    return;
+    }
 
   vtkNew<vtkTable> table;
   vtkNew<vtkMRMLTableNode> tableNode;
@@ -4127,7 +4133,7 @@ void qSlicerAstroVolumeModuleWidget::onCreateHistogram()
   double histoMaxValue = 0;
   for (int ii = 0; ii < nBins; ii++)
      {
-     table->SetValue(ii, 0, DATAMIN + ii * binFlux);
+     table->SetValue(ii, 0, binEdges->GetValue(ii));
      double histoValue = 0;
      if (histoArray->GetValue(ii) >= 1)
        {
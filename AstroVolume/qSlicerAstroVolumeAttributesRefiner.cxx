@@ -0,0 +1,304 @@
+/*==============================================================================
+
+  Copyright (c) Kapteyn Astronomical Institute
+  University of Groningen, Groningen, Netherlands. All Rights Reserved.
+
+  See COPYRIGHT.txt
+  or http://www.slicer.org/copyright/copyright.txt for details.
+
+  Unless required by applicable law or agreed to in writing, software
+  distributed under the License is distributed on an "AS IS" BASIS,
+  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+  See the License for the specific language governing permissions and
+  limitations under the License.
+
+  This file was originally developed by Davide Punzo, Kapteyn Astronomical Institute,
+  and was supported through the European Research Council grant nr. 291531.
+
+==============================================================================*/
+
+// Qt includes
+#include <QList>
+#include <QThread>
+
+// AstroVolume QtModule includes
+#include "qSlicerAstroVolumeAttributesRefiner.h"
+
+// MRML includes
+#include <vtkAstroProgressToken.h>
+#include <vtkMRMLAstroVolumeNode.h>
+#include <vtkMRMLScene.h>
+
+// VTK includes
+#include <vtkCollection.h>
+#include <vtkDataArray.h>
+#include <vtkImageData.h>
+#include <vtkPointData.h>
+#include <vtkSmartPointer.h>
+#include <vtkWeakPointer.h>
+
+namespace
+{
+// Largest scalars (in KiB) deep-copied in the snapshot
+const unsigned long MaximumSnapshotCopySize = 65536;
+}
+
+//-----------------------------------------------------------------------------
+// Calculation of the exact range and noise of a snapshot of the image data.
+// The snapshot is made by the main thread: a deep copy for small volumes,
+// a shallow copy otherwise, which keeps the scalars alive if the node
+// replaces or releases them during the calculation. The in-place writers
+// of shared scalars cancel the calculation first.
+// The thread only reads the snapshot: the node is updated by the main thread.
+class qSlicerAstroVolumeAttributesRefinerThread : public QThread
+{
+public:
+  qSlicerAstroVolumeAttributesRefinerThread(QObject* parent = 0)
+    : QThread(parent)
+    , Token(1)
+    {
+    this->ImageDataMTime = 0;
+    this->Range[0] = 0.;
+    this->Range[1] = 0.;
+    this->Noise = 0.;
+    this->Valid = false;
+    }
+
+  /// Stop the calculation as soon as possible (the results are not valid)
+  void cancel()
+    {
+    this->Token.Cancel();
+    }
+
+  bool isCancelled()
+    {
+    return this->Token.IsCancelled();
+    }
+
+  vtkWeakPointer<vtkMRMLAstroVolumeNode> VolumeNode;
+  vtkWeakPointer<vtkImageData> ImageData;
+  vtkSmartPointer<vtkImageData> Snapshot;
+  vtkMTimeType ImageDataMTime;
+  double Range[2];
+  double Noise;
+  bool Valid;
+
+protected:
+  virtual void run()
+    {
+    this->Valid = vtkMRMLAstroVolumeNode::CalculateRange
+      (this->Snapshot, this->Range, 0, NULL, &this->Token);
+    if (this->Valid)
+      {
+      this->Noise = vtkMRMLAstroVolumeNode::CalculateNoise
+        (this->Snapshot, 0, NULL, &this->Token);
+      this->Valid = !this->Token.IsCancelled();
+      }
+    }
+
+  vtkAstroProgressToken Token;
+};
+
+//-----------------------------------------------------------------------------
+class qSlicerAstroVolumeAttributesRefinerPrivate
+{
+public:
+  vtkWeakPointer<vtkMRMLScene> MRMLScene;
+  QList<qSlicerAstroVolumeAttributesRefinerThread*> Threads;
+};
+
+//-----------------------------------------------------------------------------
+qSlicerAstroVolumeAttributesRefiner::qSlicerAstroVolumeAttributesRefiner(QObject* _parent)
+  : Superclass(_parent)
+  , d_ptr(new qSlicerAstroVolumeAttributesRefinerPrivate)
+{
+}
+
+//-----------------------------------------------------------------------------
+qSlicerAstroVolumeAttributesRefiner::~qSlicerAstroVolumeAttributesRefiner()
+{
+  Q_D(qSlicerAstroVolumeAttributesRefiner);
+
+  // cancel all the calculations first, then each wait
+  // lasts at most the pass over one block of voxels
+  foreach (qSlicerAstroVolumeAttributesRefinerThread* thread, d->Threads)
+    {
+    thread->cancel();
+    }
+  foreach (qSlicerAstroVolumeAttributesRefinerThread* thread, d->Threads)
+    {
+    thread->wait();
+    delete thread;
+    }
+  d->Threads.clear();
+}
+
+//-----------------------------------------------------------------------------
+void qSlicerAstroVolumeAttributesRefiner::setMRMLScene(vtkMRMLScene* scene)
+{
+  Q_D(qSlicerAstroVolumeAttributesRefiner);
+
+  if (d->MRMLScene == scene)
+    {
+    return;
+    }
+
+  this->qvtkReconnect(d->MRMLScene, scene, vtkMRMLScene::NodeAddedEvent,
+                      this, SLOT(onNodeAdded(vtkObject*, vtkObject*)));
+  this->qvtkReconnect(d->MRMLScene, scene, vtkMRMLScene::NodeRemovedEvent,
+                      this, SLOT(onNodeRemoved(vtkObject*, vtkObject*)));
+  d->MRMLScene = scene;
+
+  if (!scene)
+    {
+    return;
+    }
+
+  vtkSmartPointer<vtkCollection> volumeNodes = vtkSmartPointer<vtkCollection>::Take
+      (scene->GetNodesByClass("vtkMRMLAstroVolumeNode"));
+  for (int i = 0; i < volumeNodes->GetNumberOfItems(); i++)
+    {
+    this->onNodeAdded(scene, volumeNodes->GetItemAsObject(i));
+    }
+}
+
+//-----------------------------------------------------------------------------
+void qSlicerAstroVolumeAttributesRefiner::refine(vtkMRMLAstroVolumeNode* volumeNode)
+{
+  Q_D(qSlicerAstroVolumeAttributesRefiner);
+
+  if (!volumeNode || !volumeNode->GetImageData() || !volumeNode->GetAttributesSampled())
+    {
+    return;
+    }
+
+  // the range and the noise updates both request the refinement:
+  // the same data are refined only once
+  vtkMTimeType imageDataMTime = volumeNode->GetImageDataMTime();
+  foreach (qSlicerAstroVolumeAttributesRefinerThread* thread, d->Threads)
+    {
+    if (thread->VolumeNode == volumeNode &&
+        thread->ImageData == volumeNode->GetImageData() &&
+        thread->ImageDataMTime == imageDataMTime)
+      {
+      return;
+      }
+    }
+
+  qSlicerAstroVolumeAttributesRefinerThread* thread =
+    new qSlicerAstroVolumeAttributesRefinerThread;
+  thread->VolumeNode = volumeNode;
+  thread->ImageData = volumeNode->GetImageData();
+  thread->Snapshot = vtkSmartPointer<vtkImageData>::New();
+  vtkDataArray* scalars = volumeNode->GetImageData()->GetPointData() ?
+    volumeNode->GetImageData()->GetPointData()->GetScalars() : NULL;
+  if (scalars && scalars->GetActualMemorySize() <= MaximumSnapshotCopySize)
+    {
+    thread->Snapshot->DeepCopy(volumeNode->GetImageData());
+    }
+  else
+    {
+    thread->Snapshot->ShallowCopy(volumeNode->GetImageData());
+    }
+  thread->ImageDataMTime = imageDataMTime;
+  d->Threads.append(thread);
+
+  QObject::connect(thread, SIGNAL(finished()), this, SLOT(onRefinementFinished()));
+  thread->start(QThread::LowPriority);
+}
+
+//-----------------------------------------------------------------------------
+void qSlicerAstroVolumeAttributesRefiner::onNodeAdded(vtkObject* scene, vtkObject* node)
+{
+  Q_UNUSED(scene);
+
+  vtkMRMLAstroVolumeNode* volumeNode = vtkMRMLAstroVolumeNode::SafeDownCast(node);
+  if (!volumeNode)
+    {
+    return;
+    }
+
+  this->qvtkConnect(volumeNode, vtkMRMLAstroVolumeNode::AttributesSampledEvent,
+                    this, SLOT(onAttributesSampled(vtkObject*)));
+  this->qvtkConnect(volumeNode, vtkMRMLAstroVolumeNode::AttributesRefinementCancelEvent,
+                    this, SLOT(onAttributesRefinementCancel(vtkObject*)));
+
+  // the attributes have been sampled before adding the node to the scene
+  if (volumeNode->GetAttributesSampled())
+    {
+    this->refine(volumeNode);
+    }
+}
+
+//-----------------------------------------------------------------------------
+void qSlicerAstroVolumeAttributesRefiner::onNodeRemoved(vtkObject* scene, vtkObject* node)
+{
+  Q_UNUSED(scene);
+
+  vtkMRMLAstroVolumeNode* volumeNode = vtkMRMLAstroVolumeNode::SafeDownCast(node);
+  if (!volumeNode)
+    {
+    return;
+    }
+
+  this->qvtkDisconnect(volumeNode, vtkMRMLAstroVolumeNode::AttributesSampledEvent,
+                       this, SLOT(onAttributesSampled(vtkObject*)));
+  this->qvtkDisconnect(volumeNode, vtkMRMLAstroVolumeNode::AttributesRefinementCancelEvent,
+                       this, SLOT(onAttributesRefinementCancel(vtkObject*)));
+}
+
+//-----------------------------------------------------------------------------
+void qSlicerAstroVolumeAttributesRefiner::onAttributesSampled(vtkObject* node)
+{
+  this->refine(vtkMRMLAstroVolumeNode::SafeDownCast(node));
+}
+
+//-----------------------------------------------------------------------------
+void qSlicerAstroVolumeAttributesRefiner::onAttributesRefinementCancel(vtkObject* node)
+{
+  Q_D(qSlicerAstroVolumeAttributesRefiner);
+
+  // the caller is about to write in the scalars: it goes on once the
+  // threads reading them have stopped (each wait lasts at most the pass
+  // over one block of voxels). They are refined again when finished.
+  foreach (qSlicerAstroVolumeAttributesRefinerThread* thread, d->Threads)
+    {
+    if (thread->VolumeNode == node)
+      {
+      thread->cancel();
+      thread->wait();
+      }
+    }
+}
+
+//-----------------------------------------------------------------------------
+void qSlicerAstroVolumeAttributesRefiner::onRefinementFinished()
+{
+  Q_D(qSlicerAstroVolumeAttributesRefiner);
+
+  qSlicerAstroVolumeAttributesRefinerThread* thread =
+    dynamic_cast<qSlicerAstroVolumeAttributesRefinerThread*>(this->sender());
+  if (!thread || !d->Threads.removeOne(thread))
+    {
+    return;
+    }
+
+  // the values are discarded if the node has been removed or its image
+  // data modified during the calculation, or if a writer of the scalars
+  // has cancelled it: the new data are refined again (a calculation
+  // failed on the data is not repeated)
+  vtkMRMLAstroVolumeNode* volumeNode = thread->VolumeNode;
+  bool refined = false;
+  if (thread->Valid && volumeNode)
+    {
+    refined = volumeNode->SetRefinedAttributes(thread->ImageData, thread->ImageDataMTime,
+                                               thread->Range, thread->Noise);
+    }
+  if (volumeNode && !refined && (thread->Valid || thread->isCancelled()) &&
+      volumeNode->GetAttributesSampled())
+    {
+    this->refine(volumeNode);
+    }
+
+  thread->deleteLater();
+}
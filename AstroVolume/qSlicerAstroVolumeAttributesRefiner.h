@@ -0,0 +1,84 @@
+/*==============================================================================
+
+  Copyright (c) Kapteyn Astronomical Institute
+  University of Groningen, Groningen, Netherlands. All Rights Reserved.
+
+  See COPYRIGHT.txt
+  or http://www.slicer.org/copyright/copyright.txt for details.
+
+  Unless required by applicable law or agreed to in writing, software
+  distributed under the License is distributed on an "AS IS" BASIS,
+  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+  See the License for the specific language governing permissions and
+  limitations under the License.
+
+  This file was originally developed by Davide Punzo, Kapteyn Astronomical Institute,
+  and was supported through the European Research Council grant nr. 291531.
+
+==============================================================================*/
+
+#ifndef __qSlicerAstroVolumeAttributesRefiner_h
+#define __qSlicerAstroVolumeAttributesRefiner_h
+
+// Qt includes
+#include <QObject>
+
+// CTK includes
+#include <ctkVTKObject.h>
+
+#include "qSlicerAstroVolumeModuleExport.h"
+
+class qSlicerAstroVolumeAttributesRefinerPrivate;
+class vtkMRMLAstroVolumeNode;
+class vtkMRMLScene;
+class vtkObject;
+
+/// \brief Refine in the background the sampled attributes of the astro volumes.
+///
+/// The refiner observes the astro volumes of the scene. When the range or the
+/// DisplayThreshold attributes of a volume have been estimated from a sample
+/// of the data (vtkMRMLAstroVolumeNode::AttributesSampledEvent), the exact
+/// values are calculated from all the voxels of a snapshot of the image
+/// data in a background thread and, once done, they replace
+/// the sampled ones (window/level and threshold of the display node included)
+/// if the image data has not been modified in the meantime.
+///
+/// The snapshot of small volumes is a deep copy. The scalars of large
+/// volumes are shared instead: before writing in place in them, call
+/// vtkMRMLAstroVolumeNode::CancelAttributesRefinement(), which stops the
+/// calculation (AttributesRefinementCancelEvent) and restarts it later.
+///
+/// \ingroup SlicerAstro_QtModules_AstroVolume
+class Q_SLICERASTRO_QTMODULES_ASTROVOLUME_EXPORT qSlicerAstroVolumeAttributesRefiner
+  : public QObject
+{
+  Q_OBJECT
+  QVTK_OBJECT
+public:
+  typedef QObject Superclass;
+  qSlicerAstroVolumeAttributesRefiner(QObject* parent = 0);
+  virtual ~qSlicerAstroVolumeAttributesRefiner();
+
+  /// Set the scene whose astro volumes are refined
+  void setMRMLScene(vtkMRMLScene* scene);
+
+public slots:
+  /// Calculate the exact attributes of volumeNode in a background thread
+  void refine(vtkMRMLAstroVolumeNode* volumeNode);
+
+protected slots:
+  void onNodeAdded(vtkObject* scene, vtkObject* node);
+  void onNodeRemoved(vtkObject* scene, vtkObject* node);
+  void onAttributesSampled(vtkObject* node);
+  void onAttributesRefinementCancel(vtkObject* node);
+  void onRefinementFinished();
+
+protected:
+  QScopedPointer<qSlicerAstroVolumeAttributesRefinerPrivate> d_ptr;
+
+private:
+  Q_DECLARE_PRIVATE(qSlicerAstroVolumeAttributesRefiner);
+  Q_DISABLE_COPY(qSlicerAstroVolumeAttributesRefiner);
+};
+
+#endif
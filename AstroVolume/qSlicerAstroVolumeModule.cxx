@@ -64,6 +64,7 @@
 #include <vtkSlicerAstroVolumeLogic.h>
 
 // AstroVolume QtModule includes
+#include <qSlicerAstroVolumeAttributesRefiner.h>
 #include <qSlicerAstroVolumeLayoutSliceViewFactory.h>
 #include <qSlicerAstroVolumeModule.h>
 #include <qSlicerAstroVolumeModuleWidget.h>
@@ -117,6 +118,7 @@ protected:
 public:
   qSlicerApplication* app;
   qSlicerAbstractCoreModule *volumeRendering;
+  qSlicerAstroVolumeAttributesRefiner *attributesRefiner;
 
   qSlicerAstroVolumeModulePrivate(qSlicerAstroVolumeModule& object);
   virtual ~qSlicerAstroVolumeModulePrivate();
@@ -129,6 +131,7 @@ qSlicerAstroVolumeModulePrivate::qSlicerAstroVolumeModulePrivate(
 {
   this->app = 0;
   this->volumeRendering = 0;
+  this->attributesRefiner = 0;
 }
 
 //-----------------------------------------------------------------------------
@@ -221,6 +224,10 @@ void qSlicerAstroVolumeModule::setup()
 
   this->setMRMLScene(d->app->mrmlScene());
 
+  // Refine in the background the sampled range and noise of the volumes
+  d->attributesRefiner = new qSlicerAstroVolumeAttributesRefiner(this);
+  d->attributesRefiner->setMRMLScene(d->app->mrmlScene());
+
   // Get Volumes logic
   qSlicerAbstractCoreModule* volumes = d->app->moduleManager()->module("Volumes");
   if (!volumes)
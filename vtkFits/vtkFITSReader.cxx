@@ -36,6 +36,7 @@
 #include <vtkFloatArray.h>
 #include <vtkImageData.h>
 #include <vtkInformation.h>
+#include <vtkIntArray.h>
 #include <vtkMatrix4x4.h>
 #include <vtkNew.h>
 #include <vtkObjectFactory.h>
@@ -44,12 +45,20 @@
 #include <vtksys/SystemTools.hxx>
 #include <vtkStreamingDemandDrivenPipeline.h>
 
+// AstroVolume includes
+#include <vtkSlicerAstroConfigure.h>
+
 // Slicer includes
 #include "vtkMRMLVolumeArchetypeStorageNode.h"
 
 // STD includes
 #include <sstream>
 
+// OpenMP includes
+#ifdef VTK_SLICER_ASTRO_SUPPORT_OPENMP
+#include <omp.h>
+#endif // VTK_SLICER_ASTRO_SUPPORT_OPENMP
+
 vtkStandardNewMacro(vtkFITSReader);
 
 //----------------------------------------------------------------------------
@@ -84,6 +93,10 @@ vtkFITSReader::vtkFITSReader()
   this->NWCS = 0;
   this->WCSStatus = 0;
   this->FixGipsyHeaderOn = false;
+  this->NumberOfHistogramBins = 0;
+  this->DataRange[0] = 0.;
+  this->DataRange[1] = 0.;
+  this->NumberOfBlanks = 0;
 }
 
 //----------------------------------------------------------------------------
@@ -193,6 +206,104 @@ std::string ZeroPadNumber(int num)
   return ret;
 }
 
+//----------------------------------------------------------------------------
+// Zero-fill a newly allocated buffer in parallel with the static partition
+// used by the processing loops. The memory pages are physically allocated
+// at the first write, therefore each page ends on the NUMA node of the
+// thread which will process it (instead of all on the node of the reader).
+template <typename T> void FirstTouch(T *outPixel, vtkIdType numElements)
+{
+  #ifdef VTK_SLICER_ASTRO_SUPPORT_OPENMP
+  #pragma omp parallel for schedule(static)
+  #endif // VTK_SLICER_ASTRO_SUPPORT_OPENMP
+  for (vtkIdType elemCnt = 0; elemCnt < numElements; elemCnt++)
+    {
+    *(outPixel + elemCnt) = 0;
+    }
+}
+
+//----------------------------------------------------------------------------
+// Number of voxels read (and analyzed) at once. A slab fits in the caches,
+// therefore the statistics are calculated without loading the data again
+// from the main memory.
+const vtkIdType SlabSize = 1 << 20;
+
+//----------------------------------------------------------------------------
+// Statistics of the data accumulated slab by slab while reading them
+struct DataStatistics
+{
+  double Min;
+  double Max;
+  vtkIdType NumberOfBlanks;
+
+  // linear histogram (empty if disabled), with the same binning of
+  // vtkSlicerAstroVolumeLogic::CalculateHistogram (LinearBins)
+  double HistogramMin;
+  double HistogramInverseWidth;
+  std::vector<vtkIdType> Histogram;
+};
+
+//----------------------------------------------------------------------------
+template <typename T> void AccumulateSlab(const T *inPixel, vtkIdType numElements,
+                                          DataStatistics &stats)
+{
+  double min_val = stats.Min, max_val = stats.Max;
+  vtkIdType blanks = 0;
+  const int numberOfBins = stats.Histogram.size();
+
+  #ifdef VTK_SLICER_ASTRO_SUPPORT_OPENMP
+  #pragma omp parallel reduction(max : max_val), reduction(min : min_val), reduction(+ : blanks)
+  #endif // VTK_SLICER_ASTRO_SUPPORT_OPENMP
+  {
+  std::vector<vtkIdType> histogram(numberOfBins, 0);
+
+  #ifdef VTK_SLICER_ASTRO_SUPPORT_OPENMP
+  #pragma omp for schedule(static)
+  #endif // VTK_SLICER_ASTRO_SUPPORT_OPENMP
+  for (vtkIdType elemCnt = 0; elemCnt < numElements; elemCnt++)
+    {
+    const double value = *(inPixel + elemCnt);
+    if (value != value)
+      {
+      blanks++;
+      continue;
+      }
+    if (value > max_val)
+      {
+      max_val = value;
+      }
+    if (value < min_val)
+      {
+      min_val = value;
+      }
+    if (numberOfBins > 0)
+      {
+      double position = (value - stats.HistogramMin) * stats.HistogramInverseWidth;
+      if (position >= 0. && position <= numberOfBins)
+        {
+        int binIndex = (int) position;
+        histogram[binIndex < numberOfBins ? binIndex : numberOfBins - 1]++;
+        }
+      }
+    }
+
+  if (numberOfBins > 0)
+    {
+    #ifdef VTK_SLICER_ASTRO_SUPPORT_OPENMP
+    #pragma omp critical
+    #endif // VTK_SLICER_ASTRO_SUPPORT_OPENMP
+    for (int binCnt = 0; binCnt < numberOfBins; binCnt++)
+      {
+      stats.Histogram[binCnt] += histogram[binCnt];
+      }
+    }
+  }
+
+  stats.Min = min_val;
+  stats.Max = max_val;
+  stats.NumberOfBlanks += blanks;
+}
+
 }// end namespace
 
 //----------------------------------------------------------------------------
@@ -2822,6 +2933,27 @@ vtkImageData *vtkFITSReader::AllocateOutputData(vtkDataObject *out, vtkInformati
   return res;
 }
 
+//----------------------------------------------------------------------------
+bool vtkFITSReader::GetHistogram(vtkIntArray *counts, vtkDoubleArray *binEdges)
+{
+  if (!counts || !binEdges || this->HistogramCounts.empty())
+    {
+    return false;
+    }
+
+  const int numberOfBins = this->HistogramCounts.size();
+  counts->SetNumberOfValues(numberOfBins);
+  binEdges->SetNumberOfValues(numberOfBins + 1);
+  for (int binCnt = 0; binCnt < numberOfBins; binCnt++)
+    {
+    counts->SetValue(binCnt, this->HistogramCounts[binCnt]);
+    binEdges->SetValue(binCnt, this->HistogramBinEdges[binCnt]);
+    }
+  binEdges->SetValue(numberOfBins, this->HistogramBinEdges[numberOfBins]);
+
+  return true;
+}
+
 //----------------------------------------------------------------------------
 bool vtkFITSReader::AllocatePointData(vtkImageData *out, vtkInformation* outInfo) {
 
@@ -2878,6 +3010,20 @@ bool vtkFITSReader::AllocatePointData(vtkImageData *out, vtkInformation* outInfo
                       (Extent[3] - Extent[2] + 1)*
                       (Extent[5] - Extent[4] + 1));
 
+  const vtkIdType numElements = pd->GetNumberOfTuples() * pd->GetNumberOfComponents();
+  switch (this->DataType)
+    {
+    case VTK_DOUBLE:
+      FirstTouch<double>(static_cast<double*> (pd->GetVoidPointer(0)), numElements);
+      break;
+    case VTK_FLOAT:
+      FirstTouch<float>(static_cast<float*> (pd->GetVoidPointer(0)), numElements);
+      break;
+    case VTK_SHORT:
+      FirstTouch<short>(static_cast<short*> (pd->GetVoidPointer(0)), numElements);
+      break;
+    }
+
   out->GetPointData()->SetScalars(pd);
   vtkDataObject::SetPointDataActiveScalarInfo(outInfo,
          this->DataType, this->GetNumberOfComponents());
@@ -2932,43 +3078,121 @@ void vtkFITSReader::ExecuteDataWithInformation(vtkDataObject *output, vtkInforma
   unsigned int naxes = data->GetDataDimension();
   int naxe[naxes];
   data->GetDimensions(naxe);
-  int dim = 1;
+  vtkIdType numElements = 1;
   for (unsigned int axii=0; axii < naxes; axii++)
     {
-    dim *= naxe[axii];
+    numElements *= naxe[axii];
+    }
+
+  DataStatistics stats;
+  stats.Min = VTK_DOUBLE_MAX;
+  stats.Max = VTK_DOUBLE_MIN;
+  stats.NumberOfBlanks = 0;
+  stats.HistogramMin = 0.;
+  stats.HistogramInverseWidth = 0.;
+
+  // the histogram can be accumulated in the same pass
+  // only if the header provides the range of the data,
+  // otherwise it needs a second pass (see below)
+  double DATAMIN = StringToDouble(this->GetHeaderValue("SlicerAstro.DATAMIN"));
+  double DATAMAX = StringToDouble(this->GetHeaderValue("SlicerAstro.DATAMAX"));
+  if (this->NumberOfHistogramBins > 0 && DATAMAX > DATAMIN &&
+      strcmp(this->GetHeaderValue("SlicerAstro.DATAMIN"), "0.") &&
+      strcmp(this->GetHeaderValue("SlicerAstro.DATAMAX"), "0."))
+    {
+    stats.HistogramMin = DATAMIN;
+    stats.HistogramInverseWidth = this->NumberOfHistogramBins / (DATAMAX - DATAMIN);
+    stats.Histogram.assign(this->NumberOfHistogramBins, 0);
     }
+
   float nullval = NAN;
   int anynull;
-  // load the data
+  int dataType = 0;
   switch (this->DataType)
     {
     case VTK_DOUBLE:
-      if(fits_read_img(this->fptr, TDOUBLE, 1, dim, &nullval, ptr, &anynull, &this->ReadStatus))
-        {
-        fits_report_error(stderr, this->ReadStatus);
-        vtkErrorMacro(<< "vtkFITSReader::ExecuteDataWithInformation: data is null.");
-        return;
-        }
+      dataType = TDOUBLE;
       break;
     case VTK_FLOAT:
-      if(fits_read_img(this->fptr, TFLOAT, 1, dim, &nullval, ptr, &anynull, &this->ReadStatus))
-        {
-        fits_report_error(stderr, this->ReadStatus);
-        vtkErrorMacro(<< "vtkFITSReader::ExecuteDataWithInformation: data is null.");
-        return;
-        }
+      dataType = TFLOAT;
       break;
-  case VTK_SHORT:
-    if(fits_read_img(this->fptr, TSHORT, 1, dim, &nullval, ptr, &anynull, &this->ReadStatus))
+    case VTK_SHORT:
+      dataType = TSHORT;
+      break;
+    default:
+      vtkErrorMacro("vtkFITSReader::ExecuteDataWithInformation: Could not load data");
+      return;
+    }
+
+  // load the data slab by slab and accumulate the statistics
+  // of each slab while it is still in the caches
+  const int dataSize = data->GetPointData()->GetScalars()->GetDataTypeSize();
+  for (vtkIdType firstElement = 0; firstElement < numElements; firstElement += SlabSize)
+    {
+    const vtkIdType slabElements = std::min(SlabSize, numElements - firstElement);
+    void *slabPtr = static_cast<char*> (ptr) + firstElement * dataSize;
+    if(fits_read_img(this->fptr, dataType, firstElement + 1, slabElements,
+                     &nullval, slabPtr, &anynull, &this->ReadStatus))
       {
       fits_report_error(stderr, this->ReadStatus);
       vtkErrorMacro(<< "vtkFITSReader::ExecuteDataWithInformation: data is null.");
       return;
       }
-    break;
-    default:
-      vtkErrorMacro("vtkFITSReader::ExecuteDataWithInformation: Could not load data");
-      return;
+
+    switch (this->DataType)
+      {
+      case VTK_DOUBLE:
+        AccumulateSlab(static_cast<double*> (slabPtr), slabElements, stats);
+        break;
+      case VTK_FLOAT:
+        AccumulateSlab(static_cast<float*> (slabPtr), slabElements, stats);
+        break;
+      case VTK_SHORT:
+        AccumulateSlab(static_cast<short*> (slabPtr), slabElements, stats);
+        break;
+      }
+    }
+
+  this->DataRange[0] = stats.Min;
+  this->DataRange[1] = stats.Max;
+  this->NumberOfBlanks = stats.NumberOfBlanks;
+
+  // without the range in the header, the histogram
+  // covers the range found while reading the data
+  if (this->NumberOfHistogramBins > 0 && stats.Histogram.empty() && stats.Max > stats.Min)
+    {
+    DATAMIN = stats.Min;
+    DATAMAX = stats.Max;
+    DataStatistics histogramStats;
+    histogramStats.Min = VTK_DOUBLE_MAX;
+    histogramStats.Max = VTK_DOUBLE_MIN;
+    histogramStats.NumberOfBlanks = 0;
+    histogramStats.HistogramMin = DATAMIN;
+    histogramStats.HistogramInverseWidth = this->NumberOfHistogramBins / (DATAMAX - DATAMIN);
+    histogramStats.Histogram.assign(this->NumberOfHistogramBins, 0);
+    switch (this->DataType)
+      {
+      case VTK_DOUBLE:
+        AccumulateSlab(static_cast<double*> (ptr), numElements, histogramStats);
+        break;
+      case VTK_FLOAT:
+        AccumulateSlab(static_cast<float*> (ptr), numElements, histogramStats);
+        break;
+      case VTK_SHORT:
+        AccumulateSlab(static_cast<short*> (ptr), numElements, histogramStats);
+        break;
+      }
+    stats.Histogram = histogramStats.Histogram;
+    }
+
+  this->HistogramCounts = stats.Histogram;
+  this->HistogramBinEdges.clear();
+  if (!stats.Histogram.empty())
+    {
+    for (int binCnt = 0; binCnt <= this->NumberOfHistogramBins; binCnt++)
+      {
+      this->HistogramBinEdges.push_back(DATAMIN + (DATAMAX - DATAMIN) * binCnt / this->NumberOfHistogramBins);
+      }
     }
 
   if (fits_close_file(this->fptr, &this->ReadStatus))
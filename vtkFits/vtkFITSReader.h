@@ -28,6 +28,8 @@
 #include "vtkMedicalImageReader2.h"
 
 // VTK decleration
+class vtkDoubleArray;
+class vtkIntArray;
 class vtkMatrix4x4;
 
 // FITS includes
@@ -139,6 +141,32 @@ public:
     UseNativeOrigin = false;
     }
 
+  ///
+  /// Number of bins of the linear histogram over the DATAMIN - DATAMAX
+  /// range of the header accumulated while reading the data. If the header
+  /// does not provide the range, the histogram covers the range of the data
+  /// and it is calculated with a second pass after reading the data.
+  /// The histogram is not calculated if the value is zero (default).
+  vtkSetMacro(NumberOfHistogramBins,int);
+  vtkGetMacro(NumberOfHistogramBins,int);
+
+  ///
+  /// Range of the data (blank voxels excluded) calculated while reading
+  /// the data. The minimum is larger than the maximum if all voxels are blank.
+  vtkGetVector2Macro(DataRange,double);
+
+  ///
+  /// Number of blank (NaN) voxels found while reading the data.
+  /// It is only reported (debug output) by vtkMRMLAstroVolumeStorageNode.
+  vtkGetMacro(NumberOfBlanks,vtkIdType);
+
+  ///
+  /// Copy the histogram accumulated while reading the data
+  /// (see SetNumberOfHistogramBins) in \a counts and the
+  /// NumberOfHistogramBins + 1 edges of the bins in \a binEdges.
+  /// \return false if the histogram has not been calculated
+  bool GetHistogram(vtkIntArray *counts, vtkDoubleArray *binEdges);
+
   virtual vtkImageData * AllocateOutputData(vtkDataObject *out, vtkInformation* outInfo) VTK_OVERRIDE;
 
   virtual void AllocateOutputData(vtkImageData *out, vtkInformation* outInfo, int *uExtent) VTK_OVERRIDE
@@ -172,6 +200,12 @@ protected:
 
   std::map <std::string, std::string> HeaderKeyValue;
 
+  int NumberOfHistogramBins;
+  double DataRange[2];
+  vtkIdType NumberOfBlanks;
+  std::vector<vtkIdType> HistogramCounts;
+  std::vector<double> HistogramBinEdges;
+
   virtual void ExecuteInformation() VTK_OVERRIDE;
   virtual bool AstroExecuteInformation();
   virtual void ExecuteDataWithInformation(vtkDataObject *output, vtkInformation* outInfo) VTK_OVERRIDE;